@@ -0,0 +1,343 @@
+/*
+ * Copyright (c) 2015, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+/* Shows several video streams in windows of one screen, one per
+ * requested sink pad. Each sink pad is backed by its own renderer on
+ * its own overlay, the display controller composites them, so there is
+ * no composition step on the GPU:
+ *
+ *   gst-launch-1.0 nvcompositorsink name=c \
+ *       windows="960x540+0+0,960x540+960+0" \
+ *       ... ! c.sink_0  ... ! c.sink_1
+ *
+ * Stream N is shown on overlay N + 1 at depth N, pads beyond the
+ * overlays of the sink are refused. Changing windows moves the
+ * existing streams. The renderers are children named renderer_%u and
+ * can be configured through the child proxy, e.g.
+ * c::renderer_1::overlay-x=100, also while playing. They
+ * offer their own buffer pools upstream, so decoders render into
+ * them without copying, and all sync against the clock of the bin.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <stdio.h>
+
+#include "gstnvcompositorsink.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_nv_compositor_sink_debug_category);
+#define GST_CAT_DEFAULT gst_nv_compositor_sink_debug_category
+
+/* prototypes */
+static void gst_nv_compositor_sink_finalize (GObject * object);
+static void gst_nv_compositor_sink_set_property (GObject * object,
+    guint prop_id, const GValue * value, GParamSpec * pspec);
+static void gst_nv_compositor_sink_get_property (GObject * object,
+    guint prop_id, GValue * value, GParamSpec * pspec);
+static GstPad *gst_nv_compositor_sink_request_new_pad (GstElement * element,
+    GstPadTemplate * templ, const gchar * name, const GstCaps * caps);
+static void gst_nv_compositor_sink_release_pad (GstElement * element,
+    GstPad * pad);
+static void gst_nv_compositor_sink_update_window (const GValue * item,
+    gpointer user_data);
+
+enum
+{
+  PROP_0,
+  PROP_SINK,
+  PROP_WINDOWS
+};
+
+#define DEFAULT_SINK "nvoverlaysink"
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink_%u",
+    GST_PAD_SINK,
+    GST_PAD_REQUEST,
+    GST_STATIC_CAPS ("video/x-raw(memory:NVMM); video/x-raw"));
+
+/* class initialization */
+
+#define DEBUG_INIT \
+  GST_DEBUG_CATEGORY_INIT (gst_nv_compositor_sink_debug_category, \
+      "nvcompositorsink", 0, "debug category for nvcompositorsink element");
+
+G_DEFINE_TYPE_WITH_CODE (GstNvCompositorSink, gst_nv_compositor_sink,
+    GST_TYPE_BIN, DEBUG_INIT);
+
+static void
+gst_nv_compositor_sink_class_init (GstNvCompositorSinkClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+
+  gobject_class->finalize = gst_nv_compositor_sink_finalize;
+  gobject_class->set_property = gst_nv_compositor_sink_set_property;
+  gobject_class->get_property = gst_nv_compositor_sink_get_property;
+
+  g_object_class_install_property (gobject_class, PROP_SINK,
+      g_param_spec_string ("sink", "Sink",
+          "Name of the overlay sink element used for every stream",
+          DEFAULT_SINK,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_WINDOWS,
+      g_param_spec_string ("windows", "Windows",
+          "Comma separated WIDTHxHEIGHT+X+Y of the windows in sink pad "
+          "order (NULL=full screen)", NULL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_PLAYING));
+
+  element_class->request_new_pad =
+      GST_DEBUG_FUNCPTR (gst_nv_compositor_sink_request_new_pad);
+  element_class->release_pad =
+      GST_DEBUG_FUNCPTR (gst_nv_compositor_sink_release_pad);
+
+  gst_element_class_add_pad_template (element_class,
+      gst_static_pad_template_get (&sink_template));
+
+  gst_element_class_set_static_metadata (element_class,
+      "Overlay Compositor Sink", "Sink/Video",
+      "Renders several video streams on the overlays of one display",
+      "NVIDIA Corporation");
+}
+
+static void
+gst_nv_compositor_sink_init (GstNvCompositorSink * self)
+{
+  self->sink_name = g_strdup (DEFAULT_SINK);
+}
+
+static void
+gst_nv_compositor_sink_finalize (GObject * object)
+{
+  GstNvCompositorSink *self = GST_NV_COMPOSITOR_SINK (object);
+
+  g_free (self->sink_name);
+  g_free (self->windows);
+
+  G_OBJECT_CLASS (gst_nv_compositor_sink_parent_class)->finalize (object);
+}
+
+static void
+gst_nv_compositor_sink_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstNvCompositorSink *self = GST_NV_COMPOSITOR_SINK (object);
+  GstIterator *it;
+
+  switch (prop_id) {
+    case PROP_SINK:
+      g_free (self->sink_name);
+      self->sink_name = g_value_dup_string (value);
+      break;
+    case PROP_WINDOWS:
+      GST_OBJECT_LOCK (self);
+      g_free (self->windows);
+      self->windows = g_value_dup_string (value);
+      GST_OBJECT_UNLOCK (self);
+
+      /* Move the streams that already exist */
+      it = gst_bin_iterate_elements (GST_BIN (self));
+      gst_iterator_foreach (it, gst_nv_compositor_sink_update_window, self);
+      gst_iterator_free (it);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_nv_compositor_sink_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstNvCompositorSink *self = GST_NV_COMPOSITOR_SINK (object);
+
+  switch (prop_id) {
+    case PROP_SINK:
+      g_value_set_string (value, self->sink_name);
+      break;
+    case PROP_WINDOWS:
+      GST_OBJECT_LOCK (self);
+      g_value_set_string (value, self->windows);
+      GST_OBJECT_UNLOCK (self);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+/* Puts the renderer of stream @id on overlay id + 1 at depth id.
+ * Returns FALSE if @sink doesn't have that many overlays, the streams
+ * would overwrite each other otherwise. */
+static gboolean
+gst_nv_compositor_sink_set_overlay (GstNvCompositorSink * self,
+    GstElement * sink, guint id)
+{
+  GObjectClass *klass = G_OBJECT_GET_CLASS (sink);
+  GParamSpec *overlay, *depth;
+
+  overlay = g_object_class_find_property (klass, "overlay");
+  depth = g_object_class_find_property (klass, "overlay-depth");
+  if (!overlay || G_PARAM_SPEC_VALUE_TYPE (overlay) != G_TYPE_UINT ||
+      !depth || G_PARAM_SPEC_VALUE_TYPE (depth) != G_TYPE_UINT) {
+    GST_WARNING_OBJECT (self, "%s has no overlay properties",
+        self->sink_name);
+    return TRUE;
+  }
+
+  if (id + 1 > G_PARAM_SPEC_UINT (overlay)->maximum ||
+      id > G_PARAM_SPEC_UINT (depth)->maximum) {
+    GST_ERROR_OBJECT (self, "%s has no overlay left for stream %u",
+        self->sink_name, id);
+    return FALSE;
+  }
+
+  g_object_set (sink, "overlay", id + 1, "overlay-depth", id, NULL);
+
+  return TRUE;
+}
+
+/* Moves the renderer of stream @id into its window from windows,
+ * full screen if it has none */
+static void
+gst_nv_compositor_sink_configure_window (GstNvCompositorSink * self,
+    GstElement * sink, guint id)
+{
+  gint width = 0, height = 0, x = 0, y = 0;
+  gboolean have_window = FALSE;
+
+  GST_OBJECT_LOCK (self);
+  if (self->windows) {
+    gchar **windows = g_strsplit (self->windows, ",", -1);
+
+    if (id < g_strv_length (windows)) {
+      have_window = sscanf (windows[id], "%dx%d+%d+%d", &width, &height, &x,
+          &y) == 4 && width > 0 && height > 0 && x >= 0 && y >= 0;
+      if (!have_window)
+        GST_WARNING_OBJECT (self, "Invalid window \"%s\"", windows[id]);
+    }
+    g_strfreev (windows);
+  }
+  GST_OBJECT_UNLOCK (self);
+
+  if (!have_window)
+    width = height = x = y = 0;
+
+  GST_DEBUG_OBJECT (self, "Stream %u shows at %dx%d+%d+%d", id, width,
+      height, x, y);
+  g_object_set (sink, "overlay-x", (guint) x, "overlay-y", (guint) y,
+      "overlay-w", (guint) width, "overlay-h", (guint) height, NULL);
+}
+
+static void
+gst_nv_compositor_sink_update_window (const GValue * item, gpointer user_data)
+{
+  GstNvCompositorSink *self = GST_NV_COMPOSITOR_SINK (user_data);
+  GstElement *sink = g_value_get_object (item);
+  guint id;
+
+  if (sscanf (GST_OBJECT_NAME (sink), "renderer_%u", &id) == 1)
+    gst_nv_compositor_sink_configure_window (self, sink, id);
+}
+
+static GstPad *
+gst_nv_compositor_sink_request_new_pad (GstElement * element,
+    GstPadTemplate * templ, const gchar * name, const GstCaps * caps)
+{
+  GstNvCompositorSink *self = GST_NV_COMPOSITOR_SINK (element);
+  GstElement *sink;
+  GstPad *sinkpad, *ghost;
+  gchar *child_name;
+  guint id;
+
+  GST_OBJECT_LOCK (self);
+  if (name == NULL || sscanf (name, "sink_%u", &id) != 1)
+    id = self->next_pad_id;
+  self->next_pad_id = MAX (self->next_pad_id, id + 1);
+  GST_OBJECT_UNLOCK (self);
+
+  child_name = g_strdup_printf ("renderer_%u", id);
+  sink = gst_element_factory_make (self->sink_name, child_name);
+  g_free (child_name);
+
+  if (!sink) {
+    GST_ERROR_OBJECT (self, "Failed to create %s", self->sink_name);
+    return NULL;
+  }
+
+  if (!gst_nv_compositor_sink_set_overlay (self, sink, id)) {
+    gst_object_unref (sink);
+    return NULL;
+  }
+  gst_nv_compositor_sink_configure_window (self, sink, id);
+
+  if (!gst_bin_add (GST_BIN (self), sink)) {
+    GST_ERROR_OBJECT (self, "Failed to add stream %u", id);
+    gst_object_unref (sink);
+    return NULL;
+  }
+
+  sinkpad = gst_element_get_static_pad (sink, "sink");
+  child_name = g_strdup_printf ("sink_%u", id);
+  ghost = gst_ghost_pad_new_from_template (child_name, sinkpad, templ);
+  g_free (child_name);
+  gst_object_unref (sinkpad);
+
+  gst_pad_set_active (ghost, TRUE);
+  gst_element_add_pad (element, ghost);
+
+  gst_element_sync_state_with_parent (sink);
+
+  GST_DEBUG_OBJECT (self, "Added stream %u", id);
+
+  return ghost;
+}
+
+static void
+gst_nv_compositor_sink_release_pad (GstElement * element, GstPad * pad)
+{
+  GstNvCompositorSink *self = GST_NV_COMPOSITOR_SINK (element);
+  GstElement *sink;
+  gchar *child_name;
+  guint id;
+
+  if (sscanf (GST_PAD_NAME (pad), "sink_%u", &id) != 1)
+    return;
+
+  GST_DEBUG_OBJECT (self, "Removing stream %u", id);
+
+  child_name = g_strdup_printf ("renderer_%u", id);
+  sink = gst_bin_get_by_name (GST_BIN (self), child_name);
+  g_free (child_name);
+
+  gst_pad_set_active (pad, FALSE);
+  gst_element_remove_pad (element, pad);
+
+  if (sink) {
+    gst_element_set_state (sink, GST_STATE_NULL);
+    gst_bin_remove (GST_BIN (self), sink);
+    gst_object_unref (sink);
+  }
+}
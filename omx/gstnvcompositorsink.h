@@ -0,0 +1,60 @@
+/*
+ * Copyright (c) 2015, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+#ifndef __GST_NV_COMPOSITOR_SINK_H__
+#define __GST_NV_COMPOSITOR_SINK_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+#define GST_TYPE_NV_COMPOSITOR_SINK \
+  (gst_nv_compositor_sink_get_type())
+#define GST_NV_COMPOSITOR_SINK(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_NV_COMPOSITOR_SINK,GstNvCompositorSink))
+#define GST_NV_COMPOSITOR_SINK_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_NV_COMPOSITOR_SINK,GstNvCompositorSinkClass))
+#define GST_NV_COMPOSITOR_SINK_GET_CLASS(obj) \
+  (G_TYPE_INSTANCE_GET_CLASS((obj),GST_TYPE_NV_COMPOSITOR_SINK,GstNvCompositorSinkClass))
+#define GST_IS_NV_COMPOSITOR_SINK(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_NV_COMPOSITOR_SINK))
+#define GST_IS_NV_COMPOSITOR_SINK_CLASS(obj) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_NV_COMPOSITOR_SINK))
+typedef struct _GstNvCompositorSink GstNvCompositorSink;
+typedef struct _GstNvCompositorSinkClass GstNvCompositorSinkClass;
+
+struct _GstNvCompositorSink
+{
+  GstBin parent;
+
+  /* properties */
+  gchar *sink_name;
+  gchar *windows;
+
+  guint next_pad_id;
+};
+
+struct _GstNvCompositorSinkClass
+{
+  GstBinClass parent_class;
+};
+
+GType gst_nv_compositor_sink_get_type (void);
+
+G_END_DECLS
+#endif /* __GST_NV_COMPOSITOR_SINK_H__ */
@@ -40,12 +40,18 @@
 #include "gstomxh264enc.h"
 #include "gstomxh263enc.h"
 #include "gstomxaacenc.h"
+#include "gstomxsimulcastenc.h"
+#include "gstomxparallelenc.h"
+#include "gstomxmultienc.h"
 #include "gstnvoverlaysink.h"
 #include "gstnvhdmioverlaysink.h"
+#include "gstnvcompositorsink.h"
 #include "gstomxaacdec.h"
 #include "gstomxmpegaudiodec.h"
 #include "gstomxamrnbdec.h"
 #include "gstomxamrwbdec.h"
+#include "gstomxac3dec.h"
+#include "gstomxdtsdec.h"
 
 #ifdef HAVE_VP8
 #include "gstomxvp8dec.h"
@@ -339,6 +345,20 @@ gst_omx_component_handle_messages (GstOMXComponent * comp)
 
         break;
       }
+      case GST_OMX_MESSAGE_PORT_CROP_CHANGED:{
+        GstOMXPort *port = NULL;
+        OMX_U32 index = msg->content.port_crop_changed.port;
+
+        port = gst_omx_component_get_port (comp, index);
+        if (!port)
+          break;
+
+        GST_DEBUG_OBJECT (comp->parent, "%s port %u crop changed", comp->name,
+            port->index);
+
+        port->crop_changed = TRUE;
+        break;
+      }
       case GST_OMX_MESSAGE_BUFFER_FLAG:{
         GstOMXPort *port = NULL;
         OMX_U32 index = msg->content.buffer_flag.port;
@@ -373,8 +393,10 @@ gst_omx_component_handle_messages (GstOMXComponent * comp)
           buf->omx_buf->nFilledLen = 0;
 
           /*Unref buffer, so it can be used again */
-          if (buf->gst_buf)
+          if (buf->gst_buf) {
             gst_buffer_unref (buf->gst_buf);
+            buf->gst_buf = NULL;
+          }
 
           /* Reset all flags, some implementations don't
            * reset them themselves and the flags are not
@@ -527,15 +549,27 @@ EventHandler (OMX_HANDLETYPE hComponent, OMX_PTR pAppData, OMX_EVENTTYPE eEvent,
         index = 1;
 
 
+      if (nData2 == OMX_IndexConfigCommonOutputCrop) {
+        /* Crop changes don't require the buffers to be reallocated */
+        msg->type = GST_OMX_MESSAGE_PORT_CROP_CHANGED;
+        msg->content.port_crop_changed.port = index;
+        GST_DEBUG_OBJECT (comp->parent, "%s crop changed (port index: %u)",
+            comp->name, (guint) msg->content.port_crop_changed.port);
+
+        gst_omx_component_send_message (comp, msg);
+        break;
+      }
+
       msg->type = GST_OMX_MESSAGE_PORT_SETTINGS_CHANGED;
       msg->content.port_settings_changed.port = index;
       GST_DEBUG_OBJECT (comp->parent, "%s settings changed (port index: %u)",
           comp->name, (guint) msg->content.port_settings_changed.port);
 
-      /* ignore crop and scale events */
-      if (nData2 != OMX_IndexConfigCommonOutputCrop
-          && nData2 != OMX_IndexConfigCommonScale)
+      /* ignore scale events */
+      if (nData2 != OMX_IndexConfigCommonScale)
         gst_omx_component_send_message (comp, msg);
+      else
+        g_slice_free (GstOMXMessage, msg);
       break;
     }
     case OMX_EventBufferFlag:{
@@ -958,6 +992,7 @@ gst_omx_component_add_port (GstOMXComponent * comp, guint32 index)
   port->disabled_pending = FALSE;
   port->eos = FALSE;
   port->reconfigure = FALSE;
+  port->crop_changed = FALSE;
 
   if (port->port_def.eDir == OMX_DirInput)
     comp->n_in_ports++;
@@ -1238,9 +1273,28 @@ gst_omx_port_update_port_definition (GstOMXPort * port,
   return err;
 }
 
+/* Number of buffers of @port that are pending or owned by the component
+ *
+ * NOTE: Must be called while holding comp->lock */
+static guint
+gst_omx_port_count_available_buffers (GstOMXPort * port)
+{
+  guint i, n = g_queue_get_length (&port->pending_buffers);
+
+  for (i = 0; port->buffers && i < port->buffers->len; i++) {
+    GstOMXBuffer *buf = g_ptr_array_index (port->buffers, i);
+
+    if (buf->used)
+      n++;
+  }
+
+  return n;
+}
+
 /* NOTE: Uses comp->lock and comp->messages_lock */
-GstOMXAcquireBufferReturn
-gst_omx_port_acquire_buffer (GstOMXPort * port, GstOMXBuffer ** buf)
+static GstOMXAcquireBufferReturn
+gst_omx_port_acquire_buffer_full (GstOMXPort * port, GstOMXBuffer ** buf,
+    guint reserve)
 {
   GstOMXAcquireBufferReturn ret = GST_OMX_ACQUIRE_BUFFER_ERROR;
   GstOMXComponent *comp;
@@ -1350,10 +1404,13 @@ retry:
 
   /* If the queue is empty we wait until a buffer
    * arrives, an error happens, the port is flushing
-   * or the port needs to be reconfigured.
+   * or the port needs to be reconfigured. The same
+   * if taking a buffer would leave less than @reserve
+   * buffers that are pending or used by the component.
    */
   gst_omx_component_handle_messages (comp);
-  if (g_queue_is_empty (&port->pending_buffers)) {
+  if (g_queue_is_empty (&port->pending_buffers)
+      || gst_omx_port_count_available_buffers (port) <= reserve) {
     GST_DEBUG_OBJECT (comp->parent, "Queue of %s port %u is empty",
         comp->name, port->index);
     g_mutex_lock (&comp->messages_lock);
@@ -1392,6 +1449,27 @@ done:
   return ret;
 }
 
+/* NOTE: Uses comp->lock and comp->messages_lock */
+GstOMXAcquireBufferReturn
+gst_omx_port_acquire_buffer (GstOMXPort * port, GstOMXBuffer ** buf)
+{
+  return gst_omx_port_acquire_buffer_full (port, buf, 0);
+}
+
+/* Acquires a buffer like gst_omx_port_acquire_buffer(), but keeps at
+ * least @reserve buffers of the port pending or used by the component.
+ * For buffer pools that hand the buffers of an input port to upstream,
+ * so that the element can still acquire buffers for the input that it
+ * fills itself.
+ *
+ * NOTE: Uses comp->lock and comp->messages_lock */
+GstOMXAcquireBufferReturn
+gst_omx_port_acquire_buffer_reserved (GstOMXPort * port, GstOMXBuffer ** buf,
+    guint reserve)
+{
+  return gst_omx_port_acquire_buffer_full (port, buf, reserve);
+}
+
 /* NOTE: Uses comp->lock and comp->messages_lock */
 OMX_ERRORTYPE
 gst_omx_port_release_buffer (GstOMXPort * port, GstOMXBuffer * buf)
@@ -1463,6 +1541,115 @@ done:
   return err;
 }
 
+/* Puts @buf, that was acquired from an input port but not filled, back
+ * to the pending buffers without passing it to the component
+ *
+ * NOTE: Uses comp->lock and comp->messages_lock */
+void
+gst_omx_port_return_buffer (GstOMXPort * port, GstOMXBuffer * buf)
+{
+  GstOMXComponent *comp;
+
+  g_return_if_fail (port != NULL);
+  g_return_if_fail (buf != NULL);
+  g_return_if_fail (buf->port == port);
+
+  comp = port->comp;
+
+  g_mutex_lock (&comp->lock);
+
+  GST_DEBUG_OBJECT (comp->parent, "Returning buffer %p (%p) to %s port %u",
+      buf, buf->omx_buf->pBuffer, comp->name, port->index);
+
+  if (buf->used || g_queue_find (&port->pending_buffers, buf)) {
+    GST_DEBUG_OBJECT (comp->parent, "Buffer %p of %s port %u is not "
+        "acquired", buf, comp->name, port->index);
+    goto done;
+  }
+
+  buf->omx_buf->nOffset = 0;
+  buf->omx_buf->nFilledLen = 0;
+  buf->omx_buf->nFlags = 0;
+
+  g_queue_push_tail (&port->pending_buffers, buf);
+  gst_omx_component_send_message (comp, NULL);
+
+done:
+  g_mutex_unlock (&comp->lock);
+}
+
+/* Takes @buf out of the pending buffers before it is released, for
+ * ports whose buffers are handed out by a buffer pool instead of
+ * gst_omx_port_acquire_buffer(). Waits until the component owns less
+ * than @max_used buffers of the port, so that the pool keeps buffers
+ * for upstream, or until the port is flushing or an error happened.
+ *
+ * NOTE: Uses comp->lock and comp->messages_lock */
+GstOMXAcquireBufferReturn
+gst_omx_port_claim_buffer (GstOMXPort * port, GstOMXBuffer * buf,
+    guint max_used)
+{
+  GstOMXAcquireBufferReturn ret = GST_OMX_ACQUIRE_BUFFER_ERROR;
+  GstOMXComponent *comp;
+  OMX_ERRORTYPE err;
+  guint used;
+
+  g_return_val_if_fail (port != NULL, GST_OMX_ACQUIRE_BUFFER_ERROR);
+  g_return_val_if_fail (buf != NULL, GST_OMX_ACQUIRE_BUFFER_ERROR);
+  g_return_val_if_fail (buf->port == port, GST_OMX_ACQUIRE_BUFFER_ERROR);
+
+  comp = port->comp;
+
+  g_mutex_lock (&comp->lock);
+  gst_omx_component_handle_messages (comp);
+
+  while (TRUE) {
+    if ((err = comp->last_error) != OMX_ErrorNone) {
+      GST_ERROR_OBJECT (comp->parent, "Component %s is in error state: %s",
+          comp->name, gst_omx_error_to_string (err));
+      ret = GST_OMX_ACQUIRE_BUFFER_ERROR;
+      goto done;
+    }
+
+    if (port->flushing) {
+      ret = GST_OMX_ACQUIRE_BUFFER_FLUSHING;
+      goto done;
+    }
+
+    used = port->buffers->len - g_queue_get_length (&port->pending_buffers);
+    if (used < max_used)
+      break;
+
+    /* Wait for the component to give a buffer back */
+    GST_LOG_OBJECT (comp->parent, "%s port %u uses %u of %u buffers",
+        comp->name, port->index, used, port->buffers->len);
+    g_mutex_lock (&comp->messages_lock);
+    g_mutex_unlock (&comp->lock);
+    if (g_queue_is_empty (&comp->messages))
+      g_cond_wait (&comp->messages_cond, &comp->messages_lock);
+    g_mutex_unlock (&comp->messages_lock);
+    g_mutex_lock (&comp->lock);
+    gst_omx_component_handle_messages (comp);
+  }
+
+  if (!g_queue_remove (&port->pending_buffers, buf)) {
+    GST_ERROR_OBJECT (comp->parent, "Buffer %p of %s port %u is not pending",
+        buf, comp->name, port->index);
+    ret = GST_OMX_ACQUIRE_BUFFER_ERROR;
+    goto done;
+  }
+
+  ret = GST_OMX_ACQUIRE_BUFFER_OK;
+
+done:
+  g_mutex_unlock (&comp->lock);
+
+  GST_DEBUG_OBJECT (comp->parent, "Claimed buffer %p of %s port %u: %d",
+      buf, comp->name, port->index, ret);
+
+  return ret;
+}
+
 /* NOTE: Uses comp->lock and comp->messages_lock */
 OMX_ERRORTYPE
 gst_omx_port_set_flushing (GstOMXPort * port, GstClockTime timeout,
@@ -2365,7 +2552,8 @@ static const GGetTypeFunction types[] = {
   gst_omx_aac_enc_get_type, gst_omx_mjpeg_dec_get_type,
   gst_nv_overlay_sink_get_type, gst_nv_hdmi_overlay_sink_get_type,
   gst_omx_aac_dec_get_type, gst_omx_mpegaudio_dec_get_type,
-  gst_omx_amrnb_dec_get_type, gst_omx_amrwb_dec_get_type
+  gst_omx_amrnb_dec_get_type, gst_omx_amrwb_dec_get_type,
+  gst_omx_ac3_dec_get_type, gst_omx_dts_dec_get_type
 #ifdef HAVE_VP8
       , gst_omx_vp8_dec_get_type, gst_omx_vp8_enc_get_type
 #endif
@@ -2897,6 +3085,16 @@ plugin_init (GstPlugin * plugin)
   }
   g_strfreev (elements);
 
+  /* Bins of the configured elements, not configurable themselves */
+  ret |= gst_element_register (plugin, "omxh264simulcastenc", GST_RANK_NONE,
+      GST_TYPE_OMX_SIMULCAST_ENC);
+  ret |= gst_element_register (plugin, "omxh264parallelenc", GST_RANK_NONE,
+      GST_TYPE_OMX_PARALLEL_ENC);
+  ret |= gst_element_register (plugin, "omxaacmultienc", GST_RANK_NONE,
+      GST_TYPE_OMX_MULTI_ENC);
+  ret |= gst_element_register (plugin, "nvcompositorsink", GST_RANK_NONE,
+      GST_TYPE_NV_COMPOSITOR_SINK);
+
 done:
   g_free (env_config_dir);
   g_free (config_dirs);
@@ -155,6 +155,7 @@ typedef enum
   GST_OMX_MESSAGE_ERROR,
   GST_OMX_MESSAGE_PORT_ENABLE,
   GST_OMX_MESSAGE_PORT_SETTINGS_CHANGED,
+  GST_OMX_MESSAGE_PORT_CROP_CHANGED,
   GST_OMX_MESSAGE_BUFFER_FLAG,
   GST_OMX_MESSAGE_BUFFER_DONE,
 } GstOMXMessageType;
@@ -194,6 +195,10 @@ struct _GstOMXMessage
       OMX_U32 port;
     } port_settings_changed;
     struct
+    {
+      OMX_U32 port;
+    } port_crop_changed;
+    struct
     {
       OMX_U32 port;
       OMX_U32 flags;
@@ -224,6 +229,8 @@ struct _GstOMXPort
   gboolean disabled_pending;    /* was done until it took effect */
   gboolean eos;                 /* TRUE after a buffer with EOS flag was received */
   gboolean reconfigure;         /* TRUE incase port needs to be reconfigured */
+  gboolean crop_changed;        /* TRUE after the output crop was changed,
+                                 * the buffers stay valid */
 
   /* Increased whenever the settings of these port change.
    * If settings_cookie != configured_settings_cookie
@@ -351,8 +358,13 @@ OMX_ERRORTYPE gst_omx_port_update_port_definition (GstOMXPort * port,
 
 GstOMXAcquireBufferReturn gst_omx_port_acquire_buffer (GstOMXPort * port,
     GstOMXBuffer ** buf);
+GstOMXAcquireBufferReturn gst_omx_port_acquire_buffer_reserved (GstOMXPort *
+    port, GstOMXBuffer ** buf, guint reserve);
 OMX_ERRORTYPE gst_omx_port_release_buffer (GstOMXPort * port,
     GstOMXBuffer * buf);
+void gst_omx_port_return_buffer (GstOMXPort * port, GstOMXBuffer * buf);
+GstOMXAcquireBufferReturn gst_omx_port_claim_buffer (GstOMXPort * port,
+    GstOMXBuffer * buf, guint max_used);
 
 OMX_ERRORTYPE gst_omx_port_set_flushing (GstOMXPort * port,
     GstClockTime timeout, gboolean flush);
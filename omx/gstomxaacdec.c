@@ -160,5 +160,11 @@ gst_omx_aac_dec_set_format (GstOMXAudioDec * decoder, GstOMXPort * port,
     return FALSE;
   }
 
+  /* ADTS and LOAS frames carry their own headers */
+  if (aac_profile.eAACStreamFormat == OMX_AUDIO_AACStreamFormatMP2ADTS ||
+      aac_profile.eAACStreamFormat == OMX_AUDIO_AACStreamFormatMP4ADTS ||
+      aac_profile.eAACStreamFormat == OMX_AUDIO_AACStreamFormatMP4LOAS)
+    decoder->can_pack = TRUE;
+
   return TRUE;
 }
@@ -42,6 +42,8 @@ static gboolean gst_omx_aac_enc_set_format (GstOMXAudioEnc * enc,
     GstOMXPort * port, GstAudioInfo * info);
 static GstCaps *gst_omx_aac_enc_get_caps (GstOMXAudioEnc * enc,
     GstOMXPort * port, GstAudioInfo * info);
+static guint gst_omx_aac_enc_get_frame_samples (GstOMXAudioEnc * enc,
+    GstAudioInfo * info);
 static guint gst_omx_aac_enc_get_num_samples (GstOMXAudioEnc * enc,
     GstOMXPort * port, GstAudioInfo * info, GstOMXBuffer * buf);
 
@@ -146,6 +148,8 @@ gst_omx_aac_enc_class_init (GstOMXAACEncClass * klass)
   audioenc_class->get_caps = GST_DEBUG_FUNCPTR (gst_omx_aac_enc_get_caps);
   audioenc_class->get_num_samples =
       GST_DEBUG_FUNCPTR (gst_omx_aac_enc_get_num_samples);
+  audioenc_class->get_frame_samples =
+      GST_DEBUG_FUNCPTR (gst_omx_aac_enc_get_frame_samples);
 
   audioenc_class->cdata.default_src_template_caps = "audio/mpeg, "
       "mpegversion=(int){2, 4}, "
@@ -503,6 +507,60 @@ gst_omx_aac_enc_get_caps (GstOMXAudioEnc * enc, GstOMXPort * port,
 
 }
 
+/* Returns the number of input samples per encoded frame. HE-AAC codes
+ * the core at half the rate, so its frames cover twice as many samples.
+ * Called before set_format, a profile from downstream takes precedence
+ * and is always one with 1024 samples per frame. */
+static guint
+gst_omx_aac_enc_get_frame_samples (GstOMXAudioEnc * enc, GstAudioInfo * info)
+{
+  OMX_AUDIO_PARAM_AACPROFILETYPE aac_profile;
+  GstCaps *templcaps, *peercaps;
+  gboolean peer_profile = FALSE;
+  OMX_ERRORTYPE err;
+
+  templcaps = gst_pad_get_pad_template_caps (GST_AUDIO_ENCODER_SRC_PAD (enc));
+  peercaps = gst_pad_peer_query_caps (GST_AUDIO_ENCODER_SRC_PAD (enc),
+      templcaps);
+  gst_caps_unref (templcaps);
+  if (peercaps) {
+    if (!gst_caps_is_empty (peercaps)) {
+      GstStructure *s = gst_caps_get_structure (peercaps, 0);
+      gint mpegversion = 0;
+
+      peer_profile = gst_structure_get_int (s, "mpegversion", &mpegversion)
+          && gst_structure_get_string (s,
+          (mpegversion == 2) ? "profile" : "base-profile") != NULL;
+    }
+    gst_caps_unref (peercaps);
+  }
+  if (peer_profile)
+    return 1024;
+
+  GST_OMX_INIT_STRUCT (&aac_profile);
+  aac_profile.nPortIndex = enc->enc_out_port->index;
+
+  err =
+      gst_omx_component_get_parameter (enc->enc, OMX_IndexParamAudioAac,
+      &aac_profile);
+  if (err != OMX_ErrorNone) {
+    GST_WARNING_OBJECT (enc,
+        "Failed to get AAC parameters from component: %s (0x%08x)",
+        gst_omx_error_to_string (err), err);
+    return 1024;
+  }
+
+  switch (aac_profile.eAACProfile) {
+    case OMX_AUDIO_AACObjectHE:
+    case OMX_AUDIO_AACObjectHE_PS:
+      return 2048;
+    case OMX_AUDIO_AACObjectLD:
+      return 512;
+    default:
+      return 1024;
+  }
+}
+
 static guint
 gst_omx_aac_enc_get_num_samples (GstOMXAudioEnc * enc, GstOMXPort * port,
     GstAudioInfo * info, GstOMXBuffer * buf)
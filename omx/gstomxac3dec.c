@@ -0,0 +1,135 @@
+/* GStreamer
+ * Copyright (c) 2015, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin Street, Suite 500,
+ * Boston, MA 02110-1335, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <gst/audio/gstaudiodecoder.h>
+#include "gstomxac3dec.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_omx_ac3_dec_debug_category);
+#define GST_CAT_DEFAULT gst_omx_ac3_dec_debug_category
+
+/* prototypes */
+
+static gboolean gst_omx_ac3_dec_set_format (GstOMXAudioDec * decoder,
+    GstOMXPort * port, GstCaps * caps);
+
+/* class initialization */
+
+G_DEFINE_TYPE_WITH_CODE (GstOMXAC3Dec, gst_omx_ac3_dec,
+    GST_TYPE_OMX_AUDIO_DEC,
+    GST_DEBUG_CATEGORY_INIT (gst_omx_ac3_dec_debug_category, "omxac3dec", 0,
+        "debug category for omxac3dec element"));
+
+static void
+gst_omx_ac3_dec_class_init (GstOMXAC3DecClass * klass)
+{
+  GstOMXAudioDecClass *omxdec_class = GST_OMX_AUDIO_DEC_CLASS (klass);
+
+  omxdec_class->set_format = GST_DEBUG_FUNCPTR (gst_omx_ac3_dec_set_format);
+
+  omxdec_class->cdata.default_sink_template_caps = "audio/x-ac3, "
+      "framed = (boolean) true; " "audio/x-eac3, " "framed = (boolean) true";
+
+  gst_element_class_set_static_metadata (GST_ELEMENT_CLASS (klass),
+      "OpenMax AC3 decoder", "Codec/Decoder/Audio",
+      "Decodes AC3 and E-AC3 audio streams or passes them through",
+      "NVIDIA Corporation");
+
+  gst_omx_set_default_role (&omxdec_class->cdata, "audio_decoder.ac3");
+}
+
+static void
+gst_omx_ac3_dec_init (GstOMXAC3Dec * omxac3dec)
+{
+}
+
+static gboolean
+gst_omx_ac3_dec_set_format (GstOMXAudioDec * decoder, GstOMXPort * port,
+    GstCaps * caps)
+{
+  GstOMXAC3Dec *self = GST_OMX_AC3_DEC (decoder);
+  NVX_AUDIO_PARAM_AC3TYPE ac3_type;
+  OMX_PARAM_PORTDEFINITIONTYPE port_def;
+  OMX_INDEXTYPE index;
+  OMX_ERRORTYPE err;
+
+  gst_omx_port_get_port_definition (port, &port_def);
+  port_def.format.audio.eEncoding = (OMX_AUDIO_CODINGTYPE) NVX_AUDIO_CodingAC3;
+  err = gst_omx_port_update_port_definition (port, &port_def);
+
+  if (err != OMX_ErrorNone) {
+    GST_ERROR_OBJECT (self,
+        "Failed to update  port definition of component: %s (0x%08x)",
+        gst_omx_error_to_string (err), err);
+    return FALSE;
+  }
+
+  err = gst_omx_component_get_index (decoder->dec,
+      (gpointer) NVX_INDEX_PARAM_AC3, &index);
+  if (err != OMX_ErrorNone) {
+    GST_ERROR_OBJECT (self, "Failed to get AC3 parameter index: %s (0x%08x)",
+        gst_omx_error_to_string (err), err);
+    return FALSE;
+  }
+
+  GST_OMX_INIT_STRUCT (&ac3_type);
+  ac3_type.nPortIndex = port->index;
+
+  err = gst_omx_component_get_parameter (decoder->dec, index, &ac3_type);
+  if (err != OMX_ErrorNone) {
+    GST_ERROR_OBJECT (self,
+        "Failed to get AC3 parameters from component: %s (0x%08x)",
+        gst_omx_error_to_string (err), err);
+    return FALSE;
+  }
+
+  if (caps) {
+    GstStructure *s;
+    gint channels = 0, sample_rate = 0;
+
+    if (gst_caps_is_empty (caps)) {
+      GST_ERROR_OBJECT (self, "Empty caps");
+      return FALSE;
+    }
+
+    s = gst_caps_get_structure (caps, 0);
+
+    if (gst_structure_get_int (s, "channels", &channels))
+      ac3_type.nChannels = channels;
+
+    if (gst_structure_get_int (s, "rate", &sample_rate))
+      ac3_type.nSampleRate = sample_rate;
+  }
+
+  err = gst_omx_component_set_parameter (decoder->dec, index, &ac3_type);
+  if (err != OMX_ErrorNone) {
+    GST_ERROR_OBJECT (self, "Error setting AC3 parameters: %s (0x%08x)",
+        gst_omx_error_to_string (err), err);
+    return FALSE;
+  }
+
+  /* Every syncframe starts with its own header */
+  decoder->can_pack = TRUE;
+
+  return TRUE;
+}
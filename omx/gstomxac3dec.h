@@ -0,0 +1,49 @@
+/* GStreamer
+ * Copyright (c) 2015, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _GST_OMX_AC3_DEC_H_
+#define _GST_OMX_AC3_DEC_H_
+
+#include <gst/gst.h>
+#include "gstomxaudiodec.h"
+
+G_BEGIN_DECLS
+#define GST_TYPE_OMX_AC3_DEC   (gst_omx_ac3_dec_get_type())
+#define GST_OMX_AC3_DEC(obj)   (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_OMX_AC3_DEC,GstOMXAC3Dec))
+#define GST_OMX_AC3_DEC_CLASS(klass)   (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_OMX_AC3_DEC,GstOMXAC3DecClass))
+#define GST_IS_OMX_AC3_DEC(obj)   (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_OMX_AC3_DEC))
+#define GST_IS_OMX_AC3_DEC_CLASS(obj)   (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_OMX_AC3_DEC))
+typedef struct _GstOMXAC3Dec GstOMXAC3Dec;
+typedef struct _GstOMXAC3DecClass GstOMXAC3DecClass;
+
+struct _GstOMXAC3Dec
+{
+  GstOMXAudioDec parent;
+
+};
+
+struct _GstOMXAC3DecClass
+{
+  GstOMXAudioDecClass parent_class;
+};
+
+GType gst_omx_ac3_dec_get_type (void);
+
+G_END_DECLS
+#endif
@@ -116,5 +116,8 @@ gst_omx_amrwb_dec_set_format (GstOMXAudioDec * decoder, GstOMXPort * port,
     return FALSE;
   }
 
+  /* Every storage format frame starts with its own header */
+  decoder->can_pack = TRUE;
+
   return TRUE;
 }
@@ -34,6 +34,8 @@ static void gst_omx_audio_dec_finalize (GObject * object);
 
 static gboolean gst_omx_audio_dec_start (GstAudioDecoder * decoder);
 static gboolean gst_omx_audio_dec_stop (GstAudioDecoder * decoder);
+static void gst_omx_audio_dec_flush (GstAudioDecoder * decoder,
+    gboolean hard);
 static gboolean gst_omx_audio_dec_set_format (GstAudioDecoder * decoder,
     GstCaps * caps);
 static GstFlowReturn gst_omx_audio_dec_handle_frame (GstAudioDecoder * decoder,
@@ -41,6 +43,64 @@ static GstFlowReturn gst_omx_audio_dec_handle_frame (GstAudioDecoder * decoder,
 static gboolean gst_omx_audio_dec_open (GstAudioDecoder * decoder);
 static gboolean gst_omx_audio_dec_close (GstAudioDecoder * decoder);
 static gboolean gst_omx_audio_dec_shutdown (GstOMXAudioDec * self);
+static OMX_ERRORTYPE gst_omx_audio_dec_submit_packed (GstOMXAudioDec * self,
+    GstOMXBuffer * buf);
+static void gst_omx_audio_dec_loop (GstOMXAudioDec * self);
+static void gst_omx_audio_dec_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec);
+static void gst_omx_audio_dec_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec);
+
+enum
+{
+  PROP_0,
+  PROP_PACKETS_PER_BUFFER,
+  PROP_PASSTHROUGH
+};
+
+#define DEFAULT_PACKETS_PER_BUFFER 1
+#define DEFAULT_PASSTHROUGH TRUE
+
+/* Output buffers kept with the component, decoded data is copied
+ * when downstream holds all others */
+#define OUT_BUFFERS_MIN_FREE 2
+
+/* Decoded data is copied while downstream holds an output buffer
+ * for longer than this */
+#define OUT_BUFFERS_MAX_HOLD (200 * G_TIME_SPAN_MILLISECOND)
+
+/* Memory of an output buffer pushed downstream without copying. When
+ * the output buffers are deallocated while downstream still holds it,
+ * its data moves into a copy */
+typedef struct _GstOMXAudioDecMemory GstOMXAudioDecMemory;
+struct _GstOMXAudioDecMemory
+{
+  GstMemory mem;
+
+  GstOMXAudioDec *self;
+  /* NULL once data is a copy */
+  GstOMXBuffer *buf;
+  guint8 *data;
+  gint64 wrap_time;
+  guint mapped;
+};
+
+typedef struct _GstOMXAudioDecAllocator GstOMXAudioDecAllocator;
+typedef struct _GstOMXAudioDecAllocatorClass GstOMXAudioDecAllocatorClass;
+
+struct _GstOMXAudioDecAllocator
+{
+  GstAllocator parent;
+};
+
+struct _GstOMXAudioDecAllocatorClass
+{
+  GstAllocatorClass parent_class;
+};
+
+GType gst_omx_audio_dec_allocator_get_type (void);
+G_DEFINE_TYPE (GstOMXAudioDecAllocator, gst_omx_audio_dec_allocator,
+    GST_TYPE_ALLOCATOR);
 
 /* class initialization */
 
@@ -122,15 +182,36 @@ gst_omx_audio_dec_class_init (GstOMXAudioDecClass * klass)
 
   klass->cdata.type = GST_OMX_COMPONENT_TYPE_FILTER;
   klass->cdata.default_src_template_caps = "audio/x-raw, "
-      "layout=(string) interleaved, " "format=(string) S16LE";
+      "layout=(string) interleaved, "
+      "format=(string) { S16LE, S24LE, S32LE }";
 
   gobject_class->finalize = gst_omx_audio_dec_finalize;
+  gobject_class->set_property = gst_omx_audio_dec_set_property;
+  gobject_class->get_property = gst_omx_audio_dec_get_property;
+
+  g_object_class_install_property (gobject_class, PROP_PACKETS_PER_BUFFER,
+      g_param_spec_uint ("packets-per-buffer", "Packets per buffer",
+          "Maximum number of whole packets passed to the component in one "
+          "input buffer, for stream formats that delimit their packets "
+          "(1=one packet per buffer)",
+          1, 256, DEFAULT_PACKETS_PER_BUFFER,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_PASSTHROUGH,
+      g_param_spec_boolean ("passthrough", "Passthrough",
+          "Pass AC3, E-AC3 and DTS streams through undecoded when the audio "
+          "output and downstream accept them",
+          DEFAULT_PASSTHROUGH,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
 
   element_class->change_state =
       GST_DEBUG_FUNCPTR (gst_omx_audio_dec_change_state);
 
   audiodec_class->start = GST_DEBUG_FUNCPTR (gst_omx_audio_dec_start);
   audiodec_class->stop = GST_DEBUG_FUNCPTR (gst_omx_audio_dec_stop);
+  audiodec_class->flush = GST_DEBUG_FUNCPTR (gst_omx_audio_dec_flush);
   audiodec_class->set_format = GST_DEBUG_FUNCPTR (gst_omx_audio_dec_set_format);
   audiodec_class->handle_frame =
       GST_DEBUG_FUNCPTR (gst_omx_audio_dec_handle_frame);
@@ -143,6 +224,14 @@ gst_omx_audio_dec_init (GstOMXAudioDec * self)
 {
   g_mutex_init (&self->drain_lock);
   g_cond_init (&self->drain_cond);
+  g_mutex_init (&self->out_lock);
+  g_cond_init (&self->out_cond);
+
+  self->packets_per_buffer = DEFAULT_PACKETS_PER_BUFFER;
+  self->allow_passthrough = DEFAULT_PASSTHROUGH;
+  self->pack_timestamps = g_array_new (FALSE, FALSE, sizeof (GstClockTime));
+  self->out_allocator =
+      g_object_new (gst_omx_audio_dec_allocator_get_type (), NULL);
 }
 
 void
@@ -151,10 +240,52 @@ gst_omx_audio_dec_finalize (GObject * object)
   GstOMXAudioDec *self = GST_OMX_AUDIO_DEC (object);
   g_mutex_clear (&self->drain_lock);
   g_cond_clear (&self->drain_cond);
+  g_mutex_clear (&self->out_lock);
+  g_cond_clear (&self->out_cond);
+  g_array_free (self->pack_timestamps, TRUE);
+  gst_object_unref (self->out_allocator);
 
   G_OBJECT_CLASS (gst_omx_audio_dec_parent_class)->finalize (object);
 }
 
+static void
+gst_omx_audio_dec_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstOMXAudioDec *self = GST_OMX_AUDIO_DEC (object);
+
+  switch (prop_id) {
+    case PROP_PACKETS_PER_BUFFER:
+      self->packets_per_buffer = g_value_get_uint (value);
+      break;
+    case PROP_PASSTHROUGH:
+      self->allow_passthrough = g_value_get_boolean (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_omx_audio_dec_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstOMXAudioDec *self = GST_OMX_AUDIO_DEC (object);
+
+  switch (prop_id) {
+    case PROP_PACKETS_PER_BUFFER:
+      g_value_set_uint (value, self->packets_per_buffer);
+      break;
+    case PROP_PASSTHROUGH:
+      g_value_set_boolean (value, self->allow_passthrough);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
 static gboolean
 gst_omx_audio_dec_start (GstAudioDecoder * decoder)
 {
@@ -163,6 +294,10 @@ gst_omx_audio_dec_start (GstAudioDecoder * decoder)
   self->last_upstream_ts = 0;
   self->eos = FALSE;
   self->downstream_flow_ret = GST_FLOW_OK;
+  self->pack_count = 0;
+  g_array_set_size (self->pack_timestamps, 0);
+  self->passthrough = FALSE;
+  self->output_passthrough = FALSE;
 
   return TRUE;
 }
@@ -179,6 +314,14 @@ gst_omx_audio_dec_stop (GstAudioDecoder * decoder)
 
   gst_pad_stop_task (GST_AUDIO_DECODER_SRC_PAD (decoder));
 
+  /* Packets not passed yet are dropped */
+  if (self->pack_buf) {
+    gst_omx_port_release_buffer (self->dec_in_port, self->pack_buf);
+    self->pack_buf = NULL;
+  }
+  self->pack_count = 0;
+  g_array_set_size (self->pack_timestamps, 0);
+
   if (gst_omx_component_get_state (self->dec, 0) > OMX_StateIdle)
     gst_omx_component_set_state (self->dec, OMX_StateIdle);
 
@@ -204,6 +347,65 @@ gst_omx_audio_dec_stop (GstAudioDecoder * decoder)
   return TRUE;
 }
 
+static void
+gst_omx_audio_dec_flush (GstAudioDecoder * decoder, gboolean hard)
+{
+  GstOMXAudioDec *self = GST_OMX_AUDIO_DEC (decoder);
+  OMX_ERRORTYPE err;
+
+  /* On a discontinuity the packets collected so far are decoded
+   * on their own */
+  if (!hard) {
+    if (self->pack_buf) {
+      GstOMXBuffer *buf = self->pack_buf;
+
+      self->pack_buf = NULL;
+      err = gst_omx_audio_dec_submit_packed (self, buf);
+      if (err != OMX_ErrorNone)
+        GST_ERROR_OBJECT (self, "Failed to pass packed packets: %s (0x%08x)",
+            gst_omx_error_to_string (err), err);
+    }
+    return;
+  }
+
+  if (gst_omx_component_get_state (self->dec, 0) < OMX_StateIdle)
+    return;
+
+  GST_DEBUG_OBJECT (self, "Flushing decoder");
+
+  gst_omx_port_set_flushing (self->dec_in_port, 5 * GST_SECOND, TRUE);
+  gst_omx_port_set_flushing (self->dec_out_port, 5 * GST_SECOND, TRUE);
+
+  /* Packets not passed yet are dropped */
+  if (self->pack_buf) {
+    gst_omx_port_release_buffer (self->dec_in_port, self->pack_buf);
+    self->pack_buf = NULL;
+  }
+  self->pack_count = 0;
+  g_array_set_size (self->pack_timestamps, 0);
+
+  /* Wait until the srcpad loop is finished,
+   * unlock GST_AUDIO_DECODER_STREAM_LOCK to prevent deadlocks
+   * caused by using this lock from inside the loop function */
+  GST_AUDIO_DECODER_STREAM_UNLOCK (self);
+  GST_PAD_STREAM_LOCK (GST_AUDIO_DECODER_SRC_PAD (self));
+  GST_PAD_STREAM_UNLOCK (GST_AUDIO_DECODER_SRC_PAD (self));
+  GST_AUDIO_DECODER_STREAM_LOCK (self);
+
+  gst_omx_port_set_flushing (self->dec_in_port, 5 * GST_SECOND, FALSE);
+  gst_omx_port_set_flushing (self->dec_out_port, 5 * GST_SECOND, FALSE);
+  gst_omx_port_populate (self->dec_out_port);
+
+  /* Start the srcpad loop again */
+  self->last_upstream_ts = 0;
+  self->eos = FALSE;
+  self->downstream_flow_ret = GST_FLOW_OK;
+  gst_pad_start_task (GST_AUDIO_DECODER_SRC_PAD (self),
+      (GstTaskFunction) gst_omx_audio_dec_loop, decoder, NULL);
+
+  GST_DEBUG_OBJECT (self, "Flushed decoder");
+}
+
 static GstFlowReturn
 gst_omx_audio_dec_drain (GstOMXAudioDec * self, gboolean is_eos)
 {
@@ -215,6 +417,15 @@ gst_omx_audio_dec_drain (GstOMXAudioDec * self, gboolean is_eos)
   GST_DEBUG_OBJECT (self, "Draining component");
   klass = GST_OMX_AUDIO_DEC_GET_CLASS (self);
 
+  if (self->pack_buf) {
+    buf = self->pack_buf;
+    self->pack_buf = NULL;
+    err = gst_omx_audio_dec_submit_packed (self, buf);
+    if (err != OMX_ErrorNone)
+      GST_ERROR_OBJECT (self, "Failed to pass packed packets: %s (0x%08x)",
+          gst_omx_error_to_string (err), err);
+  }
+
   if (!self->started) {
     GST_DEBUG_OBJECT (self, "Component not started yet");
     return GST_FLOW_OK;
@@ -366,6 +577,7 @@ gst_omx_audio_dec_set_output_format (GstOMXAudioDec * self)
   gst_audio_info_set_format (&info, format, self->rate, self->channel,
       position);
   gst_audio_decoder_set_output_format (GST_AUDIO_DECODER (self), &info);
+  self->output_passthrough = FALSE;
 
   if (position)
     g_free (position);
@@ -419,6 +631,215 @@ done:
   return err;
 }
 
+static GstMemory *
+gst_omx_audio_dec_allocator_alloc_dummy (GstAllocator * allocator,
+    gsize size, GstAllocationParams * params)
+{
+  g_assert_not_reached ();
+  return NULL;
+}
+
+/* Gives the output buffer back to the port */
+static void
+gst_omx_audio_dec_allocator_free (GstAllocator * allocator, GstMemory * mem)
+{
+  GstOMXAudioDecMemory *omem = (GstOMXAudioDecMemory *) mem;
+  GstOMXAudioDec *self = omem->self;
+
+  g_mutex_lock (&self->out_lock);
+  if (omem->buf) {
+    gst_omx_port_release_buffer (self->dec_out_port, omem->buf);
+    g_queue_remove (&self->out_memories, omem);
+    g_cond_broadcast (&self->out_cond);
+  } else {
+    g_free (omem->data);
+  }
+  g_mutex_unlock (&self->out_lock);
+
+  gst_object_unref (self);
+  g_slice_free (GstOMXAudioDecMemory, omem);
+}
+
+static gpointer
+gst_omx_audio_dec_memory_map (GstMemory * mem, gsize maxsize,
+    GstMapFlags flags)
+{
+  GstOMXAudioDecMemory *omem = (GstOMXAudioDecMemory *) mem;
+  gpointer data;
+
+  g_mutex_lock (&omem->self->out_lock);
+  omem->mapped++;
+  data = omem->data;
+  g_mutex_unlock (&omem->self->out_lock);
+
+  return data;
+}
+
+static void
+gst_omx_audio_dec_memory_unmap (GstMemory * mem)
+{
+  GstOMXAudioDecMemory *omem = (GstOMXAudioDecMemory *) mem;
+
+  g_mutex_lock (&omem->self->out_lock);
+  omem->mapped--;
+  g_cond_broadcast (&omem->self->out_cond);
+  g_mutex_unlock (&omem->self->out_lock);
+}
+
+static GstMemory *
+gst_omx_audio_dec_memory_share (GstMemory * mem, gssize offset, gssize size)
+{
+  g_assert_not_reached ();
+  return NULL;
+}
+
+static void
+gst_omx_audio_dec_allocator_class_init (GstOMXAudioDecAllocatorClass * klass)
+{
+  GstAllocatorClass *allocator_class = (GstAllocatorClass *) klass;
+
+  allocator_class->alloc = gst_omx_audio_dec_allocator_alloc_dummy;
+  allocator_class->free = gst_omx_audio_dec_allocator_free;
+}
+
+static void
+gst_omx_audio_dec_allocator_init (GstOMXAudioDecAllocator * allocator)
+{
+  GstAllocator *alloc = GST_ALLOCATOR_CAST (allocator);
+
+  alloc->mem_type = "omxaudiodec";
+  alloc->mem_map = gst_omx_audio_dec_memory_map;
+  alloc->mem_unmap = gst_omx_audio_dec_memory_unmap;
+  alloc->mem_share = gst_omx_audio_dec_memory_share;
+
+  GST_OBJECT_FLAG_SET (allocator, GST_ALLOCATOR_FLAG_CUSTOM_ALLOC);
+}
+
+/* Wraps the decoded data of @buf without copying it. Returns NULL if
+ * too few buffers would be left for the component to decode into, or
+ * if downstream holds a wrapped buffer for too long */
+static GstBuffer *
+gst_omx_audio_dec_wrap_out_buffer (GstOMXAudioDec * self, GstOMXBuffer * buf)
+{
+  OMX_BUFFERHEADERTYPE *omx_buf = buf->omx_buf;
+  GstOMXAudioDecMemory *omem, *oldest;
+  GstBuffer *outbuf;
+  gint64 now;
+  guint max, n;
+
+  max = self->dec_out_port->port_def.nBufferCountActual;
+  max = max > OUT_BUFFERS_MIN_FREE ? max - OUT_BUFFERS_MIN_FREE : 0;
+  now = g_get_monotonic_time ();
+
+  g_mutex_lock (&self->out_lock);
+  n = g_queue_get_length (&self->out_memories);
+  if (n >= max) {
+    g_mutex_unlock (&self->out_lock);
+    GST_LOG_OBJECT (self, "%u output buffers held downstream, copying", n);
+    return NULL;
+  }
+
+  oldest = g_queue_peek_head (&self->out_memories);
+  if (oldest && now - oldest->wrap_time > OUT_BUFFERS_MAX_HOLD) {
+    g_mutex_unlock (&self->out_lock);
+    GST_LOG_OBJECT (self, "Output buffer held downstream for %"
+        G_GINT64_FORMAT "ms, copying", (now - oldest->wrap_time) /
+        G_TIME_SPAN_MILLISECOND);
+    return NULL;
+  }
+
+  omem = g_slice_new0 (GstOMXAudioDecMemory);
+  gst_memory_init (GST_MEMORY_CAST (omem),
+      GST_MEMORY_FLAG_READONLY | GST_MEMORY_FLAG_NO_SHARE,
+      self->out_allocator, NULL, omx_buf->nAllocLen, 0, omx_buf->nOffset,
+      omx_buf->nFilledLen);
+  omem->self = gst_object_ref (self);
+  omem->buf = buf;
+  omem->data = omx_buf->pBuffer;
+  omem->wrap_time = now;
+  g_queue_push_tail (&self->out_memories, omem);
+  g_mutex_unlock (&self->out_lock);
+
+  outbuf = gst_buffer_new ();
+  gst_buffer_append_memory (outbuf, GST_MEMORY_CAST (omem));
+
+  return outbuf;
+}
+
+/* Waits until downstream released the wrapped output buffers before
+ * they are deallocated. Memories that are still held afterwards get a
+ * copy of their data, so they never point into freed OMX buffers */
+static void
+gst_omx_audio_dec_wait_out_buffers (GstOMXAudioDec * self)
+{
+  gint64 wait_until = g_get_monotonic_time () + 5 * G_TIME_SPAN_SECOND;
+  GstOMXAudioDecMemory *omem;
+  GList *l;
+
+  g_mutex_lock (&self->out_lock);
+  while (!g_queue_is_empty (&self->out_memories)) {
+    if (!g_cond_wait_until (&self->out_cond, &self->out_lock, wait_until)) {
+      GST_WARNING_OBJECT (self, "%u output buffers still held downstream, "
+          "copying them", g_queue_get_length (&self->out_memories));
+      break;
+    }
+  }
+
+  /* Mapped data points into the OMX buffer until it is unmapped */
+retry:
+  for (l = self->out_memories.head; l; l = l->next) {
+    omem = l->data;
+    if (omem->mapped > 0) {
+      g_cond_wait (&self->out_cond, &self->out_lock);
+      goto retry;
+    }
+  }
+
+  while ((omem = g_queue_pop_head (&self->out_memories))) {
+    omem->data = g_memdup (omem->data, omem->mem.maxsize);
+    omem->buf = NULL;
+  }
+  g_mutex_unlock (&self->out_lock);
+}
+
+/* Returns how many of the packed input packets @outbuf finishes,
+ * always at least one */
+static gint
+gst_omx_audio_dec_count_packets (GstOMXAudioDec * self, GstBuffer * outbuf)
+{
+  GArray *timestamps = self->pack_timestamps;
+  GstAudioInfo *info;
+  GstClockTime end;
+  guint n = 1;
+
+  if (timestamps->len == 0)
+    return 1;
+
+  info = gst_audio_decoder_get_audio_info (GST_AUDIO_DECODER (self));
+  if (GST_AUDIO_INFO_BPF (info) == 0 || GST_AUDIO_INFO_RATE (info) == 0
+      || !GST_BUFFER_TIMESTAMP_IS_VALID (outbuf)) {
+    g_array_remove_index (timestamps, 0);
+    return 1;
+  }
+
+  end = GST_BUFFER_TIMESTAMP (outbuf) +
+      gst_util_uint64_scale (gst_buffer_get_size (outbuf) /
+      GST_AUDIO_INFO_BPF (info), GST_SECOND, GST_AUDIO_INFO_RATE (info));
+
+  /* The first packet is always finished, the following ones as long
+   * as they start before the decoded audio ends */
+  while (n < timestamps->len) {
+    GstClockTime ts = g_array_index (timestamps, GstClockTime, n);
+
+    if (!GST_CLOCK_TIME_IS_VALID (ts) || ts >= end)
+      break;
+    n++;
+  }
+  g_array_remove_range (timestamps, 0, n);
+
+  return n;
+}
+
 static void
 gst_omx_audio_dec_loop (GstOMXAudioDec * self)
 {
@@ -439,6 +860,7 @@ gst_omx_audio_dec_loop (GstOMXAudioDec * self)
   }
 
   if (!gst_pad_has_current_caps (GST_AUDIO_DECODER_SRC_PAD (self)) ||
+      self->output_passthrough ||
       acq_return == GST_OMX_ACQUIRE_BUFFER_RECONFIGURE) {
 
     GST_DEBUG_OBJECT (self, "Port settings have changed, updating caps");
@@ -452,6 +874,7 @@ gst_omx_audio_dec_loop (GstOMXAudioDec * self)
       err = gst_omx_port_wait_buffers_released (port, 5 * GST_SECOND);
       if (err != OMX_ErrorNone)
         goto reconfigure_error;
+      gst_omx_audio_dec_wait_out_buffers (self);
       err = gst_omx_port_deallocate_buffers (port);
       if (err != OMX_ErrorNone)
         goto reconfigure_error;
@@ -492,19 +915,24 @@ gst_omx_audio_dec_loop (GstOMXAudioDec * self)
   if (buf->omx_buf->nFilledLen > 0) {
     GstBuffer *outbuf;
     GstMapInfo map = GST_MAP_INFO_INIT;
+    gboolean wrapped;
 
     GST_DEBUG_OBJECT (self, "Handling output data");
 
-    outbuf =
-        gst_audio_decoder_allocate_output_buffer (GST_AUDIO_DECODER (self),
-        buf->omx_buf->nFilledLen);
+    outbuf = gst_omx_audio_dec_wrap_out_buffer (self, buf);
+    wrapped = outbuf != NULL;
+    if (!wrapped) {
+      outbuf =
+          gst_audio_decoder_allocate_output_buffer (GST_AUDIO_DECODER (self),
+          buf->omx_buf->nFilledLen);
 
-    gst_buffer_map (outbuf, &map, GST_MAP_WRITE);
+      gst_buffer_map (outbuf, &map, GST_MAP_WRITE);
 
-    memcpy (map.data,
-        buf->omx_buf->pBuffer + buf->omx_buf->nOffset,
-        buf->omx_buf->nFilledLen);
-    gst_buffer_unmap (outbuf, &map);
+      memcpy (map.data,
+          buf->omx_buf->pBuffer + buf->omx_buf->nOffset,
+          buf->omx_buf->nFilledLen);
+      gst_buffer_unmap (outbuf, &map);
+    }
 
     GST_BUFFER_TIMESTAMP (outbuf) =
         gst_util_uint64_scale (buf->omx_buf->nTimeStamp, GST_SECOND,
@@ -514,8 +942,13 @@ gst_omx_audio_dec_loop (GstOMXAudioDec * self)
           gst_util_uint64_scale (buf->omx_buf->nTickCount, GST_SECOND,
           OMX_TICKS_PER_SECOND);
 
+    /* A wrapped buffer goes back to the port once downstream is done */
+    if (wrapped)
+      buf = NULL;
+
     flow_ret =
-        gst_audio_decoder_finish_frame (GST_AUDIO_DECODER (self), outbuf, 1);
+        gst_audio_decoder_finish_frame (GST_AUDIO_DECODER (self), outbuf,
+        gst_omx_audio_dec_count_packets (self, outbuf));
 
     GST_DEBUG_OBJECT (self, "Finished frame: %s", gst_flow_get_name (flow_ret));
   }
@@ -630,6 +1063,205 @@ release_error:
   }
 }
 
+/* Asks the component for the channel count and sample format downstream
+ * prefers, so no conversion is needed after the decoder */
+static void
+gst_omx_audio_dec_negotiate_pcm (GstOMXAudioDec * self)
+{
+  GstOMXPort *port = self->dec_out_port;
+  OMX_AUDIO_PARAM_PCMMODETYPE pcm_mode;
+  GstAudioFormat format = GST_AUDIO_FORMAT_UNKNOWN;
+  GstCaps *templ, *peer;
+  GstStructure *s;
+  const GValue *v;
+  gint channels = 0;
+  guint i;
+  OMX_ERRORTYPE err;
+
+  templ = gst_pad_get_pad_template_caps (GST_AUDIO_DECODER_SRC_PAD (self));
+  peer = gst_pad_peer_query_caps (GST_AUDIO_DECODER_SRC_PAD (self), templ);
+  gst_caps_unref (templ);
+
+  if (!peer || gst_caps_is_empty (peer) || gst_caps_is_any (peer)) {
+    GST_DEBUG_OBJECT (self, "No PCM preference downstream");
+    goto done;
+  }
+
+  GST_DEBUG_OBJECT (self, "Downstream accepts %" GST_PTR_FORMAT, peer);
+  s = gst_caps_get_structure (peer, 0);
+
+  /* Highest channel count of the preferred structure */
+  v = gst_structure_get_value (s, "channels");
+  if (v && G_VALUE_HOLDS_INT (v)) {
+    channels = g_value_get_int (v);
+  } else if (v && GST_VALUE_HOLDS_INT_RANGE (v)) {
+    channels = gst_value_get_int_range_max (v);
+  } else if (v && GST_VALUE_HOLDS_LIST (v)) {
+    for (i = 0; i < gst_value_list_get_size (v); i++) {
+      const GValue *c = gst_value_list_get_value (v, i);
+
+      if (G_VALUE_HOLDS_INT (c))
+        channels = MAX (channels, g_value_get_int (c));
+    }
+  }
+  if (channels > OMX_AUDIO_MAXCHANNELS)
+    channels = 0;
+
+  /* First sample format of the preferred structure */
+  v = gst_structure_get_value (s, "format");
+  if (v && GST_VALUE_HOLDS_LIST (v))
+    v = gst_value_list_get_size (v) > 0 ? gst_value_list_get_value (v, 0) :
+        NULL;
+  if (v && G_VALUE_HOLDS_STRING (v))
+    format = gst_audio_format_from_string (g_value_get_string (v));
+
+#ifdef USE_OMX_TARGET_TEGRA
+  if (channels > 0) {
+    OMX_INDEXTYPE index;
+    OMX_PARAM_U32TYPE max_channels;
+
+    err = gst_omx_component_get_index (self->dec,
+        (gpointer) NVX_INDEX_CONFIG_MAXOUTPUTCHANNELS, &index);
+    if (err == OMX_ErrorNone) {
+      GST_OMX_INIT_STRUCT (&max_channels);
+      max_channels.nPortIndex = port->index;
+      max_channels.nU32 = channels;
+      err = gst_omx_component_set_config (self->dec, index, &max_channels);
+    }
+    if (err != OMX_ErrorNone)
+      GST_WARNING_OBJECT (self, "Failed to limit output to %d channels: "
+          "%s (0x%08x)", channels, gst_omx_error_to_string (err), err);
+  }
+#endif
+
+  GST_OMX_INIT_STRUCT (&pcm_mode);
+  pcm_mode.nPortIndex = port->index;
+
+  err = gst_omx_component_get_parameter (self->dec, OMX_IndexParamAudioPcm,
+      &pcm_mode);
+  if (err != OMX_ErrorNone) {
+    GST_WARNING_OBJECT (self,
+        "Failed to get PCM parameters from component: %s (0x%08x)",
+        gst_omx_error_to_string (err), err);
+    goto done;
+  }
+
+  if (channels > 0 && pcm_mode.nChannels > channels)
+    pcm_mode.nChannels = channels;
+
+  if (format != GST_AUDIO_FORMAT_UNKNOWN) {
+    const GstAudioFormatInfo *finfo = gst_audio_format_get_info (format);
+
+    /* Only formats without padding map to nBitPerSample */
+    if (GST_AUDIO_FORMAT_INFO_IS_INTEGER (finfo) &&
+        GST_AUDIO_FORMAT_INFO_WIDTH (finfo) ==
+        GST_AUDIO_FORMAT_INFO_DEPTH (finfo)) {
+      pcm_mode.eNumData = GST_AUDIO_FORMAT_INFO_IS_SIGNED (finfo) ?
+          OMX_NumericalDataSigned : OMX_NumericalDataUnsigned;
+      pcm_mode.eEndian =
+          GST_AUDIO_FORMAT_INFO_ENDIANNESS (finfo) == G_BIG_ENDIAN ?
+          OMX_EndianBig : OMX_EndianLittle;
+      pcm_mode.nBitPerSample = GST_AUDIO_FORMAT_INFO_WIDTH (finfo);
+    }
+  }
+  pcm_mode.bInterleaved = OMX_TRUE;
+
+  GST_DEBUG_OBJECT (self, "Requesting %u channels of %u bit PCM",
+      (guint) pcm_mode.nChannels, (guint) pcm_mode.nBitPerSample);
+
+  err = gst_omx_component_set_parameter (self->dec, OMX_IndexParamAudioPcm,
+      &pcm_mode);
+  if (err != OMX_ErrorNone)
+    GST_WARNING_OBJECT (self,
+        "Failed to set PCM parameters on component: %s (0x%08x)",
+        gst_omx_error_to_string (err), err);
+
+done:
+  if (peer)
+    gst_caps_unref (peer);
+}
+
+/* Returns TRUE if @caps is a compressed format downstream can take as
+ * is, for example an HDMI or S/PDIF sink that wraps it in IEC 61937 */
+static gboolean
+gst_omx_audio_dec_can_passthrough (GstOMXAudioDec * self, GstCaps * caps)
+{
+  const gchar *name;
+#ifdef USE_OMX_TARGET_TEGRA
+  NVX_AUDIO_CONFIG_CAPS audio_caps;
+  OMX_INDEXTYPE index;
+  OMX_ERRORTYPE err;
+#endif
+
+  if (gst_caps_is_empty (caps))
+    return FALSE;
+
+  name = gst_structure_get_name (gst_caps_get_structure (caps, 0));
+  if (!g_str_equal (name, "audio/x-ac3") && !g_str_equal (name, "audio/x-eac3")
+      && !g_str_equal (name, "audio/x-dts"))
+    return FALSE;
+
+#ifdef USE_OMX_TARGET_TEGRA
+  /* The structure has no size and version header */
+  memset (&audio_caps, 0, sizeof (audio_caps));
+  err = gst_omx_component_get_index (self->dec,
+      (gpointer) NVX_INDEX_CONFIG_AUDIO_CAPS, &index);
+  if (err == OMX_ErrorNone)
+    err = gst_omx_component_get_config (self->dec, index, &audio_caps);
+
+  if (err == OMX_ErrorNone) {
+    OMX_BOOL supported;
+
+    if (g_str_equal (name, "audio/x-ac3"))
+      supported = audio_caps.supportAc3;
+    else if (g_str_equal (name, "audio/x-eac3"))
+      supported = audio_caps.supportEac3;
+    else
+      supported = audio_caps.supportDts;
+
+    if (!supported) {
+      GST_DEBUG_OBJECT (self, "Audio output can't take %s", name);
+      return FALSE;
+    }
+  } else {
+    GST_DEBUG_OBJECT (self, "Failed to get audio output capabilities: "
+        "%s (0x%08x)", gst_omx_error_to_string (err), err);
+  }
+#endif
+
+  if (!gst_pad_peer_query_accept_caps (GST_AUDIO_DECODER_SRC_PAD (self),
+          caps)) {
+    GST_DEBUG_OBJECT (self, "Downstream doesn't accept %s", name);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Pushes a compressed frame downstream as is */
+static GstFlowReturn
+gst_omx_audio_dec_push_passthrough (GstOMXAudioDec * self, GstBuffer * buffer)
+{
+  GstPad *srcpad = GST_AUDIO_DECODER_SRC_PAD (self);
+  GstEvent *segment;
+  GstFlowReturn flow_ret;
+
+  /* Let the base class account for the frame and send its
+   * pending events */
+  flow_ret = gst_audio_decoder_finish_frame (GST_AUDIO_DECODER (self), NULL, 1);
+  if (flow_ret != GST_FLOW_OK)
+    return flow_ret;
+
+  segment = gst_pad_get_sticky_event (srcpad, GST_EVENT_SEGMENT, 0);
+  if (segment)
+    gst_event_unref (segment);
+  else
+    gst_pad_push_event (srcpad,
+        gst_event_new_segment (&GST_AUDIO_DECODER (self)->input_segment));
+
+  return gst_pad_push (srcpad, gst_buffer_ref (buffer));
+}
+
 static gboolean
 gst_omx_audio_dec_set_format (GstAudioDecoder * decoder, GstCaps * caps)
 {
@@ -646,6 +1278,20 @@ gst_omx_audio_dec_set_format (GstAudioDecoder * decoder, GstCaps * caps)
     return TRUE;
   }
 
+  if (self->allow_passthrough
+      && gst_omx_audio_dec_can_passthrough (self, caps)) {
+    GST_INFO_OBJECT (self, "Passing %" GST_PTR_FORMAT " through", caps);
+
+    /* Audio still being decoded goes out first */
+    if (!self->passthrough)
+      gst_omx_audio_dec_drain (self, FALSE);
+
+    self->passthrough = TRUE;
+    self->output_passthrough = TRUE;
+    return gst_pad_set_caps (GST_AUDIO_DECODER_SRC_PAD (self), caps);
+  }
+  self->passthrough = FALSE;
+
   needs_disable = gst_omx_component_get_state (self->dec,
       GST_CLOCK_TIME_NONE) != OMX_StateLoaded;
 
@@ -673,6 +1319,7 @@ gst_omx_audio_dec_set_format (GstAudioDecoder * decoder, GstCaps * caps)
     if (gst_omx_port_wait_buffers_released (self->dec_out_port,
             1 * GST_SECOND) != OMX_ErrorNone)
       return FALSE;
+    gst_omx_audio_dec_wait_out_buffers (self);
     if (gst_omx_port_deallocate_buffers (self->dec_in_port) != OMX_ErrorNone)
       return FALSE;
     if (gst_omx_port_deallocate_buffers (self->dec_out_port) != OMX_ErrorNone)
@@ -706,6 +1353,7 @@ gst_omx_audio_dec_set_format (GstAudioDecoder * decoder, GstCaps * caps)
     self->channel = 2;
   }
 
+  self->can_pack = FALSE;
   if (klass->set_format) {
     if (!klass->set_format (self, self->dec_in_port, caps)) {
       GST_ERROR_OBJECT (self, "Subclass failed to set the new format");
@@ -713,6 +1361,8 @@ gst_omx_audio_dec_set_format (GstAudioDecoder * decoder, GstCaps * caps)
     }
   }
 
+  gst_omx_audio_dec_negotiate_pcm (self);
+
   GST_DEBUG_OBJECT (self, "Enabling component");
 
   if (needs_disable) {
@@ -782,6 +1432,19 @@ gst_omx_audio_dec_set_format (GstAudioDecoder * decoder, GstCaps * caps)
   return TRUE;
 }
 
+/* Passes the packets collected in @buf to the component */
+static OMX_ERRORTYPE
+gst_omx_audio_dec_submit_packed (GstOMXAudioDec * self, GstOMXBuffer * buf)
+{
+  GST_LOG_OBJECT (self, "Passing %u packed packets to the component",
+      self->pack_count);
+
+  buf->omx_buf->nFlags |= OMX_BUFFERFLAG_ENDOFFRAME;
+  self->pack_count = 0;
+
+  return gst_omx_port_release_buffer (self->dec_in_port, buf);
+}
+
 static GstFlowReturn
 gst_omx_audio_dec_handle_frame (GstAudioDecoder * decoder, GstBuffer * buffer)
 {
@@ -790,11 +1453,13 @@ gst_omx_audio_dec_handle_frame (GstAudioDecoder * decoder, GstBuffer * buffer)
   GstOMXPort *port;
   GstOMXBuffer *buf;
   GstBuffer *codec_data = NULL;
-  guint offset = 0, size;
+  guint offset = 0, size, filled, avail, len;
   GstClockTime timestamp, duration;
+  gboolean packing;
   OMX_ERRORTYPE err;
 
   self = GST_OMX_AUDIO_DEC (decoder);
+  packing = self->can_pack && self->packets_per_buffer > 1;
 
   GST_DEBUG_OBJECT (self, "Handling frame");
 
@@ -806,6 +1471,9 @@ gst_omx_audio_dec_handle_frame (GstAudioDecoder * decoder, GstBuffer * buffer)
   if (buffer == NULL)
     return GST_FLOW_OK;
 
+  if (self->passthrough)
+    return gst_omx_audio_dec_push_passthrough (self, buffer);
+
   timestamp = GST_BUFFER_TIMESTAMP (buffer);
   duration = GST_BUFFER_DURATION (buffer);
 
@@ -817,76 +1485,82 @@ gst_omx_audio_dec_handle_frame (GstAudioDecoder * decoder, GstBuffer * buffer)
 
   size = gst_buffer_get_size (buffer);
   while (offset < size) {
-    /* Make sure to release the base class stream lock, otherwise
-     * _loop() can't call _finish_frame() and we might block forever
-     * because no input buffers are released */
-    GST_AUDIO_DECODER_STREAM_UNLOCK (self);
-    acq_ret = gst_omx_port_acquire_buffer (port, &buf);
-
-    if (acq_ret == GST_OMX_ACQUIRE_BUFFER_ERROR) {
-      GST_AUDIO_DECODER_STREAM_LOCK (self);
-      goto component_error;
-    } else if (acq_ret == GST_OMX_ACQUIRE_BUFFER_FLUSHING) {
-      GST_AUDIO_DECODER_STREAM_LOCK (self);
-      goto flushing;
-    } else if (acq_ret == GST_OMX_ACQUIRE_BUFFER_RECONFIGURE) {
-      /* Reallocate all buffers */
-      err = gst_omx_port_set_enabled (port, FALSE);
-      if (err != OMX_ErrorNone) {
-        GST_AUDIO_DECODER_STREAM_LOCK (self);
-        goto reconfigure_error;
-      }
-
-      err = gst_omx_port_wait_buffers_released (port, 5 * GST_SECOND);
-      if (err != OMX_ErrorNone) {
-        GST_AUDIO_DECODER_STREAM_LOCK (self);
-        goto reconfigure_error;
-      }
-
-      err = gst_omx_port_deallocate_buffers (port);
-      if (err != OMX_ErrorNone) {
-        GST_AUDIO_DECODER_STREAM_LOCK (self);
-        goto reconfigure_error;
-      }
-
-      err = gst_omx_port_wait_enabled (port, 1 * GST_SECOND);
-      if (err != OMX_ErrorNone) {
-        GST_AUDIO_DECODER_STREAM_LOCK (self);
-        goto reconfigure_error;
-      }
-
-      err = gst_omx_port_set_enabled (port, TRUE);
-      if (err != OMX_ErrorNone) {
-        GST_AUDIO_DECODER_STREAM_LOCK (self);
-        goto reconfigure_error;
-      }
+    if (self->pack_buf) {
+      /* Append to the packets already waiting in the buffer */
+      buf = self->pack_buf;
+      self->pack_buf = NULL;
+    } else {
+      /* Make sure to release the base class stream lock, otherwise
+       * _loop() can't call _finish_frame() and we might block forever
+       * because no input buffers are released */
+      GST_AUDIO_DECODER_STREAM_UNLOCK (self);
+      acq_ret = gst_omx_port_acquire_buffer (port, &buf);
 
-      err = gst_omx_port_allocate_buffers (port);
-      if (err != OMX_ErrorNone) {
+      if (acq_ret == GST_OMX_ACQUIRE_BUFFER_ERROR) {
         GST_AUDIO_DECODER_STREAM_LOCK (self);
-        goto reconfigure_error;
-      }
-
-      err = gst_omx_port_wait_enabled (port, 5 * GST_SECOND);
-      if (err != OMX_ErrorNone) {
+        goto component_error;
+      } else if (acq_ret == GST_OMX_ACQUIRE_BUFFER_FLUSHING) {
         GST_AUDIO_DECODER_STREAM_LOCK (self);
-        goto reconfigure_error;
-      }
-
-      err = gst_omx_port_mark_reconfigured (port);
-      if (err != OMX_ErrorNone) {
+        goto flushing;
+      } else if (acq_ret == GST_OMX_ACQUIRE_BUFFER_RECONFIGURE) {
+        /* Reallocate all buffers */
+        err = gst_omx_port_set_enabled (port, FALSE);
+        if (err != OMX_ErrorNone) {
+          GST_AUDIO_DECODER_STREAM_LOCK (self);
+          goto reconfigure_error;
+        }
+
+        err = gst_omx_port_wait_buffers_released (port, 5 * GST_SECOND);
+        if (err != OMX_ErrorNone) {
+          GST_AUDIO_DECODER_STREAM_LOCK (self);
+          goto reconfigure_error;
+        }
+
+        err = gst_omx_port_deallocate_buffers (port);
+        if (err != OMX_ErrorNone) {
+          GST_AUDIO_DECODER_STREAM_LOCK (self);
+          goto reconfigure_error;
+        }
+
+        err = gst_omx_port_wait_enabled (port, 1 * GST_SECOND);
+        if (err != OMX_ErrorNone) {
+          GST_AUDIO_DECODER_STREAM_LOCK (self);
+          goto reconfigure_error;
+        }
+
+        err = gst_omx_port_set_enabled (port, TRUE);
+        if (err != OMX_ErrorNone) {
+          GST_AUDIO_DECODER_STREAM_LOCK (self);
+          goto reconfigure_error;
+        }
+
+        err = gst_omx_port_allocate_buffers (port);
+        if (err != OMX_ErrorNone) {
+          GST_AUDIO_DECODER_STREAM_LOCK (self);
+          goto reconfigure_error;
+        }
+
+        err = gst_omx_port_wait_enabled (port, 5 * GST_SECOND);
+        if (err != OMX_ErrorNone) {
+          GST_AUDIO_DECODER_STREAM_LOCK (self);
+          goto reconfigure_error;
+        }
+
+        err = gst_omx_port_mark_reconfigured (port);
+        if (err != OMX_ErrorNone) {
+          GST_AUDIO_DECODER_STREAM_LOCK (self);
+          goto reconfigure_error;
+        }
+
+        /* Now get a new buffer and fill it */
         GST_AUDIO_DECODER_STREAM_LOCK (self);
-        goto reconfigure_error;
+        continue;
       }
 
-      /* Now get a new buffer and fill it */
       GST_AUDIO_DECODER_STREAM_LOCK (self);
-      continue;
-    }
-
-    GST_AUDIO_DECODER_STREAM_LOCK (self);
 
-    g_assert (acq_ret == GST_OMX_ACQUIRE_BUFFER_OK && buf != NULL);
+      g_assert (acq_ret == GST_OMX_ACQUIRE_BUFFER_OK && buf != NULL);
+    }
 
     if (buf->omx_buf->nAllocLen - buf->omx_buf->nOffset <= 0) {
       gst_omx_port_release_buffer (port, buf);
@@ -936,35 +1610,61 @@ gst_omx_audio_dec_handle_frame (GstAudioDecoder * decoder, GstBuffer * buffer)
     /* Now handle the frame */
     GST_DEBUG_OBJECT (self, "Passing frame offset %d to the component", offset);
 
+    /* Packets are appended to the ones already in a packed buffer */
+    filled = packing ? buf->omx_buf->nFilledLen : 0;
+    avail = buf->omx_buf->nAllocLen - buf->omx_buf->nOffset - filled;
+
+    /* Only whole packets are packed, pass the others on first */
+    if (filled > 0 && size - offset > avail) {
+      err = gst_omx_audio_dec_submit_packed (self, buf);
+      if (err != OMX_ErrorNone)
+        goto release_error;
+      continue;
+    }
+
     /* Copy the buffer content in chunks of size as requested
      * by the port */
-    buf->omx_buf->nFilledLen =
-        MIN (size - offset, buf->omx_buf->nAllocLen - buf->omx_buf->nOffset);
+    len = MIN (size - offset, avail);
     gst_buffer_extract (buffer, offset,
-        buf->omx_buf->pBuffer + buf->omx_buf->nOffset,
-        buf->omx_buf->nFilledLen);
+        buf->omx_buf->pBuffer + buf->omx_buf->nOffset + filled, len);
+    buf->omx_buf->nFilledLen = filled + len;
 
+    /* A packed buffer has the timestamp of its first packet */
     if (timestamp != GST_CLOCK_TIME_NONE) {
-      buf->omx_buf->nTimeStamp =
-          gst_util_uint64_scale (timestamp, OMX_TICKS_PER_SECOND, GST_SECOND);
+      if (filled == 0)
+        buf->omx_buf->nTimeStamp =
+            gst_util_uint64_scale (timestamp, OMX_TICKS_PER_SECOND,
+            GST_SECOND);
       self->last_upstream_ts = timestamp;
-    } else {
+    } else if (filled == 0) {
       buf->omx_buf->nTimeStamp = 0;
     }
 
+    if (filled == 0)
+      buf->omx_buf->nTickCount = 0;
     if (duration != GST_CLOCK_TIME_NONE && offset == 0) {
-      buf->omx_buf->nTickCount =
-          gst_util_uint64_scale (buf->omx_buf->nFilledLen, duration, size);
+      buf->omx_buf->nTickCount +=
+          gst_util_uint64_scale (len, duration, size);
       self->last_upstream_ts += duration;
-    } else {
-      buf->omx_buf->nTickCount = 0;
     }
 
-    offset += buf->omx_buf->nFilledLen;
+    if (packing && offset == 0)
+      g_array_append_val (self->pack_timestamps, timestamp);
+
+    offset += len;
+
+    if (packing && len == size
+        && ++self->pack_count < self->packets_per_buffer) {
+      /* Wait for more packets to fill the buffer */
+      self->pack_buf = buf;
+      self->started = TRUE;
+      continue;
+    }
 
     if (offset == size)
       buf->omx_buf->nFlags |= OMX_BUFFERFLAG_ENDOFFRAME;
 
+    self->pack_count = 0;
     self->started = TRUE;
     err = gst_omx_port_release_buffer (port, buf);
     if (err != OMX_ErrorNone)
@@ -1095,6 +1795,7 @@ gst_omx_audio_dec_shutdown (GstOMXAudioDec * self)
       gst_omx_component_get_state (self->dec, 5 * GST_SECOND);
     }
     gst_omx_component_set_state (self->dec, OMX_StateLoaded);
+    gst_omx_audio_dec_wait_out_buffers (self);
     gst_omx_port_deallocate_buffers (self->dec_in_port);
     gst_omx_port_deallocate_buffers (self->dec_out_port);
 
@@ -56,6 +56,31 @@ struct _GstOMXAudioDec
   GstClockTime last_upstream_ts;
   GstFlowReturn downstream_flow_ret;
 
+  /* Memories of the output buffers pushed downstream without copying,
+   * oldest first. They go back to the port when released. Protected
+   * by out_lock */
+  GstAllocator *out_allocator;
+  GMutex out_lock;
+  GCond out_cond;
+  GQueue out_memories;
+
+  /* properties */
+  guint packets_per_buffer;
+  gboolean allow_passthrough;
+
+  /* TRUE if compressed input is pushed downstream undecoded, and
+   * while the src pad still has the compressed caps */
+  gboolean passthrough;
+  gboolean output_passthrough;
+
+  /* TRUE if the stream format delimits its packets, so several can be
+   * passed in one input buffer. Set by subclasses in set_format */
+  gboolean can_pack;
+  /* Input buffer still collecting packets, and how many it has */
+  GstOMXBuffer *pack_buf;
+  guint pack_count;
+  /* Timestamps of the packets passed and not finished yet */
+  GArray *pack_timestamps;
 };
 
 struct _GstOMXAudioDecClass
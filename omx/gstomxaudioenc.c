@@ -49,11 +49,21 @@ static void gst_omx_audio_enc_flush (GstAudioEncoder * encoder);
 
 static GstFlowReturn gst_omx_audio_enc_drain (GstOMXAudioEnc * self);
 
+static void gst_omx_audio_enc_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec);
+static void gst_omx_audio_enc_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec);
+
 enum
 {
-  PROP_0
+  PROP_0,
+  PROP_FRAMES_PER_BUFFER,
+  PROP_MAX_BATCH_LATENCY
 };
 
+#define DEFAULT_FRAMES_PER_BUFFER 1
+#define DEFAULT_MAX_BATCH_LATENCY 100
+
 /* class initialization */
 
 #define DEBUG_INIT \
@@ -71,6 +81,24 @@ gst_omx_audio_enc_class_init (GstOMXAudioEncClass * klass)
   GstAudioEncoderClass *audio_encoder_class = GST_AUDIO_ENCODER_CLASS (klass);
 
   gobject_class->finalize = gst_omx_audio_enc_finalize;
+  gobject_class->set_property = gst_omx_audio_enc_set_property;
+  gobject_class->get_property = gst_omx_audio_enc_get_property;
+
+  g_object_class_install_property (gobject_class, PROP_FRAMES_PER_BUFFER,
+      g_param_spec_uint ("frames-per-buffer", "Frames per buffer",
+          "Number of codec frames collected into one input buffer, "
+          "0 passes the input on as it arrives",
+          0, 64, DEFAULT_FRAMES_PER_BUFFER,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_MAX_BATCH_LATENCY,
+      g_param_spec_uint ("max-batch-latency", "Max batch latency",
+          "Maximum duration of the input collected into one input buffer "
+          "in milliseconds, at least one codec frame is always collected",
+          1, G_MAXUINT, DEFAULT_MAX_BATCH_LATENCY,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
 
   element_class->change_state =
       GST_DEBUG_FUNCPTR (gst_omx_audio_enc_change_state);
@@ -98,6 +126,47 @@ gst_omx_audio_enc_init (GstOMXAudioEnc * self)
 {
   g_mutex_init (&self->drain_lock);
   g_cond_init (&self->drain_cond);
+
+  self->frames_per_buffer = DEFAULT_FRAMES_PER_BUFFER;
+  self->max_batch_latency = DEFAULT_MAX_BATCH_LATENCY;
+}
+
+static void
+gst_omx_audio_enc_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstOMXAudioEnc *self = GST_OMX_AUDIO_ENC (object);
+
+  switch (prop_id) {
+    case PROP_FRAMES_PER_BUFFER:
+      self->frames_per_buffer = g_value_get_uint (value);
+      break;
+    case PROP_MAX_BATCH_LATENCY:
+      self->max_batch_latency = g_value_get_uint (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_omx_audio_enc_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstOMXAudioEnc *self = GST_OMX_AUDIO_ENC (object);
+
+  switch (prop_id) {
+    case PROP_FRAMES_PER_BUFFER:
+      g_value_set_uint (value, self->frames_per_buffer);
+      break;
+    case PROP_MAX_BATCH_LATENCY:
+      g_value_set_uint (value, self->max_batch_latency);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
 }
 
 static gboolean
@@ -624,6 +693,31 @@ gst_omx_audio_enc_stop (GstAudioEncoder * encoder)
   return TRUE;
 }
 
+/* Returns the number of samples collected into one input buffer,
+ * 0 if the input is passed on as it arrives */
+static guint
+gst_omx_audio_enc_get_batch_samples (GstOMXAudioEnc * self,
+    GstAudioInfo * info)
+{
+  GstOMXAudioEncClass *klass = GST_OMX_AUDIO_ENC_GET_CLASS (self);
+  guint frame_samples = 0, frames;
+  guint64 max_samples;
+
+  if (klass->get_frame_samples)
+    frame_samples = klass->get_frame_samples (self, info);
+
+  if (frame_samples == 0 || self->frames_per_buffer == 0)
+    return 0;
+
+  /* Stay within the latency bound, but always take a whole frame */
+  max_samples = gst_util_uint64_scale (self->max_batch_latency, info->rate,
+      1000);
+  frames = MIN (self->frames_per_buffer, max_samples / frame_samples);
+  frames = MAX (frames, 1);
+
+  return frames * frame_samples;
+}
+
 static gboolean
 gst_omx_audio_enc_set_format (GstAudioEncoder * encoder, GstAudioInfo * info)
 {
@@ -632,6 +726,7 @@ gst_omx_audio_enc_set_format (GstAudioEncoder * encoder, GstAudioInfo * info)
   gboolean needs_disable = FALSE;
   OMX_PARAM_PORTDEFINITIONTYPE port_def;
   OMX_AUDIO_PARAM_PCMMODETYPE pcm_param;
+  guint batch_samples;
   gint i;
   OMX_ERRORTYPE err;
 
@@ -640,11 +735,26 @@ gst_omx_audio_enc_set_format (GstAudioEncoder * encoder, GstAudioInfo * info)
 
   GST_DEBUG_OBJECT (self, "Setting new caps");
 
-  /* Set audio encoder base class properties */
-  gst_audio_encoder_set_frame_samples_min (encoder,
-      gst_util_uint64_scale_ceil (OMX_MIN_PCMPAYLOAD_MSEC,
-          GST_MSECOND * info->rate, GST_SECOND));
-  gst_audio_encoder_set_frame_samples_max (encoder, 0);
+  /* Set audio encoder base class properties. When batching, the base
+   * class collects whole codec frames so every input buffer is full */
+  batch_samples = gst_omx_audio_enc_get_batch_samples (self, info);
+  if (batch_samples > 0) {
+    GstClockTime latency;
+
+    GST_DEBUG_OBJECT (self, "Collecting %u samples per input buffer",
+        batch_samples);
+    gst_audio_encoder_set_frame_samples_min (encoder, batch_samples);
+    gst_audio_encoder_set_frame_samples_max (encoder, batch_samples);
+
+    latency = gst_util_uint64_scale (batch_samples, GST_SECOND, info->rate);
+    gst_audio_encoder_set_latency (encoder, latency, latency);
+  } else {
+    gst_audio_encoder_set_frame_samples_min (encoder,
+        gst_util_uint64_scale_ceil (OMX_MIN_PCMPAYLOAD_MSEC,
+            GST_MSECOND * info->rate, GST_SECOND));
+    gst_audio_encoder_set_frame_samples_max (encoder, 0);
+    gst_audio_encoder_set_latency (encoder, 0, 0);
+  }
 
   gst_omx_port_get_port_definition (self->enc_in_port, &port_def);
 
@@ -692,6 +802,9 @@ gst_omx_audio_enc_set_format (GstAudioEncoder * encoder, GstAudioInfo * info)
   }
 
   port_def.format.audio.eEncoding = OMX_AUDIO_CodingPCM;
+  /* A whole batch fits into one input buffer */
+  if (port_def.nBufferSize < batch_samples * info->bpf)
+    port_def.nBufferSize = batch_samples * info->bpf;
   GST_DEBUG_OBJECT (self, "Setting inport port definition");
   if (gst_omx_port_update_port_definition (self->enc_in_port,
           &port_def) != OMX_ErrorNone)
@@ -1125,6 +1238,16 @@ gst_omx_audio_enc_sink_event (GstAudioEncoder * encoder, GstEvent * event)
   return FALSE;
 }
 
+/* Pushes the output of all input so far downstream and resets the
+ * component, the next input is encoded like the start of a stream */
+void
+gst_omx_audio_enc_reset (GstOMXAudioEnc * self)
+{
+  GST_AUDIO_ENCODER_STREAM_LOCK (self);
+  gst_omx_audio_enc_flush (GST_AUDIO_ENCODER (self));
+  GST_AUDIO_ENCODER_STREAM_UNLOCK (self);
+}
+
 static GstFlowReturn
 gst_omx_audio_enc_drain (GstOMXAudioEnc * self)
 {
@@ -69,6 +69,11 @@ struct _GstOMXAudioEnc
   gboolean draining;
 
   GstFlowReturn downstream_flow_ret;
+
+  /* properties */
+  guint frames_per_buffer;
+  /* in milliseconds */
+  guint max_batch_latency;
 };
 
 struct _GstOMXAudioEncClass
@@ -83,9 +88,13 @@ struct _GstOMXAudioEncClass
       GstAudioInfo * info);
     guint (*get_num_samples) (GstOMXAudioEnc * self, GstOMXPort * port,
       GstAudioInfo * info, GstOMXBuffer * buffer);
+  /* Samples per codec frame, 0 if the codec has no fixed frame size */
+    guint (*get_frame_samples) (GstOMXAudioEnc * self, GstAudioInfo * info);
 };
 
 GType gst_omx_audio_enc_get_type (void);
 
+void gst_omx_audio_enc_reset (GstOMXAudioEnc * self);
+
 G_END_DECLS
 #endif /* __GST_OMX_AUDIO_ENC_H__ */
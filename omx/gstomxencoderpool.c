@@ -0,0 +1,194 @@
+/*
+ * Copyright (c) 2015, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstomxencoderpool.h"
+
+GST_DEBUG_CATEGORY_EXTERN (gstomx_debug);
+#define GST_CAT_DEFAULT gstomx_debug
+
+void
+gst_omx_encoder_pool_init (GstOMXEncoderPool * pool, GstBin * bin)
+{
+  pool->bin = bin;
+  pool->encoders = g_ptr_array_new ();
+  pool->srcpads = g_ptr_array_new ();
+  pool->sinkpads = g_ptr_array_new ();
+}
+
+void
+gst_omx_encoder_pool_clear (GstOMXEncoderPool * pool)
+{
+  gst_omx_encoder_pool_destroy (pool);
+
+  g_ptr_array_free (pool->encoders, TRUE);
+  g_ptr_array_free (pool->srcpads, TRUE);
+  g_ptr_array_free (pool->sinkpads, TRUE);
+  pool->encoders = pool->srcpads = pool->sinkpads = NULL;
+}
+
+void
+gst_omx_encoder_pool_destroy (GstOMXEncoderPool * pool)
+{
+  guint i;
+
+  for (i = 0; i < pool->encoders->len; i++) {
+    GstElement *encoder = g_ptr_array_index (pool->encoders, i);
+
+    gst_element_set_state (encoder, GST_STATE_NULL);
+    gst_bin_remove (pool->bin, encoder);
+    gst_object_unparent (g_ptr_array_index (pool->srcpads, i));
+    gst_object_unparent (g_ptr_array_index (pool->sinkpads, i));
+  }
+
+  g_ptr_array_set_size (pool->encoders, 0);
+  g_ptr_array_set_size (pool->srcpads, 0);
+  g_ptr_array_set_size (pool->sinkpads, 0);
+}
+
+/* (Re)creates @n encoders from @factory. The internal pads belong to
+ * the bin but are not exposed, so they are linked without hierarchy
+ * checks. The output of the encoders goes to @chain, @event and
+ * @query. Returns the number of encoders created. */
+guint
+gst_omx_encoder_pool_create (GstOMXEncoderPool * pool,
+    const gchar * factory, guint n, GstPadChainFunction chain,
+    GstPadEventFunction event, GstPadQueryFunction query)
+{
+  guint i;
+
+  gst_omx_encoder_pool_destroy (pool);
+
+  for (i = 0; i < n; i++) {
+    GstElement *encoder;
+    GstPad *srcpad, *sinkpad, *pad;
+    gchar *name;
+
+    name = g_strdup_printf ("encoder_%u", i);
+    encoder = gst_element_factory_make (factory, name);
+    g_free (name);
+    if (!encoder) {
+      GST_ERROR_OBJECT (pool->bin, "Failed to create %s", factory);
+      break;
+    }
+
+    name = g_strdup_printf ("encsrc_%u", i);
+    srcpad = gst_pad_new (name, GST_PAD_SRC);
+    g_free (name);
+    gst_pad_set_element_private (srcpad, GUINT_TO_POINTER (i));
+    gst_object_set_parent (GST_OBJECT (srcpad), GST_OBJECT (pool->bin));
+
+    name = g_strdup_printf ("encsink_%u", i);
+    sinkpad = gst_pad_new (name, GST_PAD_SINK);
+    g_free (name);
+    gst_pad_set_element_private (sinkpad, GUINT_TO_POINTER (i));
+    gst_pad_set_chain_function (sinkpad, chain);
+    gst_pad_set_event_function (sinkpad, event);
+    gst_pad_set_query_function (sinkpad, query);
+    gst_object_set_parent (GST_OBJECT (sinkpad), GST_OBJECT (pool->bin));
+
+    gst_bin_add (pool->bin, encoder);
+
+    pad = gst_element_get_static_pad (encoder, "sink");
+    gst_pad_link_full (srcpad, pad, GST_PAD_LINK_CHECK_NOTHING);
+    gst_object_unref (pad);
+
+    pad = gst_element_get_static_pad (encoder, "src");
+    gst_pad_link_full (pad, sinkpad, GST_PAD_LINK_CHECK_NOTHING);
+    gst_object_unref (pad);
+
+    g_ptr_array_add (pool->encoders, encoder);
+    g_ptr_array_add (pool->srcpads, srcpad);
+    g_ptr_array_add (pool->sinkpads, sinkpad);
+  }
+
+  return pool->encoders->len;
+}
+
+/* Copies the settings of encoder_0 to the other encoders */
+void
+gst_omx_encoder_pool_sync (GstOMXEncoderPool * pool)
+{
+  GObject *first;
+  GParamSpec **specs;
+  guint n_specs, i, j;
+
+  if (pool->encoders->len == 0)
+    return;
+
+  first = g_ptr_array_index (pool->encoders, 0);
+  specs = g_object_class_list_properties (G_OBJECT_GET_CLASS (first),
+      &n_specs);
+  for (i = 0; i < n_specs; i++) {
+    GParamSpec *spec = specs[i];
+    GValue value = G_VALUE_INIT;
+
+    /* Only the encoder's own settings, not its name or parent */
+    if ((spec->flags & G_PARAM_READWRITE) != G_PARAM_READWRITE
+        || (spec->flags & G_PARAM_CONSTRUCT_ONLY)
+        || g_type_is_a (GST_TYPE_ELEMENT, spec->owner_type))
+      continue;
+
+    g_value_init (&value, G_PARAM_SPEC_VALUE_TYPE (spec));
+    g_object_get_property (first, spec->name, &value);
+    for (j = 1; j < pool->encoders->len; j++)
+      g_object_set_property (g_ptr_array_index (pool->encoders, j),
+          spec->name, &value);
+    g_value_unset (&value);
+  }
+  g_free (specs);
+}
+
+/* Sets @name on all encoders that have such a boolean or unsigned
+ * property */
+void
+gst_omx_encoder_pool_set_if_exists (GstOMXEncoderPool * pool,
+    const gchar * name, guint value)
+{
+  guint i;
+
+  for (i = 0; i < pool->encoders->len; i++) {
+    GObject *encoder = g_ptr_array_index (pool->encoders, i);
+    GParamSpec *spec;
+
+    spec = g_object_class_find_property (G_OBJECT_GET_CLASS (encoder), name);
+    if (!spec)
+      continue;
+
+    if (spec->value_type == G_TYPE_BOOLEAN)
+      g_object_set (encoder, name, (gboolean) value, NULL);
+    else
+      g_object_set (encoder, name, value, NULL);
+  }
+}
+
+void
+gst_omx_encoder_pool_activate_pads (GstOMXEncoderPool * pool,
+    gboolean active)
+{
+  guint i;
+
+  for (i = 0; i < pool->encoders->len; i++) {
+    gst_pad_set_active (g_ptr_array_index (pool->srcpads, i), active);
+    gst_pad_set_active (g_ptr_array_index (pool->sinkpads, i), active);
+  }
+}
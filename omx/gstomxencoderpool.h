@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2015, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+#ifndef __GST_OMX_ENCODER_POOL_H__
+#define __GST_OMX_ENCODER_POOL_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+typedef struct _GstOMXEncoderPool GstOMXEncoderPool;
+
+/* Encoder children of a bin, named encoder_%u, with the internal pads
+ * the bin feeds them through and receives their output on */
+struct _GstOMXEncoderPool
+{
+  /* Parent of the encoders and pads, not owned */
+  GstBin *bin;
+
+  GPtrArray *encoders;
+  GPtrArray *srcpads, *sinkpads;
+};
+
+/* Index of the encoder behind an internal pad */
+#define GST_OMX_ENCODER_POOL_INDEX(pad) \
+  GPOINTER_TO_UINT (gst_pad_get_element_private (pad))
+
+void gst_omx_encoder_pool_init (GstOMXEncoderPool * pool, GstBin * bin);
+void gst_omx_encoder_pool_clear (GstOMXEncoderPool * pool);
+
+guint gst_omx_encoder_pool_create (GstOMXEncoderPool * pool,
+    const gchar * factory, guint n, GstPadChainFunction chain,
+    GstPadEventFunction event, GstPadQueryFunction query);
+void gst_omx_encoder_pool_destroy (GstOMXEncoderPool * pool);
+
+void gst_omx_encoder_pool_sync (GstOMXEncoderPool * pool);
+void gst_omx_encoder_pool_set_if_exists (GstOMXEncoderPool * pool,
+    const gchar * name, guint value);
+void gst_omx_encoder_pool_activate_pads (GstOMXEncoderPool * pool,
+    gboolean active);
+
+G_END_DECLS
+#endif /* __GST_OMX_ENCODER_POOL_H__ */
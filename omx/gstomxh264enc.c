@@ -41,13 +41,20 @@ static void gst_omx_h264_enc_set_property (GObject * object, guint prop_id,
     const GValue * value, GParamSpec * pspec);
 static void gst_omx_h264_enc_get_property (GObject * object, guint prop_id, GValue * value,
     GParamSpec * pspec);
+static OMX_ERRORTYPE ifi_setup (GstOMXVideoEnc * enc);
 
 enum
 {
   PROP_0,
-  PROP_INSERT_SPS_PPS
+  PROP_INSERT_SPS_PPS,
+  PROP_INTRA_REFRESH_PERIOD,
+  PROP_B_FRAMES
 };
 
+/* With intra refresh only the first frame is an IDR frame, the waves
+ * replace the periodic ones */
+#define NO_INTRA_PERIOD 0xffffffff
+
 /* class initialization */
 
 #define DEBUG_INIT \
@@ -66,12 +73,14 @@ gst_omx_h264_enc_class_init (GstOMXH264EncClass * klass)
 
   videoenc_class->set_format = GST_DEBUG_FUNCPTR (gst_omx_h264_enc_set_format);
   videoenc_class->get_caps = GST_DEBUG_FUNCPTR (gst_omx_h264_enc_get_caps);
+  videoenc_class->set_intra_period = GST_DEBUG_FUNCPTR (ifi_setup);
   gobject_class->set_property = GST_DEBUG_FUNCPTR (gst_omx_h264_enc_set_property);
   gobject_class->get_property = GST_DEBUG_FUNCPTR (gst_omx_h264_enc_get_property);
 
   videoenc_class->cdata.default_src_template_caps = "video/x-h264, "
       "width=(int) [ 16, 4096 ], " "height=(int) [ 16, 4096 ], "
-      "stream-format=(string) { byte-stream, avc }, " "alignment=(string) au ";
+      "stream-format=(string) { byte-stream, avc }, "
+      "alignment=(string) { au, nal } ";
   videoenc_class->handle_output_frame =
       GST_DEBUG_FUNCPTR (gst_omx_h264_enc_handle_output_frame);
 
@@ -88,12 +97,33 @@ gst_omx_h264_enc_class_init (GstOMXH264EncClass * klass)
           "Insert H.264 SPS, PPS",
           "Insert H.264 SPS, PPS at every IDR frame",
           FALSE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_INTRA_REFRESH_PERIOD,
+      g_param_spec_uint ("intra-refresh-period",
+          "Intra Refresh Period",
+          "Refresh the picture with a wave of intra coded macroblocks "
+          "spread over this many frames instead of periodic IDR frames, "
+          "iframeinterval is ignored then (0=disabled)",
+          0, G_MAXUINT, 0,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_B_FRAMES,
+      g_param_spec_uint ("b-frames",
+          "B Frames",
+          "Number of B frames between reference frames, needs main "
+          "profile or higher",
+          0, 16, 0,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
 }
 
 static void
 gst_omx_h264_enc_init (GstOMXH264Enc * self)
 {
   self->insert_sps_pps = FALSE;
+  self->intra_refresh_period = 0;
+  self->b_frames = 0;
 }
 
 static OMX_ERRORTYPE
@@ -102,7 +132,7 @@ ifi_setup (GstOMXVideoEnc * enc)
   GstOMXH264Enc *self = GST_OMX_H264_ENC (enc);
   OMX_ERRORTYPE err = OMX_ErrorNone;
 
-  if (enc->iframeinterval != 0xffffffff) {
+  if (enc->iframeinterval != 0xffffffff || self->intra_refresh_period) {
     OMX_VIDEO_CONFIG_AVCINTRAPERIOD oIntraPeriod;
     GST_OMX_INIT_STRUCT (&oIntraPeriod);
     oIntraPeriod.nPortIndex = enc->enc_out_port->index;
@@ -113,7 +143,10 @@ ifi_setup (GstOMXVideoEnc * enc)
           &oIntraPeriod);
 
     if (err == OMX_ErrorNone) {
-      if (enc->iframeinterval != 0) {
+      if (self->intra_refresh_period) {
+        oIntraPeriod.nIDRPeriod = NO_INTRA_PERIOD;
+        oIntraPeriod.nPFrames = NO_INTRA_PERIOD - 1;
+      } else if (enc->iframeinterval != 0) {
         oIntraPeriod.nIDRPeriod = enc->iframeinterval;
         oIntraPeriod.nPFrames = enc->iframeinterval - 1;
       }
@@ -157,6 +190,79 @@ gst_omx_h264_enc_set_insert_sps_pps (GstOMXVideoEnc * enc)
    return eError;
  }
 
+/* Starts a cyclic intra refresh wave, preferring the NVIDIA slice
+ * based refresh over the standard macroblock based one */
+static OMX_ERRORTYPE
+gst_omx_h264_enc_set_intra_refresh (GstOMXVideoEnc * enc)
+{
+  GstOMXH264Enc *self = GST_OMX_H264_ENC (enc);
+  OMX_INDEXTYPE eIndex;
+  OMX_ERRORTYPE eError;
+  NVX_PARAM_VIDENCPROPERTY oEncodeProp;
+  OMX_VIDEO_PARAM_INTRAREFRESHTYPE oRefresh;
+  OMX_PARAM_PORTDEFINITIONTYPE *port_def = &enc->enc_in_port->port_def;
+  guint mbs;
+
+  eError = gst_omx_component_get_index (enc->enc,
+      (gpointer) NVX_INDEX_PARAM_VIDEO_ENCODE_PROPERTY, &eIndex);
+  if (eError == OMX_ErrorNone) {
+    GST_OMX_INIT_STRUCT (&oEncodeProp);
+    oEncodeProp.nPortIndex = enc->enc_out_port->index;
+
+    eError = gst_omx_component_get_parameter (enc->enc, eIndex, &oEncodeProp);
+    if (eError == OMX_ErrorNone) {
+      oEncodeProp.bSliceIntraRefreshEnable = OMX_TRUE;
+      oEncodeProp.SliceIntraRefreshInterval = self->intra_refresh_period;
+
+      eError =
+          gst_omx_component_set_parameter (enc->enc, eIndex, &oEncodeProp);
+    }
+    if (eError == OMX_ErrorNone)
+      return eError;
+  }
+
+  mbs = ((port_def->format.video.nFrameWidth + 15) / 16) *
+      ((port_def->format.video.nFrameHeight + 15) / 16);
+
+  GST_OMX_INIT_STRUCT (&oRefresh);
+  oRefresh.nPortIndex = enc->enc_out_port->index;
+  oRefresh.eRefreshMode = OMX_VIDEO_IntraRefreshCyclic;
+  oRefresh.nCirMBs =
+      MAX (1, (mbs + self->intra_refresh_period - 1) /
+      self->intra_refresh_period);
+
+  GST_DEBUG_OBJECT (self, "Refreshing %u of %u macroblocks per frame",
+      (guint) oRefresh.nCirMBs, mbs);
+
+  return gst_omx_component_set_parameter (enc->enc,
+      OMX_IndexParamVideoIntraRefresh, &oRefresh);
+}
+
+static OMX_ERRORTYPE
+gst_omx_h264_enc_set_b_frames (GstOMXVideoEnc * enc)
+{
+  GstOMXH264Enc *self = GST_OMX_H264_ENC (enc);
+  OMX_VIDEO_PARAM_AVCTYPE avc_param;
+  OMX_ERRORTYPE err;
+
+  GST_OMX_INIT_STRUCT (&avc_param);
+  avc_param.nPortIndex = enc->enc_out_port->index;
+
+  err = gst_omx_component_get_parameter (enc->enc, OMX_IndexParamVideoAvc,
+      &avc_param);
+  if (err != OMX_ErrorNone)
+    return err;
+
+  avc_param.nBFrames = self->b_frames;
+  if (self->b_frames)
+    avc_param.nAllowedPictureTypes |= OMX_VIDEO_PictureTypeB;
+  else
+    avc_param.nAllowedPictureTypes &= ~OMX_VIDEO_PictureTypeB;
+
+  return gst_omx_component_set_parameter (enc->enc, OMX_IndexParamVideoAvc,
+      &avc_param);
+}
+
 static gboolean
 gst_omx_h264_enc_set_format (GstOMXVideoEnc * enc, GstOMXPort * port,
     GstVideoCodecState * state)
@@ -308,7 +414,7 @@ gst_omx_h264_enc_set_format (GstOMXVideoEnc * enc, GstOMXPort * port,
     }
   }
 
-  if (enc->iframeinterval != 0xffffffff) {
+  if (enc->iframeinterval != 0xffffffff || self->intra_refresh_period) {
     err = ifi_setup (enc);
     if (err != OMX_ErrorNone) {
       GST_WARNING_OBJECT (self,
@@ -329,6 +435,27 @@ gst_omx_h264_enc_set_format (GstOMXVideoEnc * enc, GstOMXPort * port,
     }
   }
 
+  if (self->b_frames) {
+    err = gst_omx_h264_enc_set_b_frames (enc);
+    if (err != OMX_ErrorNone) {
+      GST_WARNING_OBJECT (self,
+          "Error setting %u B frames: %s (0x%08x)",
+          self->b_frames, gst_omx_error_to_string (err), err);
+      return FALSE;
+    }
+    enc->reorder_frames = self->b_frames;
+  }
+
+  if (self->intra_refresh_period) {
+    err = gst_omx_h264_enc_set_intra_refresh (enc);
+    if (err != OMX_ErrorNone) {
+      GST_WARNING_OBJECT (self,
+          "Error setting intra refresh period %u: %s (0x%08x)",
+          self->intra_refresh_period, gst_omx_error_to_string (err), err);
+      return FALSE;
+    }
+  }
+
   return TRUE;
 
 unsupported_profile:
@@ -357,8 +484,10 @@ gst_omx_h264_enc_get_caps (GstOMXVideoEnc * enc, GstOMXPort * port,
   OMX_VIDEO_PARAM_PROFILELEVELTYPE param;
   const gchar *profile, *level, *out_format;
 
+  /* With slice level encoding every NAL unit is pushed separately */
   caps = gst_caps_new_simple ("video/x-h264",
-      "alignment", G_TYPE_STRING, "au", NULL);
+      "alignment", G_TYPE_STRING, enc->slice_level_encode ? "nal" : "au",
+      NULL);
 
   GST_OMX_INIT_STRUCT (&param);
   param.nPortIndex = GST_OMX_VIDEO_ENC (self)->enc_out_port->index;
@@ -601,6 +730,12 @@ gst_omx_h264_enc_set_property (GObject * object, guint prop_id,
     case PROP_INSERT_SPS_PPS:
       self->insert_sps_pps = g_value_get_boolean (value);
       break;
+    case PROP_INTRA_REFRESH_PERIOD:
+      self->intra_refresh_period = g_value_get_uint (value);
+      break;
+    case PROP_B_FRAMES:
+      self->b_frames = g_value_get_uint (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -617,6 +752,12 @@ gst_omx_h264_enc_get_property (GObject * object, guint prop_id, GValue * value,
     case PROP_INSERT_SPS_PPS:
       g_value_set_boolean (value, self->insert_sps_pps);
       break;
+    case PROP_INTRA_REFRESH_PERIOD:
+      g_value_set_uint (value, self->intra_refresh_period);
+      break;
+    case PROP_B_FRAMES:
+      g_value_set_uint (value, self->b_frames);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -56,6 +56,10 @@ struct _GstOMXH264Enc
   GstOMXVideoEnc parent;
   h264_sf stream_format;
   gboolean insert_sps_pps;
+  /* Frames over which all macroblocks are intra coded once, 0=off */
+  guint intra_refresh_period;
+  /* B frames between reference frames */
+  guint b_frames;
 };
 
 struct _GstOMXH264EncClass
@@ -130,5 +130,9 @@ gst_omx_mpegaudio_dec_set_format (GstOMXAudioDec * decoder, GstOMXPort * port,
         gst_omx_error_to_string (err), err);
     return FALSE;
   }
+
+  /* MPEG audio frames are self-delimiting */
+  decoder->can_pack = TRUE;
+
   return TRUE;
 }
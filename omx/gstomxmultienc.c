@@ -0,0 +1,1017 @@
+/*
+ * Copyright (c) 2015, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+/* Encodes many mono or stereo AAC streams on a small pool of OMX
+ * encoders, so the number of components and threads stays the same
+ * however many streams there are:
+ *
+ *   gst-launch-1.0 omxaacmultienc name=enc pool-size=4 \
+ *       src1 ! audioconvert ! enc.sink_0  enc.src_0 ! ... \
+ *       src2 ! audioconvert ! enc.sink_1  enc.src_1 ! ...
+ *
+ * Every request sink pad gets the src pad with the same number. The
+ * input of a stream is collected into slices of slice-frames AAC frames
+ * and every slice is encoded on whichever encoder is free, by the
+ * thread that found it free.
+ *
+ * OMX components can't save and restore their state, so an encoder is
+ * reset after every slice. Before the next slice of a stream it encodes
+ * the last warmup-frames frames of the stream again to get back into
+ * the state it had, their output is dropped.
+ *
+ * The encoders are children named encoder_%u. The settings of encoder_0
+ * are copied to all others when starting, all streams share the output
+ * format negotiated by the encoder. The output lags behind the input by
+ * up to one slice.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <gst/audio/audio.h>
+#include <gst/base/gstadapter.h>
+#include <stdio.h>
+
+#include "gstomxmultienc.h"
+#include "gstomxaudioenc.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_omx_multi_enc_debug_category);
+#define GST_CAT_DEFAULT gst_omx_multi_enc_debug_category
+
+struct _GstOMXMultiEncStream
+{
+  guint index;
+  GstPad *sinkpad, *srcpad;
+
+  /* Input format, NULL until the caps event */
+  GstCaps *caps;
+  GstAudioInfo info;
+  /* Samples per encoded frame for the input format */
+  guint frame_samples;
+
+  /* Input not encoded yet */
+  GstAdapter *adapter;
+  /* Last warmup-frames frames of the input already encoded */
+  GstBuffer *history;
+  /* Timestamp of the next encoded frame */
+  GstClockTime out_ts;
+  /* TRUE if out_ts follows the next timestamped input, after a
+   * segment */
+  gboolean rebase;
+
+  /* TRUE if the input left over is encoded even if not a full slice */
+  gboolean draining;
+  /* TRUE while waiting for a slot or being encoded on one */
+  gboolean busy;
+  GstFlowReturn flow_ret;
+};
+
+struct _GstOMXMultiEncSlot
+{
+  guint index;
+  /* Encoder of the pool and its internal pads */
+  GstElement *encoder;
+  GstPad *srcpad, *sinkpad;
+
+  /* TRUE once stream-start and segment were sent to the encoder */
+  gboolean started;
+  /* Caps the encoder is configured for and its output caps */
+  GstCaps *in_caps, *out_caps;
+  /* Timestamp of the next input, the encoder sees one timeline */
+  GstClockTime in_ts;
+
+  /* Stream encoded now, NULL if the slot is free */
+  GstOMXMultiEncStream *stream;
+  /* Encoded frames of the slice still to drop and to push */
+  guint drop_frames, push_frames;
+};
+
+/* prototypes */
+static void gst_omx_multi_enc_dispose (GObject * object);
+static void gst_omx_multi_enc_finalize (GObject * object);
+static void gst_omx_multi_enc_set_property (GObject * object,
+    guint prop_id, const GValue * value, GParamSpec * pspec);
+static void gst_omx_multi_enc_get_property (GObject * object,
+    guint prop_id, GValue * value, GParamSpec * pspec);
+static GstStateChangeReturn gst_omx_multi_enc_change_state (GstElement *
+    element, GstStateChange transition);
+static GstPad *gst_omx_multi_enc_request_new_pad (GstElement * element,
+    GstPadTemplate * templ, const gchar * name, const GstCaps * caps);
+static void gst_omx_multi_enc_release_pad (GstElement * element,
+    GstPad * pad);
+
+static GstFlowReturn gst_omx_multi_enc_sink_chain (GstPad * pad,
+    GstObject * parent, GstBuffer * buffer);
+static gboolean gst_omx_multi_enc_sink_event (GstPad * pad,
+    GstObject * parent, GstEvent * event);
+static gboolean gst_omx_multi_enc_sink_query (GstPad * pad,
+    GstObject * parent, GstQuery * query);
+static GstFlowReturn gst_omx_multi_enc_enc_chain (GstPad * pad,
+    GstObject * parent, GstBuffer * buffer);
+static gboolean gst_omx_multi_enc_enc_event (GstPad * pad,
+    GstObject * parent, GstEvent * event);
+static gboolean gst_omx_multi_enc_enc_query (GstPad * pad,
+    GstObject * parent, GstQuery * query);
+
+enum
+{
+  PROP_0,
+  PROP_ENCODER,
+  PROP_POOL_SIZE,
+  PROP_SLICE_FRAMES,
+  PROP_WARMUP_FRAMES
+};
+
+#define DEFAULT_ENCODER "omxaacenc"
+#define DEFAULT_POOL_SIZE 4
+#define DEFAULT_SLICE_FRAMES 50
+/* AAC encoders delay their output by about two frames, the overlap
+ * of the transform plus lookahead. With fewer warmup frames the state
+ * of the encoder isn't restored before the slice starts. */
+#define MIN_WARMUP_FRAMES 2
+#define DEFAULT_WARMUP_FRAMES 2
+
+/* Stream or slot behind a pad */
+#define PAD_STREAM(pad) \
+  ((GstOMXMultiEncStream *) gst_pad_get_element_private (pad))
+#define PAD_SLOT(self, pad) \
+  ((GstOMXMultiEncSlot *) g_ptr_array_index ((self)->slots, \
+      GST_OMX_ENCODER_POOL_INDEX (pad)))
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink_%u",
+    GST_PAD_SINK,
+    GST_PAD_REQUEST,
+    GST_STATIC_CAPS ("audio/x-raw, "
+        "format = (string) " GST_AUDIO_NE (S16) ", "
+        "layout = (string) interleaved, "
+        "rate = (int) [ 1, MAX ], " "channels = (int) [ 1, 2 ]"));
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src_%u",
+    GST_PAD_SRC,
+    GST_PAD_SOMETIMES,
+    GST_STATIC_CAPS_ANY);
+
+/* class initialization */
+
+#define DEBUG_INIT \
+  GST_DEBUG_CATEGORY_INIT (gst_omx_multi_enc_debug_category, \
+      "omxmultienc", 0, "debug category for omxaacmultienc element");
+
+G_DEFINE_TYPE_WITH_CODE (GstOMXMultiEnc, gst_omx_multi_enc,
+    GST_TYPE_BIN, DEBUG_INIT);
+
+static void
+gst_omx_multi_enc_class_init (GstOMXMultiEncClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+
+  gobject_class->dispose = gst_omx_multi_enc_dispose;
+  gobject_class->finalize = gst_omx_multi_enc_finalize;
+  gobject_class->set_property = gst_omx_multi_enc_set_property;
+  gobject_class->get_property = gst_omx_multi_enc_get_property;
+
+  g_object_class_install_property (gobject_class, PROP_ENCODER,
+      g_param_spec_string ("encoder", "Encoder",
+          "Name of the OMX AAC encoder element in the pool",
+          DEFAULT_ENCODER,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_POOL_SIZE,
+      g_param_spec_uint ("pool-size", "Pool size",
+          "Number of encoder instances the streams are encoded on",
+          1, 32, DEFAULT_POOL_SIZE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_SLICE_FRAMES,
+      g_param_spec_uint ("slice-frames", "Slice frames",
+          "Number of AAC frames of one stream encoded before the encoder "
+          "moves on to another stream",
+          1, 1000, DEFAULT_SLICE_FRAMES,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_WARMUP_FRAMES,
+      g_param_spec_uint ("warmup-frames", "Warmup frames",
+          "Number of already encoded AAC frames encoded again before every "
+          "slice to restore the encoder state, their output is dropped",
+          MIN_WARMUP_FRAMES, 8, DEFAULT_WARMUP_FRAMES,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  element_class->change_state =
+      GST_DEBUG_FUNCPTR (gst_omx_multi_enc_change_state);
+  element_class->request_new_pad =
+      GST_DEBUG_FUNCPTR (gst_omx_multi_enc_request_new_pad);
+  element_class->release_pad =
+      GST_DEBUG_FUNCPTR (gst_omx_multi_enc_release_pad);
+
+  gst_element_class_add_pad_template (element_class,
+      gst_static_pad_template_get (&sink_template));
+  gst_element_class_add_pad_template (element_class,
+      gst_static_pad_template_get (&src_template));
+
+  gst_element_class_set_static_metadata (element_class,
+      "OpenMAX Multi-Stream AAC Audio Encoder",
+      "Codec/Encoder/Audio",
+      "Encode many AAC streams on a pool of encoder instances",
+      "NVIDIA Corporation");
+}
+
+static void
+gst_omx_multi_enc_stream_free (GstOMXMultiEncStream * stream)
+{
+  gst_caps_replace (&stream->caps, NULL);
+  gst_buffer_replace (&stream->history, NULL);
+  g_object_unref (stream->adapter);
+  g_slice_free (GstOMXMultiEncStream, stream);
+}
+
+/* Drops the input queued for @stream, called with the lock */
+static void
+gst_omx_multi_enc_stream_reset (GstOMXMultiEnc * self,
+    GstOMXMultiEncStream * stream)
+{
+  /* Still waiting for a slot */
+  if (stream->busy && g_queue_remove (&self->ready, stream))
+    stream->busy = FALSE;
+
+  gst_adapter_clear (stream->adapter);
+  gst_buffer_replace (&stream->history, NULL);
+  stream->out_ts = GST_CLOCK_TIME_NONE;
+  stream->rebase = FALSE;
+  stream->draining = FALSE;
+  stream->flow_ret = GST_FLOW_OK;
+}
+
+static void
+gst_omx_multi_enc_slot_reset (GstOMXMultiEncSlot * slot)
+{
+  slot->started = FALSE;
+  gst_caps_replace (&slot->in_caps, NULL);
+  gst_caps_replace (&slot->out_caps, NULL);
+  slot->in_ts = 0;
+  slot->stream = NULL;
+  slot->drop_frames = slot->push_frames = 0;
+}
+
+static void
+gst_omx_multi_enc_destroy_slots (GstOMXMultiEnc * self)
+{
+  guint i;
+
+  for (i = 0; i < self->slots->len; i++) {
+    GstOMXMultiEncSlot *slot = g_ptr_array_index (self->slots, i);
+
+    gst_omx_multi_enc_slot_reset (slot);
+    g_slice_free (GstOMXMultiEncSlot, slot);
+  }
+  g_ptr_array_set_size (self->slots, 0);
+
+  gst_omx_encoder_pool_destroy (&self->pool);
+}
+
+static void
+gst_omx_multi_enc_create_slots (GstOMXMultiEnc * self)
+{
+  guint i, n;
+
+  gst_omx_multi_enc_destroy_slots (self);
+
+  n = gst_omx_encoder_pool_create (&self->pool, self->encoder_name,
+      self->pool_size, GST_DEBUG_FUNCPTR (gst_omx_multi_enc_enc_chain),
+      GST_DEBUG_FUNCPTR (gst_omx_multi_enc_enc_event),
+      GST_DEBUG_FUNCPTR (gst_omx_multi_enc_enc_query));
+
+  for (i = 0; i < n; i++) {
+    GstOMXMultiEncSlot *slot = g_slice_new0 (GstOMXMultiEncSlot);
+
+    slot->index = i;
+    slot->encoder = g_ptr_array_index (self->pool.encoders, i);
+    slot->srcpad = g_ptr_array_index (self->pool.srcpads, i);
+    slot->sinkpad = g_ptr_array_index (self->pool.sinkpads, i);
+    g_ptr_array_add (self->slots, slot);
+  }
+}
+
+static void
+gst_omx_multi_enc_init (GstOMXMultiEnc * self)
+{
+  self->encoder_name = g_strdup (DEFAULT_ENCODER);
+  self->pool_size = DEFAULT_POOL_SIZE;
+  self->slice_frames = DEFAULT_SLICE_FRAMES;
+  self->warmup_frames = DEFAULT_WARMUP_FRAMES;
+
+  g_mutex_init (&self->lock);
+  g_cond_init (&self->cond);
+  g_queue_init (&self->ready);
+
+  self->streams = g_ptr_array_new ();
+  self->slots = g_ptr_array_new ();
+  gst_omx_encoder_pool_init (&self->pool, GST_BIN (self));
+  gst_omx_multi_enc_create_slots (self);
+}
+
+static void
+gst_omx_multi_enc_dispose (GObject * object)
+{
+  GstOMXMultiEnc *self = GST_OMX_MULTI_ENC (object);
+
+  gst_omx_multi_enc_destroy_slots (self);
+
+  G_OBJECT_CLASS (gst_omx_multi_enc_parent_class)->dispose (object);
+}
+
+static void
+gst_omx_multi_enc_finalize (GObject * object)
+{
+  GstOMXMultiEnc *self = GST_OMX_MULTI_ENC (object);
+
+  /* Pads that were never released */
+  g_ptr_array_foreach (self->streams,
+      (GFunc) gst_omx_multi_enc_stream_free, NULL);
+  g_ptr_array_free (self->streams, TRUE);
+  g_ptr_array_free (self->slots, TRUE);
+  gst_omx_encoder_pool_clear (&self->pool);
+  g_queue_clear (&self->ready);
+
+  g_free (self->encoder_name);
+  g_mutex_clear (&self->lock);
+  g_cond_clear (&self->cond);
+
+  G_OBJECT_CLASS (gst_omx_multi_enc_parent_class)->finalize (object);
+}
+
+static void
+gst_omx_multi_enc_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstOMXMultiEnc *self = GST_OMX_MULTI_ENC (object);
+
+  switch (prop_id) {
+    case PROP_ENCODER:
+      g_free (self->encoder_name);
+      self->encoder_name = g_value_dup_string (value);
+      gst_omx_multi_enc_create_slots (self);
+      break;
+    case PROP_POOL_SIZE:
+      self->pool_size = g_value_get_uint (value);
+      gst_omx_multi_enc_create_slots (self);
+      break;
+    case PROP_SLICE_FRAMES:
+      self->slice_frames = g_value_get_uint (value);
+      break;
+    case PROP_WARMUP_FRAMES:
+      self->warmup_frames = g_value_get_uint (value);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_omx_multi_enc_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstOMXMultiEnc *self = GST_OMX_MULTI_ENC (object);
+
+  switch (prop_id) {
+    case PROP_ENCODER:
+      g_value_set_string (value, self->encoder_name);
+      break;
+    case PROP_POOL_SIZE:
+      g_value_set_uint (value, self->pool_size);
+      break;
+    case PROP_SLICE_FRAMES:
+      g_value_set_uint (value, self->slice_frames);
+      break;
+    case PROP_WARMUP_FRAMES:
+      g_value_set_uint (value, self->warmup_frames);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static GstStateChangeReturn
+gst_omx_multi_enc_change_state (GstElement * element,
+    GstStateChange transition)
+{
+  GstOMXMultiEnc *self = GST_OMX_MULTI_ENC (element);
+  GstStateChangeReturn ret;
+  guint i;
+
+  switch (transition) {
+    case GST_STATE_CHANGE_NULL_TO_READY:
+      if (self->slots->len == 0 || self->slots->len != self->pool_size) {
+        GST_ELEMENT_ERROR (self, CORE, MISSING_PLUGIN, (NULL),
+            ("Failed to create %u %s encoders", self->pool_size,
+                self->encoder_name));
+        return GST_STATE_CHANGE_FAILURE;
+      }
+      for (i = 0; i < self->slots->len; i++) {
+        GstOMXMultiEncSlot *slot = g_ptr_array_index (self->slots, i);
+
+        if (!GST_IS_OMX_AUDIO_ENC (slot->encoder)) {
+          GST_ELEMENT_ERROR (self, CORE, FAILED, (NULL),
+              ("%s is not an OMX audio encoder", self->encoder_name));
+          return GST_STATE_CHANGE_FAILURE;
+        }
+      }
+      break;
+    case GST_STATE_CHANGE_READY_TO_PAUSED:
+      /* All streams are encoded alike. Slices are whole frames,
+       * nothing may stay behind in an encoder when it moves on to
+       * the next stream */
+      gst_omx_encoder_pool_sync (&self->pool);
+      gst_omx_encoder_pool_set_if_exists (&self->pool, "frames-per-buffer",
+          1);
+      GST_DEBUG_OBJECT (self, "Encoding slices of %u frames on %u encoders",
+          self->slice_frames, self->slots->len);
+      g_mutex_lock (&self->lock);
+      for (i = 0; i < self->slots->len; i++)
+        gst_omx_multi_enc_slot_reset (g_ptr_array_index (self->slots, i));
+      g_mutex_unlock (&self->lock);
+      gst_omx_encoder_pool_activate_pads (&self->pool, TRUE);
+      break;
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      gst_omx_encoder_pool_activate_pads (&self->pool, FALSE);
+      break;
+    default:
+      break;
+  }
+
+  ret =
+      GST_ELEMENT_CLASS (gst_omx_multi_enc_parent_class)->change_state
+      (element, transition);
+
+  switch (transition) {
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      g_mutex_lock (&self->lock);
+      for (i = 0; i < self->streams->len; i++)
+        gst_omx_multi_enc_stream_reset (self,
+            g_ptr_array_index (self->streams, i));
+      g_mutex_unlock (&self->lock);
+      break;
+    default:
+      break;
+  }
+
+  return ret;
+}
+
+static GstPad *
+gst_omx_multi_enc_request_new_pad (GstElement * element,
+    GstPadTemplate * templ, const gchar * name, const GstCaps * caps)
+{
+  GstOMXMultiEnc *self = GST_OMX_MULTI_ENC (element);
+  GstOMXMultiEncStream *stream;
+  guint index;
+  gchar *padname;
+
+  g_mutex_lock (&self->lock);
+  if (name && sscanf (name, "sink_%u", &index) == 1) {
+    self->next_stream = MAX (self->next_stream, index + 1);
+  } else {
+    index = self->next_stream++;
+  }
+  g_mutex_unlock (&self->lock);
+
+  stream = g_slice_new0 (GstOMXMultiEncStream);
+  stream->index = index;
+  stream->adapter = gst_adapter_new ();
+  stream->out_ts = GST_CLOCK_TIME_NONE;
+  stream->flow_ret = GST_FLOW_OK;
+
+  padname = g_strdup_printf ("sink_%u", index);
+  stream->sinkpad = gst_pad_new_from_template (templ, padname);
+  g_free (padname);
+  gst_pad_set_element_private (stream->sinkpad, stream);
+  gst_pad_set_chain_function (stream->sinkpad,
+      GST_DEBUG_FUNCPTR (gst_omx_multi_enc_sink_chain));
+  gst_pad_set_event_function (stream->sinkpad,
+      GST_DEBUG_FUNCPTR (gst_omx_multi_enc_sink_event));
+  gst_pad_set_query_function (stream->sinkpad,
+      GST_DEBUG_FUNCPTR (gst_omx_multi_enc_sink_query));
+
+  padname = g_strdup_printf ("src_%u", index);
+  stream->srcpad = gst_pad_new_from_static_template (&src_template, padname);
+  g_free (padname);
+  gst_pad_set_element_private (stream->srcpad, stream);
+  gst_pad_use_fixed_caps (stream->srcpad);
+
+  g_mutex_lock (&self->lock);
+  g_ptr_array_add (self->streams, stream);
+  g_mutex_unlock (&self->lock);
+
+  GST_DEBUG_OBJECT (self, "Adding stream %u", index);
+
+  gst_element_add_pad (element, stream->srcpad);
+  gst_element_add_pad (element, stream->sinkpad);
+
+  return stream->sinkpad;
+}
+
+static void
+gst_omx_multi_enc_release_pad (GstElement * element, GstPad * pad)
+{
+  GstOMXMultiEnc *self = GST_OMX_MULTI_ENC (element);
+  GstOMXMultiEncStream *stream = PAD_STREAM (pad);
+
+  GST_DEBUG_OBJECT (self, "Removing stream %u", stream->index);
+
+  g_mutex_lock (&self->lock);
+  gst_omx_multi_enc_stream_reset (self, stream);
+  while (stream->busy)
+    g_cond_wait (&self->cond, &self->lock);
+  g_ptr_array_remove (self->streams, stream);
+  g_mutex_unlock (&self->lock);
+
+  gst_element_remove_pad (element, stream->srcpad);
+  gst_element_remove_pad (element, stream->sinkpad);
+  gst_omx_multi_enc_stream_free (stream);
+}
+
+/* Queues @stream for a slot once a full slice or, when draining,
+ * anything is waiting. Called with the lock. */
+static void
+gst_omx_multi_enc_queue_stream (GstOMXMultiEnc * self,
+    GstOMXMultiEncStream * stream)
+{
+  gsize avail, slice_size;
+
+  if (stream->busy || !stream->caps)
+    return;
+
+  avail = gst_adapter_available (stream->adapter);
+  slice_size = self->slice_frames * stream->frame_samples * stream->info.bpf;
+  if (avail == 0 || (avail < slice_size && !stream->draining))
+    return;
+
+  stream->busy = TRUE;
+  g_queue_push_tail (&self->ready, stream);
+}
+
+/* Pushes @buffer into the encoder of @slot, continuing its timeline */
+static GstFlowReturn
+gst_omx_multi_enc_push_input (GstOMXMultiEncSlot * slot,
+    GstOMXMultiEncStream * stream, GstBuffer * buffer)
+{
+  guint samples = gst_buffer_get_size (buffer) / stream->info.bpf;
+
+  buffer = gst_buffer_make_writable (buffer);
+  GST_BUFFER_PTS (buffer) = slot->in_ts;
+  GST_BUFFER_DTS (buffer) = GST_CLOCK_TIME_NONE;
+  GST_BUFFER_DURATION (buffer) =
+      gst_util_uint64_scale (samples, GST_SECOND, stream->info.rate);
+  slot->in_ts += GST_BUFFER_DURATION (buffer);
+
+  return gst_pad_push (slot->srcpad, buffer);
+}
+
+/* Encodes a slice of @stream on @slot, returns once all of its output
+ * was pushed. Called without the lock. */
+static void
+gst_omx_multi_enc_encode_slice (GstOMXMultiEnc * self,
+    GstOMXMultiEncSlot * slot, GstOMXMultiEncStream * stream,
+    GstBuffer * warmup, GstBuffer * slice)
+{
+  GstFlowReturn ret = GST_FLOW_OK;
+
+  GST_LOG_OBJECT (self, "Encoding %" G_GSIZE_FORMAT " bytes of stream %u "
+      "on encoder %u", gst_buffer_get_size (slice), stream->index,
+      slot->index);
+
+  if (!slot->started) {
+    gchar *stream_id;
+
+    stream_id = g_strdup_printf ("%s/%u", GST_OBJECT_NAME (self),
+        slot->index);
+    gst_pad_push_event (slot->srcpad, gst_event_new_stream_start (stream_id));
+    g_free (stream_id);
+  }
+
+  /* The encoder reconfigures itself for other input formats */
+  if (!slot->in_caps || !gst_caps_is_equal (slot->in_caps, stream->caps)) {
+    gst_pad_push_event (slot->srcpad, gst_event_new_caps (stream->caps));
+    gst_caps_replace (&slot->in_caps, stream->caps);
+  }
+
+  if (!slot->started) {
+    GstSegment segment;
+
+    gst_segment_init (&segment, GST_FORMAT_TIME);
+    gst_pad_push_event (slot->srcpad, gst_event_new_segment (&segment));
+    slot->started = TRUE;
+  }
+
+  if (warmup)
+    ret = gst_omx_multi_enc_push_input (slot, stream, warmup);
+  if (ret == GST_FLOW_OK)
+    ret = gst_omx_multi_enc_push_input (slot, stream, slice);
+  else
+    gst_buffer_unref (slice);
+
+  if (ret != GST_FLOW_OK)
+    GST_WARNING_OBJECT (self, "Encoder %u refused input: %s", slot->index,
+        gst_flow_get_name (ret));
+
+  /* Get all output out and start over for the next stream */
+  gst_omx_audio_enc_reset (GST_OMX_AUDIO_ENC (slot->encoder));
+}
+
+/* Encodes the queued slices as long as encoders are free */
+static void
+gst_omx_multi_enc_run (GstOMXMultiEnc * self)
+{
+  g_mutex_lock (&self->lock);
+  while (!g_queue_is_empty (&self->ready)) {
+    GstOMXMultiEncSlot *slot = NULL;
+    GstOMXMultiEncStream *stream;
+    GstBuffer *slice, *warmup;
+    gsize frame_size, size;
+    guint i, history;
+
+    for (i = 0; i < self->slots->len && !slot; i++) {
+      GstOMXMultiEncSlot *s = g_ptr_array_index (self->slots, i);
+
+      if (!s->stream)
+        slot = s;
+    }
+    /* The threads of the busy encoders pick it up later */
+    if (!slot)
+      break;
+
+    stream = g_queue_pop_head (&self->ready);
+    frame_size = stream->frame_samples * stream->info.bpf;
+    size = MIN (gst_adapter_available (stream->adapter),
+        self->slice_frames * frame_size);
+    slice = gst_adapter_take_buffer (stream->adapter, size);
+
+    /* Pad the last slice to whole frames, the encoder must not keep
+     * any of it back */
+    if (size % frame_size) {
+      GstMemory *silence;
+      GstMapInfo map;
+      gsize pad = frame_size - size % frame_size;
+
+      silence = gst_allocator_alloc (NULL, pad, NULL);
+      gst_memory_map (silence, &map, GST_MAP_WRITE);
+      memset (map.data, 0, pad);
+      gst_memory_unmap (silence, &map);
+      slice = gst_buffer_make_writable (slice);
+      gst_buffer_append_memory (slice, silence);
+      size += pad;
+    }
+
+    warmup = stream->history;
+    history = MIN (self->warmup_frames, size / frame_size);
+    stream->history = history == 0 ? NULL :
+        gst_buffer_copy_region (slice, GST_BUFFER_COPY_MEMORY,
+        size - history * frame_size, history * frame_size);
+
+    slot->stream = stream;
+    slot->drop_frames = warmup ? gst_buffer_get_size (warmup) / frame_size : 0;
+    slot->push_frames = size / frame_size;
+    g_mutex_unlock (&self->lock);
+
+    gst_omx_multi_enc_encode_slice (self, slot, stream, warmup, slice);
+
+    g_mutex_lock (&self->lock);
+    slot->stream = NULL;
+    stream->busy = FALSE;
+    gst_omx_multi_enc_queue_stream (self, stream);
+    g_cond_broadcast (&self->cond);
+  }
+  g_mutex_unlock (&self->lock);
+}
+
+/* Returns the duration of the input of @stream that wasn't pushed
+ * encoded yet. Called with the lock. */
+static GstClockTime
+gst_omx_multi_enc_pending_time (GstOMXMultiEnc * self,
+    GstOMXMultiEncStream * stream)
+{
+  guint64 samples;
+  guint i;
+
+  if (!stream->caps)
+    return 0;
+
+  samples = gst_adapter_available (stream->adapter) / stream->info.bpf;
+  for (i = 0; i < self->slots->len; i++) {
+    GstOMXMultiEncSlot *slot = g_ptr_array_index (self->slots, i);
+
+    if (slot->stream == stream)
+      samples += (guint64) slot->push_frames * stream->frame_samples;
+  }
+
+  return gst_util_uint64_scale (samples, GST_SECOND, stream->info.rate);
+}
+
+/* Encodes all input queued for @stream and waits until it is pushed */
+static void
+gst_omx_multi_enc_drain_stream (GstOMXMultiEnc * self,
+    GstOMXMultiEncStream * stream)
+{
+  g_mutex_lock (&self->lock);
+  stream->draining = TRUE;
+  gst_omx_multi_enc_queue_stream (self, stream);
+  g_mutex_unlock (&self->lock);
+
+  gst_omx_multi_enc_run (self);
+
+  g_mutex_lock (&self->lock);
+  while (stream->busy)
+    g_cond_wait (&self->cond, &self->lock);
+  stream->draining = FALSE;
+  g_mutex_unlock (&self->lock);
+}
+
+static GstFlowReturn
+gst_omx_multi_enc_sink_chain (GstPad * pad, GstObject * parent,
+    GstBuffer * buffer)
+{
+  GstOMXMultiEnc *self = GST_OMX_MULTI_ENC (parent);
+  GstOMXMultiEncStream *stream = PAD_STREAM (pad);
+  GstFlowReturn ret;
+
+  g_mutex_lock (&self->lock);
+  ret = stream->flow_ret;
+  if (ret == GST_FLOW_OK && !stream->caps)
+    ret = GST_FLOW_NOT_NEGOTIATED;
+  if (ret != GST_FLOW_OK) {
+    g_mutex_unlock (&self->lock);
+    gst_buffer_unref (buffer);
+    return ret;
+  }
+
+  /* The output goes on without a gap, the input still queued ends
+   * where the new segment starts */
+  if (stream->rebase && GST_BUFFER_PTS_IS_VALID (buffer)) {
+    GstClockTime pending = gst_omx_multi_enc_pending_time (self, stream);
+
+    stream->out_ts = GST_BUFFER_PTS (buffer) > pending ?
+        GST_BUFFER_PTS (buffer) - pending : 0;
+    stream->rebase = FALSE;
+  } else if (!GST_CLOCK_TIME_IS_VALID (stream->out_ts)) {
+    stream->out_ts = GST_BUFFER_PTS (buffer);
+  }
+  gst_adapter_push (stream->adapter, buffer);
+  gst_omx_multi_enc_queue_stream (self, stream);
+  g_mutex_unlock (&self->lock);
+
+  gst_omx_multi_enc_run (self);
+
+  return GST_FLOW_OK;
+}
+
+static gboolean
+gst_omx_multi_enc_sink_event (GstPad * pad, GstObject * parent,
+    GstEvent * event)
+{
+  GstOMXMultiEnc *self = GST_OMX_MULTI_ENC (parent);
+  GstOMXMultiEncStream *stream = PAD_STREAM (pad);
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_CAPS:{
+      GstOMXMultiEncSlot *first;
+      GstOMXAudioEncClass *klass;
+      GstAudioInfo info;
+      GstCaps *caps;
+      guint frame_samples = 0;
+
+      gst_event_parse_caps (event, &caps);
+      if (!gst_audio_info_from_caps (&info, caps)) {
+        GST_WARNING_OBJECT (self, "Invalid caps %" GST_PTR_FORMAT, caps);
+        gst_event_unref (event);
+        return FALSE;
+      }
+
+      /* All encoders are configured alike */
+      first = g_ptr_array_index (self->slots, 0);
+      klass = GST_OMX_AUDIO_ENC_GET_CLASS (first->encoder);
+      if (klass->get_frame_samples)
+        frame_samples = klass->get_frame_samples (GST_OMX_AUDIO_ENC
+            (first->encoder), &info);
+      if (frame_samples == 0) {
+        GST_WARNING_OBJECT (self, "%s has no fixed frame size",
+            self->encoder_name);
+        gst_event_unref (event);
+        return FALSE;
+      }
+
+      /* Input in the old format goes first */
+      gst_omx_multi_enc_drain_stream (self, stream);
+
+      g_mutex_lock (&self->lock);
+      gst_caps_replace (&stream->caps, caps);
+      stream->info = info;
+      stream->frame_samples = frame_samples;
+      g_mutex_unlock (&self->lock);
+
+      /* The output caps come from the encoder */
+      gst_event_unref (event);
+      return TRUE;
+    }
+    case GST_EVENT_SEGMENT:
+      /* Only the last slice is padded, a new segment continues the
+       * stream */
+      g_mutex_lock (&self->lock);
+      stream->rebase = GST_CLOCK_TIME_IS_VALID (stream->out_ts);
+      g_mutex_unlock (&self->lock);
+      break;
+    case GST_EVENT_EOS:
+      gst_omx_multi_enc_drain_stream (self, stream);
+      break;
+    case GST_EVENT_FLUSH_STOP:
+      g_mutex_lock (&self->lock);
+      gst_omx_multi_enc_stream_reset (self, stream);
+      while (stream->busy)
+        g_cond_wait (&self->cond, &self->lock);
+      g_mutex_unlock (&self->lock);
+      break;
+    default:
+      break;
+  }
+
+  /* The caps come with the first output, the segment and other sticky
+   * events have to wait for them */
+  if (GST_EVENT_IS_STICKY (event) && GST_EVENT_TYPE (event) != GST_EVENT_EOS
+      && !gst_pad_has_current_caps (stream->srcpad)) {
+    gst_pad_store_sticky_event (stream->srcpad, event);
+    gst_event_unref (event);
+    return TRUE;
+  }
+
+  return gst_pad_push_event (stream->srcpad, event);
+}
+
+static gboolean
+gst_omx_multi_enc_sink_query (GstPad * pad, GstObject * parent,
+    GstQuery * query)
+{
+  GstOMXMultiEnc *self = GST_OMX_MULTI_ENC (parent);
+
+  /* All encoders are configured alike, encoder_0 answers for them */
+  switch (GST_QUERY_TYPE (query)) {
+    case GST_QUERY_CAPS:{
+      GstOMXMultiEncSlot *slot;
+      GstCaps *filter, *templ, *caps;
+
+      if (self->slots->len == 0)
+        break;
+
+      slot = g_ptr_array_index (self->slots, 0);
+      gst_query_parse_caps (query, &filter);
+      templ = gst_pad_get_pad_template_caps (pad);
+      if (filter) {
+        caps = gst_caps_intersect_full (filter, templ,
+            GST_CAPS_INTERSECT_FIRST);
+        gst_caps_unref (templ);
+        templ = caps;
+      }
+      caps = gst_pad_peer_query_caps (slot->srcpad, templ);
+      gst_caps_unref (templ);
+
+      gst_query_set_caps_result (query, caps);
+      gst_caps_unref (caps);
+      return TRUE;
+    }
+    default:
+      break;
+  }
+
+  return gst_pad_query_default (pad, parent, query);
+}
+
+static GstFlowReturn
+gst_omx_multi_enc_enc_chain (GstPad * pad, GstObject * parent,
+    GstBuffer * buffer)
+{
+  GstOMXMultiEnc *self = GST_OMX_MULTI_ENC (parent);
+  GstOMXMultiEncSlot *slot = PAD_SLOT (self, pad);
+  GstOMXMultiEncStream *stream;
+  GstCaps *caps = NULL, *current;
+  GstPad *srcpad;
+  GstFlowReturn ret;
+
+  g_mutex_lock (&self->lock);
+  stream = slot->stream;
+
+  /* Output of the warmup frames, and anything the encoder flushes out
+   * past the end of the slice */
+  if (!stream || slot->push_frames == 0 || slot->drop_frames > 0) {
+    if (stream && slot->drop_frames > 0)
+      slot->drop_frames--;
+    g_mutex_unlock (&self->lock);
+    gst_buffer_unref (buffer);
+    return GST_FLOW_OK;
+  }
+  slot->push_frames--;
+
+  buffer = gst_buffer_make_writable (buffer);
+  GST_BUFFER_PTS (buffer) = stream->out_ts;
+  GST_BUFFER_DTS (buffer) = stream->out_ts;
+  GST_BUFFER_DURATION (buffer) =
+      gst_util_uint64_scale (stream->frame_samples, GST_SECOND,
+      stream->info.rate);
+  if (GST_CLOCK_TIME_IS_VALID (stream->out_ts))
+    stream->out_ts += GST_BUFFER_DURATION (buffer);
+
+  /* The encoder only sends caps once, pass them on to every stream */
+  current = gst_pad_get_current_caps (stream->srcpad);
+  if (slot->out_caps && (!current || !gst_caps_is_equal (current,
+              slot->out_caps)))
+    caps = gst_caps_ref (slot->out_caps);
+  if (current)
+    gst_caps_unref (current);
+  srcpad = gst_object_ref (stream->srcpad);
+  g_mutex_unlock (&self->lock);
+
+  if (caps) {
+    gst_pad_push_event (srcpad, gst_event_new_caps (caps));
+    gst_caps_unref (caps);
+  }
+  ret = gst_pad_push (srcpad, buffer);
+  gst_object_unref (srcpad);
+
+  if (ret != GST_FLOW_OK) {
+    g_mutex_lock (&self->lock);
+    stream->flow_ret = ret;
+    g_mutex_unlock (&self->lock);
+  }
+
+  /* The encoder keeps going for the other streams */
+  return GST_FLOW_OK;
+}
+
+static gboolean
+gst_omx_multi_enc_enc_event (GstPad * pad, GstObject * parent,
+    GstEvent * event)
+{
+  GstOMXMultiEnc *self = GST_OMX_MULTI_ENC (parent);
+  GstOMXMultiEncSlot *slot = PAD_SLOT (self, pad);
+
+  /* The streams have their own events, only the caps are of use */
+  if (GST_EVENT_TYPE (event) == GST_EVENT_CAPS) {
+    GstCaps *caps;
+
+    gst_event_parse_caps (event, &caps);
+    g_mutex_lock (&self->lock);
+    gst_caps_replace (&slot->out_caps, caps);
+    g_mutex_unlock (&self->lock);
+  }
+  gst_event_unref (event);
+
+  return TRUE;
+}
+
+static gboolean
+gst_omx_multi_enc_enc_query (GstPad * pad, GstObject * parent,
+    GstQuery * query)
+{
+  GstOMXMultiEnc *self = GST_OMX_MULTI_ENC (parent);
+  GstOMXMultiEncSlot *slot = PAD_SLOT (self, pad);
+  GstPad *srcpad = NULL;
+  gboolean ret = FALSE;
+
+  /* Downstream of the stream being encoded decides the output format */
+  if (GST_QUERY_TYPE (query) == GST_QUERY_CAPS) {
+    g_mutex_lock (&self->lock);
+    if (slot->stream)
+      srcpad = gst_object_ref (slot->stream->srcpad);
+    g_mutex_unlock (&self->lock);
+
+    if (srcpad) {
+      ret = gst_pad_peer_query (srcpad, query);
+      gst_object_unref (srcpad);
+      if (ret)
+        return TRUE;
+    }
+  }
+
+  return gst_pad_query_default (pad, parent, query);
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2015, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+#ifndef __GST_OMX_MULTI_ENC_H__
+#define __GST_OMX_MULTI_ENC_H__
+
+#include <gst/gst.h>
+
+#include "gstomxencoderpool.h"
+
+G_BEGIN_DECLS
+#define GST_TYPE_OMX_MULTI_ENC \
+  (gst_omx_multi_enc_get_type())
+#define GST_OMX_MULTI_ENC(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_OMX_MULTI_ENC,GstOMXMultiEnc))
+#define GST_OMX_MULTI_ENC_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_OMX_MULTI_ENC,GstOMXMultiEncClass))
+#define GST_OMX_MULTI_ENC_GET_CLASS(obj) \
+  (G_TYPE_INSTANCE_GET_CLASS((obj),GST_TYPE_OMX_MULTI_ENC,GstOMXMultiEncClass))
+#define GST_IS_OMX_MULTI_ENC(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_OMX_MULTI_ENC))
+#define GST_IS_OMX_MULTI_ENC_CLASS(obj) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_OMX_MULTI_ENC))
+typedef struct _GstOMXMultiEnc GstOMXMultiEnc;
+typedef struct _GstOMXMultiEncClass GstOMXMultiEncClass;
+typedef struct _GstOMXMultiEncStream GstOMXMultiEncStream;
+typedef struct _GstOMXMultiEncSlot GstOMXMultiEncSlot;
+
+struct _GstOMXMultiEnc
+{
+  GstBin parent;
+
+  /* properties */
+  gchar *encoder_name;
+  guint pool_size;
+  guint slice_frames;
+  guint warmup_frames;
+
+  GstOMXEncoderPool pool;
+  /* One GstOMXMultiEncSlot per encoder of the pool */
+  GPtrArray *slots;
+
+  /* Protects the stream and slot state below */
+  GMutex lock;
+  /* Signalled when a slot finished a slice */
+  GCond cond;
+  /* Streams of the request pads */
+  GPtrArray *streams;
+  guint next_stream;
+  /* Streams with a full slice waiting for a free slot */
+  GQueue ready;
+};
+
+struct _GstOMXMultiEncClass
+{
+  GstBinClass parent_class;
+};
+
+GType gst_omx_multi_enc_get_type (void);
+
+G_END_DECLS
+#endif /* __GST_OMX_MULTI_ENC_H__ */
@@ -0,0 +1,704 @@
+/*
+ * Copyright (c) 2015, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+/* Encodes one stream with several OMX encoder instances for offline
+ * transcodes. The input is split into segments of iframeinterval frames
+ * that are fed round-robin into the encoders, every segment starting
+ * with a forced keyframe. The encoded segments are pushed in their
+ * original order, the output of a segment is held back until all
+ * earlier segments were pushed:
+ *
+ *   gst-launch-1.0 filesrc ! ... ! omxh264parallelenc num-encoders=3 \
+ *       encoder_0::bitrate=8000000 encoder_0::iframeinterval=30 ! ...
+ *
+ * The encoders are children named encoder_%u. The settings of encoder_0
+ * are copied to all others when starting so that all segments share the
+ * same SPS/PPS. Slice level output and static scene skipping are
+ * disabled as segments are tracked by counting the encoded frames.
+ *
+ * Only useful when the input isn't live, the output lags behind by up
+ * to num-encoders segments.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+#include "gstomxparallelenc.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_omx_parallel_enc_debug_category);
+#define GST_CAT_DEFAULT gst_omx_parallel_enc_debug_category
+
+struct _GstOMXParallelEncSegment
+{
+  guint index;
+  guint encoder;
+  /* Frames fed into the encoder and encoded frames received */
+  guint in_frames;
+  guint out_frames;
+  /* TRUE if no more frames are fed into the segment */
+  gboolean closed;
+  /* Output buffers and events of encoder_0 held back until all
+   * earlier segments are pushed */
+  GQueue items;
+};
+
+/* prototypes */
+static void gst_omx_parallel_enc_dispose (GObject * object);
+static void gst_omx_parallel_enc_finalize (GObject * object);
+static void gst_omx_parallel_enc_set_property (GObject * object,
+    guint prop_id, const GValue * value, GParamSpec * pspec);
+static void gst_omx_parallel_enc_get_property (GObject * object,
+    guint prop_id, GValue * value, GParamSpec * pspec);
+static GstStateChangeReturn gst_omx_parallel_enc_change_state (GstElement *
+    element, GstStateChange transition);
+
+static GstFlowReturn gst_omx_parallel_enc_sink_chain (GstPad * pad,
+    GstObject * parent, GstBuffer * buffer);
+static gboolean gst_omx_parallel_enc_sink_event (GstPad * pad,
+    GstObject * parent, GstEvent * event);
+static gboolean gst_omx_parallel_enc_sink_query (GstPad * pad,
+    GstObject * parent, GstQuery * query);
+static gboolean gst_omx_parallel_enc_src_query (GstPad * pad,
+    GstObject * parent, GstQuery * query);
+static GstFlowReturn gst_omx_parallel_enc_enc_chain (GstPad * pad,
+    GstObject * parent, GstBuffer * buffer);
+static gboolean gst_omx_parallel_enc_enc_event (GstPad * pad,
+    GstObject * parent, GstEvent * event);
+static gboolean gst_omx_parallel_enc_enc_query (GstPad * pad,
+    GstObject * parent, GstQuery * query);
+
+enum
+{
+  PROP_0,
+  PROP_ENCODER,
+  PROP_NUM_ENCODERS
+};
+
+#define DEFAULT_ENCODER "omxh264enc"
+#define DEFAULT_NUM_ENCODERS 2
+/* Used if encoder_0 has no or a zero iframeinterval */
+#define DEFAULT_SEGMENT_FRAMES 60
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("video/x-raw(memory:NVMM); video/x-raw"));
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS_ANY);
+
+/* class initialization */
+
+#define DEBUG_INIT \
+  GST_DEBUG_CATEGORY_INIT (gst_omx_parallel_enc_debug_category, \
+      "omxparallelenc", 0, "debug category for omxh264parallelenc element");
+
+G_DEFINE_TYPE_WITH_CODE (GstOMXParallelEnc, gst_omx_parallel_enc,
+    GST_TYPE_BIN, DEBUG_INIT);
+
+static void
+gst_omx_parallel_enc_class_init (GstOMXParallelEncClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+
+  gobject_class->dispose = gst_omx_parallel_enc_dispose;
+  gobject_class->finalize = gst_omx_parallel_enc_finalize;
+  gobject_class->set_property = gst_omx_parallel_enc_set_property;
+  gobject_class->get_property = gst_omx_parallel_enc_get_property;
+
+  g_object_class_install_property (gobject_class, PROP_ENCODER,
+      g_param_spec_string ("encoder", "Encoder",
+          "Name of the OMX encoder element used for every segment",
+          DEFAULT_ENCODER,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_NUM_ENCODERS,
+      g_param_spec_uint ("num-encoders", "Number of Encoders",
+          "Number of encoder instances segments are distributed over",
+          1, 16, DEFAULT_NUM_ENCODERS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  element_class->change_state =
+      GST_DEBUG_FUNCPTR (gst_omx_parallel_enc_change_state);
+
+  gst_element_class_add_pad_template (element_class,
+      gst_static_pad_template_get (&sink_template));
+  gst_element_class_add_pad_template (element_class,
+      gst_static_pad_template_get (&src_template));
+
+  gst_element_class_set_static_metadata (element_class,
+      "OpenMAX Parallel Video Encoder",
+      "Codec/Encoder/Video",
+      "Encode segments of one video stream on several encoder instances",
+      "NVIDIA Corporation");
+}
+
+static GstOMXParallelEncSegment *
+gst_omx_parallel_enc_segment_new (guint index, guint encoder)
+{
+  GstOMXParallelEncSegment *seg = g_slice_new0 (GstOMXParallelEncSegment);
+
+  seg->index = index;
+  seg->encoder = encoder;
+  g_queue_init (&seg->items);
+
+  return seg;
+}
+
+static void
+gst_omx_parallel_enc_segment_free (GstOMXParallelEncSegment * seg)
+{
+  g_queue_foreach (&seg->items, (GFunc) gst_mini_object_unref, NULL);
+  g_queue_clear (&seg->items);
+  g_slice_free (GstOMXParallelEncSegment, seg);
+}
+
+static gboolean
+gst_omx_parallel_enc_segment_is_done (GstOMXParallelEncSegment * seg)
+{
+  return seg->closed && seg->out_frames >= seg->in_frames;
+}
+
+/* Drops all segments, called with the push lock */
+static void
+gst_omx_parallel_enc_reset (GstOMXParallelEnc * self)
+{
+  g_mutex_lock (&self->lock);
+  g_queue_foreach (&self->segments,
+      (GFunc) gst_omx_parallel_enc_segment_free, NULL);
+  g_queue_clear (&self->segments);
+  self->current = NULL;
+  self->next_segment = 0;
+  self->eos_count = 0;
+  g_mutex_unlock (&self->lock);
+}
+
+static void
+gst_omx_parallel_enc_create_encoders (GstOMXParallelEnc * self)
+{
+  gst_omx_encoder_pool_create (&self->pool, self->encoder_name,
+      self->num_encoders, GST_DEBUG_FUNCPTR (gst_omx_parallel_enc_enc_chain),
+      GST_DEBUG_FUNCPTR (gst_omx_parallel_enc_enc_event),
+      GST_DEBUG_FUNCPTR (gst_omx_parallel_enc_enc_query));
+}
+
+static void
+gst_omx_parallel_enc_init (GstOMXParallelEnc * self)
+{
+  self->encoder_name = g_strdup (DEFAULT_ENCODER);
+  self->num_encoders = DEFAULT_NUM_ENCODERS;
+  self->segment_frames = DEFAULT_SEGMENT_FRAMES;
+
+  g_mutex_init (&self->push_lock);
+  g_mutex_init (&self->lock);
+  g_queue_init (&self->segments);
+
+  self->sinkpad = gst_pad_new_from_static_template (&sink_template, "sink");
+  gst_pad_set_chain_function (self->sinkpad,
+      GST_DEBUG_FUNCPTR (gst_omx_parallel_enc_sink_chain));
+  gst_pad_set_event_function (self->sinkpad,
+      GST_DEBUG_FUNCPTR (gst_omx_parallel_enc_sink_event));
+  gst_pad_set_query_function (self->sinkpad,
+      GST_DEBUG_FUNCPTR (gst_omx_parallel_enc_sink_query));
+  gst_element_add_pad (GST_ELEMENT (self), self->sinkpad);
+
+  self->srcpad = gst_pad_new_from_static_template (&src_template, "src");
+  gst_pad_set_query_function (self->srcpad,
+      GST_DEBUG_FUNCPTR (gst_omx_parallel_enc_src_query));
+  gst_element_add_pad (GST_ELEMENT (self), self->srcpad);
+
+  gst_omx_encoder_pool_init (&self->pool, GST_BIN (self));
+  gst_omx_parallel_enc_create_encoders (self);
+}
+
+static void
+gst_omx_parallel_enc_dispose (GObject * object)
+{
+  GstOMXParallelEnc *self = GST_OMX_PARALLEL_ENC (object);
+
+  gst_omx_encoder_pool_destroy (&self->pool);
+
+  G_OBJECT_CLASS (gst_omx_parallel_enc_parent_class)->dispose (object);
+}
+
+static void
+gst_omx_parallel_enc_finalize (GObject * object)
+{
+  GstOMXParallelEnc *self = GST_OMX_PARALLEL_ENC (object);
+
+  gst_omx_parallel_enc_reset (self);
+
+  gst_omx_encoder_pool_clear (&self->pool);
+
+  g_free (self->encoder_name);
+  g_mutex_clear (&self->push_lock);
+  g_mutex_clear (&self->lock);
+
+  G_OBJECT_CLASS (gst_omx_parallel_enc_parent_class)->finalize (object);
+}
+
+static void
+gst_omx_parallel_enc_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstOMXParallelEnc *self = GST_OMX_PARALLEL_ENC (object);
+
+  switch (prop_id) {
+    case PROP_ENCODER:
+      g_free (self->encoder_name);
+      self->encoder_name = g_value_dup_string (value);
+      gst_omx_parallel_enc_create_encoders (self);
+      break;
+    case PROP_NUM_ENCODERS:
+      self->num_encoders = g_value_get_uint (value);
+      gst_omx_parallel_enc_create_encoders (self);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_omx_parallel_enc_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstOMXParallelEnc *self = GST_OMX_PARALLEL_ENC (object);
+
+  switch (prop_id) {
+    case PROP_ENCODER:
+      g_value_set_string (value, self->encoder_name);
+      break;
+    case PROP_NUM_ENCODERS:
+      g_value_set_uint (value, self->num_encoders);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+/* Makes all encoders produce the same SPS/PPS and picks up the
+ * segment length */
+static void
+gst_omx_parallel_enc_sync_encoders (GstOMXParallelEnc * self)
+{
+  GstElement *first = g_ptr_array_index (self->pool.encoders, 0);
+
+  gst_omx_encoder_pool_sync (&self->pool);
+
+  /* Every frame has to come out as one buffer to be counted */
+  gst_omx_encoder_pool_set_if_exists (&self->pool, "slice-level-encode",
+      FALSE);
+  gst_omx_encoder_pool_set_if_exists (&self->pool, "static-threshold", 0);
+
+  self->segment_frames = 0;
+  if (g_object_class_find_property (G_OBJECT_GET_CLASS (first),
+          "iframeinterval"))
+    g_object_get (first, "iframeinterval", &self->segment_frames, NULL);
+  if (self->segment_frames == 0)
+    self->segment_frames = DEFAULT_SEGMENT_FRAMES;
+
+  GST_DEBUG_OBJECT (self, "Encoding segments of %u frames on %u encoders",
+      self->segment_frames, self->pool.encoders->len);
+}
+
+static GstStateChangeReturn
+gst_omx_parallel_enc_change_state (GstElement * element,
+    GstStateChange transition)
+{
+  GstOMXParallelEnc *self = GST_OMX_PARALLEL_ENC (element);
+  GstStateChangeReturn ret;
+
+  switch (transition) {
+    case GST_STATE_CHANGE_NULL_TO_READY:
+      if (self->pool.encoders->len == 0 ||
+          self->pool.encoders->len != self->num_encoders) {
+        GST_ELEMENT_ERROR (self, CORE, MISSING_PLUGIN, (NULL),
+            ("Failed to create %u %s encoders", self->num_encoders,
+                self->encoder_name));
+        return GST_STATE_CHANGE_FAILURE;
+      }
+      break;
+    case GST_STATE_CHANGE_READY_TO_PAUSED:
+      gst_omx_parallel_enc_sync_encoders (self);
+      gst_omx_parallel_enc_reset (self);
+      gst_omx_encoder_pool_activate_pads (&self->pool, TRUE);
+      break;
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      gst_omx_encoder_pool_activate_pads (&self->pool, FALSE);
+      break;
+    default:
+      break;
+  }
+
+  ret =
+      GST_ELEMENT_CLASS (gst_omx_parallel_enc_parent_class)->change_state
+      (element, transition);
+
+  switch (transition) {
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      g_mutex_lock (&self->push_lock);
+      gst_omx_parallel_enc_reset (self);
+      g_mutex_unlock (&self->push_lock);
+      break;
+    default:
+      break;
+  }
+
+  return ret;
+}
+
+/* Pushes a held back buffer or event, takes ownership of @item */
+static GstFlowReturn
+gst_omx_parallel_enc_push_item (GstOMXParallelEnc * self, gpointer item)
+{
+  if (GST_IS_BUFFER (item))
+    return gst_pad_push (self->srcpad, GST_BUFFER_CAST (item));
+
+  gst_pad_push_event (self->srcpad, GST_EVENT_CAST (item));
+  return GST_FLOW_OK;
+}
+
+/* Pushes the output of the segment at the head of the stream once it
+ * is complete, followed by what the next segment buffered so far.
+ * With @force the remaining output is pushed even if incomplete.
+ * Called with the push lock. */
+static GstFlowReturn
+gst_omx_parallel_enc_push_ready (GstOMXParallelEnc * self, gboolean force)
+{
+  GstFlowReturn ret = GST_FLOW_OK;
+
+  while (ret == GST_FLOW_OK) {
+    GstOMXParallelEncSegment *seg, *next;
+    GQueue items = G_QUEUE_INIT;
+    gpointer item;
+
+    g_mutex_lock (&self->lock);
+    seg = g_queue_peek_head (&self->segments);
+    if (!seg || (!force && !gst_omx_parallel_enc_segment_is_done (seg))) {
+      g_mutex_unlock (&self->lock);
+      break;
+    }
+
+    g_queue_pop_head (&self->segments);
+    if (seg == self->current)
+      self->current = NULL;
+
+    /* The next segment becomes the head and pushes directly from now on */
+    next = g_queue_peek_head (&self->segments);
+    if (next) {
+      items = next->items;
+      g_queue_init (&next->items);
+    }
+    g_mutex_unlock (&self->lock);
+
+    GST_DEBUG_OBJECT (self, "Segment %u done, %u frames", seg->index,
+        seg->out_frames);
+
+    /* Only left over when forced */
+    while ((item = g_queue_pop_head (&seg->items)) && ret == GST_FLOW_OK)
+      ret = gst_omx_parallel_enc_push_item (self, item);
+    if (item)
+      gst_mini_object_unref (item);
+    gst_omx_parallel_enc_segment_free (seg);
+
+    while ((item = g_queue_pop_head (&items)) && ret == GST_FLOW_OK)
+      ret = gst_omx_parallel_enc_push_item (self, item);
+    if (item)
+      gst_mini_object_unref (item);
+    g_queue_foreach (&items, (GFunc) gst_mini_object_unref, NULL);
+    g_queue_clear (&items);
+  }
+
+  return ret;
+}
+
+static GstFlowReturn
+gst_omx_parallel_enc_sink_chain (GstPad * pad, GstObject * parent,
+    GstBuffer * buffer)
+{
+  GstOMXParallelEnc *self = GST_OMX_PARALLEL_ENC (parent);
+  GstOMXParallelEncSegment *seg;
+  gboolean new_segment = FALSE;
+  GstPad *encpad;
+
+  g_mutex_lock (&self->lock);
+  seg = self->current;
+  if (!seg) {
+    guint index = self->next_segment++;
+
+    seg = gst_omx_parallel_enc_segment_new (index,
+        index % self->pool.encoders->len);
+    g_queue_push_tail (&self->segments, seg);
+    self->current = seg;
+    new_segment = TRUE;
+  }
+
+  /* Closed before the last frame goes in, so the segment can only
+   * complete once its output arrived */
+  if (++seg->in_frames == self->segment_frames) {
+    seg->closed = TRUE;
+    self->current = NULL;
+  }
+  encpad = g_ptr_array_index (self->pool.srcpads, seg->encoder);
+  g_mutex_unlock (&self->lock);
+
+  if (new_segment) {
+    GST_DEBUG_OBJECT (self, "Starting segment %u on encoder %u at %"
+        GST_TIME_FORMAT, seg->index, seg->encoder,
+        GST_TIME_ARGS (GST_BUFFER_PTS (buffer)));
+
+    /* Closed GOPs, every segment starts with an IDR frame and headers */
+    gst_pad_push_event (encpad,
+        gst_video_event_new_downstream_force_key_unit (GST_BUFFER_PTS
+            (buffer), GST_CLOCK_TIME_NONE, GST_CLOCK_TIME_NONE, TRUE,
+            seg->index));
+  }
+
+  return gst_pad_push (encpad, buffer);
+}
+
+/* Sends @event to all encoders, takes ownership of it */
+static gboolean
+gst_omx_parallel_enc_push_event_to_encoders (GstOMXParallelEnc * self,
+    GstEvent * event)
+{
+  gboolean ret = TRUE;
+  guint i;
+
+  for (i = 0; i < self->pool.srcpads->len; i++)
+    ret &= gst_pad_push_event (g_ptr_array_index (self->pool.srcpads, i),
+        gst_event_ref (event));
+  gst_event_unref (event);
+
+  return ret;
+}
+
+static gboolean
+gst_omx_parallel_enc_sink_event (GstPad * pad, GstObject * parent,
+    GstEvent * event)
+{
+  GstOMXParallelEnc *self = GST_OMX_PARALLEL_ENC (parent);
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_EOS:
+      /* The last segment is shorter, it completes with the output */
+      g_mutex_lock (&self->push_lock);
+      g_mutex_lock (&self->lock);
+      if (self->current) {
+        self->current->closed = TRUE;
+        self->current = NULL;
+      }
+      g_mutex_unlock (&self->lock);
+      gst_omx_parallel_enc_push_ready (self, FALSE);
+      g_mutex_unlock (&self->push_lock);
+      break;
+    case GST_EVENT_FLUSH_START:
+      gst_pad_push_event (self->srcpad, gst_event_ref (event));
+      break;
+    case GST_EVENT_FLUSH_STOP:
+      gst_omx_parallel_enc_push_event_to_encoders (self,
+          gst_event_ref (event));
+
+      g_mutex_lock (&self->push_lock);
+      gst_omx_parallel_enc_reset (self);
+      g_mutex_unlock (&self->push_lock);
+
+      return gst_pad_push_event (self->srcpad, event);
+    default:
+      break;
+  }
+
+  return gst_omx_parallel_enc_push_event_to_encoders (self, event);
+}
+
+static gboolean
+gst_omx_parallel_enc_sink_query (GstPad * pad, GstObject * parent,
+    GstQuery * query)
+{
+  GstOMXParallelEnc *self = GST_OMX_PARALLEL_ENC (parent);
+
+  /* All encoders are configured alike, encoder_0 answers for them */
+  switch (GST_QUERY_TYPE (query)) {
+    case GST_QUERY_CAPS:
+    case GST_QUERY_ACCEPT_CAPS:
+    case GST_QUERY_ALLOCATION:
+      if (self->pool.srcpads->len > 0)
+        return gst_pad_peer_query (g_ptr_array_index (self->pool.srcpads, 0),
+            query);
+      break;
+    default:
+      break;
+  }
+
+  return gst_pad_query_default (pad, parent, query);
+}
+
+static gboolean
+gst_omx_parallel_enc_src_query (GstPad * pad, GstObject * parent,
+    GstQuery * query)
+{
+  GstOMXParallelEnc *self = GST_OMX_PARALLEL_ENC (parent);
+
+  switch (GST_QUERY_TYPE (query)) {
+    case GST_QUERY_CAPS:
+    case GST_QUERY_ACCEPT_CAPS:
+    case GST_QUERY_LATENCY:
+      if (self->pool.sinkpads->len > 0)
+        return gst_pad_peer_query (g_ptr_array_index (self->pool.sinkpads, 0),
+            query);
+      break;
+    default:
+      break;
+  }
+
+  return gst_pad_query_default (pad, parent, query);
+}
+
+/* Returns the segment @encoder currently outputs, every encoder
+ * outputs its segments in order. Called with the lock. */
+static GstOMXParallelEncSegment *
+gst_omx_parallel_enc_find_output_segment (GstOMXParallelEnc * self,
+    guint encoder)
+{
+  GList *l;
+
+  for (l = self->segments.head; l; l = l->next) {
+    GstOMXParallelEncSegment *seg = l->data;
+
+    if (seg->encoder == encoder && !gst_omx_parallel_enc_segment_is_done (seg))
+      return seg;
+  }
+
+  return NULL;
+}
+
+static GstFlowReturn
+gst_omx_parallel_enc_enc_chain (GstPad * pad, GstObject * parent,
+    GstBuffer * buffer)
+{
+  GstOMXParallelEnc *self = GST_OMX_PARALLEL_ENC (parent);
+  GstOMXParallelEncSegment *seg;
+  guint encoder = GST_OMX_ENCODER_POOL_INDEX (pad);
+  GstFlowReturn ret = GST_FLOW_OK;
+
+  g_mutex_lock (&self->push_lock);
+  g_mutex_lock (&self->lock);
+
+  seg = gst_omx_parallel_enc_find_output_segment (self, encoder);
+  if (!seg) {
+    g_mutex_unlock (&self->lock);
+    g_mutex_unlock (&self->push_lock);
+    GST_WARNING_OBJECT (self, "Output of encoder %u without segment",
+        encoder);
+    gst_buffer_unref (buffer);
+    return GST_FLOW_OK;
+  }
+
+  /* Headers come in addition to the frames */
+  if (!GST_BUFFER_FLAG_IS_SET (buffer, GST_BUFFER_FLAG_HEADER))
+    seg->out_frames++;
+
+  if (seg == g_queue_peek_head (&self->segments)) {
+    g_mutex_unlock (&self->lock);
+    ret = gst_pad_push (self->srcpad, buffer);
+  } else {
+    g_queue_push_tail (&seg->items, buffer);
+    g_mutex_unlock (&self->lock);
+  }
+
+  if (ret == GST_FLOW_OK)
+    ret = gst_omx_parallel_enc_push_ready (self, FALSE);
+  g_mutex_unlock (&self->push_lock);
+
+  return ret;
+}
+
+static gboolean
+gst_omx_parallel_enc_enc_event (GstPad * pad, GstObject * parent,
+    GstEvent * event)
+{
+  GstOMXParallelEnc *self = GST_OMX_PARALLEL_ENC (parent);
+  gboolean ret = TRUE;
+
+  switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_EOS:
+      g_mutex_lock (&self->push_lock);
+      if (++self->eos_count == self->pool.encoders->len) {
+        GST_DEBUG_OBJECT (self, "All encoders drained");
+        gst_omx_parallel_enc_push_ready (self, TRUE);
+        ret = gst_pad_push_event (self->srcpad, event);
+      } else {
+        gst_event_unref (event);
+      }
+      g_mutex_unlock (&self->push_lock);
+      break;
+    case GST_EVENT_FLUSH_START:
+    case GST_EVENT_FLUSH_STOP:
+      /* Flushing is forwarded from the sink pad */
+      gst_event_unref (event);
+      break;
+    default:{
+      GstOMXParallelEncSegment *seg = NULL;
+
+      /* encoder_0 speaks for all encoders */
+      if (GST_OMX_ENCODER_POOL_INDEX (pad) != 0) {
+        gst_event_unref (event);
+        break;
+      }
+
+      /* Serialized events stay in order with the output of the
+       * segment they were sent in */
+      g_mutex_lock (&self->push_lock);
+      g_mutex_lock (&self->lock);
+      if (GST_EVENT_IS_SERIALIZED (event))
+        seg = gst_omx_parallel_enc_find_output_segment (self, 0);
+      if (seg && seg != g_queue_peek_head (&self->segments)) {
+        g_queue_push_tail (&seg->items, event);
+        g_mutex_unlock (&self->lock);
+      } else {
+        g_mutex_unlock (&self->lock);
+        ret = gst_pad_push_event (self->srcpad, event);
+      }
+      g_mutex_unlock (&self->push_lock);
+      break;
+    }
+  }
+
+  return ret;
+}
+
+static gboolean
+gst_omx_parallel_enc_enc_query (GstPad * pad, GstObject * parent,
+    GstQuery * query)
+{
+  GstOMXParallelEnc *self = GST_OMX_PARALLEL_ENC (parent);
+
+  return gst_pad_peer_query (self->srcpad, query);
+}
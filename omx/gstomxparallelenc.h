@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2015, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+#ifndef __GST_OMX_PARALLEL_ENC_H__
+#define __GST_OMX_PARALLEL_ENC_H__
+
+#include <gst/gst.h>
+
+#include "gstomxencoderpool.h"
+
+G_BEGIN_DECLS
+#define GST_TYPE_OMX_PARALLEL_ENC \
+  (gst_omx_parallel_enc_get_type())
+#define GST_OMX_PARALLEL_ENC(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_OMX_PARALLEL_ENC,GstOMXParallelEnc))
+#define GST_OMX_PARALLEL_ENC_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_OMX_PARALLEL_ENC,GstOMXParallelEncClass))
+#define GST_OMX_PARALLEL_ENC_GET_CLASS(obj) \
+  (G_TYPE_INSTANCE_GET_CLASS((obj),GST_TYPE_OMX_PARALLEL_ENC,GstOMXParallelEncClass))
+#define GST_IS_OMX_PARALLEL_ENC(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_OMX_PARALLEL_ENC))
+#define GST_IS_OMX_PARALLEL_ENC_CLASS(obj) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_OMX_PARALLEL_ENC))
+typedef struct _GstOMXParallelEnc GstOMXParallelEnc;
+typedef struct _GstOMXParallelEncClass GstOMXParallelEncClass;
+typedef struct _GstOMXParallelEncSegment GstOMXParallelEncSegment;
+
+struct _GstOMXParallelEnc
+{
+  GstBin parent;
+
+  GstPad *sinkpad, *srcpad;
+
+  /* properties */
+  gchar *encoder_name;
+  guint num_encoders;
+
+  GstOMXEncoderPool pool;
+
+  /* Number of frames per segment, the iframeinterval of encoder_0 */
+  guint segment_frames;
+
+  /* Serializes everything pushed on the src pad, taken before lock */
+  GMutex push_lock;
+  /* Protects the segment state below */
+  GMutex lock;
+  /* Segments not completely pushed yet, in stream order */
+  GQueue segments;
+  /* Segment the input is currently fed into, NULL if none */
+  GstOMXParallelEncSegment *current;
+  guint next_segment;
+  /* Number of encoders that finished their EOS */
+  guint eos_count;
+};
+
+struct _GstOMXParallelEncClass
+{
+  GstBinClass parent_class;
+};
+
+GType gst_omx_parallel_enc_get_type (void);
+
+G_END_DECLS
+#endif /* __GST_OMX_PARALLEL_ENC_H__ */
@@ -0,0 +1,392 @@
+/*
+ * Copyright (c) 2015, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+/* Encodes one input into several streams, one per requested src pad.
+ * Each src pad is backed by its own OMX encoder instance. One shared
+ * scaling stage writes all scaled copies of the input straight into
+ * the input buffers of the encoders, scaling the smaller streams down
+ * from the larger ones, so the input is read once per frame:
+ *
+ *   gst-launch-1.0 ... ! omxh264simulcastenc name=s \
+ *       output-sizes="1920x1080,1280x720,640x360" \
+ *       s.src_0 ! ... s.src_1 ! ... s.src_2 ! ...
+ *
+ * The size of a stream can also be given with the caps when requesting
+ * its pad.
+ *
+ * The encoders are children named encoder_%u and can be configured
+ * through the child proxy, e.g. s::encoder_1::bitrate=2000000.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <stdio.h>
+
+#include "gstomxsimulcastenc.h"
+#include "gstomxsimulcastscale.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_omx_simulcast_enc_debug_category);
+#define GST_CAT_DEFAULT gst_omx_simulcast_enc_debug_category
+
+/* prototypes */
+static void gst_omx_simulcast_enc_finalize (GObject * object);
+static void gst_omx_simulcast_enc_set_property (GObject * object,
+    guint prop_id, const GValue * value, GParamSpec * pspec);
+static void gst_omx_simulcast_enc_get_property (GObject * object,
+    guint prop_id, GValue * value, GParamSpec * pspec);
+static GstPad *gst_omx_simulcast_enc_request_new_pad (GstElement * element,
+    GstPadTemplate * templ, const gchar * name, const GstCaps * caps);
+static void gst_omx_simulcast_enc_release_pad (GstElement * element,
+    GstPad * pad);
+
+enum
+{
+  PROP_0,
+  PROP_ENCODER,
+  PROP_OUTPUT_SIZES
+};
+
+#define DEFAULT_ENCODER "omxh264enc"
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("video/x-raw(memory:NVMM); video/x-raw"));
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src_%u",
+    GST_PAD_SRC,
+    GST_PAD_REQUEST,
+    GST_STATIC_CAPS_ANY);
+
+/* class initialization */
+
+#define DEBUG_INIT \
+  GST_DEBUG_CATEGORY_INIT (gst_omx_simulcast_enc_debug_category, \
+      "omxsimulcastenc", 0, "debug category for omxh264simulcastenc element");
+
+G_DEFINE_TYPE_WITH_CODE (GstOMXSimulcastEnc, gst_omx_simulcast_enc,
+    GST_TYPE_BIN, DEBUG_INIT);
+
+static void
+gst_omx_simulcast_enc_class_init (GstOMXSimulcastEncClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+
+  gobject_class->finalize = gst_omx_simulcast_enc_finalize;
+  gobject_class->set_property = gst_omx_simulcast_enc_set_property;
+  gobject_class->get_property = gst_omx_simulcast_enc_get_property;
+
+  g_object_class_install_property (gobject_class, PROP_ENCODER,
+      g_param_spec_string ("encoder", "Encoder",
+          "Name of the OMX encoder element used for every stream",
+          DEFAULT_ENCODER,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_OUTPUT_SIZES,
+      g_param_spec_string ("output-sizes", "Output Sizes",
+          "Comma separated WIDTHxHEIGHT of the streams in src pad order "
+          "(NULL=input size)", NULL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  element_class->request_new_pad =
+      GST_DEBUG_FUNCPTR (gst_omx_simulcast_enc_request_new_pad);
+  element_class->release_pad =
+      GST_DEBUG_FUNCPTR (gst_omx_simulcast_enc_release_pad);
+
+  gst_element_class_add_pad_template (element_class,
+      gst_static_pad_template_get (&sink_template));
+  gst_element_class_add_pad_template (element_class,
+      gst_static_pad_template_get (&src_template));
+
+  gst_element_class_set_static_metadata (element_class,
+      "OpenMAX Simulcast Video Encoder",
+      "Codec/Encoder/Video",
+      "Encode one video stream at several resolutions",
+      "NVIDIA Corporation");
+}
+
+static void
+gst_omx_simulcast_enc_init (GstOMXSimulcastEnc * self)
+{
+  GstPad *pad;
+
+  self->encoder_name = g_strdup (DEFAULT_ENCODER);
+
+  self->scale = g_object_new (GST_TYPE_OMX_SIMULCAST_SCALE, "name", "scale",
+      NULL);
+  gst_bin_add (GST_BIN (self), self->scale);
+
+  pad = gst_element_get_static_pad (self->scale, "sink");
+  self->sinkpad = gst_ghost_pad_new_from_template ("sink", pad,
+      gst_static_pad_template_get (&sink_template));
+  gst_object_unref (pad);
+  gst_element_add_pad (GST_ELEMENT (self), self->sinkpad);
+}
+
+static void
+gst_omx_simulcast_enc_finalize (GObject * object)
+{
+  GstOMXSimulcastEnc *self = GST_OMX_SIMULCAST_ENC (object);
+
+  g_free (self->encoder_name);
+  g_free (self->output_sizes);
+
+  G_OBJECT_CLASS (gst_omx_simulcast_enc_parent_class)->finalize (object);
+}
+
+static void
+gst_omx_simulcast_enc_set_property (GObject * object, guint prop_id,
+    const GValue * value, GParamSpec * pspec)
+{
+  GstOMXSimulcastEnc *self = GST_OMX_SIMULCAST_ENC (object);
+
+  switch (prop_id) {
+    case PROP_ENCODER:
+      g_free (self->encoder_name);
+      self->encoder_name = g_value_dup_string (value);
+      break;
+    case PROP_OUTPUT_SIZES:
+      GST_OBJECT_LOCK (self);
+      g_free (self->output_sizes);
+      self->output_sizes = g_value_dup_string (value);
+      GST_OBJECT_UNLOCK (self);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+static void
+gst_omx_simulcast_enc_get_property (GObject * object, guint prop_id,
+    GValue * value, GParamSpec * pspec)
+{
+  GstOMXSimulcastEnc *self = GST_OMX_SIMULCAST_ENC (object);
+
+  switch (prop_id) {
+    case PROP_ENCODER:
+      g_value_set_string (value, self->encoder_name);
+      break;
+    case PROP_OUTPUT_SIZES:
+      GST_OBJECT_LOCK (self);
+      g_value_set_string (value, self->output_sizes);
+      GST_OBJECT_UNLOCK (self);
+      break;
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+  }
+}
+
+/* Returns caps with the size of stream @id from @caps or else from
+ * its entry in output-sizes, NULL to keep the input size */
+static GstCaps *
+gst_omx_simulcast_enc_get_size_caps (GstOMXSimulcastEnc * self, guint id,
+    const GstCaps * caps)
+{
+  GstCaps *size_caps;
+  gint width = 0, height = 0;
+
+  if (caps && !gst_caps_is_empty (caps) && !gst_caps_is_any (caps)) {
+    GstStructure *s = gst_caps_get_structure (caps, 0);
+
+    gst_structure_get_int (s, "width", &width);
+    gst_structure_get_int (s, "height", &height);
+  }
+
+  GST_OBJECT_LOCK (self);
+  if (width == 0 && height == 0 && self->output_sizes) {
+    gchar **sizes = g_strsplit (self->output_sizes, ",", -1);
+
+    if (id < g_strv_length (sizes)
+        && sscanf (sizes[id], "%dx%d", &width, &height) != 2) {
+      GST_WARNING_OBJECT (self, "Invalid output size \"%s\"", sizes[id]);
+      width = height = 0;
+    }
+    g_strfreev (sizes);
+  }
+  GST_OBJECT_UNLOCK (self);
+
+  if (width <= 0 && height <= 0)
+    return NULL;
+
+  GST_DEBUG_OBJECT (self, "Stream %u encodes at %dx%d", id, width, height);
+  size_caps = gst_caps_new_empty_simple ("video/x-raw");
+  if (width > 0)
+    gst_caps_set_simple (size_caps, "width", G_TYPE_INT, width, NULL);
+  if (height > 0)
+    gst_caps_set_simple (size_caps, "height", G_TYPE_INT, height, NULL);
+
+  return size_caps;
+}
+
+static GstPad *
+gst_omx_simulcast_enc_request_new_pad (GstElement * element,
+    GstPadTemplate * templ, const gchar * name, const GstCaps * caps)
+{
+  GstOMXSimulcastEnc *self = GST_OMX_SIMULCAST_ENC (element);
+  GstElement *queue = NULL, *encoder = NULL;
+  GstPad *scalepad = NULL, *sinkpad = NULL, *srcpad = NULL, *ghost = NULL;
+  GstCaps *size_caps;
+  gchar *child_name;
+  guint id;
+
+  GST_OBJECT_LOCK (self);
+  if (name == NULL || sscanf (name, "src_%u", &id) != 1)
+    id = self->next_pad_id;
+  self->next_pad_id = MAX (self->next_pad_id, id + 1);
+  GST_OBJECT_UNLOCK (self);
+
+  child_name = g_strdup_printf ("queue_%u", id);
+  queue = gst_element_factory_make ("queue", child_name);
+  g_free (child_name);
+
+  child_name = g_strdup_printf ("encoder_%u", id);
+  encoder = gst_element_factory_make (self->encoder_name, child_name);
+  g_free (child_name);
+
+  if (!queue || !encoder)
+    goto no_element;
+
+  if (!gst_bin_add (GST_BIN (self), queue)) {
+    queue = NULL;
+    goto add_failed;
+  }
+  if (!gst_bin_add (GST_BIN (self), encoder)) {
+    gst_bin_remove (GST_BIN (self), queue);
+    queue = NULL;
+    encoder = NULL;
+    goto add_failed;
+  }
+
+  if (!gst_element_link (queue, encoder))
+    goto link_failed;
+
+  size_caps = gst_omx_simulcast_enc_get_size_caps (self, id, caps);
+  scalepad = gst_element_request_pad (self->scale,
+      gst_element_class_get_pad_template (GST_ELEMENT_GET_CLASS
+          (self->scale), "src_%u"), NULL, size_caps);
+  if (size_caps)
+    gst_caps_unref (size_caps);
+  sinkpad = gst_element_get_static_pad (queue, "sink");
+  if (!scalepad || gst_pad_link (scalepad, sinkpad) != GST_PAD_LINK_OK)
+    goto link_failed;
+  gst_object_unref (sinkpad);
+  sinkpad = NULL;
+
+  srcpad = gst_element_get_static_pad (encoder, "src");
+  child_name = g_strdup_printf ("src_%u", id);
+  ghost = gst_ghost_pad_new_from_template (child_name, srcpad, templ);
+  g_free (child_name);
+  gst_object_unref (srcpad);
+
+  /* Remembered to release the scaler pad together with the ghost pad */
+  g_object_set_data_full (G_OBJECT (ghost), "simulcast-scale-pad", scalepad,
+      (GDestroyNotify) gst_object_unref);
+
+  gst_pad_set_active (ghost, TRUE);
+  gst_element_add_pad (element, ghost);
+
+  gst_element_sync_state_with_parent (encoder);
+  gst_element_sync_state_with_parent (queue);
+
+  GST_DEBUG_OBJECT (self, "Added stream %u", id);
+
+  return ghost;
+
+no_element:
+  {
+    GST_ERROR_OBJECT (self, "Failed to create %s", queue ? self->encoder_name :
+        "queue");
+    if (queue)
+      gst_object_unref (queue);
+    if (encoder)
+      gst_object_unref (encoder);
+    return NULL;
+  }
+add_failed:
+  {
+    GST_ERROR_OBJECT (self, "Failed to add stream %u", id);
+    if (queue)
+      gst_object_unref (queue);
+    if (encoder)
+      gst_object_unref (encoder);
+    return NULL;
+  }
+link_failed:
+  {
+    GST_ERROR_OBJECT (self, "Failed to link stream %u", id);
+    if (sinkpad)
+      gst_object_unref (sinkpad);
+    if (scalepad) {
+      gst_element_release_request_pad (self->scale, scalepad);
+      gst_object_unref (scalepad);
+    }
+    gst_bin_remove (GST_BIN (self), encoder);
+    gst_bin_remove (GST_BIN (self), queue);
+    return NULL;
+  }
+}
+
+static void
+gst_omx_simulcast_enc_release_pad (GstElement * element, GstPad * pad)
+{
+  GstOMXSimulcastEnc *self = GST_OMX_SIMULCAST_ENC (element);
+  GstElement *queue, *encoder;
+  GstPad *scalepad;
+  gchar *child_name;
+  guint id;
+
+  if (sscanf (GST_PAD_NAME (pad), "src_%u", &id) != 1)
+    return;
+
+  GST_DEBUG_OBJECT (self, "Removing stream %u", id);
+
+  scalepad = g_object_get_data (G_OBJECT (pad), "simulcast-scale-pad");
+  if (scalepad)
+    gst_element_release_request_pad (self->scale, scalepad);
+
+  child_name = g_strdup_printf ("queue_%u", id);
+  queue = gst_bin_get_by_name (GST_BIN (self), child_name);
+  g_free (child_name);
+
+  child_name = g_strdup_printf ("encoder_%u", id);
+  encoder = gst_bin_get_by_name (GST_BIN (self), child_name);
+  g_free (child_name);
+
+  gst_pad_set_active (pad, FALSE);
+  gst_element_remove_pad (element, pad);
+
+  if (encoder) {
+    gst_element_set_state (encoder, GST_STATE_NULL);
+    gst_bin_remove (GST_BIN (self), encoder);
+    gst_object_unref (encoder);
+  }
+  if (queue) {
+    gst_element_set_state (queue, GST_STATE_NULL);
+    gst_bin_remove (GST_BIN (self), queue);
+    gst_object_unref (queue);
+  }
+}
@@ -0,0 +1,574 @@
+/*
+ * Copyright (c) 2015, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+/* Scaling stage of the simulcast encoder. Fans the input out to one
+ * src pad per stream, the size of a stream is given with the caps when
+ * requesting its pad. Streams at the input size get the input buffer
+ * itself, all others a scaled copy written straight into a buffer from
+ * the pool of their encoder. Every copy is scaled down from the smallest
+ * frame of this input that was already scaled and still covers it, so
+ * the input is only read once for a ladder of sizes.
+ *
+ * NVMM input can only be passed on as it is.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <stdio.h>
+
+#include "gstomxsimulcastscale.h"
+#include "gstomxvideoenc.h"
+
+GST_DEBUG_CATEGORY_STATIC (gst_omx_simulcast_scale_debug_category);
+#define GST_CAT_DEFAULT gst_omx_simulcast_scale_debug_category
+
+/* prototypes */
+static void gst_omx_simulcast_scale_finalize (GObject * object);
+static GstStateChangeReturn gst_omx_simulcast_scale_change_state (GstElement *
+    element, GstStateChange transition);
+static GstPad *gst_omx_simulcast_scale_request_new_pad (GstElement * element,
+    GstPadTemplate * templ, const gchar * name, const GstCaps * caps);
+static void gst_omx_simulcast_scale_release_pad (GstElement * element,
+    GstPad * pad);
+static GstFlowReturn gst_omx_simulcast_scale_chain (GstPad * pad,
+    GstObject * parent, GstBuffer * buf);
+static gboolean gst_omx_simulcast_scale_sink_event (GstPad * pad,
+    GstObject * parent, GstEvent * event);
+static gboolean gst_omx_simulcast_scale_sink_query (GstPad * pad,
+    GstObject * parent, GstQuery * query);
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
+    GST_PAD_SINK,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS ("video/x-raw(memory:NVMM); video/x-raw"));
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src_%u",
+    GST_PAD_SRC,
+    GST_PAD_REQUEST,
+    GST_STATIC_CAPS ("video/x-raw(memory:NVMM); video/x-raw"));
+
+/* class initialization */
+
+#define DEBUG_INIT \
+  GST_DEBUG_CATEGORY_INIT (gst_omx_simulcast_scale_debug_category, \
+      "omxsimulcastscale", 0, "debug category for simulcast scaling");
+
+G_DEFINE_TYPE_WITH_CODE (GstOMXSimulcastScale, gst_omx_simulcast_scale,
+    GST_TYPE_ELEMENT, DEBUG_INIT);
+
+static void
+gst_omx_simulcast_scale_class_init (GstOMXSimulcastScaleClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+  GstElementClass *element_class = GST_ELEMENT_CLASS (klass);
+
+  gobject_class->finalize = gst_omx_simulcast_scale_finalize;
+
+  element_class->change_state =
+      GST_DEBUG_FUNCPTR (gst_omx_simulcast_scale_change_state);
+  element_class->request_new_pad =
+      GST_DEBUG_FUNCPTR (gst_omx_simulcast_scale_request_new_pad);
+  element_class->release_pad =
+      GST_DEBUG_FUNCPTR (gst_omx_simulcast_scale_release_pad);
+
+  gst_element_class_add_pad_template (element_class,
+      gst_static_pad_template_get (&sink_template));
+  gst_element_class_add_pad_template (element_class,
+      gst_static_pad_template_get (&src_template));
+
+  gst_element_class_set_static_metadata (element_class,
+      "OpenMAX Simulcast Scaler",
+      "Filter/Converter/Video/Scaler",
+      "Scale one video stream to several sizes at once",
+      "NVIDIA Corporation");
+}
+
+static void
+gst_omx_simulcast_scale_init (GstOMXSimulcastScale * self)
+{
+  self->sinkpad = gst_pad_new_from_static_template (&sink_template, "sink");
+  gst_pad_set_chain_function (self->sinkpad,
+      GST_DEBUG_FUNCPTR (gst_omx_simulcast_scale_chain));
+  gst_pad_set_event_function (self->sinkpad,
+      GST_DEBUG_FUNCPTR (gst_omx_simulcast_scale_sink_event));
+  gst_pad_set_query_function (self->sinkpad,
+      GST_DEBUG_FUNCPTR (gst_omx_simulcast_scale_sink_query));
+  gst_element_add_pad (GST_ELEMENT (self), self->sinkpad);
+}
+
+static void
+gst_omx_simulcast_scale_release_pool (GstOMXSimulcastScaleStream * stream)
+{
+  if (stream->pool) {
+    gst_buffer_pool_set_active (stream->pool, FALSE);
+    gst_object_unref (stream->pool);
+    stream->pool = NULL;
+  }
+}
+
+static void
+gst_omx_simulcast_scale_stream_free (GstOMXSimulcastScaleStream * stream)
+{
+  gst_omx_simulcast_scale_release_pool (stream);
+  g_slice_free (GstOMXSimulcastScaleStream, stream);
+}
+
+static void
+gst_omx_simulcast_scale_finalize (GObject * object)
+{
+  GstOMXSimulcastScale *self = GST_OMX_SIMULCAST_SCALE (object);
+
+  g_list_free_full (self->streams,
+      (GDestroyNotify) gst_omx_simulcast_scale_stream_free);
+  gst_caps_replace (&self->caps, NULL);
+
+  G_OBJECT_CLASS (gst_omx_simulcast_scale_parent_class)->finalize (object);
+}
+
+static GstStateChangeReturn
+gst_omx_simulcast_scale_change_state (GstElement * element,
+    GstStateChange transition)
+{
+  GstOMXSimulcastScale *self = GST_OMX_SIMULCAST_SCALE (element);
+  GstStateChangeReturn ret;
+  GList *l;
+
+  ret =
+      GST_ELEMENT_CLASS (gst_omx_simulcast_scale_parent_class)->change_state
+      (element, transition);
+
+  if (transition == GST_STATE_CHANGE_PAUSED_TO_READY) {
+    GST_PAD_STREAM_LOCK (self->sinkpad);
+    for (l = self->streams; l; l = l->next) {
+      GstOMXSimulcastScaleStream *stream = l->data;
+
+      gst_omx_simulcast_scale_release_pool (stream);
+      stream->configured = FALSE;
+    }
+    gst_caps_replace (&self->caps, NULL);
+    GST_PAD_STREAM_UNLOCK (self->sinkpad);
+  }
+
+  return ret;
+}
+
+static GstPad *
+gst_omx_simulcast_scale_request_new_pad (GstElement * element,
+    GstPadTemplate * templ, const gchar * name, const GstCaps * caps)
+{
+  GstOMXSimulcastScale *self = GST_OMX_SIMULCAST_SCALE (element);
+  GstOMXSimulcastScaleStream *stream;
+  gchar *pad_name;
+  guint id;
+
+  stream = g_slice_new0 (GstOMXSimulcastScaleStream);
+
+  if (caps && !gst_caps_is_empty (caps) && !gst_caps_is_any (caps)) {
+    GstStructure *s = gst_caps_get_structure (caps, 0);
+
+    gst_structure_get_int (s, "width", &stream->width);
+    gst_structure_get_int (s, "height", &stream->height);
+  }
+
+  GST_OBJECT_LOCK (self);
+  if (name == NULL || sscanf (name, "src_%u", &id) != 1)
+    id = self->next_pad_id;
+  self->next_pad_id = MAX (self->next_pad_id, id + 1);
+  GST_OBJECT_UNLOCK (self);
+
+  pad_name = g_strdup_printf ("src_%u", id);
+  stream->srcpad = gst_pad_new_from_template (templ, pad_name);
+  g_free (pad_name);
+  gst_pad_set_element_private (stream->srcpad, stream);
+
+  GST_DEBUG_OBJECT (self, "Stream %u scales to %dx%d", id, stream->width,
+      stream->height);
+
+  /* Configured with the next buffer */
+  GST_PAD_STREAM_LOCK (self->sinkpad);
+  self->streams = g_list_append (self->streams, stream);
+  GST_PAD_STREAM_UNLOCK (self->sinkpad);
+
+  gst_pad_set_active (stream->srcpad, TRUE);
+  gst_element_add_pad (element, stream->srcpad);
+
+  return stream->srcpad;
+}
+
+static void
+gst_omx_simulcast_scale_release_pad (GstElement * element, GstPad * pad)
+{
+  GstOMXSimulcastScale *self = GST_OMX_SIMULCAST_SCALE (element);
+  GstOMXSimulcastScaleStream *stream = gst_pad_get_element_private (pad);
+
+  GST_PAD_STREAM_LOCK (self->sinkpad);
+  self->streams = g_list_remove (self->streams, stream);
+  GST_PAD_STREAM_UNLOCK (self->sinkpad);
+
+  gst_pad_set_active (pad, FALSE);
+  gst_element_remove_pad (element, pad);
+
+  gst_omx_simulcast_scale_stream_free (stream);
+}
+
+/* Largest streams first, so smaller ones can be scaled from them */
+static gint
+gst_omx_simulcast_scale_compare_streams (gconstpointer a, gconstpointer b)
+{
+  const GstOMXSimulcastScaleStream *sa = a, *sb = b;
+  gint area_a = GST_VIDEO_INFO_WIDTH (&sa->info) *
+      GST_VIDEO_INFO_HEIGHT (&sa->info);
+  gint area_b = GST_VIDEO_INFO_WIDTH (&sb->info) *
+      GST_VIDEO_INFO_HEIGHT (&sb->info);
+
+  return area_b - area_a;
+}
+
+static gboolean
+gst_omx_simulcast_scale_copy_sticky_event (GstPad * pad, GstEvent ** event,
+    gpointer user_data)
+{
+  GstOMXSimulcastScaleStream *stream = user_data;
+
+  if (GST_EVENT_TYPE (*event) != GST_EVENT_CAPS)
+    gst_pad_store_sticky_event (stream->srcpad, *event);
+
+  return TRUE;
+}
+
+/* Takes a pool from downstream for the scaled copies of @stream */
+static void
+gst_omx_simulcast_scale_find_pool (GstOMXSimulcastScale * self,
+    GstOMXSimulcastScaleStream * stream, GstCaps * caps)
+{
+  GstQuery *query;
+  GstBufferPool *pool = NULL;
+  GstStructure *config;
+  guint size, min, max;
+
+  query = gst_query_new_allocation (caps, TRUE);
+  if (!gst_pad_peer_query (stream->srcpad, query)
+      || gst_query_get_n_allocation_pools (query) == 0) {
+    gst_query_unref (query);
+    return;
+  }
+  gst_query_parse_nth_allocation_pool (query, 0, &pool, &size, &min, &max);
+  gst_query_unref (query);
+
+  if (!pool)
+    return;
+
+  config = gst_buffer_pool_get_config (pool);
+  gst_buffer_pool_config_set_params (config, caps,
+      MAX (size, GST_VIDEO_INFO_SIZE (&stream->info)), min, max);
+  if (gst_buffer_pool_has_option (pool, GST_BUFFER_POOL_OPTION_VIDEO_META))
+    gst_buffer_pool_config_add_option (config,
+        GST_BUFFER_POOL_OPTION_VIDEO_META);
+
+  if (!gst_buffer_pool_set_config (pool, config)
+      || !gst_buffer_pool_set_active (pool, TRUE)) {
+    GST_WARNING_OBJECT (self, "Can't use the pool of %s",
+        GST_PAD_NAME (stream->srcpad));
+    gst_object_unref (pool);
+    return;
+  }
+
+  stream->pool = pool;
+}
+
+/* Sends the caps of @stream for the current input caps */
+static gboolean
+gst_omx_simulcast_scale_configure_stream (GstOMXSimulcastScale * self,
+    GstOMXSimulcastScaleStream * stream)
+{
+  gint in_width = GST_VIDEO_INFO_WIDTH (&self->info);
+  gint in_height = GST_VIDEO_INFO_HEIGHT (&self->info);
+  gint width = stream->width > 0 ? stream->width : in_width;
+  gint height = stream->height > 0 ? stream->height : in_height;
+  GstCapsFeatures *features;
+  GstVideoFormat format;
+  GstCaps *caps;
+
+  gst_omx_simulcast_scale_release_pool (stream);
+  stream->configured = FALSE;
+  stream->scaled = width != in_width || height != in_height;
+
+  if (!stream->scaled) {
+    caps = gst_caps_ref (self->caps);
+    stream->info = self->info;
+  } else {
+    features = gst_caps_get_features (self->caps, 0);
+    if (features && gst_caps_features_contains (features, "memory:NVMM"))
+      goto nvmm_input;
+
+    format = GST_VIDEO_INFO_FORMAT (&self->info);
+    if (format != GST_VIDEO_FORMAT_I420 && format != GST_VIDEO_FORMAT_NV12)
+      goto unsupported_format;
+
+    caps = gst_caps_copy (self->caps);
+    gst_caps_set_simple (caps, "width", G_TYPE_INT, width, "height",
+        G_TYPE_INT, height, NULL);
+    gst_video_info_from_caps (&stream->info, caps);
+  }
+
+  /* Streams added while running didn't see the sticky events yet */
+  gst_pad_sticky_events_foreach (self->sinkpad,
+      gst_omx_simulcast_scale_copy_sticky_event, stream);
+
+  if (!gst_pad_push_event (stream->srcpad, gst_event_new_caps (caps))) {
+    GST_WARNING_OBJECT (self, "%s refused %" GST_PTR_FORMAT,
+        GST_PAD_NAME (stream->srcpad), caps);
+  } else if (stream->scaled) {
+    gst_omx_simulcast_scale_find_pool (self, stream, caps);
+  }
+  gst_caps_unref (caps);
+
+  stream->configured = TRUE;
+
+  return TRUE;
+
+nvmm_input:
+  {
+    GST_ERROR_OBJECT (self, "Can't scale NVMM input from %dx%d to %dx%d",
+        in_width, in_height, width, height);
+    return FALSE;
+  }
+unsupported_format:
+  {
+    GST_ERROR_OBJECT (self, "Can't scale %s input",
+        gst_video_format_to_string (format));
+    return FALSE;
+  }
+}
+
+static gboolean
+gst_omx_simulcast_scale_set_caps (GstOMXSimulcastScale * self, GstCaps * caps)
+{
+  GList *l;
+
+  GST_DEBUG_OBJECT (self, "Setting caps %" GST_PTR_FORMAT, caps);
+
+  if (!gst_video_info_from_caps (&self->info, caps)) {
+    GST_ERROR_OBJECT (self, "Invalid caps %" GST_PTR_FORMAT, caps);
+    return FALSE;
+  }
+  gst_caps_replace (&self->caps, caps);
+
+  for (l = self->streams; l; l = l->next) {
+    if (!gst_omx_simulcast_scale_configure_stream (self, l->data))
+      return FALSE;
+  }
+  self->streams = g_list_sort (self->streams,
+      gst_omx_simulcast_scale_compare_streams);
+
+  return TRUE;
+}
+
+/* Errors win over EOS, streams that are EOS or not linked don't
+ * stop the others */
+static GstFlowReturn
+gst_omx_simulcast_scale_combine_flow (GstFlowReturn combined,
+    GstFlowReturn ret)
+{
+  if (ret == GST_FLOW_NOT_LINKED)
+    return combined;
+  if (combined == GST_FLOW_NOT_LINKED)
+    return ret;
+  if (ret == GST_FLOW_EOS)
+    return combined;
+  if (combined == GST_FLOW_EOS)
+    return ret;
+  return MIN (combined, ret);
+}
+
+static GstFlowReturn
+gst_omx_simulcast_scale_chain (GstPad * pad, GstObject * parent,
+    GstBuffer * buf)
+{
+  GstOMXSimulcastScale *self = GST_OMX_SIMULCAST_SCALE (parent);
+  GstFlowReturn ret = GST_FLOW_NOT_LINKED, flow;
+  GstVideoFrame in_frame, *frames;
+  GstBuffer **outbufs;
+  gboolean in_mapped = FALSE, resort = FALSE;
+  guint n, i, j;
+  GList *l;
+
+  if (!self->caps)
+    goto not_negotiated;
+
+  for (l = self->streams; l; l = l->next) {
+    GstOMXSimulcastScaleStream *stream = l->data;
+
+    if (stream->configured)
+      continue;
+    if (!gst_omx_simulcast_scale_configure_stream (self, stream))
+      goto not_negotiated;
+    resort = TRUE;
+  }
+  if (resort)
+    self->streams = g_list_sort (self->streams,
+        gst_omx_simulcast_scale_compare_streams);
+
+  n = g_list_length (self->streams);
+  outbufs = g_new0 (GstBuffer *, n);
+  frames = g_new0 (GstVideoFrame, n);
+
+  for (l = self->streams, i = 0; l; l = l->next, i++) {
+    GstOMXSimulcastScaleStream *stream = l->data;
+    GstVideoFrame *src;
+
+    if (!stream->scaled) {
+      outbufs[i] = gst_buffer_ref (buf);
+      continue;
+    }
+
+    if (!in_mapped) {
+      if (!gst_video_frame_map (&in_frame, &self->info, buf, GST_MAP_READ))
+        goto map_failed;
+      in_mapped = TRUE;
+    }
+
+    if (stream->pool) {
+      flow = gst_buffer_pool_acquire_buffer (stream->pool, &outbufs[i], NULL);
+      if (flow != GST_FLOW_OK) {
+        ret = flow;
+        goto done;
+      }
+    } else {
+      outbufs[i] =
+          gst_buffer_new_allocate (NULL, GST_VIDEO_INFO_SIZE (&stream->info),
+          NULL);
+    }
+
+    if (!gst_video_frame_map (&frames[i], &stream->info, outbufs[i],
+            GST_MAP_READWRITE))
+      goto map_failed;
+
+    /* The smallest frame scaled so far that still covers this one */
+    src = &in_frame;
+    for (j = i; j-- > 0;) {
+      if (frames[j].buffer
+          && GST_VIDEO_FRAME_WIDTH (&frames[j]) >= GST_VIDEO_INFO_WIDTH
+          (&stream->info)
+          && GST_VIDEO_FRAME_HEIGHT (&frames[j]) >=
+          GST_VIDEO_INFO_HEIGHT (&stream->info)) {
+        src = &frames[j];
+        break;
+      }
+    }
+
+    gst_omx_video_enc_scale_frame (src, &frames[i]);
+    gst_buffer_copy_into (outbufs[i], buf,
+        GST_BUFFER_COPY_FLAGS | GST_BUFFER_COPY_TIMESTAMPS, 0, -1);
+  }
+
+  for (i = 0; i < n; i++) {
+    if (frames[i].buffer) {
+      gst_video_frame_unmap (&frames[i]);
+      frames[i].buffer = NULL;
+    }
+  }
+  if (in_mapped)
+    gst_video_frame_unmap (&in_frame);
+  in_mapped = FALSE;
+
+  for (l = self->streams, i = 0; l; l = l->next, i++) {
+    GstOMXSimulcastScaleStream *stream = l->data;
+
+    flow = gst_pad_push (stream->srcpad, outbufs[i]);
+    outbufs[i] = NULL;
+    ret = gst_omx_simulcast_scale_combine_flow (ret, flow);
+  }
+
+done:
+  for (i = 0; i < n; i++) {
+    if (frames[i].buffer)
+      gst_video_frame_unmap (&frames[i]);
+    if (outbufs[i])
+      gst_buffer_unref (outbufs[i]);
+  }
+  if (in_mapped)
+    gst_video_frame_unmap (&in_frame);
+  g_free (frames);
+  g_free (outbufs);
+  gst_buffer_unref (buf);
+
+  return ret;
+
+not_negotiated:
+  {
+    GST_ELEMENT_ERROR (self, CORE, NEGOTIATION, (NULL),
+        ("Streams not negotiated"));
+    gst_buffer_unref (buf);
+    return GST_FLOW_NOT_NEGOTIATED;
+  }
+map_failed:
+  {
+    GST_ELEMENT_ERROR (self, RESOURCE, READ, (NULL),
+        ("Failed to map frames for scaling"));
+    ret = GST_FLOW_ERROR;
+    goto done;
+  }
+}
+
+static gboolean
+gst_omx_simulcast_scale_sink_event (GstPad * pad, GstObject * parent,
+    GstEvent * event)
+{
+  GstOMXSimulcastScale *self = GST_OMX_SIMULCAST_SCALE (parent);
+
+  if (GST_EVENT_TYPE (event) == GST_EVENT_CAPS) {
+    GstCaps *caps;
+    gboolean ret;
+
+    gst_event_parse_caps (event, &caps);
+    ret = gst_omx_simulcast_scale_set_caps (self, caps);
+    gst_event_unref (event);
+
+    return ret;
+  }
+
+  return gst_pad_event_default (pad, parent, event);
+}
+
+static gboolean
+gst_omx_simulcast_scale_sink_query (GstPad * pad, GstObject * parent,
+    GstQuery * query)
+{
+  GstOMXSimulcastScale *self = GST_OMX_SIMULCAST_SCALE (parent);
+
+  /* Upstream may allocate from the pool of the first stream that
+   * gets the input as it is, scaled streams only read it */
+  if (GST_QUERY_TYPE (query) == GST_QUERY_ALLOCATION) {
+    GList *l;
+
+    for (l = self->streams; l; l = l->next) {
+      GstOMXSimulcastScaleStream *stream = l->data;
+
+      if (stream->configured && !stream->scaled)
+        return gst_pad_peer_query (stream->srcpad, query);
+    }
+    return FALSE;
+  }
+
+  return gst_pad_query_default (pad, parent, query);
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2015, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+
+#ifndef __GST_OMX_SIMULCAST_SCALE_H__
+#define __GST_OMX_SIMULCAST_SCALE_H__
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+G_BEGIN_DECLS
+#define GST_TYPE_OMX_SIMULCAST_SCALE \
+  (gst_omx_simulcast_scale_get_type())
+#define GST_OMX_SIMULCAST_SCALE(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_OMX_SIMULCAST_SCALE,GstOMXSimulcastScale))
+#define GST_OMX_SIMULCAST_SCALE_CLASS(klass) \
+  (G_TYPE_CHECK_CLASS_CAST((klass),GST_TYPE_OMX_SIMULCAST_SCALE,GstOMXSimulcastScaleClass))
+#define GST_OMX_SIMULCAST_SCALE_GET_CLASS(obj) \
+  (G_TYPE_INSTANCE_GET_CLASS((obj),GST_TYPE_OMX_SIMULCAST_SCALE,GstOMXSimulcastScaleClass))
+#define GST_IS_OMX_SIMULCAST_SCALE(obj) \
+  (G_TYPE_CHECK_INSTANCE_TYPE((obj),GST_TYPE_OMX_SIMULCAST_SCALE))
+#define GST_IS_OMX_SIMULCAST_SCALE_CLASS(obj) \
+  (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_OMX_SIMULCAST_SCALE))
+typedef struct _GstOMXSimulcastScale GstOMXSimulcastScale;
+typedef struct _GstOMXSimulcastScaleClass GstOMXSimulcastScaleClass;
+typedef struct _GstOMXSimulcastScaleStream GstOMXSimulcastScaleStream;
+
+struct _GstOMXSimulcastScaleStream
+{
+  GstPad *srcpad;
+
+  /* Requested size, 0 keeps the input size */
+  gint width, height;
+
+  /* TRUE if caps were pushed for the current input caps */
+  gboolean configured;
+  /* TRUE if the stream gets its own scaled copy of the input */
+  gboolean scaled;
+  GstVideoInfo info;
+  /* Pool of downstream, NULL if buffers are allocated directly */
+  GstBufferPool *pool;
+};
+
+struct _GstOMXSimulcastScale
+{
+  GstElement parent;
+
+  GstPad *sinkpad;
+
+  /* Current input caps, NULL before the first CAPS event */
+  GstCaps *caps;
+  GstVideoInfo info;
+
+  /* Streams with scaled ones sorted by area, largest first.
+   * Protected by the stream lock of the sink pad */
+  GList *streams;
+
+  guint next_pad_id;
+};
+
+struct _GstOMXSimulcastScaleClass
+{
+  GstElementClass parent_class;
+};
+
+GType gst_omx_simulcast_scale_get_type (void);
+
+G_END_DECLS
+#endif /* __GST_OMX_SIMULCAST_SCALE_H__ */
@@ -54,38 +54,17 @@
 #include <string.h>
 
 #include "gstomxvideodec.h"
+#include "gstomxbufferpool.h"
 
 GST_DEBUG_CATEGORY_STATIC (gst_omx_video_dec_debug_category);
 #define GST_CAT_DEFAULT gst_omx_video_dec_debug_category
 
 #ifdef USE_OMX_TARGET_TEGRA
 #define DEFAULT_USE_OMXDEC_RES      FALSE
+/* Stride alignment of default GStreamer video frames */
+#define DEFAULT_STRIDE_ALIGN        4
 #endif
 
-typedef struct _GstOMXMemory GstOMXMemory;
-typedef struct _GstOMXMemoryAllocator GstOMXMemoryAllocator;
-typedef struct _GstOMXMemoryAllocatorClass GstOMXMemoryAllocatorClass;
-
-struct _GstOMXMemory
-{
-  GstMemory mem;
-
-  GstOMXBuffer *buf;
-};
-
-struct _GstOMXMemoryAllocator
-{
-  GstAllocator parent;
-};
-
-struct _GstOMXMemoryAllocatorClass
-{
-  GstAllocatorClass parent_class;
-};
-
-#define GST_OMX_MEMORY_TYPE "openmax"
-#define GST_OMX_SINK_MEMORY_TYPE "omxsink"
-
 #define DEFAULT_SKIP_FRAME_TYPE GST_DECODE_ALL
 #define GST_TYPE_OMX_VID_DEC_SKIP_FRAMES (gst_video_dec_skip_frames ())
 static GType
@@ -107,630 +86,49 @@ gst_video_dec_skip_frames (void)
   return qtype;
 }
 
-static GstMemory *
-gst_omx_memory_allocator_alloc_dummy (GstAllocator * allocator, gsize size,
-    GstAllocationParams * params)
-{
-  g_assert_not_reached ();
-  return NULL;
-}
-
-static void
-gst_omx_memory_allocator_free (GstAllocator * allocator, GstMemory * mem)
-{
-  GstOMXMemory *omem = (GstOMXMemory *) mem;
-
-  /* TODO: We need to remember which memories are still used
-   * so we can wait until everything is released before allocating
-   * new memory
-   */
-
-  g_slice_free (GstOMXMemory, omem);
-}
-
-static gpointer
-gst_omx_memory_map (GstMemory * mem, gsize maxsize, GstMapFlags flags)
-{
-  GstOMXMemory *omem = (GstOMXMemory *) mem;
-
-  return omem->buf->omx_buf->pBuffer + omem->mem.offset;
-}
-
-static void
-gst_omx_memory_unmap (GstMemory * mem)
-{
-}
-
-static GstMemory *
-gst_omx_memory_share (GstMemory * mem, gssize offset, gssize size)
-{
-  g_assert_not_reached ();
-  return NULL;
-}
-
-GType gst_omx_memory_allocator_get_type (void);
-G_DEFINE_TYPE (GstOMXMemoryAllocator, gst_omx_memory_allocator,
-    GST_TYPE_ALLOCATOR);
-
-#define GST_TYPE_OMX_MEMORY_ALLOCATOR   (gst_omx_memory_allocator_get_type())
-#define GST_IS_OMX_MEMORY_ALLOCATOR(obj) (G_TYPE_CHECK_INSTANCE_TYPE ((obj), GST_TYPE_OMX_MEMORY_ALLOCATOR))
-
-static void
-gst_omx_memory_allocator_class_init (GstOMXMemoryAllocatorClass * klass)
-{
-  GstAllocatorClass *allocator_class;
-
-  allocator_class = (GstAllocatorClass *) klass;
-
-  allocator_class->alloc = gst_omx_memory_allocator_alloc_dummy;
-  allocator_class->free = gst_omx_memory_allocator_free;
-}
-
-static void
-gst_omx_memory_allocator_init (GstOMXMemoryAllocator * allocator)
-{
-  GstAllocator *alloc = GST_ALLOCATOR_CAST (allocator);
-
-  alloc->mem_type = GST_OMX_MEMORY_TYPE;
-  alloc->mem_map = gst_omx_memory_map;
-  alloc->mem_unmap = gst_omx_memory_unmap;
-  alloc->mem_share = gst_omx_memory_share;
-
-  /* default copy & is_span */
-
-  GST_OBJECT_FLAG_SET (allocator, GST_ALLOCATOR_FLAG_CUSTOM_ALLOC);
-}
-
-static GstMemory *
-gst_omx_memory_allocator_alloc (GstAllocator * allocator, GstMemoryFlags flags,
-    GstOMXBuffer * buf)
-{
-  GstOMXMemory *mem;
-
-  /* FIXME: We don't allow sharing because we need to know
-   * when the memory becomes unused and can only then put
-   * it back to the pool. Which is done in the pool's release
-   * function
-   */
-  flags |= GST_MEMORY_FLAG_NO_SHARE;
-
-  mem = g_slice_new (GstOMXMemory);
-  /* the shared memory is always readonly */
-  gst_memory_init (GST_MEMORY_CAST (mem), flags, allocator, NULL,
-      buf->omx_buf->nAllocLen, buf->port->port_def.nBufferAlignment,
-      0, buf->omx_buf->nAllocLen);
-
-  mem->buf = buf;
-
-  return GST_MEMORY_CAST (mem);
-}
-
-/* Buffer pool for the buffers of an OpenMAX port.
- *
- * This pool is only used if we either passed buffers from another
- * pool to the OMX port or provide the OMX buffers directly to other
- * elements.
- *
- *
- * A buffer is in the pool if it is currently owned by the port,
- * i.e. after OMX_{Fill,Empty}ThisBuffer(). A buffer is outside
- * the pool after it was taken from the port after it was handled
- * by the port, i.e. {Empty,Fill}BufferDone.
- *
- * Buffers can be allocated by us (OMX_AllocateBuffer()) or allocated
- * by someone else and (temporarily) passed to this pool
- * (OMX_UseBuffer(), OMX_UseEGLImage()). In the latter case the pool of
- * the buffer will be overriden, and restored in free_buffer(). Other
- * buffers are just freed there.
- *
- * The pool always has a fixed number of minimum and maximum buffers
- * and these are allocated while starting the pool and released afterwards.
- * They correspond 1:1 to the OMX buffers of the port, which are allocated
- * before the pool is started.
- *
- * Acquiring a buffer from this pool happens after the OMX buffer has
- * been acquired from the port. gst_buffer_pool_acquire_buffer() is
- * supposed to return the buffer that corresponds to the OMX buffer.
- *
- * For buffers provided to upstream, the buffer will be passed to
- * the component manually when it arrives and then unreffed. If the
- * buffer is released before reaching the component it will be just put
- * back into the pool as if EmptyBufferDone has happened. If it was
- * passed to the component, it will be back into the pool when it was
- * released and EmptyBufferDone has happened.
- *
- * For buffers provided to downstream, the buffer will be returned
- * back to the component (OMX_FillThisBuffer()) when it is released.
- */
-
-static GQuark gst_omx_buffer_data_quark = 0;
-extern GQuark gst_omx_sink_data_quark;
-
-#define GST_OMX_BUFFER_POOL(pool) ((GstOMXBufferPool *) pool)
-typedef struct _GstOMXBufferPool GstOMXBufferPool;
-typedef struct _GstOMXBufferPoolClass GstOMXBufferPoolClass;
-
-struct _GstOMXBufferPool
-{
-  GstVideoBufferPool parent;
-
-  GstElement *element;
-
-  GstCaps *caps;
-  gboolean add_videometa;
-  GstVideoInfo video_info;
-
-  /* Owned by element, element has to stop this pool before
-   * it destroys component or port */
-  GstOMXComponent *component;
-  GstOMXPort *port;
-
-  /* For handling OpenMAX allocated memory */
-  GstAllocator *allocator;
-
-  /* Set from outside this pool */
-  /* TRUE if we're currently allocating all our buffers */
-  gboolean allocating;
-
-  /* TRUE if the pool is not used anymore */
-  gboolean deactivated;
-
-  /* For populating the pool from another one */
-  GstBufferPool *other_pool;
-  GPtrArray *buffers;
-
-  /* Used during acquire for output ports to
-   * specify which buffer has to be retrieved
-   * and during alloc, which buffer has to be
-   * wrapped
-   */
-  gint current_buffer_index;
-};
-
-struct _GstOMXBufferPoolClass
-{
-  GstVideoBufferPoolClass parent_class;
-};
-
-GType gst_omx_buffer_pool_get_type (void);
-
-G_DEFINE_TYPE (GstOMXBufferPool, gst_omx_buffer_pool, GST_TYPE_BUFFER_POOL);
-
-static void
-gst_omx_buffer_pool_free_buffer (GstBufferPool * bpool, GstBuffer * buffer);
-
+/* Gets the plane offsets and strides of the frames in the output port's
+ * buffers. Returns FALSE for unsupported formats */
 static gboolean
-gst_omx_buffer_pool_start (GstBufferPool * bpool)
+gst_omx_video_dec_get_output_layout (GstOMXVideoDec * self,
+    GstVideoFormat format, gsize offset[GST_VIDEO_MAX_PLANES],
+    gint stride[GST_VIDEO_MAX_PLANES])
 {
-  GstOMXBufferPool *pool = GST_OMX_BUFFER_POOL (bpool);
-
-  /* Only allow to start the pool if we still are attached
-   * to a component and port */
-  GST_OBJECT_LOCK (pool);
-  if (!pool->component || !pool->port) {
-    GST_OBJECT_UNLOCK (pool);
-    return FALSE;
-  }
-  GST_OBJECT_UNLOCK (pool);
-
-  return
-      GST_BUFFER_POOL_CLASS (gst_omx_buffer_pool_parent_class)->start (bpool);
-}
-
-static gboolean
-gst_omx_buffer_pool_stop (GstBufferPool * bpool)
-{
-  GstOMXBufferPool *pool = GST_OMX_BUFFER_POOL (bpool);
-  GstBuffer *buf;
-  guint i;
-
-  /* Remove any buffers that are there */
-  if (pool->buffers) {
-    for (i = 0; i < pool->buffers->len; i++) {
-      buf = g_ptr_array_index (pool->buffers, i);
-      gst_omx_buffer_pool_free_buffer (bpool, buf);
-    }
-    g_ptr_array_set_size (pool->buffers, 0);
-  }
-
-  if (pool->caps)
-    gst_caps_unref (pool->caps);
-  pool->caps = NULL;
-
-  pool->add_videometa = FALSE;
-
-  return GST_BUFFER_POOL_CLASS (gst_omx_buffer_pool_parent_class)->stop (bpool);
-}
-
-static const gchar **
-gst_omx_buffer_pool_get_options (GstBufferPool * bpool)
-{
-  static const gchar *raw_video_options[] =
-      { GST_BUFFER_POOL_OPTION_VIDEO_META, NULL };
-  static const gchar *options[] = { NULL };
-  GstOMXBufferPool *pool = GST_OMX_BUFFER_POOL (bpool);
-
-  GST_OBJECT_LOCK (pool);
-  if (pool->port && pool->port->port_def.eDomain == OMX_PortDomainVideo
-      && pool->port->port_def.format.video.eCompressionFormat ==
-      OMX_VIDEO_CodingUnused) {
-    GST_OBJECT_UNLOCK (pool);
-    return raw_video_options;
-  }
-  GST_OBJECT_UNLOCK (pool);
-
-  return options;
-}
-
-static gboolean
-gst_omx_buffer_pool_set_config (GstBufferPool * bpool, GstStructure * config)
-{
-  GstOMXBufferPool *pool = GST_OMX_BUFFER_POOL (bpool);
-  GstCaps *caps;
-
-  GST_OBJECT_LOCK (pool);
-
-  if (!gst_buffer_pool_config_get_params (config, &caps, NULL, NULL, NULL))
-    goto wrong_config;
-
-  if (caps == NULL)
-    goto no_caps;
-
-  if (pool->port && pool->port->port_def.eDomain == OMX_PortDomainVideo
-      && pool->port->port_def.format.video.eCompressionFormat ==
-      OMX_VIDEO_CodingUnused) {
-    GstVideoInfo info;
-
-    /* now parse the caps from the config */
-    if (!gst_video_info_from_caps (&info, caps))
-      goto wrong_video_caps;
-
-    /* enable metadata based on config of the pool */
-    pool->add_videometa =
-        gst_buffer_pool_config_has_option (config,
-        GST_BUFFER_POOL_OPTION_VIDEO_META);
-
-    pool->video_info = info;
-  }
-
-  if (pool->caps)
-    gst_caps_unref (pool->caps);
-  pool->caps = gst_caps_ref (caps);
-
-  GST_OBJECT_UNLOCK (pool);
-
-  return GST_BUFFER_POOL_CLASS (gst_omx_buffer_pool_parent_class)->set_config
-      (bpool, config);
-
-  /* ERRORS */
-wrong_config:
-  {
-    GST_OBJECT_UNLOCK (pool);
-    GST_WARNING_OBJECT (pool, "invalid config");
-    return FALSE;
-  }
-no_caps:
-  {
-    GST_OBJECT_UNLOCK (pool);
-    GST_WARNING_OBJECT (pool, "no caps in config");
-    return FALSE;
-  }
-wrong_video_caps:
+#ifdef USE_OMX_TARGET_TEGRA
   {
-    GST_OBJECT_UNLOCK (pool);
-    GST_WARNING_OBJECT (pool,
-        "failed getting geometry from caps %" GST_PTR_FORMAT, caps);
-    return FALSE;
-  }
-}
-
-static GstFlowReturn
-gst_omx_buffer_pool_alloc_buffer (GstBufferPool * bpool,
-    GstBuffer ** buffer, GstBufferPoolAcquireParams * params)
-{
-  GstOMXBufferPool *pool = GST_OMX_BUFFER_POOL (bpool);
-  GstBuffer *buf;
-  GstOMXBuffer *omx_buf;
-
-  g_return_val_if_fail (pool->allocating, GST_FLOW_ERROR);
-
-  omx_buf = g_ptr_array_index (pool->port->buffers, pool->current_buffer_index);
-  g_return_val_if_fail (omx_buf != NULL, GST_FLOW_ERROR);
-
-  if (pool->other_pool) {
-    guint i, n;
-
-    buf = g_ptr_array_index (pool->buffers, pool->current_buffer_index);
-    g_assert (pool->other_pool == buf->pool);
-    gst_object_replace ((GstObject **) & buf->pool, NULL);
-
-    n = gst_buffer_n_memory (buf);
-    for (i = 0; i < n; i++) {
-      GstMemory *mem = gst_buffer_peek_memory (buf, i);
-
-      /* FIXME: We don't allow sharing because we need to know
-       * when the memory becomes unused and can only then put
-       * it back to the pool. Which is done in the pool's release
-       * function
-       */
-      GST_MINI_OBJECT_FLAG_SET (mem, GST_MEMORY_FLAG_NO_SHARE);
-    }
-
-    if (pool->add_videometa) {
-      GstVideoMeta *meta;
-
-      meta = gst_buffer_get_video_meta (buf);
-      if (!meta) {
-        gst_buffer_add_video_meta (buf, GST_VIDEO_FRAME_FLAG_NONE,
-            GST_VIDEO_INFO_FORMAT (&pool->video_info),
-            GST_VIDEO_INFO_WIDTH (&pool->video_info),
-            GST_VIDEO_INFO_HEIGHT (&pool->video_info));
-      }
-    }
-  } else {
-    GstMemory *mem;
+    OMX_INDEXTYPE eIndex;
+    OMX_ERRORTYPE eError = OMX_ErrorUndefined;
 
-    mem = gst_omx_memory_allocator_alloc (pool->allocator, 0, omx_buf);
-    buf = gst_buffer_new ();
-    gst_buffer_append_memory (buf, mem);
-    g_ptr_array_add (pool->buffers, buf);
+    eError = OMX_GetExtensionIndex (self->dec->handle,
+        (OMX_STRING) NVX_INDEX_CONFIG_VIDEOPLANESINFO, &eIndex);
 
-    if (pool->add_videometa) {
-      gsize offset[4] = { 0, };
-      gint stride[4] = { 0, };
+    if (eError == OMX_ErrorNone) {
+      NVX_CONFIG_VIDEOPLANESINFO oInfo;
 
-#ifdef USE_OMX_TARGET_TEGRA
-      OMX_INDEXTYPE eIndex;
-      GstOMXVideoDec *self = (GstOMXVideoDec *) pool->element;
-      OMX_ERRORTYPE eError = OMX_ErrorUndefined;
+      GST_OMX_INIT_STRUCT (&oInfo);
 
-      eError = OMX_GetExtensionIndex (self->dec->handle,
-         (OMX_STRING) NVX_INDEX_CONFIG_VIDEOPLANESINFO, &eIndex);
+      eError = OMX_GetConfig (self->dec->handle, eIndex, &oInfo);
 
       if (eError == OMX_ErrorNone) {
-        NVX_CONFIG_VIDEOPLANESINFO oInfo;
-
-        GST_OMX_INIT_STRUCT (&oInfo);
-
-        eError = OMX_GetConfig (self->dec->handle, eIndex, &oInfo);
-
-        if (eError == OMX_ErrorNone) {
-          offset[0] = 0;
-          stride[0] = oInfo.nAlign[0][0];
-          offset[1] = oInfo.nAlign[0][0] * oInfo.nAlign[0][1];
+        /* nAlign[plane] is { pitch in samples, height in lines } */
+        offset[0] = 0;
+        stride[0] = oInfo.nAlign[0][0];
+        offset[1] = oInfo.nAlign[0][0] * oInfo.nAlign[0][1];
+        if (format == GST_VIDEO_FORMAT_NV12) {
+          /* Interleaved UV samples */
           stride[1] = oInfo.nAlign[1][0] << 1;
-          offset[2] = offset[1] + stride[1] * oInfo.nAlign[1][1];
-          stride[2] = oInfo.nAlign[2][0];
+        } else {
+          stride[1] = oInfo.nAlign[1][0];
         }
+        offset[2] = offset[1] + stride[1] * oInfo.nAlign[1][1];
+        stride[2] = oInfo.nAlign[2][0];
+        return TRUE;
       }
-
-      if (eError != OMX_ErrorNone)
-#endif
-        switch (pool->video_info.finfo->format) {
-          case GST_VIDEO_FORMAT_I420:
-            offset[0] = 0;
-            stride[0] = pool->port->port_def.format.video.nStride;
-            offset[1] =
-                stride[0] * pool->port->port_def.format.video.nSliceHeight;
-            stride[1] = pool->port->port_def.format.video.nStride / 2;
-            offset[2] =
-                offset[1] +
-                stride[1] * (pool->port->port_def.format.video.nSliceHeight /
-                2);
-            stride[2] = pool->port->port_def.format.video.nStride / 2;
-            break;
-          case GST_VIDEO_FORMAT_NV12:
-            offset[0] = 0;
-            stride[0] = pool->port->port_def.format.video.nStride;
-            offset[1] =
-                stride[0] * pool->port->port_def.format.video.nSliceHeight;
-            stride[1] = pool->port->port_def.format.video.nStride;
-            break;
-          default:
-            g_assert_not_reached ();
-            break;
-        }
-
-      gst_buffer_add_video_meta_full (buf, GST_VIDEO_FRAME_FLAG_NONE,
-          GST_VIDEO_INFO_FORMAT (&pool->video_info),
-          GST_VIDEO_INFO_WIDTH (&pool->video_info),
-          GST_VIDEO_INFO_HEIGHT (&pool->video_info),
-          GST_VIDEO_INFO_N_PLANES (&pool->video_info), offset, stride);
     }
   }
-
-  gst_mini_object_set_qdata (GST_MINI_OBJECT_CAST (buf),
-      gst_omx_buffer_data_quark, omx_buf, NULL);
-
-  *buffer = buf;
-
-  pool->current_buffer_index++;
-
-  return GST_FLOW_OK;
-}
-
-static void
-gst_omx_buffer_pool_free_buffer (GstBufferPool * bpool, GstBuffer * buffer)
-{
-  GstOMXBufferPool *pool = GST_OMX_BUFFER_POOL (bpool);
-
-  /* If the buffers belong to another pool, restore them now */
-  GST_OBJECT_LOCK (pool);
-  if (pool->other_pool) {
-    gst_object_replace ((GstObject **) & buffer->pool,
-        (GstObject *) pool->other_pool);
-  }
-  GST_OBJECT_UNLOCK (pool);
-
-  gst_mini_object_set_qdata (GST_MINI_OBJECT_CAST (buffer),
-      gst_omx_buffer_data_quark, NULL, NULL);
-
-  GST_BUFFER_POOL_CLASS (gst_omx_buffer_pool_parent_class)->free_buffer (bpool,
-      buffer);
-}
-
-static GstFlowReturn
-gst_omx_buffer_pool_acquire_buffer (GstBufferPool * bpool,
-    GstBuffer ** buffer, GstBufferPoolAcquireParams * params)
-{
-  GstFlowReturn ret;
-  GstOMXBufferPool *pool = GST_OMX_BUFFER_POOL (bpool);
-
-  if (pool->port->port_def.eDir == OMX_DirOutput) {
-    GstBuffer *buf;
-
-    g_return_val_if_fail (pool->current_buffer_index != -1, GST_FLOW_ERROR);
-
-    buf = g_ptr_array_index (pool->buffers, pool->current_buffer_index);
-    g_return_val_if_fail (buf != NULL, GST_FLOW_ERROR);
-    *buffer = buf;
-    ret = GST_FLOW_OK;
-
-    /* If it's our own memory we have to set the sizes */
-    if (!pool->other_pool) {
-      GstMemory *mem = gst_buffer_peek_memory (*buffer, 0);
-
-      g_assert (mem
-          && g_strcmp0 (mem->allocator->mem_type, GST_OMX_MEMORY_TYPE) == 0);
-      mem->size = ((GstOMXMemory *) mem)->buf->omx_buf->nFilledLen;
-      mem->offset = ((GstOMXMemory *) mem)->buf->omx_buf->nOffset;
-    } else {
-#ifdef USE_OMX_TARGET_TEGRA
-      GstMemory *mem = gst_buffer_peek_memory (buf, 0);
-      if (mem
-          && g_strcmp0 (mem->allocator->mem_type,
-              GST_OMX_SINK_MEMORY_TYPE) == 0) {
-        GstOMXBuffer *omxbuf =
-            gst_mini_object_get_qdata (GST_MINI_OBJECT_CAST (buf),
-            gst_omx_buffer_data_quark);
-        mem->size = omxbuf->omx_buf->nFilledLen;
-        mem->offset = omxbuf->omx_buf->nOffset;
-        omxbuf =
-            gst_mini_object_get_qdata (GST_MINI_OBJECT_CAST (buf),
-            gst_omx_sink_data_quark);
-        omxbuf->omx_buf->nFlags |= OMX_BUFFERFLAG_NV_BUFFER;
-      }
 #endif
-    }
-  } else {
-    /* Acquire any buffer that is available to be filled by upstream */
-    ret =
-        GST_BUFFER_POOL_CLASS (gst_omx_buffer_pool_parent_class)->acquire_buffer
-        (bpool, buffer, params);
-  }
-
-  return ret;
-}
-
-static void
-gst_omx_buffer_pool_release_buffer (GstBufferPool * bpool, GstBuffer * buffer)
-{
-  GstOMXBufferPool *pool = GST_OMX_BUFFER_POOL (bpool);
-  OMX_ERRORTYPE err;
-  GstOMXBuffer *omx_buf;
-
-  g_assert (pool->component && pool->port);
-
-  if (!pool->allocating && !pool->deactivated) {
-    omx_buf =
-        gst_mini_object_get_qdata (GST_MINI_OBJECT_CAST (buffer),
-        gst_omx_buffer_data_quark);
-    if (pool->port->port_def.eDir == OMX_DirOutput && !omx_buf->used) {
-      /* Release back to the port, can be filled again */
-      err = gst_omx_port_release_buffer (pool->port, omx_buf);
-      if (err != OMX_ErrorNone) {
-        GST_ELEMENT_ERROR (pool->element, LIBRARY, SETTINGS, (NULL),
-            ("Failed to relase output buffer to component: %s (0x%08x)",
-                gst_omx_error_to_string (err), err));
-      }
-    } else if (!omx_buf->used) {
-      /* TODO: Implement.
-       *
-       * If not used (i.e. was not passed to the component) this should do
-       * the same as EmptyBufferDone.
-       * If it is used (i.e. was passed to the component) this should do
-       * nothing until EmptyBufferDone.
-       *
-       * EmptyBufferDone should release the buffer to the pool so it can
-       * be allocated again
-       *
-       * Needs something to call back here in EmptyBufferDone, like keeping
-       * a ref on the buffer in GstOMXBuffer until EmptyBufferDone... which
-       * would ensure that the buffer is always unused when this is called.
-       */
-      g_assert_not_reached ();
-      GST_BUFFER_POOL_CLASS (gst_omx_buffer_pool_parent_class)->release_buffer
-          (bpool, buffer);
-    }
-  }
-}
-
-static void
-gst_omx_buffer_pool_finalize (GObject * object)
-{
-  GstOMXBufferPool *pool = GST_OMX_BUFFER_POOL (object);
-
-  if (pool->element)
-    gst_object_unref (pool->element);
-  pool->element = NULL;
-
-  if (pool->buffers)
-    g_ptr_array_unref (pool->buffers);
-  pool->buffers = NULL;
-
-  if (pool->other_pool)
-    gst_object_unref (pool->other_pool);
-  pool->other_pool = NULL;
-
-  if (pool->allocator)
-    gst_object_unref (pool->allocator);
-  pool->allocator = NULL;
-
-  if (pool->caps)
-    gst_caps_unref (pool->caps);
-  pool->caps = NULL;
-
-  G_OBJECT_CLASS (gst_omx_buffer_pool_parent_class)->finalize (object);
-}
-
-static void
-gst_omx_buffer_pool_class_init (GstOMXBufferPoolClass * klass)
-{
-  GObjectClass *gobject_class = (GObjectClass *) klass;
-  GstBufferPoolClass *gstbufferpool_class = (GstBufferPoolClass *) klass;
-
-  gst_omx_buffer_data_quark = g_quark_from_static_string ("GstOMXBufferData");
-
-  gobject_class->finalize = gst_omx_buffer_pool_finalize;
-  gstbufferpool_class->start = gst_omx_buffer_pool_start;
-  gstbufferpool_class->stop = gst_omx_buffer_pool_stop;
-  gstbufferpool_class->get_options = gst_omx_buffer_pool_get_options;
-  gstbufferpool_class->set_config = gst_omx_buffer_pool_set_config;
-  gstbufferpool_class->alloc_buffer = gst_omx_buffer_pool_alloc_buffer;
-  gstbufferpool_class->free_buffer = gst_omx_buffer_pool_free_buffer;
-  gstbufferpool_class->acquire_buffer = gst_omx_buffer_pool_acquire_buffer;
-  gstbufferpool_class->release_buffer = gst_omx_buffer_pool_release_buffer;
-}
-
-static void
-gst_omx_buffer_pool_init (GstOMXBufferPool * pool)
-{
-  pool->buffers = g_ptr_array_new ();
-  pool->allocator = g_object_new (gst_omx_memory_allocator_get_type (), NULL);
-}
-
-static GstBufferPool *
-gst_omx_buffer_pool_new (GstElement * element, GstOMXComponent * component,
-    GstOMXPort * port)
-{
-  GstOMXBufferPool *pool;
-
-  pool = g_object_new (gst_omx_buffer_pool_get_type (), NULL);
-  pool->element = gst_object_ref (element);
-  pool->component = component;
-  pool->port = port;
 
-  return GST_BUFFER_POOL (pool);
+  return gst_omx_buffer_pool_get_port_layout (self->dec_out_port, format,
+      offset, stride);
 }
 
 typedef struct _BufferIdentification BufferIdentification;
@@ -765,6 +163,8 @@ static GstFlowReturn gst_omx_video_dec_handle_frame (GstVideoDecoder * decoder,
 static GstFlowReturn gst_omx_video_dec_finish (GstVideoDecoder * decoder);
 static gboolean gst_omx_video_dec_decide_allocation (GstVideoDecoder * bdec,
     GstQuery * query);
+static gboolean gst_omx_video_dec_propose_allocation (GstVideoDecoder * bdec,
+    GstQuery * query);
 
 static GstFlowReturn gst_omx_video_dec_drain (GstOMXVideoDec * self,
     gboolean is_eos);
@@ -773,6 +173,9 @@ static OMX_ERRORTYPE gst_omx_video_dec_allocate_output_buffers (GstOMXVideoDec *
     self);
 static OMX_ERRORTYPE gst_omx_video_dec_deallocate_output_buffers (GstOMXVideoDec
     * self);
+static void gst_omx_video_dec_release_in_port_pool (GstOMXVideoDec * self);
+static OMX_ERRORTYPE gst_omx_video_dec_deallocate_in_port_buffers
+    (GstOMXVideoDec * self);
 
 enum
 {
@@ -905,6 +308,8 @@ gst_omx_video_dec_class_init (GstOMXVideoDecClass * klass)
   video_decoder_class->finish = GST_DEBUG_FUNCPTR (gst_omx_video_dec_finish);
   video_decoder_class->decide_allocation =
       GST_DEBUG_FUNCPTR (gst_omx_video_dec_decide_allocation);
+  video_decoder_class->propose_allocation =
+      GST_DEBUG_FUNCPTR (gst_omx_video_dec_propose_allocation);
 
   klass->cdata.type = GST_OMX_COMPONENT_TYPE_FILTER;
   klass->cdata.default_src_template_caps =
@@ -1082,7 +487,8 @@ gst_omx_video_dec_shutdown (GstOMXVideoDec * self)
     gst_omx_component_set_state (self->egl_render, OMX_StateLoaded);
     gst_omx_component_set_state (self->dec, OMX_StateLoaded);
 
-    gst_omx_port_deallocate_buffers (self->dec_in_port);
+    gst_omx_video_dec_release_in_port_pool (self);
+    gst_omx_video_dec_deallocate_in_port_buffers (self);
     gst_omx_video_dec_deallocate_output_buffers (self);
     gst_omx_component_close_tunnel (self->dec, self->dec_out_port,
         self->egl_render, self->egl_in_port);
@@ -1103,7 +509,8 @@ gst_omx_video_dec_shutdown (GstOMXVideoDec * self)
       gst_omx_component_get_state (self->dec, 5 * GST_SECOND);
     }
     gst_omx_component_set_state (self->dec, OMX_StateLoaded);
-    gst_omx_port_deallocate_buffers (self->dec_in_port);
+    gst_omx_video_dec_release_in_port_pool (self);
+    gst_omx_video_dec_deallocate_in_port_buffers (self);
     gst_omx_video_dec_deallocate_output_buffers (self);
     if (state > OMX_StateLoaded)
       gst_omx_component_get_state (self->dec, 5 * GST_SECOND);
@@ -1127,6 +534,9 @@ gst_omx_video_dec_close (GstVideoDecoder * decoder)
   if (self->dec)
     gst_omx_component_free (self->dec);
   self->dec = NULL;
+#ifdef USE_OMX_TARGET_TEGRA
+  self->hw_scaling = FALSE;
+#endif
 
 #if defined (USE_OMX_TARGET_RPI) && defined (HAVE_GST_GL)
   self->egl_in_port = NULL;
@@ -1318,6 +728,33 @@ _find_nearest_frame (GstOMXVideoDec * self, GstOMXBuffer * buf)
   return best;
 }
 
+/* TRUE if the buffer's GstVideoMeta describes the same frame layout as
+ * the output port's buffers, i.e. it can be filled with a single memcpy */
+static gboolean
+gst_omx_video_dec_layout_matches (GstOMXVideoDec * self, GstVideoInfo * vinfo,
+    GstBuffer * buffer)
+{
+  GstVideoMeta *meta;
+  gsize offset[GST_VIDEO_MAX_PLANES] = { 0, };
+  gint stride[GST_VIDEO_MAX_PLANES] = { 0, };
+  guint i;
+
+  meta = gst_buffer_get_video_meta (buffer);
+  if (!meta || gst_buffer_n_memory (buffer) != 1)
+    return FALSE;
+
+  if (!gst_omx_video_dec_get_output_layout (self, GST_VIDEO_INFO_FORMAT (vinfo),
+          offset, stride))
+    return FALSE;
+
+  for (i = 0; i < meta->n_planes; i++) {
+    if (meta->offset[i] != offset[i] || meta->stride[i] != stride[i])
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
 static gboolean
 gst_omx_video_dec_fill_buffer (GstOMXVideoDec * self,
     GstOMXBuffer * inbuf, GstBuffer * outbuf)
@@ -1328,9 +765,17 @@ gst_omx_video_dec_fill_buffer (GstOMXVideoDec * self,
   OMX_PARAM_PORTDEFINITIONTYPE *port_def = &self->dec_out_port->port_def;
   gboolean ret = FALSE;
   GstVideoFrame frame;
-
-  if (vinfo->width != port_def->format.video.nFrameWidth ||
-      vinfo->height != port_def->format.video.nFrameHeight) {
+  guint crop_x = 0, crop_y = 0;
+
+  if (vinfo->width == port_def->format.video.nFrameWidth &&
+      vinfo->height == port_def->format.video.nFrameHeight) {
+    /* Full frames */
+  } else if (vinfo->width == self->crop.nWidth &&
+      vinfo->height == self->crop.nHeight) {
+    /* Downstream can't crop, only copy the visible region */
+    crop_x = self->crop.nLeft;
+    crop_y = self->crop.nTop;
+  } else {
     GST_ERROR_OBJECT (self, "Resolution do not match: port=%ux%u vinfo=%dx%d",
         (guint) port_def->format.video.nFrameWidth,
         (guint) port_def->format.video.nFrameHeight,
@@ -1339,104 +784,70 @@ gst_omx_video_dec_fill_buffer (GstOMXVideoDec * self,
   }
 
   /* Same strides and everything */
-  if (gst_buffer_get_size (outbuf) == inbuf->omx_buf->nFilledLen) {
+  if (crop_x == 0 && crop_y == 0 &&
+      (gst_buffer_get_size (outbuf) == inbuf->omx_buf->nFilledLen
+          || gst_omx_video_dec_layout_matches (self, vinfo, outbuf))) {
     GstMapInfo map = GST_MAP_INFO_INIT;
 
     gst_buffer_map (outbuf, &map, GST_MAP_WRITE);
     memcpy (map.data,
         inbuf->omx_buf->pBuffer + inbuf->omx_buf->nOffset,
-        inbuf->omx_buf->nFilledLen);
+        MIN (map.size, inbuf->omx_buf->nFilledLen));
     gst_buffer_unmap (outbuf, &map);
     ret = TRUE;
     goto done;
   }
 
   /* Different strides */
-#ifdef USE_OMX_TARGET_TEGRA
-  /*TODO: get videoplanesinfo() for TEGRA, currently this path is not used */
-  return FALSE;
-#endif
-
   switch (vinfo->finfo->format) {
-    case GST_VIDEO_FORMAT_I420:{
+    case GST_VIDEO_FORMAT_I420:
+    case GST_VIDEO_FORMAT_NV12:{
+      gsize offset[GST_VIDEO_MAX_PLANES] = { 0, };
+      gint stride[GST_VIDEO_MAX_PLANES] = { 0, };
       gint i, j, height, width;
       guint8 *src, *dest;
       gint src_stride, dest_stride;
 
-      gst_video_frame_map (&frame, vinfo, outbuf, GST_MAP_WRITE);
-      for (i = 0; i < 3; i++) {
-        if (i == 0) {
-          src_stride = port_def->format.video.nStride;
-          dest_stride = GST_VIDEO_FRAME_COMP_STRIDE (&frame, i);
-
-          /* XXX: Try this if no stride was set */
-          if (src_stride == 0)
-            src_stride = dest_stride;
-        } else {
-          src_stride = port_def->format.video.nStride / 2;
-          dest_stride = GST_VIDEO_FRAME_COMP_STRIDE (&frame, i);
-
-          /* XXX: Try this if no stride was set */
-          if (src_stride == 0)
-            src_stride = dest_stride;
-        }
-
-        src = inbuf->omx_buf->pBuffer + inbuf->omx_buf->nOffset;
-        if (i > 0)
-          src +=
-              port_def->format.video.nSliceHeight *
-              port_def->format.video.nStride;
-        if (i == 2)
-          src +=
-              (port_def->format.video.nSliceHeight / 2) *
-              (port_def->format.video.nStride / 2);
-
-        dest = GST_VIDEO_FRAME_COMP_DATA (&frame, i);
-        height = GST_VIDEO_FRAME_COMP_HEIGHT (&frame, i);
-        width = GST_VIDEO_FRAME_COMP_WIDTH (&frame, i);
-
-        for (j = 0; j < height; j++) {
-          memcpy (dest, src, width);
-          src += src_stride;
-          dest += dest_stride;
-        }
+      if (!gst_omx_video_dec_get_output_layout (self,
+              GST_VIDEO_INFO_FORMAT (vinfo), offset, stride)) {
+        GST_ERROR_OBJECT (self, "Unknown output layout");
+        goto done;
       }
-      gst_video_frame_unmap (&frame);
-      ret = TRUE;
-      break;
-    }
-    case GST_VIDEO_FORMAT_NV12:{
-      gint i, j, height, width;
-      guint8 *src, *dest;
-      gint src_stride, dest_stride;
 
       gst_video_frame_map (&frame, vinfo, outbuf, GST_MAP_WRITE);
-      for (i = 0; i < 2; i++) {
-        if (i == 0) {
-          src_stride = port_def->format.video.nStride;
-          dest_stride = GST_VIDEO_FRAME_COMP_STRIDE (&frame, i);
-
-          /* XXX: Try this if no stride was set */
-          if (src_stride == 0)
-            src_stride = dest_stride;
-        } else {
-          src_stride = port_def->format.video.nStride;
-          dest_stride = GST_VIDEO_FRAME_COMP_STRIDE (&frame, i);
+      for (i = 0; i < GST_VIDEO_FRAME_N_PLANES (&frame); i++) {
+        src_stride = stride[i];
+        dest_stride = GST_VIDEO_FRAME_PLANE_STRIDE (&frame, i);
+
+        /* XXX: Try this if no stride was set */
+        if (src_stride == 0)
+          src_stride = dest_stride;
+
+        src = inbuf->omx_buf->pBuffer + inbuf->omx_buf->nOffset + offset[i];
+        if (i == 0)
+          src += crop_y * src_stride + crop_x;
+        else if (vinfo->finfo->format == GST_VIDEO_FORMAT_NV12)
+          src += (crop_y / 2) * src_stride + crop_x;
+        else
+          src += (crop_y / 2) * src_stride + crop_x / 2;
+
+        dest = GST_VIDEO_FRAME_PLANE_DATA (&frame, i);
+        height = GST_VIDEO_FRAME_COMP_HEIGHT (&frame, i);
+        width = GST_VIDEO_FRAME_COMP_WIDTH (&frame, i) *
+            GST_VIDEO_FRAME_COMP_PSTRIDE (&frame, i);
 
-          /* XXX: Try this if no stride was set */
-          if (src_stride == 0)
-            src_stride = dest_stride;
+        if (src + (height - 1) * src_stride + width >
+            inbuf->omx_buf->pBuffer + inbuf->omx_buf->nAllocLen) {
+          GST_ERROR_OBJECT (self, "Plane %d exceeds the output buffer", i);
+          gst_video_frame_unmap (&frame);
+          goto done;
         }
 
-        src = inbuf->omx_buf->pBuffer + inbuf->omx_buf->nOffset;
-        if (i == 1)
-          src +=
-              port_def->format.video.nSliceHeight *
-              port_def->format.video.nStride;
-
-        dest = GST_VIDEO_FRAME_COMP_DATA (&frame, i);
-        height = GST_VIDEO_FRAME_COMP_HEIGHT (&frame, i);
-        width = GST_VIDEO_FRAME_COMP_WIDTH (&frame, i) * (i == 0 ? 1 : 2);
+        /* Only the padding differs, copy the whole plane at once */
+        if (src_stride == dest_stride) {
+          memcpy (dest, src, (height - 1) * src_stride + width);
+          continue;
+        }
 
         for (j = 0; j < height; j++) {
           memcpy (dest, src, width);
@@ -1471,6 +882,126 @@ done:
   return ret;
 }
 
+/* Queries the visible region of the output frames from the component.
+ * Returns TRUE if it changed */
+static gboolean
+gst_omx_video_dec_update_crop (GstOMXVideoDec * self)
+{
+  OMX_PARAM_PORTDEFINITIONTYPE *port_def = &self->dec_out_port->port_def;
+  OMX_U32 frame_width = port_def->format.video.nFrameWidth;
+  OMX_U32 frame_height = port_def->format.video.nFrameHeight;
+  OMX_CONFIG_RECTTYPE rect;
+  OMX_ERRORTYPE err;
+  gboolean changed;
+
+  GST_OMX_INIT_STRUCT (&rect);
+  rect.nPortIndex = self->dec_out_port->index;
+
+  err =
+      gst_omx_component_get_config (self->dec,
+      OMX_IndexConfigCommonOutputCrop, &rect);
+  if (err != OMX_ErrorNone || rect.nLeft < 0 || rect.nTop < 0
+      || rect.nWidth == 0 || rect.nHeight == 0
+      || rect.nLeft + rect.nWidth > frame_width
+      || rect.nTop + rect.nHeight > frame_height) {
+    rect.nLeft = 0;
+    rect.nTop = 0;
+    rect.nWidth = frame_width;
+    rect.nHeight = frame_height;
+  }
+
+  /* Chroma planes can only be cropped at even offsets */
+  rect.nLeft &= ~1;
+  rect.nTop &= ~1;
+
+  changed = rect.nLeft != self->crop.nLeft || rect.nTop != self->crop.nTop
+      || rect.nWidth != self->crop.nWidth
+      || rect.nHeight != self->crop.nHeight;
+
+  if (changed)
+    GST_DEBUG_OBJECT (self, "Crop is now %dx%d at %d,%d of %ux%u",
+        (gint) rect.nWidth, (gint) rect.nHeight, (gint) rect.nLeft,
+        (gint) rect.nTop, (guint) frame_width, (guint) frame_height);
+
+  self->crop = rect;
+
+  return changed;
+}
+
+/* Makes sure the output caps match the crop: full frames if downstream
+ * crops itself or gets our buffers, otherwise the visible region only.
+ * Only renegotiates if that changes the output size, crop meta support
+ * is known from the last allocation query.
+ * NOTE: Call with the stream lock */
+static gboolean
+gst_omx_video_dec_negotiate_crop (GstOMXVideoDec * self)
+{
+  OMX_PARAM_PORTDEFINITIONTYPE *port_def = &self->dec_out_port->port_def;
+  GstVideoCodecState *state;
+  GstVideoFormat format;
+  guint width, height;
+  gboolean ret = TRUE;
+
+  state = gst_video_decoder_get_output_state (GST_VIDEO_DECODER (self));
+  if (!state)
+    return TRUE;
+
+  self->crop_meta_negotiated = self->have_crop_meta;
+  if (self->have_crop_meta || self->out_port_pool) {
+    width = port_def->format.video.nFrameWidth;
+    height = port_def->format.video.nFrameHeight;
+  } else {
+    width = self->crop.nWidth;
+    height = self->crop.nHeight;
+  }
+
+  if (GST_VIDEO_INFO_WIDTH (&state->info) == width
+      && GST_VIDEO_INFO_HEIGHT (&state->info) == height) {
+    gst_video_codec_state_unref (state);
+    return TRUE;
+  }
+
+  format = GST_VIDEO_INFO_FORMAT (&state->info);
+  gst_video_codec_state_unref (state);
+
+  GST_DEBUG_OBJECT (self, "Setting output state for crop: %ux%u", width,
+      height);
+
+  state = gst_video_decoder_set_output_state (GST_VIDEO_DECODER (self),
+      format, width, height, self->input_state);
+  if (!gst_video_decoder_negotiate (GST_VIDEO_DECODER (self)))
+    ret = FALSE;
+  gst_video_codec_state_unref (state);
+
+  return ret;
+}
+
+static void
+gst_omx_video_dec_set_crop_meta (GstOMXVideoDec * self, GstBuffer * buffer)
+{
+  OMX_PARAM_PORTDEFINITIONTYPE *port_def = &self->dec_out_port->port_def;
+  GstVideoCropMeta *crop_meta;
+
+  if (!self->have_crop_meta)
+    return;
+
+  crop_meta = gst_buffer_get_video_crop_meta (buffer);
+  if (!crop_meta) {
+    /* Nothing to crop */
+    if (self->crop.nLeft == 0 && self->crop.nTop == 0
+        && self->crop.nWidth == port_def->format.video.nFrameWidth
+        && self->crop.nHeight == port_def->format.video.nFrameHeight)
+      return;
+
+    crop_meta = gst_buffer_add_video_crop_meta (buffer);
+  }
+
+  crop_meta->x = self->crop.nLeft;
+  crop_meta->y = self->crop.nTop;
+  crop_meta->width = self->crop.nWidth;
+  crop_meta->height = self->crop.nHeight;
+}
+
 static gfloat y_invert_matrix[] = {
   1.0, 0.0, 0.0, 0.0,
   0.0, -1.0, 0.0, 1.0,
@@ -1557,9 +1088,12 @@ gst_omx_video_dec_allocate_output_buffers (GstOMXVideoDec * self)
   }
 #endif
 
-  if (caps)
+  if (caps) {
     self->out_port_pool =
         gst_omx_buffer_pool_new (GST_ELEMENT_CAST (self), self->dec, port);
+    GST_OMX_BUFFER_POOL (self->out_port_pool)->get_layout =
+        (GstOMXBufferPoolLayoutFunc) gst_omx_video_dec_get_output_layout;
+  }
 
 #if defined (USE_OMX_TARGET_RPI) && defined (HAVE_GST_GL)
   if (eglimage) {
@@ -1972,21 +1506,153 @@ gst_omx_video_dec_allocate_output_buffers (GstOMXVideoDec * self)
     self->out_port_pool = NULL;
   }
 
-done:
-  if (!self->out_port_pool && err == OMX_ErrorNone)
-    GST_DEBUG_OBJECT (self,
-        "Not using our internal pool and copying buffers for downstream");
+done:
+  if (!self->out_port_pool && err == OMX_ErrorNone)
+    GST_DEBUG_OBJECT (self,
+        "Not using our internal pool and copying buffers for downstream");
+
+  if (caps)
+    gst_caps_unref (caps);
+  if (pool)
+    gst_object_unref (pool);
+  if (state)
+    gst_video_codec_state_unref (state);
+
+  return err;
+}
+
+/* Stops handing out the input port's buffers to upstream when shutting
+ * down, buffers that upstream still holds are not returned anymore */
+static void
+gst_omx_video_dec_release_in_port_pool (GstOMXVideoDec * self)
+{
+  if (self->in_port_pool) {
+    GST_OMX_BUFFER_POOL (self->in_port_pool)->deactivated = TRUE;
+    gst_buffer_pool_set_active (self->in_port_pool, FALSE);
+    gst_object_unref (self->in_port_pool);
+    self->in_port_pool = NULL;
+  }
+  self->in_port_pool_dropped = FALSE;
+}
+
+/* Stops handing out the input port's buffers to upstream before they
+ * are reallocated and asks upstream to renegotiate its allocation.
+ * Buffers that upstream still holds are put back to the port right
+ * away, so only the ones the component owns are waited for. They keep
+ * our memory and are freed whenever upstream releases them */
+static void
+gst_omx_video_dec_drop_in_port_pool (GstOMXVideoDec * self)
+{
+  GstOMXPort *port = self->dec_in_port;
+  guint i;
+
+  if (!self->in_port_pool)
+    return;
+
+  GST_DEBUG_OBJECT (self, "Dropping input port pool");
+
+  GST_OMX_BUFFER_POOL (self->in_port_pool)->deactivated = TRUE;
+  for (i = 0; i < port->buffers->len; i++)
+    gst_omx_port_return_buffer (port, g_ptr_array_index (port->buffers, i));
+
+  gst_buffer_pool_set_active (self->in_port_pool, FALSE);
+  gst_object_unref (self->in_port_pool);
+  self->in_port_pool = NULL;
+  self->in_port_pool_dropped = TRUE;
+
+  gst_pad_push_event (GST_VIDEO_DECODER_SINK_PAD (self),
+      gst_event_new_reconfigure ());
+}
+
+/* Allocates the input port's buffers from our own memory, so that
+ * upstream can keep buffers of the pool after the port's buffers are
+ * freed. Falls back to buffers allocated by the component, which are
+ * not shared with upstream */
+static OMX_ERRORTYPE
+gst_omx_video_dec_allocate_in_port_buffers (GstOMXVideoDec * self)
+{
+  GstOMXPort *port = self->dec_in_port;
+  GstAllocationParams params;
+  GList *data = NULL;
+  OMX_ERRORTYPE err;
+  guint i, n;
+
+  g_assert (self->in_port_memories == NULL);
+
+  err = gst_omx_port_update_port_definition (port, NULL);
+  if (err != OMX_ErrorNone)
+    return err;
+
+  gst_allocation_params_init (&params);
+  if (port->port_def.nBufferAlignment)
+    params.align = port->port_def.nBufferAlignment - 1;
+
+  n = port->port_def.nBufferCountActual;
+  self->in_port_memories =
+      g_ptr_array_new_with_free_func ((GDestroyNotify) gst_memory_unref);
+  for (i = 0; i < n; i++) {
+    GstMemory *mem;
+    GstMapInfo map;
+
+    mem = gst_allocator_alloc (NULL, port->port_def.nBufferSize, &params);
+    if (!mem || !gst_memory_map (mem, &map, GST_MAP_READWRITE)) {
+      if (mem)
+        gst_memory_unref (mem);
+      err = OMX_ErrorInsufficientResources;
+      goto fallback;
+    }
+    data = g_list_append (data, map.data);
+    gst_memory_unmap (mem, &map);
+    g_ptr_array_add (self->in_port_memories, mem);
+  }
+
+  err = gst_omx_port_use_buffers (port, data);
+  if (err != OMX_ErrorNone)
+    goto fallback;
+
+  g_list_free (data);
+
+  return OMX_ErrorNone;
+
+fallback:
+  {
+    GST_INFO_OBJECT (self, "Component can't use our input buffers: "
+        "%s (0x%08x)", gst_omx_error_to_string (err), err);
+    g_list_free (data);
+    g_ptr_array_unref (self->in_port_memories);
+    self->in_port_memories = NULL;
+
+    return gst_omx_port_allocate_buffers (port);
+  }
+}
+
+static OMX_ERRORTYPE
+gst_omx_video_dec_deallocate_in_port_buffers (GstOMXVideoDec * self)
+{
+  OMX_ERRORTYPE err;
 
-  if (caps)
-    gst_caps_unref (caps);
-  if (pool)
-    gst_object_unref (pool);
-  if (state)
-    gst_video_codec_state_unref (state);
+  err = gst_omx_port_deallocate_buffers (self->dec_in_port);
+
+  /* Pool buffers that upstream holds keep their memory */
+  if (self->in_port_memories)
+    g_ptr_array_unref (self->in_port_memories);
+  self->in_port_memories = NULL;
 
   return err;
 }
 
+/* Lets upstream get a pool of the reallocated input port buffers */
+static void
+gst_omx_video_dec_offer_in_port_pool (GstOMXVideoDec * self)
+{
+  if (!self->in_port_pool_dropped)
+    return;
+
+  self->in_port_pool_dropped = FALSE;
+  gst_pad_push_event (GST_VIDEO_DECODER_SINK_PAD (self),
+      gst_event_new_reconfigure ());
+}
+
 static OMX_ERRORTYPE
 gst_omx_video_dec_deallocate_output_buffers (GstOMXVideoDec * self)
 {
@@ -2080,6 +1746,187 @@ done:
 }
 #endif
 
+#ifdef USE_OMX_TARGET_TEGRA
+/* Returns TRUE and the size downstream wants if it can't take the native
+ * size of the stream, so that the component can scale for us */
+static gboolean
+gst_omx_video_dec_get_downstream_size (GstOMXVideoDec * self,
+    GstVideoFormat format, guint width, guint height, guint * out_width,
+    guint * out_height)
+{
+  GstCaps *templ_caps, *peer_caps, *native_caps;
+  GstStructure *s;
+  gint w = 0, h = 0;
+  gboolean ret = FALSE;
+
+  templ_caps = gst_pad_get_pad_template_caps (GST_VIDEO_DECODER_SRC_PAD (self));
+  peer_caps =
+      gst_pad_peer_query_caps (GST_VIDEO_DECODER_SRC_PAD (self), templ_caps);
+  gst_caps_unref (templ_caps);
+
+  if (!peer_caps || gst_caps_is_empty (peer_caps)
+      || gst_caps_is_any (peer_caps))
+    goto done;
+
+  /* Keeps the caps features, downstream usually wants NVMM memory */
+  native_caps = gst_caps_copy (peer_caps);
+  gst_caps_set_simple (native_caps,
+      "width", G_TYPE_INT, (gint) width,
+      "height", G_TYPE_INT, (gint) height, NULL);
+  if (gst_caps_can_intersect (peer_caps, native_caps)) {
+    gst_caps_unref (native_caps);
+    goto done;
+  }
+  gst_caps_unref (native_caps);
+
+  peer_caps = gst_caps_truncate (peer_caps);
+  peer_caps = gst_caps_make_writable (peer_caps);
+  s = gst_caps_get_structure (peer_caps, 0);
+
+  if (!gst_structure_has_field (s, "width")
+      || !gst_structure_has_field (s, "height"))
+    goto done;
+
+  gst_structure_fixate_field_nearest_int (s, "width", width);
+  gst_structure_fixate_field_nearest_int (s, "height", height);
+
+  if (!gst_structure_get_int (s, "width", &w)
+      || !gst_structure_get_int (s, "height", &h) || w <= 0 || h <= 0)
+    goto done;
+
+  /* NV12 and I420 need even dimensions */
+  *out_width = GST_ROUND_UP_2 (w);
+  *out_height = GST_ROUND_UP_2 (h);
+  if (*out_width == width && *out_height == height)
+    goto done;
+  ret = TRUE;
+
+  GST_DEBUG_OBJECT (self, "Downstream wants %ux%u %s instead of %ux%u",
+      *out_width, *out_height, gst_video_format_to_string (format), width,
+      height);
+
+done:
+  if (peer_caps)
+    gst_caps_unref (peer_caps);
+
+  return ret;
+}
+
+/* Configures the 2D processing stage of the output port to scale the decoded
+ * frames to width x height, or disables it if either is 0.
+ * NOTE: Call with the output port disabled */
+static OMX_ERRORTYPE
+gst_omx_video_dec_set_output_scaling (GstOMXVideoDec * self,
+    OMX_PARAM_PORTDEFINITIONTYPE * port_def, guint width, guint height)
+{
+  NVX_CONFIG_VIDEO2DPROCESSING proc;
+  OMX_INDEXTYPE eIndex;
+  OMX_ERRORTYPE err;
+  guint src_width = port_def->format.video.nFrameWidth;
+  guint src_height = port_def->format.video.nFrameHeight;
+
+  err = gst_omx_component_get_index (self->dec,
+      (char *) NVX_INDEX_CONFIG_VIDEO2DPROC, &eIndex);
+  if (err != OMX_ErrorNone) {
+    GST_DEBUG_OBJECT (self, "Component doesn't support 2D processing");
+    return err;
+  }
+
+  GST_OMX_INIT_STRUCT (&proc);
+  proc.nPortIndex = self->dec_out_port->index;
+
+  if (width && height) {
+    proc.nSetupFlags = NVX_V2DPROC_FLAG_SOURCERECTANGLE |
+        NVX_V2DPROC_FLAG_DESTINATIONRECTANGLE | NVX_V2DPROC_FLAG_SCALEOPTIONS;
+    proc.nScaleOption = NVX_V2DPROC_VIDEOSCALE_STRETCH;
+    proc.nSrcWidth = src_width;
+    proc.nSrcHeight = src_height;
+    proc.nDstWidth = width;
+    proc.nDstHeight = height;
+  }
+
+  err = gst_omx_component_set_config (self->dec, eIndex, &proc);
+  if (err != OMX_ErrorNone) {
+    GST_WARNING_OBJECT (self, "Failed to configure 2D processing: %s (0x%08x)",
+        gst_omx_error_to_string (err), err);
+    return err;
+  }
+
+  if (!width || !height) {
+    if (!self->hw_scaling)
+      return OMX_ErrorNone;
+
+    /* The port may still describe the scaled frames. If it reports
+     * another size, the stream changed resolution and that is the new
+     * native size */
+    gst_omx_port_get_port_definition (self->dec_out_port, port_def);
+    if (port_def->format.video.nFrameWidth == self->scaled_width
+        && port_def->format.video.nFrameHeight == self->scaled_height) {
+      port_def->format.video.nFrameWidth = self->native_width;
+      port_def->format.video.nFrameHeight = self->native_height;
+      port_def->format.video.nStride = 0;
+      port_def->format.video.nSliceHeight = 0;
+      gst_omx_port_update_port_definition (self->dec_out_port, port_def);
+      gst_omx_port_get_port_definition (self->dec_out_port, port_def);
+    }
+
+    GST_DEBUG_OBJECT (self, "Stopped scaling, output is %ux%u",
+        (guint) port_def->format.video.nFrameWidth,
+        (guint) port_def->format.video.nFrameHeight);
+    self->hw_scaling = FALSE;
+    return OMX_ErrorNone;
+  }
+
+  port_def->format.video.nFrameWidth = width;
+  port_def->format.video.nFrameHeight = height;
+  port_def->format.video.nStride = 0;
+  port_def->format.video.nSliceHeight = 0;
+  gst_omx_port_update_port_definition (self->dec_out_port, port_def);
+  gst_omx_port_get_port_definition (self->dec_out_port, port_def);
+
+  if (port_def->format.video.nFrameWidth != width
+      || port_def->format.video.nFrameHeight != height) {
+    GST_WARNING_OBJECT (self, "Component refused to scale to %ux%u", width,
+        height);
+    proc.nSetupFlags = 0;
+    gst_omx_component_set_config (self->dec, eIndex, &proc);
+    gst_omx_port_get_port_definition (self->dec_out_port, port_def);
+    self->hw_scaling = FALSE;
+    return OMX_ErrorUnsupportedSetting;
+  }
+
+  GST_INFO_OBJECT (self, "Scaling %ux%u to %ux%u in the component", src_width,
+      src_height, width, height);
+  self->hw_scaling = TRUE;
+  self->native_width = src_width;
+  self->native_height = src_height;
+  self->scaled_width = width;
+  self->scaled_height = height;
+
+  return OMX_ErrorNone;
+}
+
+/* Turns scaling off when the component stops, the next stream
+ * configures the output port from its own size again */
+static void
+gst_omx_video_dec_stop_output_scaling (GstOMXVideoDec * self)
+{
+  NVX_CONFIG_VIDEO2DPROCESSING proc;
+  OMX_INDEXTYPE eIndex;
+
+  if (self->hw_scaling && gst_omx_component_get_index (self->dec,
+          (char *) NVX_INDEX_CONFIG_VIDEO2DPROC, &eIndex) == OMX_ErrorNone) {
+    GST_OMX_INIT_STRUCT (&proc);
+    proc.nPortIndex = self->dec_out_port->index;
+    gst_omx_component_set_config (self->dec, eIndex, &proc);
+  }
+
+  self->hw_scaling = FALSE;
+  self->native_width = self->native_height = 0;
+  self->scaled_width = self->scaled_height = 0;
+}
+#endif
+
 static OMX_ERRORTYPE
 gst_omx_video_dec_reconfigure_output_port (GstOMXVideoDec * self)
 {
@@ -2305,6 +2152,20 @@ gst_omx_video_dec_reconfigure_output_port (GstOMXVideoDec * self)
   }
 
 #ifdef USE_OMX_TARGET_TEGRA
+  {
+    guint scaled_width, scaled_height;
+
+    /* Start from the native size again, downstream might have changed */
+    if (self->hw_scaling)
+      gst_omx_video_dec_set_output_scaling (self, &port_def, 0, 0);
+
+    if (gst_omx_video_dec_get_downstream_size (self, format,
+            port_def.format.video.nFrameWidth,
+            port_def.format.video.nFrameHeight, &scaled_width, &scaled_height))
+      gst_omx_video_dec_set_output_scaling (self, &port_def, scaled_width,
+          scaled_height);
+  }
+
   if (!self->use_omxdec_res) {
     OMX_INDEXTYPE eIndex;
     OMX_ERRORTYPE eError;
@@ -2326,6 +2187,14 @@ gst_omx_video_dec_reconfigure_output_port (GstOMXVideoDec * self)
         GST_OMX_INIT_STRUCT (&iport_def);
         gst_omx_port_get_port_definition (iport, &iport_def);
 
+        /* Planes are laid out for the scaled size if the component scales */
+        if (self->hw_scaling) {
+          iport_def.format.video.nFrameWidth =
+              port_def.format.video.nFrameWidth;
+          iport_def.format.video.nFrameHeight =
+              port_def.format.video.nFrameHeight;
+        }
+
         if (iport_def.format.video.nFrameWidth &&
             iport_def.format.video.nFrameHeight) {
           switch (format) {
@@ -2342,6 +2211,20 @@ gst_omx_video_dec_reconfigure_output_port (GstOMXVideoDec * self)
                   oInfo.nAlign[0][0] * oInfo.nAlign[0][1] +
                   oInfo.nAlign[1][0] * oInfo.nAlign[1][1];
               break;
+            case GST_VIDEO_FORMAT_I420:
+              oInfo.nAlign[0][0] =
+                  GST_ROUND_UP_4 (iport_def.format.video.nFrameWidth);
+              oInfo.nAlign[0][1] =
+                  GST_ROUND_UP_2 (iport_def.format.video.nFrameHeight);
+              oInfo.nAlign[1][0] = oInfo.nAlign[2][0] =
+                  GST_ROUND_UP_4 (GST_ROUND_UP_2
+                  (iport_def.format.video.nFrameWidth) / 2);
+              oInfo.nAlign[1][1] = oInfo.nAlign[2][1] =
+                  (GST_ROUND_UP_2 (iport_def.format.video.nFrameHeight)) >> 1;
+              frame_size =
+                  oInfo.nAlign[0][0] * oInfo.nAlign[0][1] +
+                  2 * oInfo.nAlign[1][0] * oInfo.nAlign[1][1];
+              break;
             default:
               eError = OMX_ErrorUnsupportedSetting;
               break;
@@ -2363,6 +2246,21 @@ gst_omx_video_dec_reconfigure_output_port (GstOMXVideoDec * self)
       g_warning ("omxvideodec: failed to set output video alignment %x",
           eError);
 
+  } else {
+    OMX_INDEXTYPE eIndex;
+    NVX_CONFIG_VIDEO_STRIDEALIGN stride_align;
+
+    /* Keep the component's resolution but ask for the stride alignment
+     * of the downstream pool's frames, so that the layouts can match */
+    if (gst_omx_component_get_index (self->dec,
+            (char *) NVX_INDEX_CONFIG_VIDEOSTRIDEALIGN,
+            &eIndex) == OMX_ErrorNone) {
+      GST_OMX_INIT_STRUCT (&stride_align);
+      stride_align.nAlign = self->stride_align;
+      if (gst_omx_component_set_config (self->dec, eIndex,
+              &stride_align) == OMX_ErrorNone)
+        gst_omx_port_get_port_definition (port, &port_def);
+    }
   }
 #endif
 
@@ -2375,6 +2273,22 @@ gst_omx_video_dec_reconfigure_output_port (GstOMXVideoDec * self)
   state = gst_video_decoder_set_output_state (GST_VIDEO_DECODER (self),
       format, port_def.format.video.nFrameWidth,
       port_def.format.video.nFrameHeight, self->input_state);
+#ifdef USE_OMX_TARGET_TEGRA
+  /* Keep the display aspect ratio if the component stretches the frames */
+  if (self->hw_scaling && self->input_state
+      && self->input_state->info.width && self->input_state->info.height) {
+    GstVideoInfo *in_info = &self->input_state->info;
+    gint par_n, par_d;
+
+    if (gst_util_fraction_multiply (in_info->par_n, in_info->par_d,
+            in_info->width * (gint) port_def.format.video.nFrameHeight,
+            in_info->height * (gint) port_def.format.video.nFrameWidth,
+            &par_n, &par_d)) {
+      state->info.par_n = par_n;
+      state->info.par_d = par_d;
+    }
+  }
+#endif
 #if defined (USE_OMX_TARGET_TEGRA) && defined (HAVE_GST_GL)
   {
     nv_buf = gst_omx_video_dec_negotiate_nv_caps (self, state);
@@ -2470,6 +2384,7 @@ gst_omx_video_dec_loop (GstOMXVideoDec * self)
     GstVideoFormat format;
 
     GST_DEBUG_OBJECT (self, "Port settings have changed, updating caps");
+    self->update_crop = TRUE;
 
     /* Reallocate all buffers */
     if (acq_return == GST_OMX_ACQUIRE_BUFFER_RECONFIGURE
@@ -2576,6 +2491,23 @@ gst_omx_video_dec_loop (GstOMXVideoDec * self)
       (guint) buf->omx_buf->nFlags, (guint64) buf->omx_buf->nTimeStamp);
 
   GST_VIDEO_DECODER_STREAM_LOCK (self);
+
+  /* Also when downstream changed its crop meta support while
+   * renegotiating on a reconfigure event */
+  if (self->update_crop || self->dec_out_port->crop_changed
+      || self->crop_meta_negotiated != self->have_crop_meta) {
+    gboolean update_crop = self->update_crop
+        || self->crop_meta_negotiated != self->have_crop_meta;
+
+    self->update_crop = FALSE;
+    self->dec_out_port->crop_changed = FALSE;
+    if ((gst_omx_video_dec_update_crop (self) || update_crop)
+        && !gst_omx_video_dec_negotiate_crop (self)) {
+      gst_omx_port_release_buffer (port, buf);
+      goto caps_failed;
+    }
+  }
+
   frame = _find_nearest_frame (self, buf);
 
   if (frame
@@ -2628,6 +2560,7 @@ gst_omx_video_dec_loop (GstOMXVideoDec * self)
       }
     }
 
+    gst_omx_video_dec_set_crop_meta (self, outbuf);
     flow_ret = gst_pad_push (GST_VIDEO_DECODER_SRC_PAD (self), outbuf);
   } else if (buf->omx_buf->nFilledLen > 0 || buf->eglimage) {
     if (self->out_port_pool) {
@@ -2654,6 +2587,7 @@ gst_omx_video_dec_loop (GstOMXVideoDec * self)
         gst_omx_port_release_buffer (port, buf);
         goto invalid_buffer;
       }
+      gst_omx_video_dec_set_crop_meta (self, frame->output_buffer);
       flow_ret =
           gst_video_decoder_finish_frame (GST_VIDEO_DECODER (self), frame);
       frame = NULL;
@@ -2674,6 +2608,7 @@ gst_omx_video_dec_loop (GstOMXVideoDec * self)
           gst_omx_port_release_buffer (port, buf);
           goto invalid_buffer;
         }
+        gst_omx_video_dec_set_crop_meta (self, frame->output_buffer);
         flow_ret =
             gst_video_decoder_finish_frame (GST_VIDEO_DECODER (self), frame);
         frame = NULL;
@@ -2831,6 +2766,11 @@ gst_omx_video_dec_start (GstVideoDecoder * decoder)
   self->last_upstream_ts = 0;
   self->eos = FALSE;
   self->downstream_flow_ret = GST_FLOW_OK;
+  GST_OMX_INIT_STRUCT (&self->crop);
+  self->update_crop = TRUE;
+#ifdef USE_OMX_TARGET_TEGRA
+  self->stride_align = DEFAULT_STRIDE_ALIGN;
+#endif
 
   return TRUE;
 }
@@ -2874,6 +2814,9 @@ gst_omx_video_dec_stop (GstVideoDecoder * decoder)
 #if defined (USE_OMX_TARGET_RPI) && defined (HAVE_GST_GL)
   gst_omx_component_get_state (self->egl_render, 1 * GST_SECOND);
 #endif
+#ifdef USE_OMX_TARGET_TEGRA
+  gst_omx_video_dec_stop_output_scaling (self);
+#endif
 
   gst_buffer_replace (&self->codec_data, NULL);
 
@@ -3151,12 +3094,13 @@ gst_omx_video_dec_set_format (GstVideoDecoder * decoder,
       }
 #endif
 
+      gst_omx_video_dec_drop_in_port_pool (self);
       if (gst_omx_port_set_enabled (self->dec_in_port, FALSE) != OMX_ErrorNone)
         return FALSE;
       if (gst_omx_port_wait_buffers_released (self->dec_in_port,
               5 * GST_SECOND) != OMX_ErrorNone)
         return FALSE;
-      if (gst_omx_port_deallocate_buffers (self->dec_in_port) != OMX_ErrorNone)
+      if (gst_omx_video_dec_deallocate_in_port_buffers (self) != OMX_ErrorNone)
         return FALSE;
       if (gst_omx_port_wait_enabled (self->dec_in_port,
               1 * GST_SECOND) != OMX_ErrorNone)
@@ -3247,13 +3191,15 @@ gst_omx_video_dec_set_format (GstVideoDecoder * decoder,
   if (needs_disable) {
     if (gst_omx_port_set_enabled (self->dec_in_port, TRUE) != OMX_ErrorNone)
       return FALSE;
-    if (gst_omx_port_allocate_buffers (self->dec_in_port) != OMX_ErrorNone)
+    if (gst_omx_video_dec_allocate_in_port_buffers (self) != OMX_ErrorNone)
       return FALSE;
     if (gst_omx_port_wait_enabled (self->dec_in_port,
             5 * GST_SECOND) != OMX_ErrorNone)
       return FALSE;
     if (gst_omx_port_mark_reconfigured (self->dec_in_port) != OMX_ErrorNone)
       return FALSE;
+
+    gst_omx_video_dec_offer_in_port_pool (self);
   } else {
     if (!gst_omx_video_dec_negotiate (self))
       GST_LOG_OBJECT (self, "Negotiation failed, will get output format later");
@@ -3270,7 +3216,7 @@ gst_omx_video_dec_set_format (GstVideoDecoder * decoder,
       return FALSE;
 
     /* Need to allocate buffers to reach Idle state */
-    if (gst_omx_port_allocate_buffers (self->dec_in_port) != OMX_ErrorNone)
+    if (gst_omx_video_dec_allocate_in_port_buffers (self) != OMX_ErrorNone)
       return FALSE;
 
     if (gst_omx_component_get_state (self->dec,
@@ -3355,6 +3301,40 @@ gst_omx_video_dec_reset (GstVideoDecoder * decoder, gboolean hard)
   return TRUE;
 }
 
+/* Returns the OMX buffer that upstream filled if @buffer comes from
+ * our input port pool and can be passed to the component as is */
+static GstOMXBuffer *
+gst_omx_video_dec_get_in_port_buffer (GstOMXVideoDec * self,
+    GstBuffer * buffer)
+{
+  GstOMXBuffer *omx_buf;
+  GstMemory *mem;
+  GstMapInfo map;
+  gboolean same;
+
+  if (!self->in_port_pool || buffer->pool != self->in_port_pool)
+    return NULL;
+
+  /* We take over the buffer until EmptyBufferDone, so nobody
+   * else may hold a reference */
+  if (gst_buffer_n_memory (buffer) != 1 || !gst_buffer_is_writable (buffer))
+    return NULL;
+
+  omx_buf = gst_mini_object_get_qdata (GST_MINI_OBJECT_CAST (buffer),
+      gst_omx_buffer_data_quark);
+  if (!omx_buf || omx_buf->port != self->dec_in_port || omx_buf->used)
+    return NULL;
+
+  /* Upstream might have replaced the memory */
+  mem = gst_buffer_peek_memory (buffer, 0);
+  if (!gst_memory_map (mem, &map, GST_MAP_READ))
+    return NULL;
+  same = map.data - mem->offset == omx_buf->omx_buf->pBuffer;
+  gst_memory_unmap (mem, &map);
+
+  return same ? omx_buf : NULL;
+}
+
 static GstFlowReturn
 gst_omx_video_dec_handle_frame (GstVideoDecoder * decoder,
     GstVideoCodecFrame * frame)
@@ -3363,9 +3343,10 @@ gst_omx_video_dec_handle_frame (GstVideoDecoder * decoder,
   GstOMXVideoDec *self;
   GstOMXVideoDecClass *klass;
   GstOMXPort *port;
-  GstOMXBuffer *buf;
+  GstOMXBuffer *buf, *in_buf;
   GstBuffer *codec_data = NULL;
   guint offset = 0, size;
+  gboolean zero_copy = FALSE;
   GstClockTime timestamp, duration;
   OMX_ERRORTYPE err;
 
@@ -3408,133 +3389,168 @@ gst_omx_video_dec_handle_frame (GstVideoDecoder * decoder,
   }
 
   port = self->dec_in_port;
+  in_buf = gst_omx_video_dec_get_in_port_buffer (self, frame->input_buffer);
 
   size = gst_buffer_get_size (frame->input_buffer);
   while (offset < size) {
-    /* Make sure to release the base class stream lock, otherwise
-     * _loop() can't call _finish_frame() and we might block forever
-     * because no input buffers are released */
-    GST_VIDEO_DECODER_STREAM_UNLOCK (self);
-    acq_ret = gst_omx_port_acquire_buffer (port, &buf);
-
-    if (acq_ret == GST_OMX_ACQUIRE_BUFFER_ERROR) {
-      GST_VIDEO_DECODER_STREAM_LOCK (self);
-      goto component_error;
-    } else if (acq_ret == GST_OMX_ACQUIRE_BUFFER_FLUSHING) {
-      GST_VIDEO_DECODER_STREAM_LOCK (self);
-      goto flushing;
-    } else if (acq_ret == GST_OMX_ACQUIRE_BUFFER_RECONFIGURE) {
-      /* Reallocate all buffers */
-      err = gst_omx_port_set_enabled (port, FALSE);
-      if (err != OMX_ErrorNone) {
-        GST_VIDEO_DECODER_STREAM_LOCK (self);
-        goto reconfigure_error;
-      }
+    if (in_buf && !self->codec_data) {
+      GstMemory *mem = gst_buffer_peek_memory (frame->input_buffer, 0);
+      GstBuffer *meta_buf;
+
+      if (self->downstream_flow_ret != GST_FLOW_OK)
+        goto flow_error;
+      if (port->flushing)
+        goto flushing;
+
+      /* Upstream wrote the frame into one of our input buffers, keep it
+       * referenced by the OMX buffer until EmptyBufferDone and only keep
+       * the metadata in the frame */
+      buf = in_buf;
+      in_buf = NULL;
+
+      meta_buf = gst_buffer_new ();
+      gst_buffer_copy_into (meta_buf, frame->input_buffer,
+          GST_BUFFER_COPY_METADATA, 0, -1);
+      buf->gst_buf = frame->input_buffer;
+      frame->input_buffer = meta_buf;
+
+      buf->omx_buf->nFlags = 0;
+      buf->omx_buf->nOffset = mem->offset;
+      zero_copy = TRUE;
+    } else {
+      /* Make sure to release the base class stream lock, otherwise
+       * _loop() can't call _finish_frame() and we might block forever
+       * because no input buffers are released */
+      GST_VIDEO_DECODER_STREAM_UNLOCK (self);
+      acq_ret = gst_omx_port_acquire_buffer (port, &buf);
 
-      err = gst_omx_port_wait_buffers_released (port, 5 * GST_SECOND);
-      if (err != OMX_ErrorNone) {
+      if (acq_ret == GST_OMX_ACQUIRE_BUFFER_ERROR) {
         GST_VIDEO_DECODER_STREAM_LOCK (self);
-        goto reconfigure_error;
-      }
-
-      err = gst_omx_port_deallocate_buffers (port);
-      if (err != OMX_ErrorNone) {
+        goto component_error;
+      } else if (acq_ret == GST_OMX_ACQUIRE_BUFFER_FLUSHING) {
         GST_VIDEO_DECODER_STREAM_LOCK (self);
-        goto reconfigure_error;
-      }
+        goto flushing;
+      } else if (acq_ret == GST_OMX_ACQUIRE_BUFFER_RECONFIGURE) {
+        /* Reallocate all buffers */
+        gst_omx_video_dec_drop_in_port_pool (self);
+        err = gst_omx_port_set_enabled (port, FALSE);
+        if (err != OMX_ErrorNone) {
+          GST_VIDEO_DECODER_STREAM_LOCK (self);
+          goto reconfigure_error;
+        }
 
-      err = gst_omx_port_wait_enabled (port, 1 * GST_SECOND);
-      if (err != OMX_ErrorNone) {
-        GST_VIDEO_DECODER_STREAM_LOCK (self);
-        goto reconfigure_error;
-      }
+        err = gst_omx_port_wait_buffers_released (port, 5 * GST_SECOND);
+        if (err != OMX_ErrorNone) {
+          GST_VIDEO_DECODER_STREAM_LOCK (self);
+          goto reconfigure_error;
+        }
 
-      err = gst_omx_port_set_enabled (port, TRUE);
-      if (err != OMX_ErrorNone) {
-        GST_VIDEO_DECODER_STREAM_LOCK (self);
-        goto reconfigure_error;
-      }
+        err = gst_omx_video_dec_deallocate_in_port_buffers (self);
+        if (err != OMX_ErrorNone) {
+          GST_VIDEO_DECODER_STREAM_LOCK (self);
+          goto reconfigure_error;
+        }
 
-      err = gst_omx_port_allocate_buffers (port);
-      if (err != OMX_ErrorNone) {
-        GST_VIDEO_DECODER_STREAM_LOCK (self);
-        goto reconfigure_error;
-      }
+        err = gst_omx_port_wait_enabled (port, 1 * GST_SECOND);
+        if (err != OMX_ErrorNone) {
+          GST_VIDEO_DECODER_STREAM_LOCK (self);
+          goto reconfigure_error;
+        }
 
-      err = gst_omx_port_wait_enabled (port, 5 * GST_SECOND);
-      if (err != OMX_ErrorNone) {
-        GST_VIDEO_DECODER_STREAM_LOCK (self);
-        goto reconfigure_error;
-      }
+        err = gst_omx_port_set_enabled (port, TRUE);
+        if (err != OMX_ErrorNone) {
+          GST_VIDEO_DECODER_STREAM_LOCK (self);
+          goto reconfigure_error;
+        }
 
-      err = gst_omx_port_mark_reconfigured (port);
-      if (err != OMX_ErrorNone) {
-        GST_VIDEO_DECODER_STREAM_LOCK (self);
-        goto reconfigure_error;
-      }
+        err = gst_omx_video_dec_allocate_in_port_buffers (self);
+        if (err != OMX_ErrorNone) {
+          GST_VIDEO_DECODER_STREAM_LOCK (self);
+          goto reconfigure_error;
+        }
 
-      /* Now get a new buffer and fill it */
-      GST_VIDEO_DECODER_STREAM_LOCK (self);
-      continue;
-    }
-    GST_VIDEO_DECODER_STREAM_LOCK (self);
+        err = gst_omx_port_wait_enabled (port, 5 * GST_SECOND);
+        if (err != OMX_ErrorNone) {
+          GST_VIDEO_DECODER_STREAM_LOCK (self);
+          goto reconfigure_error;
+        }
 
-    g_assert (acq_ret == GST_OMX_ACQUIRE_BUFFER_OK && buf != NULL);
+        err = gst_omx_port_mark_reconfigured (port);
+        if (err != OMX_ErrorNone) {
+          GST_VIDEO_DECODER_STREAM_LOCK (self);
+          goto reconfigure_error;
+        }
 
-    if (buf->omx_buf->nAllocLen - buf->omx_buf->nOffset <= 0) {
-      gst_omx_port_release_buffer (port, buf);
-      goto full_buffer;
-    }
+        gst_omx_video_dec_offer_in_port_pool (self);
 
-    if (self->downstream_flow_ret != GST_FLOW_OK) {
-      gst_omx_port_release_buffer (port, buf);
-      goto flow_error;
-    }
+        /* Now get a new buffer and fill it */
+        GST_VIDEO_DECODER_STREAM_LOCK (self);
+        continue;
+      }
+      GST_VIDEO_DECODER_STREAM_LOCK (self);
 
-    if (self->codec_data) {
-      GST_DEBUG_OBJECT (self, "Passing codec data to the component");
+      g_assert (acq_ret == GST_OMX_ACQUIRE_BUFFER_OK && buf != NULL);
 
-      codec_data = self->codec_data;
+      if (buf->omx_buf->nAllocLen - buf->omx_buf->nOffset <= 0) {
+        gst_omx_port_release_buffer (port, buf);
+        goto full_buffer;
+      }
 
-      if (buf->omx_buf->nAllocLen - buf->omx_buf->nOffset <
-          gst_buffer_get_size (codec_data)) {
+      if (self->downstream_flow_ret != GST_FLOW_OK) {
         gst_omx_port_release_buffer (port, buf);
-        goto too_large_codec_data;
+        goto flow_error;
       }
 
-      buf->omx_buf->nFlags |= OMX_BUFFERFLAG_CODECCONFIG;
-      buf->omx_buf->nFlags |= OMX_BUFFERFLAG_ENDOFFRAME;
-      buf->omx_buf->nFilledLen = gst_buffer_get_size (codec_data);;
-      gst_buffer_extract (codec_data, 0,
-          buf->omx_buf->pBuffer + buf->omx_buf->nOffset,
-          buf->omx_buf->nFilledLen);
+      if (self->codec_data) {
+        GST_DEBUG_OBJECT (self, "Passing codec data to the component");
 
-      if (GST_CLOCK_TIME_IS_VALID (timestamp))
-        buf->omx_buf->nTimeStamp =
-            gst_util_uint64_scale (timestamp, OMX_TICKS_PER_SECOND, GST_SECOND);
-      else
-        buf->omx_buf->nTimeStamp = 0;
-      buf->omx_buf->nTickCount = 0;
+        codec_data = self->codec_data;
 
-      self->started = TRUE;
-      err = gst_omx_port_release_buffer (port, buf);
-      gst_buffer_replace (&self->codec_data, NULL);
-      if (err != OMX_ErrorNone)
-        goto release_error;
-      /* Acquire new buffer for the actual frame */
-      continue;
+        if (buf->omx_buf->nAllocLen - buf->omx_buf->nOffset <
+            gst_buffer_get_size (codec_data)) {
+          gst_omx_port_release_buffer (port, buf);
+          goto too_large_codec_data;
+        }
+
+        buf->omx_buf->nFlags |= OMX_BUFFERFLAG_CODECCONFIG;
+        buf->omx_buf->nFlags |= OMX_BUFFERFLAG_ENDOFFRAME;
+        buf->omx_buf->nFilledLen = gst_buffer_get_size (codec_data);;
+        gst_buffer_extract (codec_data, 0,
+            buf->omx_buf->pBuffer + buf->omx_buf->nOffset,
+            buf->omx_buf->nFilledLen);
+
+        if (GST_CLOCK_TIME_IS_VALID (timestamp))
+          buf->omx_buf->nTimeStamp =
+              gst_util_uint64_scale (timestamp, OMX_TICKS_PER_SECOND,
+              GST_SECOND);
+        else
+          buf->omx_buf->nTimeStamp = 0;
+        buf->omx_buf->nTickCount = 0;
+
+        self->started = TRUE;
+        err = gst_omx_port_release_buffer (port, buf);
+        gst_buffer_replace (&self->codec_data, NULL);
+        if (err != OMX_ErrorNone)
+          goto release_error;
+        /* Acquire new buffer for the actual frame */
+        continue;
+      }
     }
 
     /* Now handle the frame */
     GST_DEBUG_OBJECT (self, "Passing frame offset %d to the component", offset);
 
-    /* Copy the buffer content in chunks of size as requested
-     * by the port */
-    buf->omx_buf->nFilledLen =
-        MIN (size - offset, buf->omx_buf->nAllocLen - buf->omx_buf->nOffset);
-    gst_buffer_extract (frame->input_buffer, offset,
-        buf->omx_buf->pBuffer + buf->omx_buf->nOffset,
-        buf->omx_buf->nFilledLen);
+    if (zero_copy) {
+      buf->omx_buf->nFilledLen = size;
+    } else {
+      /* Copy the buffer content in chunks of size as requested
+       * by the port */
+      buf->omx_buf->nFilledLen =
+          MIN (size - offset, buf->omx_buf->nAllocLen - buf->omx_buf->nOffset);
+      gst_buffer_extract (frame->input_buffer, offset,
+          buf->omx_buf->pBuffer + buf->omx_buf->nOffset,
+          buf->omx_buf->nFilledLen);
+    }
 
     if (timestamp != GST_CLOCK_TIME_NONE) {
       buf->omx_buf->nTimeStamp =
@@ -3742,6 +3758,69 @@ gst_omx_video_dec_drain (GstOMXVideoDec * self, gboolean is_eos)
   return GST_FLOW_OK;
 }
 
+/* Pads the frames of a downstream video pool so that they get the layout
+ * of the output port's buffers. Only done if downstream understands the
+ * resulting GstVideoMeta */
+static void
+gst_omx_video_dec_align_pool (GstOMXVideoDec * self, GstBufferPool * pool,
+    GstStructure * config)
+{
+  OMX_PARAM_PORTDEFINITIONTYPE *port_def = &self->dec_out_port->port_def;
+  GstVideoAlignment align;
+  GstVideoInfo info, aligned_info;
+  GstCaps *caps = NULL;
+  gsize offset[GST_VIDEO_MAX_PLANES] = { 0, };
+  gint stride[GST_VIDEO_MAX_PLANES] = { 0, };
+  guint i, slice_height;
+
+  if (!gst_buffer_pool_has_option (pool,
+          GST_BUFFER_POOL_OPTION_VIDEO_ALIGNMENT))
+    return;
+
+  if (!gst_buffer_pool_config_get_params (config, &caps, NULL, NULL, NULL)
+      || !caps || !gst_video_info_from_caps (&info, caps))
+    return;
+
+  /* Cropped or scaled frames are copied row by row anyway */
+  if (GST_VIDEO_INFO_WIDTH (&info) != port_def->format.video.nFrameWidth
+      || GST_VIDEO_INFO_HEIGHT (&info) != port_def->format.video.nFrameHeight)
+    return;
+
+  if (!gst_omx_video_dec_get_output_layout (self, GST_VIDEO_INFO_FORMAT (&info),
+          offset, stride))
+    return;
+
+  if (stride[0] < GST_VIDEO_INFO_WIDTH (&info) || offset[1] % stride[0] != 0)
+    return;
+
+  slice_height = offset[1] / stride[0];
+  if (slice_height < GST_VIDEO_INFO_HEIGHT (&info))
+    return;
+
+  gst_video_alignment_reset (&align);
+  align.padding_right = stride[0] - GST_VIDEO_INFO_WIDTH (&info);
+  align.padding_bottom = slice_height - GST_VIDEO_INFO_HEIGHT (&info);
+
+  aligned_info = info;
+  gst_video_info_align (&aligned_info, &align);
+
+  /* Padding can't express every layout, check what we would get */
+  for (i = 0; i < GST_VIDEO_INFO_N_PLANES (&info); i++) {
+    if (GST_VIDEO_INFO_PLANE_OFFSET (&aligned_info, i) != offset[i]
+        || GST_VIDEO_INFO_PLANE_STRIDE (&aligned_info, i) != stride[i]) {
+      GST_DEBUG_OBJECT (self, "Can't match output layout with padding");
+      return;
+    }
+  }
+
+  GST_DEBUG_OBJECT (self, "Padding downstream frames by %u,%u to match "
+      "output layout", align.padding_right, align.padding_bottom);
+
+  gst_buffer_pool_config_add_option (config,
+      GST_BUFFER_POOL_OPTION_VIDEO_ALIGNMENT);
+  gst_buffer_pool_config_set_video_alignment (config, &align);
+}
+
 static gboolean
 gst_omx_video_dec_decide_allocation (GstVideoDecoder * bdec, GstQuery * query)
 {
@@ -3882,17 +3961,82 @@ next_pool:
 #endif
 
   config = gst_buffer_pool_get_config (pool);
+#ifdef USE_OMX_TARGET_TEGRA
+  {
+    GstVideoAlignment align;
+
+    /* The pool is decided after the output port was configured, its
+     * stride alignment applies from the next port configuration */
+    self->stride_align = DEFAULT_STRIDE_ALIGN;
+    if (gst_buffer_pool_config_has_option (config,
+            GST_BUFFER_POOL_OPTION_VIDEO_ALIGNMENT)
+        && gst_buffer_pool_config_get_video_alignment (config, &align))
+      self->stride_align = MAX (DEFAULT_STRIDE_ALIGN,
+          align.stride_align[0] + 1);
+  }
+#endif
   if (gst_query_find_allocation_meta (query, GST_VIDEO_META_API_TYPE, NULL)) {
     gst_buffer_pool_config_add_option (config,
         GST_BUFFER_POOL_OPTION_VIDEO_META);
+    gst_omx_video_dec_align_pool (self, pool, config);
   }
 
   self->have_affine_transformation_meta =
       gst_query_find_allocation_meta (query,
       GST_VIDEO_AFFINE_TRANSFORMATION_META_API_TYPE, NULL);
 
+  self->have_crop_meta =
+      gst_query_find_allocation_meta (query, GST_VIDEO_CROP_META_API_TYPE,
+      NULL);
+
   gst_buffer_pool_set_config (pool, config);
   gst_object_unref (pool);
 
   return TRUE;
 }
+
+static gboolean
+gst_omx_video_dec_propose_allocation (GstVideoDecoder * bdec, GstQuery * query)
+{
+  GstOMXVideoDec *self = GST_OMX_VIDEO_DEC (bdec);
+  GstOMXPort *port = self->dec_in_port;
+  GstCaps *caps;
+
+  gst_query_parse_allocation (query, &caps, NULL);
+
+  /* Let upstream write the compressed frames directly into the
+   * buffers of the input port, once set_format() allocated them
+   * from our memory. One of them stays with us for codec data and
+   * copied input */
+  if (caps && port && port->buffers && port->buffers->len > 1
+      && self->in_port_memories) {
+    guint size = port->port_def.nBufferSize;
+    guint n = port->buffers->len - 1;
+
+    if (!self->in_port_pool) {
+      GstStructure *config;
+
+      self->in_port_pool =
+          gst_omx_buffer_pool_new (GST_ELEMENT_CAST (self), self->dec, port);
+      GST_OMX_BUFFER_POOL (self->in_port_pool)->memories =
+          g_ptr_array_ref (self->in_port_memories);
+      config = gst_buffer_pool_get_config (self->in_port_pool);
+      gst_buffer_pool_config_set_params (config, caps, size, n, n);
+      if (!gst_buffer_pool_set_config (self->in_port_pool, config)) {
+        GST_INFO_OBJECT (self, "Failed to set config on input port pool");
+        gst_object_unref (self->in_port_pool);
+        self->in_port_pool = NULL;
+      }
+    }
+
+    if (self->in_port_pool) {
+      GST_DEBUG_OBJECT (self, "Proposing input port pool with %u buffers "
+          "of %u bytes", n, size);
+      gst_query_add_allocation_pool (query, self->in_port_pool, size, n, n);
+    }
+  }
+
+  return
+      GST_VIDEO_DECODER_CLASS
+      (gst_omx_video_dec_parent_class)->propose_allocation (bdec, query);
+}
@@ -69,6 +69,13 @@ struct _GstOMXVideoDec
   GstBufferPool *in_port_pool, *out_port_pool;
 
   /* < private > */
+  /* TRUE if upstream lost the input port pool and gets
+   * a new one once the port's buffers are reallocated */
+  gboolean in_port_pool_dropped;
+  /* Memory behind the input port's buffers if the component uses
+   * ours, NULL if it allocated them itself */
+  GPtrArray *in_port_memories;
+
   GstVideoCodecState *input_state;
   GstBuffer *codec_data;
   /* TRUE if the component is configured and saw
@@ -89,12 +96,30 @@ struct _GstOMXVideoDec
   GstFlowReturn downstream_flow_ret;
 
   gboolean have_affine_transformation_meta;
+  /* TRUE if downstream handles GstVideoCropMeta */
+  gboolean have_crop_meta;
+  /* have_crop_meta the output size was last chosen for */
+  gboolean crop_meta_negotiated;
+
+  /* Visible region of the output frames, updated
+   * whenever update_crop is set */
+  OMX_CONFIG_RECTTYPE crop;
+  gboolean update_crop;
 
 #ifdef USE_OMX_TARGET_TEGRA
   gboolean use_omxdec_res;
   gboolean full_frame_data;
   gboolean disable_dpb;
   guint32 skip_frames;
+  /* TRUE if the output port scales to the downstream size */
+  gboolean hw_scaling;
+  /* Size of the decoded frames before scaling */
+  guint native_width, native_height;
+  /* Size the output port was set to for scaling */
+  guint scaled_width, scaled_height;
+  /* Stride alignment of the frames of the downstream pool, used
+   * for the next configuration of the output port */
+  guint stride_align;
 #endif
 
 #ifdef USE_OMX_TARGET_RPI
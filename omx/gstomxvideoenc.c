@@ -25,9 +25,11 @@
 
 #include <gst/gst.h>
 #include <gst/video/gstvideometa.h>
+#include <stdio.h>
 #include <string.h>
 
 #include "gstomxvideoenc.h"
+#include "gstomxbufferpool.h"
 
 GST_DEBUG_CATEGORY_STATIC (gst_omx_video_enc_debug_category);
 #define GST_CAT_DEFAULT gst_omx_video_enc_debug_category
@@ -56,10 +58,38 @@ gst_omx_videnc_rc_mode_get_type (void)
   return (GType) rcmode_type_type;
 }
 
+#define GST_TYPE_OMX_VID_ENC_RGB_MATRIX (gst_omx_videnc_rgb_matrix_get_type ())
+static GType
+gst_omx_videnc_rgb_matrix_get_type (void)
+{
+  static volatile gsize rgb_matrix_type = 0;
+  static const GEnumValue rgb_matrix[] = {
+    {GST_OMX_VIDEO_ENC_RGB_MATRIX_AUTO, "GST_OMX_VIDENC_RGB_MATRIX_TYPE_AUTO",
+        "auto"},
+    {GST_OMX_VIDEO_ENC_RGB_MATRIX_BT601, "GST_OMX_VIDENC_RGB_MATRIX_TYPE_BT601",
+        "bt601"},
+    {GST_OMX_VIDEO_ENC_RGB_MATRIX_BT709, "GST_OMX_VIDENC_RGB_MATRIX_TYPE_BT709",
+        "bt709"},
+    {0, NULL, NULL}
+  };
+
+  if (g_once_init_enter (&rgb_matrix_type)) {
+    GType tmp =
+        g_enum_register_static ("GstOmxVideoEncRGBMatrix", rgb_matrix);
+    g_once_init_leave (&rgb_matrix_type, tmp);
+  }
+
+  return (GType) rgb_matrix_type;
+}
+
 typedef struct _BufferIdentification BufferIdentification;
 struct _BufferIdentification
 {
   guint64 timestamp;
+  /* Monotonic time the frame was passed to the component */
+  gint64 submit_time;
+  /* Input timestamp not used as DTS yet, see gst_omx_video_enc_set_dts() */
+  GstClockTime dts;
 };
 
 static void
@@ -68,6 +98,74 @@ buffer_identification_free (BufferIdentification * id)
   g_slice_free (BufferIdentification, id);
 }
 
+GType
+gst_omx_video_enc_stats_meta_api_get_type (void)
+{
+  static volatile GType type = 0;
+  static const gchar *tags[] = { NULL };
+
+  if (g_once_init_enter (&type)) {
+    GType _type =
+        gst_meta_api_type_register ("GstOMXVideoEncStatsMetaAPI", tags);
+    g_once_init_leave (&type, _type);
+  }
+  return type;
+}
+
+static gboolean
+gst_omx_video_enc_stats_meta_init (GstMeta * meta, gpointer params,
+    GstBuffer * buffer)
+{
+  GstOMXVideoEncStatsMeta *smeta = (GstOMXVideoEncStatsMeta *) meta;
+
+  smeta->qp = G_MAXUINT;
+  smeta->size = 0;
+  smeta->picture_type = OMX_VIDEO_PictureTypeP;
+  smeta->encode_time = GST_CLOCK_TIME_NONE;
+
+  return TRUE;
+}
+
+static gboolean
+gst_omx_video_enc_stats_meta_transform (GstBuffer * dest, GstMeta * meta,
+    GstBuffer * buffer, GQuark type, gpointer data)
+{
+  GstOMXVideoEncStatsMeta *smeta = (GstOMXVideoEncStatsMeta *) meta;
+  GstOMXVideoEncStatsMeta *dmeta;
+
+  /* Only copies keep describing the same frame */
+  if (!GST_META_TRANSFORM_IS_COPY (type))
+    return FALSE;
+
+  dmeta = (GstOMXVideoEncStatsMeta *) gst_buffer_add_meta (dest,
+      GST_OMX_VIDEO_ENC_STATS_META_INFO, NULL);
+  if (!dmeta)
+    return FALSE;
+
+  dmeta->qp = smeta->qp;
+  dmeta->size = smeta->size;
+  dmeta->picture_type = smeta->picture_type;
+  dmeta->encode_time = smeta->encode_time;
+
+  return TRUE;
+}
+
+const GstMetaInfo *
+gst_omx_video_enc_stats_meta_get_info (void)
+{
+  static const GstMetaInfo *meta_info = NULL;
+
+  if (g_once_init_enter (&meta_info)) {
+    const GstMetaInfo *mi =
+        gst_meta_register (GST_OMX_VIDEO_ENC_STATS_META_API_TYPE,
+        "GstOMXVideoEncStatsMeta", sizeof (GstOMXVideoEncStatsMeta),
+        gst_omx_video_enc_stats_meta_init, NULL,
+        gst_omx_video_enc_stats_meta_transform);
+    g_once_init_leave (&meta_info, mi);
+  }
+  return meta_info;
+}
+
 /* prototypes */
 static void gst_omx_video_enc_finalize (GObject * object);
 static void gst_omx_video_enc_set_property (GObject * object, guint prop_id,
@@ -117,7 +215,16 @@ enum
   PROP_QUANT_I_FRAMES,
   PROP_QUANT_P_FRAMES,
   PROP_QUANT_B_FRAMES,
-  PROP_INTRA_FRAME_INTERVAL
+  PROP_INTRA_FRAME_INTERVAL,
+  PROP_SLICE_LEVEL_ENCODE,
+  PROP_STATS,
+  PROP_STATIC_THRESHOLD,
+  PROP_MAX_SKIP_FRAMES,
+  PROP_QP_RANGE,
+  PROP_OUTPUT_WIDTH,
+  PROP_OUTPUT_HEIGHT,
+  PROP_RGB_MATRIX,
+  PROP_RGB_FULL_RANGE
 };
 
 /* FIXME: Better defaults */
@@ -127,6 +234,24 @@ enum
 #define GST_OMX_VIDEO_ENC_QUANT_P_FRAMES_DEFAULT (0xffffffff)
 #define GST_OMX_VIDEO_ENC_QUANT_B_FRAMES_DEFAULT (0xffffffff)
 #define DEFAULT_INTRA_FRAME_INTERVAL             60
+#define DEFAULT_SLICE_LEVEL_ENCODE               FALSE
+
+#define DEFAULT_STATIC_THRESHOLD                 0
+#define DEFAULT_MAX_SKIP_FRAMES                  30
+
+#define DEFAULT_RGB_MATRIX                       GST_OMX_VIDEO_ENC_RGB_MATRIX_AUTO
+#define DEFAULT_RGB_FULL_RANGE                   FALSE
+
+/* Fractional bits of the RGB to YUV coefficients */
+#define RGB_TO_YUV_SHIFT                         14
+
+/* Static scene detection samples every 4th pixel of every 4th line
+ * and compares blocks of 4x4 samples, i.e. 16x16 pixels */
+#define STATIC_SAMPLE_STEP                       4
+#define STATIC_BLOCK_SAMPLES                     4
+
+/* Length of the window the stats property averages over */
+#define STATS_WINDOW_USEC                        (G_USEC_PER_SEC)
 
 #ifdef USE_OMX_TARGET_TEGRA
 #define ENCODER_CONF_LOCATION   "/etc/enctune.conf"
@@ -141,6 +266,9 @@ enum
 G_DEFINE_ABSTRACT_TYPE_WITH_CODE (GstOMXVideoEnc, gst_omx_video_enc,
     GST_TYPE_VIDEO_ENCODER, DEBUG_INIT);
 
+/* Converted to the component's YUV format while copying */
+#define RGB_FORMATS "RGBA, BGRA, RGBx, BGRx, RGB16"
+
 #ifdef USE_OMX_TARGET_TEGRA
 #define FORMATS "I420, NV12"
 #endif
@@ -173,32 +301,101 @@ gst_omx_video_enc_class_init (GstOMXVideoEncClass * klass)
 
   g_object_class_install_property (gobject_class, PROP_QUANT_I_FRAMES,
       g_param_spec_uint ("quant-i-frames", "I-Frame Quantization",
-          "Quantization parameter for I-frames (0xffffffff=component default)",
+          "Quantization parameter for I-frames, changes while playing fix "
+          "the QP through the QP range (0xffffffff=component default)",
           0, G_MAXUINT, GST_OMX_VIDEO_ENC_QUANT_I_FRAMES_DEFAULT,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
-          GST_PARAM_MUTABLE_READY));
+          GST_PARAM_MUTABLE_PLAYING));
 
   g_object_class_install_property (gobject_class, PROP_QUANT_P_FRAMES,
       g_param_spec_uint ("quant-p-frames", "P-Frame Quantization",
-          "Quantization parameter for P-frames (0xffffffff=component default)",
+          "Quantization parameter for P-frames, changes while playing fix "
+          "the QP through the QP range (0xffffffff=component default)",
           0, G_MAXUINT, GST_OMX_VIDEO_ENC_QUANT_P_FRAMES_DEFAULT,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
-          GST_PARAM_MUTABLE_READY));
+          GST_PARAM_MUTABLE_PLAYING));
 
   g_object_class_install_property (gobject_class, PROP_QUANT_B_FRAMES,
       g_param_spec_uint ("quant-b-frames", "B-Frame Quantization",
-          "Quantization parameter for B-frames (0xffffffff=component default)",
+          "Quantization parameter for B-frames, changes while playing fix "
+          "the QP through the QP range (0xffffffff=component default)",
           0, G_MAXUINT, GST_OMX_VIDEO_ENC_QUANT_B_FRAMES_DEFAULT,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
-          GST_PARAM_MUTABLE_READY));
+          GST_PARAM_MUTABLE_PLAYING));
 
   g_object_class_install_property (gobject_class, PROP_INTRA_FRAME_INTERVAL,
       g_param_spec_uint ("iframeinterval", "Intra Frame interval",
           "Encoding Intra Frame occurance frequency",
           0, G_MAXUINT, DEFAULT_INTRA_FRAME_INTERVAL,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_PLAYING));
+
+  g_object_class_install_property (gobject_class, PROP_QP_RANGE,
+      g_param_spec_string ("qp-range", "QP Range",
+          "Quantization range for I, P and B frames as "
+          "\"MinQpI,MaxQpI:MinQpP,MaxQpP:MinQpB,MaxQpB\" "
+          "(NULL=component default)", NULL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_PLAYING));
+
+  g_object_class_install_property (gobject_class, PROP_OUTPUT_WIDTH,
+      g_param_spec_uint ("output-width", "Output Width",
+          "Width to scale the input to before encoding (0=input width)",
+          0, G_MAXUINT, 0,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_OUTPUT_HEIGHT,
+      g_param_spec_uint ("output-height", "Output Height",
+          "Height to scale the input to before encoding (0=input height)",
+          0, G_MAXUINT, 0,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_RGB_MATRIX,
+      g_param_spec_enum ("rgb-matrix", "RGB Matrix",
+          "Color matrix used to convert RGB input to YUV "
+          "(auto=BT.709 for HD, BT.601 otherwise)",
+          GST_TYPE_OMX_VID_ENC_RGB_MATRIX, DEFAULT_RGB_MATRIX,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_RGB_FULL_RANGE,
+      g_param_spec_boolean ("rgb-full-range", "RGB Full Range",
+          "Convert RGB input to full range instead of limited range YUV",
+          DEFAULT_RGB_FULL_RANGE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
           GST_PARAM_MUTABLE_READY));
 
+  g_object_class_install_property (gobject_class, PROP_SLICE_LEVEL_ENCODE,
+      g_param_spec_boolean ("slice-level-encode", "Slice Level Encode",
+          "Push every encoded slice as soon as it is available instead of "
+          "waiting for the complete frame",
+          DEFAULT_SLICE_LEVEL_ENCODE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_STATS,
+      g_param_spec_boxed ("stats", "Statistics",
+          "Encoder statistics: total frames and bytes, and bitrate, "
+          "framerate, average QP and encode time over the last second",
+          GST_TYPE_STRUCTURE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_STATIC_THRESHOLD,
+      g_param_spec_uint ("static-threshold", "Static Scene Threshold",
+          "Skip frames where no 16x16 block differs from the last encoded "
+          "frame by more than this average luma difference (0=disabled)",
+          0, 255, DEFAULT_STATIC_THRESHOLD,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_READY));
+
+  g_object_class_install_property (gobject_class, PROP_MAX_SKIP_FRAMES,
+      g_param_spec_uint ("max-skip-frames", "Maximum Skipped Frames",
+          "Maximum number of static frames skipped in a row",
+          0, G_MAXUINT, DEFAULT_MAX_SKIP_FRAMES,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS |
+          GST_PARAM_MUTABLE_PLAYING));
+
   element_class->change_state =
       GST_DEBUG_FUNCPTR (gst_omx_video_enc_change_state);
 
@@ -225,7 +422,7 @@ gst_omx_video_enc_class_init (GstOMXVideoEncClass * klass)
       "height = " GST_VIDEO_SIZE_RANGE ", " "framerate = " GST_VIDEO_FPS_RANGE
       ";" "video/x-raw, "
 #ifdef USE_OMX_TARGET_TEGRA
-      "format = (string) { " FORMATS " }, "
+      "format = (string) { " FORMATS ", " RGB_FORMATS " }, "
 #endif
       "width = " GST_VIDEO_SIZE_RANGE ", "
       "height = " GST_VIDEO_SIZE_RANGE ", " "framerate = " GST_VIDEO_FPS_RANGE;
@@ -242,12 +439,73 @@ gst_omx_video_enc_init (GstOMXVideoEnc * self)
   self->quant_i_frames = GST_OMX_VIDEO_ENC_QUANT_I_FRAMES_DEFAULT;
   self->quant_p_frames = GST_OMX_VIDEO_ENC_QUANT_P_FRAMES_DEFAULT;
   self->quant_b_frames = GST_OMX_VIDEO_ENC_QUANT_B_FRAMES_DEFAULT;
+  memset (self->qp_range, 0xff, sizeof (self->qp_range));
+  memset (self->applied_quant, 0xff, sizeof (self->applied_quant));
+  memset (self->applied_qp_range, 0xff, sizeof (self->applied_qp_range));
+  self->slice_level_encode = DEFAULT_SLICE_LEVEL_ENCODE;
+  self->static_threshold = DEFAULT_STATIC_THRESHOLD;
+  self->max_skip_frames = DEFAULT_MAX_SKIP_FRAMES;
+  self->rgb_matrix = DEFAULT_RGB_MATRIX;
+  self->rgb_full_range = DEFAULT_RGB_FULL_RANGE;
   self->hw_path = FALSE;
 
   g_mutex_init (&self->drain_lock);
   g_cond_init (&self->drain_cond);
 }
 
+static OMX_ERRORTYPE
+gstomx_set_quantization (GstOMXVideoEnc * self)
+{
+  OMX_ERRORTYPE err = OMX_ErrorNone;
+
+  if (self->quant_i_frames != 0xffffffff ||
+      self->quant_p_frames != 0xffffffff ||
+      self->quant_b_frames != 0xffffffff) {
+    OMX_VIDEO_PARAM_QUANTIZATIONTYPE quant_param;
+
+    GST_OMX_INIT_STRUCT (&quant_param);
+    quant_param.nPortIndex = self->enc_out_port->index;
+
+    err = gst_omx_component_get_parameter (self->enc,
+        OMX_IndexParamVideoQuantization, &quant_param);
+
+    if (err == OMX_ErrorNone) {
+
+      if (self->quant_i_frames != 0xffffffff)
+        quant_param.nQpI = self->quant_i_frames;
+      if (self->quant_p_frames != 0xffffffff)
+        quant_param.nQpP = self->quant_p_frames;
+      if (self->quant_b_frames != 0xffffffff)
+        quant_param.nQpB = self->quant_b_frames;
+
+      err =
+          gst_omx_component_set_parameter (self->enc,
+          OMX_IndexParamVideoQuantization, &quant_param);
+      if (err == OMX_ErrorUnsupportedIndex) {
+        GST_WARNING_OBJECT (self,
+            "Setting quantization parameters not supported by the component");
+        err = OMX_ErrorNone;
+      } else if (err == OMX_ErrorUnsupportedSetting) {
+        GST_WARNING_OBJECT (self,
+            "Setting quantization parameters %u %u %u not supported by the component",
+            self->quant_i_frames, self->quant_p_frames, self->quant_b_frames);
+        err = OMX_ErrorNone;
+      } else if (err != OMX_ErrorNone) {
+        GST_ERROR_OBJECT (self,
+            "Failed to set quantization parameters: %s (0x%08x)",
+            gst_omx_error_to_string (err), err);
+      }
+    } else {
+      GST_ERROR_OBJECT (self,
+          "Failed to get quantization parameters: %s (0x%08x)",
+          gst_omx_error_to_string (err), err);
+      err = OMX_ErrorNone;
+    }
+  }
+
+  return err;
+}
+
 static gboolean
 gst_omx_video_enc_open (GstVideoEncoder * encoder)
 {
@@ -302,10 +560,9 @@ gst_omx_video_enc_open (GstVideoEncoder * encoder)
 
   /* Set properties */
   {
-    OMX_ERRORTYPE err;
-
 #ifdef USE_OMX_TARGET_TEGRA
 
+    OMX_ERRORTYPE err;
     OMX_INDEXTYPE eIndex;
     NVX_PARAM_TEMPFILEPATH enc_conf_loc;
     gchar *location = g_strdup (ENCODER_CONF_LOCATION);
@@ -334,52 +591,65 @@ gst_omx_video_enc_open (GstVideoEncoder * encoder)
 
 #endif
 
-    if (self->quant_i_frames != 0xffffffff ||
-        self->quant_p_frames != 0xffffffff ||
-        self->quant_b_frames != 0xffffffff) {
-      OMX_VIDEO_PARAM_QUANTIZATIONTYPE quant_param;
+    if (gstomx_set_quantization (self) != OMX_ErrorNone)
+      return FALSE;
 
-      GST_OMX_INIT_STRUCT (&quant_param);
-      quant_param.nPortIndex = self->enc_out_port->index;
+    GST_OBJECT_LOCK (self);
+    self->applied_quant[0] = self->quant_i_frames;
+    self->applied_quant[1] = self->quant_p_frames;
+    self->applied_quant[2] = self->quant_b_frames;
+    self->pending_config &= ~GST_OMX_VIDEO_ENC_CONFIG_QUANT;
+    GST_OBJECT_UNLOCK (self);
+  }
 
-      err = gst_omx_component_get_parameter (self->enc,
-          OMX_IndexParamVideoQuantization, &quant_param);
+  return TRUE;
+}
+
+/* Stops handing out the input port's buffers to upstream when shutting
+ * down, buffers that upstream still holds are not returned anymore */
+static void
+gst_omx_video_enc_release_in_port_pool (GstOMXVideoEnc * self)
+{
+  if (self->in_port_pool) {
+    GST_OMX_BUFFER_POOL (self->in_port_pool)->deactivated = TRUE;
+    gst_buffer_pool_set_active (self->in_port_pool, FALSE);
+    gst_object_unref (self->in_port_pool);
+    self->in_port_pool = NULL;
+  }
+  self->in_port_pool_dropped = FALSE;
+}
+
+/* Stops handing out the input port's buffers to upstream before they
+ * are reallocated and asks upstream to renegotiate its allocation.
+ * Buffers that upstream still holds go back to the port when they are
+ * released, gst_omx_port_wait_buffers_released() waits for them */
+static void
+gst_omx_video_enc_drop_in_port_pool (GstOMXVideoEnc * self)
+{
+  if (!self->in_port_pool)
+    return;
 
-      if (err == OMX_ErrorNone) {
+  GST_DEBUG_OBJECT (self, "Dropping input port pool");
 
-        if (self->quant_i_frames != 0xffffffff)
-          quant_param.nQpI = self->quant_i_frames;
-        if (self->quant_p_frames != 0xffffffff)
-          quant_param.nQpP = self->quant_p_frames;
-        if (self->quant_b_frames != 0xffffffff)
-          quant_param.nQpB = self->quant_b_frames;
+  gst_buffer_pool_set_active (self->in_port_pool, FALSE);
+  gst_object_unref (self->in_port_pool);
+  self->in_port_pool = NULL;
+  self->in_port_pool_dropped = TRUE;
 
-        err =
-            gst_omx_component_set_parameter (self->enc,
-            OMX_IndexParamVideoQuantization, &quant_param);
-        if (err == OMX_ErrorUnsupportedIndex) {
-          GST_WARNING_OBJECT (self,
-              "Setting quantization parameters not supported by the component");
-        } else if (err == OMX_ErrorUnsupportedSetting) {
-          GST_WARNING_OBJECT (self,
-              "Setting quantization parameters %u %u %u not supported by the component",
-              self->quant_i_frames, self->quant_p_frames, self->quant_b_frames);
-        } else if (err != OMX_ErrorNone) {
-          GST_ERROR_OBJECT (self,
-              "Failed to set quantization parameters: %s (0x%08x)",
-              gst_omx_error_to_string (err), err);
-          return FALSE;
-        }
-      } else {
-        GST_ERROR_OBJECT (self,
-            "Failed to get quantization parameters: %s (0x%08x)",
-            gst_omx_error_to_string (err), err);
+  gst_pad_push_event (GST_VIDEO_ENCODER_SINK_PAD (self),
+      gst_event_new_reconfigure ());
+}
 
-      }
-    }
-  }
+/* Lets upstream get a pool of the reallocated input port buffers */
+static void
+gst_omx_video_enc_offer_in_port_pool (GstOMXVideoEnc * self)
+{
+  if (!self->in_port_pool_dropped)
+    return;
 
-  return TRUE;
+  self->in_port_pool_dropped = FALSE;
+  gst_pad_push_event (GST_VIDEO_ENCODER_SINK_PAD (self),
+      gst_event_new_reconfigure ());
 }
 
 static gboolean
@@ -396,6 +666,7 @@ gst_omx_video_enc_shutdown (GstOMXVideoEnc * self)
       gst_omx_component_get_state (self->enc, 5 * GST_SECOND);
     }
     gst_omx_component_set_state (self->enc, OMX_StateLoaded);
+    gst_omx_video_enc_release_in_port_pool (self);
     gst_omx_port_deallocate_buffers (self->enc_in_port);
     gst_omx_port_deallocate_buffers (self->enc_out_port);
     if (state > OMX_StateLoaded)
@@ -424,6 +695,20 @@ gst_omx_video_enc_close (GstVideoEncoder * encoder)
   return TRUE;
 }
 
+static void
+gst_omx_video_enc_free_static_state (GstOMXVideoEnc * self)
+{
+  g_free (self->static_prev);
+  g_free (self->static_cur);
+  g_free (self->static_block_sad);
+  self->static_prev = NULL;
+  self->static_cur = NULL;
+  self->static_block_sad = NULL;
+  self->static_width = 0;
+  self->static_height = 0;
+  self->static_skipped = 0;
+}
+
 static void
 gst_omx_video_enc_finalize (GObject * object)
 {
@@ -432,6 +717,8 @@ gst_omx_video_enc_finalize (GObject * object)
   g_mutex_clear (&self->drain_lock);
   g_cond_clear (&self->drain_cond);
 
+  gst_omx_video_enc_free_static_state (self);
+
   G_OBJECT_CLASS (gst_omx_video_enc_parent_class)->finalize (object);
 }
 
@@ -441,39 +728,80 @@ gst_omx_video_enc_set_property (GObject * object, guint prop_id,
 {
   GstOMXVideoEnc *self = GST_OMX_VIDEO_ENC (object);
 
+  /* Settings that can change while playing are applied by
+   * gst_omx_video_enc_handle_frame() before the next frame */
   switch (prop_id) {
     case PROP_RC_MODE:
       self->rc_mode = g_value_get_enum (value);
       break;
     case PROP_BITRATE:
+      GST_OBJECT_LOCK (self);
       self->bitrate = g_value_get_uint (value);
-      if (self->enc) {
-        OMX_VIDEO_CONFIG_BITRATETYPE config;
-        OMX_ERRORTYPE err;
-
-        GST_OMX_INIT_STRUCT (&config);
-        config.nPortIndex = self->enc_out_port->index;
-        config.nEncodeBitrate = self->bitrate;
-        err =
-            gst_omx_component_set_config (self->enc,
-            OMX_IndexConfigVideoBitrate, &config);
-        if (err != OMX_ErrorNone)
-          GST_ERROR_OBJECT (self,
-              "Failed to set bitrate parameter: %s (0x%08x)",
-              gst_omx_error_to_string (err), err);
-      }
+      self->pending_config |= GST_OMX_VIDEO_ENC_CONFIG_BITRATE;
+      GST_OBJECT_UNLOCK (self);
       break;
     case PROP_QUANT_I_FRAMES:
+      GST_OBJECT_LOCK (self);
       self->quant_i_frames = g_value_get_uint (value);
+      self->pending_config |= GST_OMX_VIDEO_ENC_CONFIG_QUANT;
+      GST_OBJECT_UNLOCK (self);
       break;
     case PROP_QUANT_P_FRAMES:
+      GST_OBJECT_LOCK (self);
       self->quant_p_frames = g_value_get_uint (value);
+      self->pending_config |= GST_OMX_VIDEO_ENC_CONFIG_QUANT;
+      GST_OBJECT_UNLOCK (self);
       break;
     case PROP_QUANT_B_FRAMES:
+      GST_OBJECT_LOCK (self);
       self->quant_b_frames = g_value_get_uint (value);
+      self->pending_config |= GST_OMX_VIDEO_ENC_CONFIG_QUANT;
+      GST_OBJECT_UNLOCK (self);
       break;
     case PROP_INTRA_FRAME_INTERVAL:
+      GST_OBJECT_LOCK (self);
       self->iframeinterval = g_value_get_uint (value);
+      self->pending_config |= GST_OMX_VIDEO_ENC_CONFIG_INTRA_PERIOD;
+      GST_OBJECT_UNLOCK (self);
+      break;
+    case PROP_QP_RANGE:
+    {
+      const gchar *str = g_value_get_string (value);
+      guint32 range[6];
+
+      memset (range, 0xff, sizeof (range));
+      if (str && sscanf (str, "%u,%u:%u,%u:%u,%u", &range[0], &range[1],
+              &range[2], &range[3], &range[4], &range[5]) != 6) {
+        GST_WARNING_OBJECT (self, "Invalid qp-range \"%s\"", str);
+        break;
+      }
+
+      GST_OBJECT_LOCK (self);
+      memcpy (self->qp_range, range, sizeof (range));
+      self->pending_config |= GST_OMX_VIDEO_ENC_CONFIG_QP_RANGE;
+      GST_OBJECT_UNLOCK (self);
+      break;
+    }
+    case PROP_SLICE_LEVEL_ENCODE:
+      self->slice_level_encode = g_value_get_boolean (value);
+      break;
+    case PROP_OUTPUT_WIDTH:
+      self->output_width = g_value_get_uint (value);
+      break;
+    case PROP_OUTPUT_HEIGHT:
+      self->output_height = g_value_get_uint (value);
+      break;
+    case PROP_RGB_MATRIX:
+      self->rgb_matrix = g_value_get_enum (value);
+      break;
+    case PROP_RGB_FULL_RANGE:
+      self->rgb_full_range = g_value_get_boolean (value);
+      break;
+    case PROP_STATIC_THRESHOLD:
+      self->static_threshold = g_value_get_uint (value);
+      break;
+    case PROP_MAX_SKIP_FRAMES:
+      self->max_skip_frames = g_value_get_uint (value);
       break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
@@ -481,6 +809,25 @@ gst_omx_video_enc_set_property (GObject * object, guint prop_id,
   }
 }
 
+static GstStructure *
+gst_omx_video_enc_create_stats (GstOMXVideoEnc * self)
+{
+  GstOMXVideoEncStats *stats = &self->stats;
+  GstStructure *s;
+
+  GST_OBJECT_LOCK (self);
+  s = gst_structure_new ("application/x-omx-video-enc-stats",
+      "frames", G_TYPE_UINT64, stats->frames,
+      "bytes", G_TYPE_UINT64, stats->bytes,
+      "bitrate", G_TYPE_UINT64, stats->bitrate,
+      "framerate", G_TYPE_DOUBLE, stats->framerate,
+      "average-qp", G_TYPE_DOUBLE, stats->average_qp,
+      "average-encode-time", G_TYPE_UINT64, stats->average_encode_time, NULL);
+  GST_OBJECT_UNLOCK (self);
+
+  return s;
+}
+
 static void
 gst_omx_video_enc_get_property (GObject * object, guint prop_id, GValue * value,
     GParamSpec * pspec)
@@ -495,17 +842,58 @@ gst_omx_video_enc_get_property (GObject * object, guint prop_id, GValue * value,
       g_value_set_uint (value, self->bitrate);
       break;
     case PROP_QUANT_I_FRAMES:
+      GST_OBJECT_LOCK (self);
       g_value_set_uint (value, self->quant_i_frames);
+      GST_OBJECT_UNLOCK (self);
       break;
     case PROP_QUANT_P_FRAMES:
+      GST_OBJECT_LOCK (self);
       g_value_set_uint (value, self->quant_p_frames);
+      GST_OBJECT_UNLOCK (self);
       break;
     case PROP_QUANT_B_FRAMES:
+      GST_OBJECT_LOCK (self);
       g_value_set_uint (value, self->quant_b_frames);
+      GST_OBJECT_UNLOCK (self);
       break;
     case PROP_INTRA_FRAME_INTERVAL:
       g_value_set_uint (value, self->iframeinterval);
       break;
+    case PROP_QP_RANGE:
+      GST_OBJECT_LOCK (self);
+      if (self->qp_range[0] == 0xffffffff)
+        g_value_set_string (value, NULL);
+      else
+        g_value_take_string (value,
+            g_strdup_printf ("%u,%u:%u,%u:%u,%u", self->qp_range[0],
+                self->qp_range[1], self->qp_range[2], self->qp_range[3],
+                self->qp_range[4], self->qp_range[5]));
+      GST_OBJECT_UNLOCK (self);
+      break;
+    case PROP_SLICE_LEVEL_ENCODE:
+      g_value_set_boolean (value, self->slice_level_encode);
+      break;
+    case PROP_OUTPUT_WIDTH:
+      g_value_set_uint (value, self->output_width);
+      break;
+    case PROP_OUTPUT_HEIGHT:
+      g_value_set_uint (value, self->output_height);
+      break;
+    case PROP_RGB_MATRIX:
+      g_value_set_enum (value, self->rgb_matrix);
+      break;
+    case PROP_RGB_FULL_RANGE:
+      g_value_set_boolean (value, self->rgb_full_range);
+      break;
+    case PROP_STATS:
+      g_value_take_boxed (value, gst_omx_video_enc_create_stats (self));
+      break;
+    case PROP_STATIC_THRESHOLD:
+      g_value_set_uint (value, self->static_threshold);
+      break;
+    case PROP_MAX_SKIP_FRAMES:
+      g_value_set_uint (value, self->max_skip_frames);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -671,6 +1059,234 @@ _find_nearest_frame (GstOMXVideoEnc * self, GstOMXBuffer * buf)
   return best;
 }
 
+/* Like gst_video_encoder_set_output_state() but with the size
+ * the component encodes */
+static GstVideoCodecState *
+gst_omx_video_enc_set_output_state (GstOMXVideoEnc * self, GstCaps * caps,
+    GstVideoCodecState * reference)
+{
+  OMX_PARAM_PORTDEFINITIONTYPE *port_def = &self->enc_in_port->port_def;
+  GstVideoCodecState *state;
+
+  state =
+      gst_video_encoder_set_output_state (GST_VIDEO_ENCODER (self), caps,
+      reference);
+  state->info.width = port_def->format.video.nFrameWidth;
+  state->info.height = port_def->format.video.nFrameHeight;
+
+  return state;
+}
+
+/* Frames come out in decoding order, so the n-th finished frame gets the
+ * n-th input timestamp as DTS, shifted by the reorder delay to stay
+ * before its PTS. A frame finishing ahead of frames with lower
+ * timestamps hands its own timestamp on to the one whose it takes. */
+static void
+gst_omx_video_enc_set_dts (GstOMXVideoEnc * self, GstVideoCodecFrame * frame)
+{
+  BufferIdentification *id = gst_video_codec_frame_get_user_data (frame);
+  BufferIdentification *min_id = NULL;
+  GstClockTime duration, delay;
+  GList *frames, *l;
+
+  if (self->reorder_frames == 0 || !id || GST_CLOCK_TIME_IS_VALID (frame->dts))
+    return;
+
+  frames = gst_video_encoder_get_frames (GST_VIDEO_ENCODER (self));
+  for (l = frames; l; l = l->next) {
+    BufferIdentification *tmp = gst_video_codec_frame_get_user_data (l->data);
+
+    if (tmp && GST_CLOCK_TIME_IS_VALID (tmp->dts)
+        && (min_id == NULL || tmp->dts < min_id->dts))
+      min_id = tmp;
+  }
+  g_list_foreach (frames, (GFunc) gst_video_codec_frame_unref, NULL);
+  g_list_free (frames);
+
+  if (min_id == NULL)
+    return;
+
+  duration = frame->duration;
+  if (!GST_CLOCK_TIME_IS_VALID (duration) && self->input_state
+      && self->input_state->info.fps_n > 0)
+    duration = gst_util_uint64_scale (GST_SECOND,
+        self->input_state->info.fps_d, self->input_state->info.fps_n);
+  delay = GST_CLOCK_TIME_IS_VALID (duration) ?
+      self->reorder_frames * duration : 0;
+
+  /* Frames before the first B frame can't go below zero */
+  frame->dts = min_id->dts > delay ? min_id->dts - delay : 0;
+  if (min_id != id)
+    min_id->dts = id->dts;
+  id->dts = GST_CLOCK_TIME_NONE;
+
+  GST_LOG_OBJECT (self, "Frame %u: PTS %" GST_TIME_FORMAT ", DTS %"
+      GST_TIME_FORMAT, frame->system_frame_number, GST_TIME_ARGS (frame->pts),
+      GST_TIME_ARGS (frame->dts));
+}
+
+/* Attaches a stats meta for @frame to @outbuf, the buffer that finishes
+ * the frame, and accounts the frame in the stats property. @size is the
+ * encoded size of the whole frame. */
+static void
+gst_omx_video_enc_add_stats (GstOMXVideoEnc * self,
+    GstVideoCodecFrame * frame, GstBuffer * outbuf, gsize size)
+{
+  GstOMXVideoEncStats *stats = &self->stats;
+  GstOMXVideoEncStatsMeta *meta;
+  BufferIdentification *id = gst_video_codec_frame_get_user_data (frame);
+  gint64 now = g_get_monotonic_time ();
+  gboolean last_output;
+
+  meta = (GstOMXVideoEncStatsMeta *) gst_buffer_add_meta (outbuf,
+      GST_OMX_VIDEO_ENC_STATS_META_INFO, NULL);
+  meta->size = size;
+  /* Frames output after a later one were reordered, which only
+   * happens to B frames */
+  if (GST_VIDEO_CODEC_FRAME_IS_SYNC_POINT (frame))
+    meta->picture_type = OMX_VIDEO_PictureTypeI;
+  else if (self->reorder_frames > 0 && GST_CLOCK_TIME_IS_VALID (frame->pts)
+      && GST_CLOCK_TIME_IS_VALID (self->max_out_pts)
+      && frame->pts < self->max_out_pts)
+    meta->picture_type = OMX_VIDEO_PictureTypeB;
+  else
+    meta->picture_type = OMX_VIDEO_PictureTypeP;
+  if (GST_CLOCK_TIME_IS_VALID (frame->pts)
+      && (!GST_CLOCK_TIME_IS_VALID (self->max_out_pts)
+          || frame->pts > self->max_out_pts))
+    self->max_out_pts = frame->pts;
+  if (id && id->submit_time)
+    meta->encode_time = (now - id->submit_time) * GST_USECOND;
+
+  /* The component only reports the QP of the frame it encoded last,
+   * which is another one if more output is already waiting */
+  g_mutex_lock (&self->enc->lock);
+  last_output = g_queue_is_empty (&self->enc_out_port->pending_buffers);
+  g_mutex_unlock (&self->enc->lock);
+
+  if (self->last_qp_index && last_output) {
+    NVX_PARAM_LASTFRAMEQP last_qp;
+    OMX_ERRORTYPE err;
+
+    GST_OMX_INIT_STRUCT (&last_qp);
+    last_qp.nPortIndex = self->enc_out_port->index;
+    err =
+        gst_omx_component_get_config (self->enc, self->last_qp_index,
+        &last_qp);
+    if (err == OMX_ErrorNone)
+      meta->qp = last_qp.LastFrameQP;
+  }
+
+  GST_LOG_OBJECT (self, "Frame %u: %" G_GSIZE_FORMAT " bytes, qp %d, "
+      "encode time %" GST_TIME_FORMAT, frame->system_frame_number, size,
+      (gint) meta->qp, GST_TIME_ARGS (meta->encode_time));
+
+  GST_OBJECT_LOCK (self);
+  stats->frames++;
+  stats->bytes += size;
+
+  if (stats->window_start == 0)
+    stats->window_start = now;
+  stats->window_frames++;
+  stats->window_bytes += size;
+  if (GST_CLOCK_TIME_IS_VALID (frame->duration))
+    stats->window_duration += frame->duration;
+  if (meta->qp != G_MAXUINT) {
+    stats->window_qp += meta->qp;
+    stats->window_qp_frames++;
+  }
+  if (GST_CLOCK_TIME_IS_VALID (meta->encode_time))
+    stats->window_encode_time += meta->encode_time;
+
+  if (now - stats->window_start >= STATS_WINDOW_USEC) {
+    gint64 elapsed = now - stats->window_start;
+
+    /* Bitrate relative to stream time, wall clock if durations are unknown */
+    if (stats->window_duration > 0)
+      stats->bitrate =
+          gst_util_uint64_scale (stats->window_bytes * 8, GST_SECOND,
+          stats->window_duration);
+    else
+      stats->bitrate =
+          gst_util_uint64_scale (stats->window_bytes * 8, G_USEC_PER_SEC,
+          elapsed);
+    stats->framerate =
+        (gdouble) stats->window_frames * G_USEC_PER_SEC / elapsed;
+    stats->average_qp = stats->window_qp_frames ?
+        (gdouble) stats->window_qp / stats->window_qp_frames : 0.0;
+    stats->average_encode_time =
+        stats->window_encode_time / stats->window_frames;
+
+    stats->window_start = now;
+    stats->window_frames = 0;
+    stats->window_bytes = 0;
+    stats->window_duration = 0;
+    stats->window_qp = 0;
+    stats->window_qp_frames = 0;
+    stats->window_encode_time = 0;
+  }
+  GST_OBJECT_UNLOCK (self);
+}
+
+static void
+gst_omx_video_enc_reset_slices (GstOMXVideoEnc * self)
+{
+  if (self->slice_frame) {
+    gst_video_codec_frame_unref (self->slice_frame);
+    self->slice_frame = NULL;
+  }
+  self->slice_bytes = 0;
+}
+
+/* Sends @outbuf as one slice of @frame without waiting for the other
+ * slices. The first slice finishes the frame, so the base class sends
+ * pending events, headers and tags before it, the following slices are
+ * pushed directly until @last. Takes ownership of @frame and @outbuf. */
+static GstFlowReturn
+gst_omx_video_enc_push_slice (GstOMXVideoEnc * self,
+    GstVideoCodecFrame * frame, GstBuffer * outbuf, gboolean last)
+{
+  GstFlowReturn flow_ret;
+  gsize size = gst_buffer_get_size (outbuf);
+
+  /* Marks the end of the access unit for payloaders */
+  if (last) {
+    GST_BUFFER_FLAG_SET (outbuf, GST_BUFFER_FLAG_MARKER);
+    gst_omx_video_enc_add_stats (self, frame, outbuf, self->slice_bytes + size);
+  }
+
+  if (frame != self->slice_frame) {
+    GST_LOG_OBJECT (self, "Finishing frame %u with its first slice",
+        frame->system_frame_number);
+    if (!last)
+      self->slice_frame = gst_video_codec_frame_ref (frame);
+    self->slice_bytes = last ? 0 : size;
+    frame->output_buffer = outbuf;
+    return gst_video_encoder_finish_frame (GST_VIDEO_ENCODER (self), frame);
+  }
+
+  /* All slices of a frame share its timestamps and sync point */
+  GST_BUFFER_PTS (outbuf) = frame->pts;
+  GST_BUFFER_DTS (outbuf) =
+      GST_CLOCK_TIME_IS_VALID (frame->dts) ? frame->dts : frame->pts;
+  GST_BUFFER_DURATION (outbuf) = frame->duration;
+  if (GST_VIDEO_CODEC_FRAME_IS_SYNC_POINT (frame))
+    GST_BUFFER_FLAG_UNSET (outbuf, GST_BUFFER_FLAG_DELTA_UNIT);
+  else
+    GST_BUFFER_FLAG_SET (outbuf, GST_BUFFER_FLAG_DELTA_UNIT);
+
+  GST_LOG_OBJECT (self, "Pushing slice of frame %u",
+      frame->system_frame_number);
+  self->slice_bytes += size;
+  gst_video_codec_frame_unref (frame);
+  if (last)
+    gst_omx_video_enc_reset_slices (self);
+
+  flow_ret = gst_pad_push (GST_VIDEO_ENCODER_SRC_PAD (self), outbuf);
+
+  return flow_ret;
+}
+
 static GstFlowReturn
 gst_omx_video_enc_handle_output_frame (GstOMXVideoEnc * self, GstOMXPort * port,
     GstOMXBuffer * buf, GstVideoCodecFrame * frame)
@@ -699,9 +1315,7 @@ gst_omx_video_enc_handle_output_frame (GstOMXVideoEnc * self, GstOMXPort * port,
           buf->omx_buf->nFilledLen);
       gst_buffer_unmap (codec_data, &map);
     }
-    state =
-        gst_video_encoder_set_output_state (GST_VIDEO_ENCODER (self), caps,
-        self->input_state);
+    state = gst_omx_video_enc_set_output_state (self, caps, self->input_state);
     state->codec_data = codec_data;
     if (!gst_video_encoder_negotiate (GST_VIDEO_ENCODER (self))) {
       gst_video_codec_frame_unref (frame);
@@ -747,7 +1361,16 @@ gst_omx_video_enc_handle_output_frame (GstOMXVideoEnc * self, GstOMXPort * port,
         GST_BUFFER_FLAG_SET (outbuf, GST_BUFFER_FLAG_DELTA_UNIT);
     }
 
-    if (frame) {
+    if (frame)
+      gst_omx_video_enc_set_dts (self, frame);
+
+    if (frame && self->slice_level_encode) {
+      /* The component sets ENDOFFRAME only on the last slice */
+      flow_ret = gst_omx_video_enc_push_slice (self, frame, outbuf,
+          buf->omx_buf->nFlags & OMX_BUFFERFLAG_ENDOFFRAME);
+    } else if (frame) {
+      gst_omx_video_enc_add_stats (self, frame, outbuf,
+          gst_buffer_get_size (outbuf));
       frame->output_buffer = outbuf;
       flow_ret =
           gst_video_encoder_finish_frame (GST_VIDEO_ENCODER (self), frame);
@@ -755,6 +1378,10 @@ gst_omx_video_enc_handle_output_frame (GstOMXVideoEnc * self, GstOMXPort * port,
       GST_ERROR_OBJECT (self, "No corresponding frame found");
       flow_ret = gst_pad_push (GST_VIDEO_ENCODER_SRC_PAD (self), outbuf);
     }
+  } else if (frame != NULL && frame == self->slice_frame) {
+    /* Empty end of a frame that was already finished */
+    gst_video_codec_frame_unref (frame);
+    gst_omx_video_enc_reset_slices (self);
   } else if (frame != NULL) {
     flow_ret = gst_video_encoder_finish_frame (GST_VIDEO_ENCODER (self), frame);
   }
@@ -823,9 +1450,7 @@ gst_omx_video_enc_loop (GstOMXVideoEnc * self)
 
     GST_DEBUG_OBJECT (self, "Setting output state: %" GST_PTR_FORMAT, caps);
 
-    state =
-        gst_video_encoder_set_output_state (GST_VIDEO_ENCODER (self), caps,
-        self->input_state);
+    state = gst_omx_video_enc_set_output_state (self, caps, self->input_state);
     gst_video_codec_state_unref (state);
 
     if (!gst_video_encoder_negotiate (GST_VIDEO_ENCODER (self))) {
@@ -881,7 +1506,11 @@ gst_omx_video_enc_loop (GstOMXVideoEnc * self)
       (guint) buf->omx_buf->nFlags, (guint64) buf->omx_buf->nTimeStamp);
 
   GST_VIDEO_ENCODER_STREAM_LOCK (self);
-  frame = _find_nearest_frame (self, buf);
+  /* Later slices belong to the frame their first slice finished */
+  if (self->slice_frame)
+    frame = gst_video_codec_frame_ref (self->slice_frame);
+  else
+    frame = _find_nearest_frame (self, buf);
 
   g_assert (klass->handle_output_frame);
   flow_ret = klass->handle_output_frame (self, self->enc_out_port, buf, frame);
@@ -1013,6 +1642,12 @@ gst_omx_video_enc_start (GstVideoEncoder * encoder)
   self->last_upstream_ts = 0;
   self->eos = FALSE;
   self->downstream_flow_ret = GST_FLOW_OK;
+  self->slice_bytes = 0;
+  self->max_out_pts = GST_CLOCK_TIME_NONE;
+
+  GST_OBJECT_LOCK (self);
+  memset (&self->stats, 0, sizeof (self->stats));
+  GST_OBJECT_UNLOCK (self);
 
   return TRUE;
 }
@@ -1042,6 +1677,10 @@ gst_omx_video_enc_stop (GstVideoEncoder * encoder)
     gst_video_codec_state_unref (self->input_state);
   self->input_state = NULL;
 
+  gst_omx_video_enc_reset_slices (self);
+
+  gst_omx_video_enc_free_static_state (self);
+
   g_mutex_lock (&self->drain_lock);
   self->draining = FALSE;
   g_cond_broadcast (&self->drain_cond);
@@ -1265,31 +1904,329 @@ gstomx_set_bitrate (GstOMXVideoEnc * self)
   return err;
 }
 
-static gboolean
-gst_omx_video_enc_set_format (GstVideoEncoder * encoder,
-    GstVideoCodecState * state)
+/* Sets the QP range of the qp-range property. While executing the
+ * quantization parameter can't be changed anymore, so with @fix_quant
+ * the frame types with a quantization set get it as min and max QP. */
+static OMX_ERRORTYPE
+gstomx_set_qp_range (GstOMXVideoEnc * self, gboolean fix_quant)
 {
-  GstOMXVideoEnc *self;
-  GstOMXVideoEncClass *klass;
-  OMX_ERRORTYPE err;
-  gboolean needs_disable = FALSE;
-  OMX_PARAM_PORTDEFINITIONTYPE port_def;
-  GstVideoInfo *info = &state->info;
-  GList *negotiation_map = NULL, *l;
+  OMX_INDEXTYPE eIndex;
+  OMX_ERRORTYPE eError = OMX_ErrorNone;
+  NVX_CONFIG_VIDENC_QUANTIZATION_RANGE oQpRange;
 
-  self = GST_OMX_VIDEO_ENC (encoder);
-  klass = GST_OMX_VIDEO_ENC_GET_CLASS (encoder);
+  eError =
+      gst_omx_component_get_index (self->enc,
+      (gpointer) NVX_INDEX_CONFIG_VIDEO_ENCODE_QUANTIZATION_RANGE, &eIndex);
+  if (eError == OMX_ErrorNone) {
+    GST_OMX_INIT_STRUCT (&oQpRange);
+    oQpRange.nPortIndex = self->enc_out_port->index;
+
+    GST_OBJECT_LOCK (self);
+    oQpRange.nMinQpI = self->qp_range[0];
+    oQpRange.nMaxQpI = self->qp_range[1];
+    oQpRange.nMinQpP = self->qp_range[2];
+    oQpRange.nMaxQpP = self->qp_range[3];
+    oQpRange.nMinQpB = self->qp_range[4];
+    oQpRange.nMaxQpB = self->qp_range[5];
+    if (fix_quant && self->quant_i_frames != 0xffffffff)
+      oQpRange.nMinQpI = oQpRange.nMaxQpI = self->quant_i_frames;
+    if (fix_quant && self->quant_p_frames != 0xffffffff)
+      oQpRange.nMinQpP = oQpRange.nMaxQpP = self->quant_p_frames;
+    if (fix_quant && self->quant_b_frames != 0xffffffff)
+      oQpRange.nMinQpB = oQpRange.nMaxQpB = self->quant_b_frames;
+    GST_OBJECT_UNLOCK (self);
+
+    eError = gst_omx_component_set_config (self->enc, eIndex, &oQpRange);
+  }
+  if (eError != OMX_ErrorNone)
+    GST_ERROR_OBJECT (self,
+        "Failed to set qp range: %s (0x%08x)",
+        gst_omx_error_to_string (eError), eError);
+  return eError;
+}
 
-  GST_DEBUG_OBJECT (self, "Setting new format %s",
-      gst_video_format_to_string (info->finfo->format));
+static OMX_ERRORTYPE
+gstomx_set_framerate (GstOMXVideoEnc * self)
+{
+  GstOMXVideoEncClass *klass = GST_OMX_VIDEO_ENC_GET_CLASS (self);
+  OMX_CONFIG_FRAMERATETYPE oFramerate;
+  GstVideoInfo *info = &self->input_state->info;
+  OMX_ERRORTYPE err;
 
-  gst_omx_port_get_port_definition (self->enc_in_port, &port_def);
-  gst_omx_video_enc_check_nvfeatures (self, state);
+  GST_OMX_INIT_STRUCT (&oFramerate);
+  oFramerate.nPortIndex = self->enc_out_port->index;
 
-  needs_disable =
-      gst_omx_component_get_state (self->enc,
-      GST_CLOCK_TIME_NONE) != OMX_StateLoaded;
-  /* If the component is not in Loaded state and a real format change happens
+  if (info->fps_n == 0)
+    oFramerate.xEncodeFramerate = 0;
+  else if (!(klass->cdata.hacks & GST_OMX_HACK_VIDEO_FRAMERATE_INTEGER))
+    oFramerate.xEncodeFramerate = (info->fps_n << 16) / (info->fps_d);
+  else
+    oFramerate.xEncodeFramerate = (info->fps_n) / (info->fps_d);
+
+  err =
+      gst_omx_component_set_config (self->enc,
+      OMX_IndexConfigVideoFramerate, &oFramerate);
+  if (err != OMX_ErrorNone)
+    GST_ERROR_OBJECT (self,
+        "Failed to set framerate: %s (0x%08x)",
+        gst_omx_error_to_string (err), err);
+
+  return err;
+}
+
+/* Applies the settings changed while playing. Called at a frame boundary
+ * so every frame is encoded with one consistent configuration; failures
+ * are not fatal and keep the previous setting. */
+static void
+gst_omx_video_enc_apply_pending_config (GstOMXVideoEnc * self)
+{
+  GstOMXVideoEncClass *klass = GST_OMX_VIDEO_ENC_GET_CLASS (self);
+  guint pending;
+
+  GST_OBJECT_LOCK (self);
+  pending = self->pending_config;
+  self->pending_config = 0;
+  GST_OBJECT_UNLOCK (self);
+
+  if (!pending)
+    return;
+
+  GST_DEBUG_OBJECT (self, "Applying new configuration 0x%x", pending);
+
+  if (pending & GST_OMX_VIDEO_ENC_CONFIG_BITRATE)
+    gstomx_set_bitrate (self);
+  if (pending & (GST_OMX_VIDEO_ENC_CONFIG_QUANT |
+          GST_OMX_VIDEO_ENC_CONFIG_QP_RANGE)) {
+    gboolean applied = gstomx_set_qp_range (self, TRUE) == OMX_ErrorNone;
+
+    GST_OBJECT_LOCK (self);
+    if (applied) {
+      self->applied_quant[0] = self->quant_i_frames;
+      self->applied_quant[1] = self->quant_p_frames;
+      self->applied_quant[2] = self->quant_b_frames;
+      memcpy (self->applied_qp_range, self->qp_range,
+          sizeof (self->qp_range));
+    } else {
+      /* Report the quantization that is still in effect */
+      self->quant_i_frames = self->applied_quant[0];
+      self->quant_p_frames = self->applied_quant[1];
+      self->quant_b_frames = self->applied_quant[2];
+      memcpy (self->qp_range, self->applied_qp_range,
+          sizeof (self->qp_range));
+    }
+    GST_OBJECT_UNLOCK (self);
+  }
+  if ((pending & GST_OMX_VIDEO_ENC_CONFIG_INTRA_PERIOD)
+      && klass->set_intra_period) {
+    OMX_ERRORTYPE err = klass->set_intra_period (self);
+
+    if (err != OMX_ErrorNone)
+      GST_ERROR_OBJECT (self,
+          "Failed to set iframeinterval %u: %s (0x%08x)",
+          (guint) self->iframeinterval, gst_omx_error_to_string (err), err);
+  }
+  if (pending & GST_OMX_VIDEO_ENC_CONFIG_FRAMERATE)
+    gstomx_set_framerate (self);
+}
+
+/* Reports the frames held back for reordering as latency */
+static void
+gst_omx_video_enc_update_latency (GstOMXVideoEnc * self, GstVideoInfo * info)
+{
+  GstClockTime latency = 0;
+
+  if (self->reorder_frames > 0 && info->fps_n > 0)
+    latency = gst_util_uint64_scale (self->reorder_frames * GST_SECOND,
+        info->fps_d, info->fps_n);
+
+  GST_DEBUG_OBJECT (self, "Latency %" GST_TIME_FORMAT " for %u reordered "
+      "frames", GST_TIME_ARGS (latency), self->reorder_frames);
+  gst_video_encoder_set_latency (GST_VIDEO_ENCODER (self), latency, latency);
+}
+
+/* TRUE if @new_state only differs from the current input state
+ * in the framerate */
+static gboolean
+gst_omx_video_enc_is_framerate_change (GstOMXVideoEnc * self,
+    GstVideoCodecState * new_state)
+{
+  GstVideoInfo *old_info, *new_info = &new_state->info;
+
+  if (!self->input_state)
+    return FALSE;
+
+  old_info = &self->input_state->info;
+
+  return GST_VIDEO_INFO_FORMAT (old_info) == GST_VIDEO_INFO_FORMAT (new_info)
+      && GST_VIDEO_INFO_WIDTH (old_info) == GST_VIDEO_INFO_WIDTH (new_info)
+      && GST_VIDEO_INFO_HEIGHT (old_info) == GST_VIDEO_INFO_HEIGHT (new_info)
+      && GST_VIDEO_INFO_INTERLACE_MODE (old_info) ==
+      GST_VIDEO_INFO_INTERLACE_MODE (new_info)
+      && gst_caps_features_is_equal (gst_caps_get_features (self->
+          input_state->caps, 0), gst_caps_get_features (new_state->caps, 0));
+}
+
+static OMX_ERRORTYPE
+gstomx_set_skip_frame (GstOMXVideoEnc * self)
+{
+  OMX_INDEXTYPE eIndex;
+  OMX_ERRORTYPE eError = OMX_ErrorNone;
+  OMX_CONFIG_BOOLEANTYPE oSkipFrame;
+
+  eError =
+      gst_omx_component_get_index (self->enc,
+      (gpointer) NVX_INDEX_PARAM_VIDENC_SKIP_FRAME, &eIndex);
+  if (eError == OMX_ErrorNone) {
+    GST_OMX_INIT_STRUCT (&oSkipFrame);
+    oSkipFrame.bEnabled = OMX_TRUE;
+
+    eError = gst_omx_component_set_parameter (self->enc, eIndex, &oSkipFrame);
+  }
+  return eError;
+}
+
+static OMX_ERRORTYPE
+gstomx_set_slice_level_encode (GstOMXVideoEnc * self)
+{
+  OMX_INDEXTYPE eIndex;
+  OMX_ERRORTYPE eError = OMX_ErrorNone;
+  NVX_CONFIG_VIDEO_SLICELEVELENCODE oSliceEncode;
+
+  eError =
+      gst_omx_component_get_index (self->enc,
+      (gpointer) NVX_INDEX_CONFIG_VIDEO_SLICELEVELENCODE, &eIndex);
+  if (eError == OMX_ErrorNone) {
+    GST_OMX_INIT_STRUCT (&oSliceEncode);
+    oSliceEncode.nPortIndex = self->enc_out_port->index;
+    oSliceEncode.SliceLevelEncode = OMX_TRUE;
+
+    eError = gst_omx_component_set_parameter (self->enc, eIndex,
+        &oSliceEncode);
+  }
+  return eError;
+}
+
+/* Derives the fixed point RGB to YUV matrix from the luma weights
+ * of the configured color matrix */
+static void
+gst_omx_video_enc_setup_rgb_conversion (GstOMXVideoEnc * self,
+    GstVideoInfo * info)
+{
+  GstOMXVideoEncRGBMatrix matrix = self->rgb_matrix;
+  gdouble kr, kg, kb, y_scale, uv_scale, y_offset;
+  gdouble m[3][3];
+  gint i, j;
+
+  if (matrix == GST_OMX_VIDEO_ENC_RGB_MATRIX_AUTO)
+    matrix = info->height >= 720 ? GST_OMX_VIDEO_ENC_RGB_MATRIX_BT709 :
+        GST_OMX_VIDEO_ENC_RGB_MATRIX_BT601;
+
+  if (matrix == GST_OMX_VIDEO_ENC_RGB_MATRIX_BT709) {
+    kr = 0.2126;
+    kb = 0.0722;
+  } else {
+    kr = 0.299;
+    kb = 0.114;
+  }
+  kg = 1.0 - kr - kb;
+
+  if (self->rgb_full_range) {
+    y_scale = uv_scale = 1.0;
+    y_offset = 0.0;
+  } else {
+    y_scale = 219.0 / 255.0;
+    uv_scale = 224.0 / 255.0;
+    y_offset = 16.0;
+  }
+
+  m[0][0] = kr * y_scale;
+  m[0][1] = kg * y_scale;
+  m[0][2] = kb * y_scale;
+  m[1][0] = -kr / (2.0 * (1.0 - kb)) * uv_scale;
+  m[1][1] = -kg / (2.0 * (1.0 - kb)) * uv_scale;
+  m[1][2] = 0.5 * uv_scale;
+  m[2][0] = 0.5 * uv_scale;
+  m[2][1] = -kg / (2.0 * (1.0 - kr)) * uv_scale;
+  m[2][2] = -kb / (2.0 * (1.0 - kr)) * uv_scale;
+
+  for (i = 0; i < 3; i++) {
+    for (j = 0; j < 3; j++) {
+      gdouble c = m[i][j] * (1 << RGB_TO_YUV_SHIFT);
+
+      self->rgb_coef[i][j] = (gint) (c < 0 ? c - 0.5 : c + 0.5);
+    }
+    /* Offset includes the rounding of the final shift */
+    self->rgb_coef[i][3] =
+        ((gint) (i == 0 ? y_offset : 128.0) << RGB_TO_YUV_SHIFT) +
+        (1 << (RGB_TO_YUV_SHIFT - 1));
+  }
+
+  GST_DEBUG_OBJECT (self, "Converting %s input with %s %s range matrix",
+      gst_video_format_to_string (GST_VIDEO_INFO_FORMAT (info)),
+      matrix == GST_OMX_VIDEO_ENC_RGB_MATRIX_BT709 ? "BT.709" : "BT.601",
+      self->rgb_full_range ? "full" : "limited");
+}
+
+static gboolean
+gst_omx_video_enc_set_format (GstVideoEncoder * encoder,
+    GstVideoCodecState * state)
+{
+  GstOMXVideoEnc *self;
+  GstOMXVideoEncClass *klass;
+  OMX_ERRORTYPE err;
+  gboolean needs_disable = FALSE;
+  OMX_PARAM_PORTDEFINITIONTYPE port_def;
+  GstVideoInfo *info = &state->info;
+  GList *negotiation_map = NULL, *l;
+  guint width, height;
+
+  self = GST_OMX_VIDEO_ENC (encoder);
+  klass = GST_OMX_VIDEO_ENC_GET_CLASS (encoder);
+
+  GST_DEBUG_OBJECT (self, "Setting new format %s",
+      gst_video_format_to_string (info->finfo->format));
+
+  gst_omx_port_get_port_definition (self->enc_in_port, &port_def);
+  gst_omx_video_enc_check_nvfeatures (self, state);
+
+  needs_disable =
+      gst_omx_component_get_state (self->enc,
+      GST_CLOCK_TIME_NONE) != OMX_StateLoaded;
+
+  /* A new framerate is passed to the running component before
+   * the next frame instead of reconfiguring the ports */
+  if (needs_disable && gst_omx_video_enc_is_framerate_change (self, state)) {
+    GstVideoCodecState *output_state;
+
+    GST_DEBUG_OBJECT (self, "Only the framerate changed");
+
+    gst_video_codec_state_unref (self->input_state);
+    self->input_state = gst_video_codec_state_ref (state);
+
+    output_state = gst_video_encoder_get_output_state (encoder);
+    if (output_state) {
+      GstCaps *caps = klass->get_caps (self, self->enc_out_port, state);
+
+      if (caps) {
+        GstVideoCodecState *new_state =
+            gst_omx_video_enc_set_output_state (self, caps, state);
+
+        if (output_state->codec_data)
+          new_state->codec_data = gst_buffer_ref (output_state->codec_data);
+        gst_video_codec_state_unref (new_state);
+      }
+      gst_video_codec_state_unref (output_state);
+    }
+
+    GST_OBJECT_LOCK (self);
+    self->pending_config |= GST_OMX_VIDEO_ENC_CONFIG_FRAMERATE;
+    GST_OBJECT_UNLOCK (self);
+
+    gst_omx_video_enc_update_latency (self, info);
+
+    return TRUE;
+  }
+  /* If the component is not in Loaded state and a real format change happens
    * we have to disable the port and re-allocate all buffers. If no real
    * format change happened we can just exit here.
    */
@@ -1305,6 +2242,7 @@ gst_omx_video_enc_set_format (GstVideoEncoder * encoder,
     gst_pad_stop_task (GST_VIDEO_ENCODER_SRC_PAD (encoder));
     GST_VIDEO_ENCODER_STREAM_LOCK (self);
 
+    gst_omx_video_enc_drop_in_port_pool (self);
     if (gst_omx_port_set_enabled (self->enc_in_port, FALSE) != OMX_ErrorNone)
       return FALSE;
     if (gst_omx_port_set_enabled (self->enc_out_port, FALSE) != OMX_ErrorNone)
@@ -1326,6 +2264,8 @@ gst_omx_video_enc_set_format (GstVideoEncoder * encoder,
             1 * GST_SECOND) != OMX_ErrorNone)
       return FALSE;
 
+    gst_omx_video_enc_reset_slices (self);
+
     GST_DEBUG_OBJECT (self, "Encoder drained and disabled");
   }
 
@@ -1339,6 +2279,13 @@ gst_omx_video_enc_set_format (GstVideoEncoder * encoder,
       case GST_VIDEO_FORMAT_NV12:
         port_def.format.video.eColorFormat = OMX_COLOR_FormatYUV420SemiPlanar;
         break;
+      case GST_VIDEO_FORMAT_RGBA:
+      case GST_VIDEO_FORMAT_BGRA:
+      case GST_VIDEO_FORMAT_RGBx:
+      case GST_VIDEO_FORMAT_BGRx:
+      case GST_VIDEO_FORMAT_RGB16:
+        port_def.format.video.eColorFormat = OMX_COLOR_FormatYUV420Planar;
+        break;
       default:
         GST_ERROR_OBJECT (self, "Unsupported format %s",
             gst_video_format_to_string (info->finfo->format));
@@ -1349,7 +2296,8 @@ gst_omx_video_enc_set_format (GstVideoEncoder * encoder,
     for (l = negotiation_map; l; l = l->next) {
       VideoNegotiationMap *m = l->data;
 
-      if (m->format == info->finfo->format) {
+      /* RGB is converted to the first format of the component */
+      if (m->format == info->finfo->format || GST_VIDEO_INFO_IS_RGB (info)) {
         port_def.format.video.eColorFormat = m->type;
         break;
       }
@@ -1358,16 +2306,35 @@ gst_omx_video_enc_set_format (GstVideoEncoder * encoder,
         (GDestroyNotify) video_negotiation_map_free);
   }
 
-  port_def.format.video.nFrameWidth = info->width;
+  /* Scaling happens while copying into the input buffers,
+   * NVMM buffers are passed to the component as they are */
+  width = self->output_width ? self->output_width : info->width;
+  height = self->output_height ? self->output_height : info->height;
+  if (self->hw_path && (width != info->width || height != info->height)) {
+    GST_ERROR_OBJECT (self, "Can't scale NVMM input from %ux%u to %ux%u",
+        info->width, info->height, width, height);
+    return FALSE;
+  } else if (GST_VIDEO_INFO_IS_RGB (info) && (width != info->width
+          || height != info->height)) {
+    GST_WARNING_OBJECT (self, "Can't scale RGB input, encoding at %ux%u",
+        info->width, info->height);
+    width = info->width;
+    height = info->height;
+  }
+
+  if (GST_VIDEO_INFO_IS_RGB (info))
+    gst_omx_video_enc_setup_rgb_conversion (self, info);
+
+  port_def.format.video.nFrameWidth = width;
   if (port_def.nBufferAlignment)
     port_def.format.video.nStride =
-        (info->width + port_def.nBufferAlignment - 1) &
+        (width + port_def.nBufferAlignment - 1) &
         (~(port_def.nBufferAlignment - 1));
   else
-    port_def.format.video.nStride = GST_ROUND_UP_4 (info->width);       /* safe (?) default */
+    port_def.format.video.nStride = GST_ROUND_UP_4 (width);     /* safe (?) default */
 
-  port_def.format.video.nFrameHeight = info->height;
-  port_def.format.video.nSliceHeight = info->height;
+  port_def.format.video.nFrameHeight = height;
+  port_def.format.video.nSliceHeight = height;
 
   switch (port_def.format.video.eColorFormat) {
     case OMX_COLOR_FormatYUV420Planar:
@@ -1403,12 +2370,14 @@ gst_omx_video_enc_set_format (GstVideoEncoder * encoder,
           &port_def) != OMX_ErrorNone)
     return FALSE;
 
+  self->reorder_frames = 0;
   if (klass->set_format) {
     if (!klass->set_format (self, self->enc_in_port, state)) {
       GST_ERROR_OBJECT (self, "Subclass failed to set the new format");
       return FALSE;
     }
   }
+  gst_omx_video_enc_update_latency (self, info);
 
   err = gstomx_set_rc_mode (self);
   if (err != OMX_ErrorNone) {
@@ -1426,6 +2395,43 @@ gst_omx_video_enc_set_format (GstVideoEncoder * encoder,
     return FALSE;
   }
 
+  if (gst_omx_component_get_index (self->enc,
+          (gpointer) NVX_INDEX_CONFIG_VIDEO_ENCODE_LAST_FRAME_QP,
+          &self->last_qp_index) != OMX_ErrorNone) {
+    GST_DEBUG_OBJECT (self, "Component doesn't report the frame QP");
+    self->last_qp_index = 0;
+  }
+
+  if (self->qp_range[0] != 0xffffffff
+      && gstomx_set_qp_range (self, FALSE) == OMX_ErrorNone) {
+    GST_OBJECT_LOCK (self);
+    memcpy (self->applied_qp_range, self->qp_range,
+        sizeof (self->qp_range));
+    GST_OBJECT_UNLOCK (self);
+  }
+
+  self->skip_frame_supported = FALSE;
+  if (self->static_threshold > 0) {
+    gst_omx_video_enc_free_static_state (self);
+    if (self->hw_path)
+      GST_WARNING_OBJECT (self,
+          "Static scene detection needs system memory input");
+    else if (gstomx_set_skip_frame (self) == OMX_ErrorNone)
+      self->skip_frame_supported = TRUE;
+    else
+      GST_INFO_OBJECT (self, "Dropping static frames instead of skipping");
+  }
+
+  if (self->slice_level_encode) {
+    err = gstomx_set_slice_level_encode (self);
+    if (err != OMX_ErrorNone) {
+      GST_WARNING_OBJECT (self,
+          "Error enabling slice level encode : %s (0x%08x)",
+          gst_omx_error_to_string (err), err);
+      return FALSE;
+    }
+  }
+
   GST_DEBUG_OBJECT (self, "Updating outport port definition");
   if (gst_omx_port_update_port_definition (self->enc_out_port,
           NULL) != OMX_ErrorNone)
@@ -1442,6 +2448,8 @@ gst_omx_video_enc_set_format (GstVideoEncoder * encoder,
       return FALSE;
     if (gst_omx_port_mark_reconfigured (self->enc_in_port) != OMX_ErrorNone)
       return FALSE;
+
+    gst_omx_video_enc_offer_in_port_pool (self);
   } else {
     /* Disable output port */
     if (gst_omx_port_set_enabled (self->enc_out_port, FALSE) != OMX_ErrorNone)
@@ -1492,6 +2500,12 @@ gst_omx_video_enc_set_format (GstVideoEncoder * encoder,
     gst_video_codec_state_unref (self->input_state);
   self->input_state = gst_video_codec_state_ref (state);
 
+  /* Everything was just configured from the current properties, except
+   * quantization which is only applied by open() */
+  GST_OBJECT_LOCK (self);
+  self->pending_config &= GST_OMX_VIDEO_ENC_CONFIG_QUANT;
+  GST_OBJECT_UNLOCK (self);
+
   /* Start the srcpad loop again */
   GST_DEBUG_OBJECT (self, "Starting task again");
   self->downstream_flow_ret = GST_FLOW_OK;
@@ -1525,6 +2539,9 @@ gst_omx_video_enc_reset (GstVideoEncoder * encoder, gboolean hard)
   gst_omx_port_set_flushing (self->enc_out_port, 5 * GST_SECOND, FALSE);
   gst_omx_port_populate (self->enc_out_port);
 
+  gst_omx_video_enc_reset_slices (self);
+  self->max_out_pts = GST_CLOCK_TIME_NONE;
+
   /* Start the srcpad loop again */
   self->last_upstream_ts = 0;
   self->eos = FALSE;
@@ -1535,6 +2552,316 @@ gst_omx_video_enc_reset (GstVideoEncoder * encoder, gboolean hard)
   return TRUE;
 }
 
+/* Bilinear scaling of one plane with @pixel_stride interleaved
+ * components per pixel, in 8 bit fixed point */
+static void
+gst_omx_video_enc_scale_plane (const guint8 * src, gint src_stride,
+    gint src_width, gint src_height, guint8 * dest, gint dest_stride,
+    gint dest_width, gint dest_height, gint pixel_stride)
+{
+  guint32 x_step = ((guint32) src_width << 16) / dest_width;
+  guint32 y_step = ((guint32) src_height << 16) / dest_height;
+  gint x, y, c;
+
+  for (y = 0; y < dest_height; y++) {
+    guint32 sy = y * y_step;
+    gint y0 = sy >> 16;
+    gint y1 = MIN (y0 + 1, src_height - 1);
+    guint fy = (sy >> 8) & 0xff;
+    const guint8 *row0 = src + y0 * src_stride;
+    const guint8 *row1 = src + y1 * src_stride;
+    guint8 *out = dest + y * dest_stride;
+
+    for (x = 0; x < dest_width; x++) {
+      guint32 sx = x * x_step;
+      gint x0 = (sx >> 16) * pixel_stride;
+      gint x1 = MIN ((gint) (sx >> 16) + 1, src_width - 1) * pixel_stride;
+      guint fx = (sx >> 8) & 0xff;
+
+      for (c = 0; c < pixel_stride; c++) {
+        guint top = row0[x0 + c] * (256 - fx) + row0[x1 + c] * fx;
+        guint bottom = row1[x0 + c] * (256 - fx) + row1[x1 + c] * fx;
+
+        out[x * pixel_stride + c] =
+            (top * (256 - fy) + bottom * fy + (1 << 15)) >> 16;
+      }
+    }
+  }
+}
+
+/* Scales the I420 or NV12 planes of @src into the planes @dest of the
+ * same format with @width x @height pixels */
+static void
+gst_omx_video_enc_scale_planes (GstVideoFrame * src, guint8 * dest[3],
+    const gint dest_stride[3], gint width, gint height)
+{
+  gst_omx_video_enc_scale_plane (GST_VIDEO_FRAME_COMP_DATA (src, 0),
+      GST_VIDEO_FRAME_COMP_STRIDE (src, 0),
+      GST_VIDEO_FRAME_COMP_WIDTH (src, 0),
+      GST_VIDEO_FRAME_COMP_HEIGHT (src, 0), dest[0], dest_stride[0], width,
+      height, 1);
+
+  if (GST_VIDEO_FRAME_FORMAT (src) == GST_VIDEO_FORMAT_I420) {
+    gint i;
+
+    for (i = 1; i < 3; i++) {
+      gst_omx_video_enc_scale_plane (GST_VIDEO_FRAME_COMP_DATA (src, i),
+          GST_VIDEO_FRAME_COMP_STRIDE (src, i),
+          GST_VIDEO_FRAME_COMP_WIDTH (src, i),
+          GST_VIDEO_FRAME_COMP_HEIGHT (src, i), dest[i], dest_stride[i],
+          (width + 1) / 2, (height + 1) / 2, 1);
+    }
+  } else {
+    gst_omx_video_enc_scale_plane (GST_VIDEO_FRAME_COMP_DATA (src, 1),
+        GST_VIDEO_FRAME_COMP_STRIDE (src, 1),
+        GST_VIDEO_FRAME_COMP_WIDTH (src, 1),
+        GST_VIDEO_FRAME_COMP_HEIGHT (src, 1), dest[1], dest_stride[1],
+        (width + 1) / 2, (height + 1) / 2, 2);
+  }
+}
+
+/* Scales @src into @dest, both I420 or both NV12 */
+void
+gst_omx_video_enc_scale_frame (GstVideoFrame * src, GstVideoFrame * dest)
+{
+  guint8 *planes[3] = { NULL, };
+  gint strides[3] = { 0, };
+  guint i;
+
+  g_return_if_fail (GST_VIDEO_FRAME_FORMAT (src) ==
+      GST_VIDEO_FRAME_FORMAT (dest));
+
+  for (i = 0; i < GST_VIDEO_FRAME_N_PLANES (dest); i++) {
+    planes[i] = GST_VIDEO_FRAME_PLANE_DATA (dest, i);
+    strides[i] = GST_VIDEO_FRAME_PLANE_STRIDE (dest, i);
+  }
+
+  gst_omx_video_enc_scale_planes (src, planes, strides,
+      GST_VIDEO_FRAME_WIDTH (dest), GST_VIDEO_FRAME_HEIGHT (dest));
+}
+
+/* Scales @inbuf to the size of the input port while copying it */
+static gboolean
+gst_omx_video_enc_scale_buffer (GstOMXVideoEnc * self, GstVideoInfo * info,
+    GstBuffer * inbuf, GstOMXBuffer * outbuf)
+{
+  OMX_PARAM_PORTDEFINITIONTYPE *port_def = &self->enc_in_port->port_def;
+  gint stride = port_def->format.video.nStride;
+  gint slice_height = port_def->format.video.nSliceHeight;
+  gint width = port_def->format.video.nFrameWidth;
+  gint height = port_def->format.video.nFrameHeight;
+  guint8 *dest = outbuf->omx_buf->pBuffer + outbuf->omx_buf->nOffset;
+  guint8 *planes[3];
+  gint strides[3];
+  GstVideoFrame frame;
+  gsize size;
+
+  if (stride == 0)
+    stride = GST_ROUND_UP_4 (width);
+
+  switch (info->finfo->format) {
+    case GST_VIDEO_FORMAT_I420:
+      size = stride * slice_height +
+          2 * ((stride / 2) * ((slice_height + 1) / 2));
+      break;
+    case GST_VIDEO_FORMAT_NV12:
+      size = stride * slice_height + stride * ((slice_height + 1) / 2);
+      break;
+    default:
+      GST_ERROR_OBJECT (self, "Unsupported format");
+      return FALSE;
+  }
+
+  if (outbuf->omx_buf->nOffset + size > outbuf->omx_buf->nAllocLen) {
+    GST_ERROR_OBJECT (self, "Invalid output buffer size");
+    return FALSE;
+  }
+
+  if (!gst_video_frame_map (&frame, info, inbuf, GST_MAP_READ)) {
+    GST_ERROR_OBJECT (self, "Invalid input buffer size");
+    return FALSE;
+  }
+
+  planes[0] = dest;
+  strides[0] = stride;
+  planes[1] = dest + stride * slice_height;
+  if (info->finfo->format == GST_VIDEO_FORMAT_I420) {
+    strides[1] = strides[2] = stride / 2;
+    planes[2] = planes[1] + (stride / 2) * ((slice_height + 1) / 2);
+  } else {
+    strides[1] = stride;
+    planes[2] = NULL;
+    strides[2] = 0;
+  }
+
+  gst_omx_video_enc_scale_planes (&frame, planes, strides, width, height);
+
+  gst_video_frame_unmap (&frame);
+
+  outbuf->omx_buf->nFilledLen = size;
+
+  return TRUE;
+}
+
+/* Splits one line of packed RGB into planar rows, so that the
+ * conversion below works on plain arrays */
+static void
+gst_omx_video_enc_unpack_rgb_row (const GstVideoFormatInfo * finfo,
+    const guint8 * src, gint width, guint8 * r, guint8 * g, guint8 * b)
+{
+  gint i;
+
+  if (GST_VIDEO_FORMAT_INFO_FORMAT (finfo) == GST_VIDEO_FORMAT_RGB16) {
+    const guint16 *p = (const guint16 *) src;
+
+    for (i = 0; i < width; i++) {
+      guint16 px = p[i];
+
+      r[i] = ((px >> 8) & 0xf8) | (px >> 13);
+      g[i] = ((px >> 3) & 0xfc) | ((px >> 9) & 0x03);
+      b[i] = ((px << 3) & 0xf8) | ((px >> 2) & 0x07);
+    }
+  } else {
+    const guint8 *pr = src + GST_VIDEO_FORMAT_INFO_POFFSET (finfo, 0);
+    const guint8 *pg = src + GST_VIDEO_FORMAT_INFO_POFFSET (finfo, 1);
+    const guint8 *pb = src + GST_VIDEO_FORMAT_INFO_POFFSET (finfo, 2);
+
+    for (i = 0; i < width; i++) {
+      r[i] = pr[i * 4];
+      g[i] = pg[i * 4];
+      b[i] = pb[i * 4];
+    }
+  }
+}
+
+/* Converts two planar RGB rows to two luma rows and one row of 2x2
+ * subsampled chroma. Straight fixed point loops without branches,
+ * so the compiler can vectorise them for NEON or SSE */
+static void
+gst_omx_video_enc_convert_rgb_rows (const gint coef[3][4], guint8 * rgb[2][3],
+    gint width, guint8 * y[2], guint8 * u, guint8 * v, gint uv_step)
+{
+  gint i, k;
+
+  for (k = 0; k < 2; k++) {
+    const guint8 *r = rgb[k][0], *g = rgb[k][1], *b = rgb[k][2];
+    guint8 *out = y[k];
+
+    for (i = 0; i < width; i++) {
+      gint val = (coef[0][0] * r[i] + coef[0][1] * g[i] + coef[0][2] * b[i] +
+          coef[0][3]) >> RGB_TO_YUV_SHIFT;
+
+      out[i] = CLAMP (val, 0, 255);
+    }
+  }
+
+  for (i = 0; i < (width + 1) / 2; i++) {
+    gint i0 = 2 * i, i1 = MIN (2 * i + 1, width - 1);
+    gint r = rgb[0][0][i0] + rgb[0][0][i1] + rgb[1][0][i0] + rgb[1][0][i1];
+    gint g = rgb[0][1][i0] + rgb[0][1][i1] + rgb[1][1][i0] + rgb[1][1][i1];
+    gint b = rgb[0][2][i0] + rgb[0][2][i1] + rgb[1][2][i0] + rgb[1][2][i1];
+    gint cb, cr;
+
+    /* Sums of four pixels, two more bits to shift out */
+    cb = (coef[1][0] * r + coef[1][1] * g + coef[1][2] * b +
+        (coef[1][3] << 2)) >> (RGB_TO_YUV_SHIFT + 2);
+    cr = (coef[2][0] * r + coef[2][1] * g + coef[2][2] * b +
+        (coef[2][3] << 2)) >> (RGB_TO_YUV_SHIFT + 2);
+
+    u[i * uv_step] = CLAMP (cb, 0, 255);
+    v[i * uv_step] = CLAMP (cr, 0, 255);
+  }
+}
+
+/* Converts RGB @inbuf directly into the YUV layout of the input port */
+static gboolean
+gst_omx_video_enc_convert_rgb (GstOMXVideoEnc * self, GstVideoInfo * info,
+    GstBuffer * inbuf, GstOMXBuffer * outbuf)
+{
+  OMX_PARAM_PORTDEFINITIONTYPE *port_def = &self->enc_in_port->port_def;
+  gint stride = port_def->format.video.nStride;
+  gint slice_height = port_def->format.video.nSliceHeight;
+  gint width = GST_VIDEO_INFO_WIDTH (info);
+  gint height = GST_VIDEO_INFO_HEIGHT (info);
+  guint8 *dest = outbuf->omx_buf->pBuffer + outbuf->omx_buf->nOffset;
+  guint8 *y_plane, *u_plane, *v_plane;
+  gint uv_stride, uv_step;
+  guint8 *rows, *rgb[2][3];
+  GstVideoFrame frame;
+  gsize size;
+  gint i, j;
+
+  if (stride == 0)
+    stride = GST_ROUND_UP_4 (width);
+
+  y_plane = dest;
+  switch (port_def->format.video.eColorFormat) {
+    case OMX_COLOR_FormatYUV420Planar:
+    case OMX_COLOR_FormatYUV420PackedPlanar:
+      uv_stride = stride / 2;
+      uv_step = 1;
+      u_plane = dest + stride * slice_height;
+      v_plane = u_plane + uv_stride * ((slice_height + 1) / 2);
+      size = (v_plane - dest) + uv_stride * ((height + 1) / 2);
+      break;
+    case OMX_COLOR_FormatYUV420SemiPlanar:
+      uv_stride = stride;
+      uv_step = 2;
+      u_plane = dest + stride * slice_height;
+      v_plane = u_plane + 1;
+      size = (u_plane - dest) + uv_stride * ((height + 1) / 2);
+      break;
+    default:
+      GST_ERROR_OBJECT (self, "Unsupported color format %d",
+          port_def->format.video.eColorFormat);
+      return FALSE;
+  }
+
+  if (outbuf->omx_buf->nOffset + size > outbuf->omx_buf->nAllocLen) {
+    GST_ERROR_OBJECT (self, "Invalid output buffer size");
+    return FALSE;
+  }
+
+  if (!gst_video_frame_map (&frame, info, inbuf, GST_MAP_READ)) {
+    GST_ERROR_OBJECT (self, "Invalid input buffer size");
+    return FALSE;
+  }
+
+  rows = g_malloc (6 * width);
+  for (i = 0; i < 2; i++)
+    for (j = 0; j < 3; j++)
+      rgb[i][j] = rows + (3 * i + j) * width;
+
+  for (j = 0; j < height; j += 2) {
+    const guint8 *src = GST_VIDEO_FRAME_PLANE_DATA (&frame, 0);
+    gint src_stride = GST_VIDEO_FRAME_PLANE_STRIDE (&frame, 0);
+    guint8 *y[2];
+
+    /* The last line of odd heights is paired with itself */
+    y[0] = y_plane + j * stride;
+    y[1] = j + 1 < height ? y[0] + stride : y[0];
+
+    gst_omx_video_enc_unpack_rgb_row (frame.info.finfo, src + j * src_stride,
+        width, rgb[0][0], rgb[0][1], rgb[0][2]);
+    if (j + 1 < height)
+      gst_omx_video_enc_unpack_rgb_row (frame.info.finfo,
+          src + (j + 1) * src_stride, width, rgb[1][0], rgb[1][1], rgb[1][2]);
+    else
+      memcpy (rows + 3 * width, rows, 3 * width);
+
+    gst_omx_video_enc_convert_rgb_rows ((const gint (*)[4]) self->rgb_coef,
+        rgb, width, y, u_plane + (j / 2) * uv_stride,
+        v_plane + (j / 2) * uv_stride, uv_step);
+  }
+
+  g_free (rows);
+  gst_video_frame_unmap (&frame);
+
+  outbuf->omx_buf->nFilledLen = size;
+
+  return TRUE;
+}
+
 static gboolean
 gst_omx_video_enc_fill_buffer (GstOMXVideoEnc * self, GstBuffer * inbuf,
     GstOMXBuffer * outbuf)
@@ -1545,9 +2872,18 @@ gst_omx_video_enc_fill_buffer (GstOMXVideoEnc * self, GstBuffer * inbuf,
   gboolean ret = FALSE;
   GstVideoFrame frame;
 
+  if (GST_VIDEO_INFO_IS_RGB (info)) {
+    ret = gst_omx_video_enc_convert_rgb (self, info, inbuf, outbuf);
+    goto done;
+  }
+
   if (info->width != port_def->format.video.nFrameWidth ||
       info->height != port_def->format.video.nFrameHeight) {
-    GST_ERROR_OBJECT (self, "Width or height do not match");
+    if (self->hw_path || (!self->output_width && !self->output_height)) {
+      GST_ERROR_OBJECT (self, "Width or height do not match");
+      goto done;
+    }
+    ret = gst_omx_video_enc_scale_buffer (self, info, inbuf, outbuf);
     goto done;
   }
 
@@ -1608,7 +2944,7 @@ gst_omx_video_enc_fill_buffer (GstOMXVideoEnc * self, GstBuffer * inbuf,
               port_def->format.video.nStride;
         if (i == 2)
           dest +=
-              (port_def->format.video.nSliceHeight / 2) *
+              ((port_def->format.video.nSliceHeight + 1) / 2) *
               (port_def->format.video.nStride / 2);
 
         src = GST_VIDEO_FRAME_COMP_DATA (&frame, i);
@@ -1706,6 +3042,111 @@ done:
   return ret;
 }
 
+/* Samples the luma of @inbuf and compares it against the last encoded
+ * frame. Returns TRUE if no block changed by more than static-threshold
+ * per sample on average. The samples are kept in static_cur until
+ * gst_omx_video_enc_handle_frame() decides to encode the frame. */
+static gboolean
+gst_omx_video_enc_is_static_frame (GstOMXVideoEnc * self, GstBuffer * inbuf)
+{
+  GstVideoFrame vframe;
+  const guint8 *data;
+  gint stride, pstride;
+  guint sw, sh, nblocks, x, y, bx;
+  guint32 limit;
+  gboolean is_static;
+
+  if (!gst_video_frame_map (&vframe, &self->input_state->info, inbuf,
+          GST_MAP_READ))
+    return FALSE;
+
+  sw = GST_VIDEO_FRAME_COMP_WIDTH (&vframe, 0) / STATIC_SAMPLE_STEP;
+  sh = GST_VIDEO_FRAME_COMP_HEIGHT (&vframe, 0) / STATIC_SAMPLE_STEP;
+  nblocks = (sw + STATIC_BLOCK_SAMPLES - 1) / STATIC_BLOCK_SAMPLES;
+
+  if (sw != self->static_width || sh != self->static_height) {
+    gst_omx_video_enc_free_static_state (self);
+    self->static_cur = g_malloc (sw * sh);
+    self->static_block_sad = g_new (guint32, nblocks);
+    self->static_width = sw;
+    self->static_height = sh;
+  }
+
+  data = GST_VIDEO_FRAME_COMP_DATA (&vframe, 0);
+  stride = GST_VIDEO_FRAME_COMP_STRIDE (&vframe, 0);
+  /* For RGB input the first component stands in for the luma */
+  pstride = GST_VIDEO_FRAME_COMP_PSTRIDE (&vframe, 0);
+  limit = self->static_threshold * STATIC_BLOCK_SAMPLES * STATIC_BLOCK_SAMPLES;
+  is_static = self->static_prev != NULL;
+
+  for (y = 0; y < sh; y++) {
+    const guint8 *src = data + y * STATIC_SAMPLE_STEP * stride;
+    guint8 *cur = self->static_cur + y * sw;
+
+    for (x = 0; x < sw; x++)
+      cur[x] = src[x * STATIC_SAMPLE_STEP * pstride];
+
+    /* Keep sampling after a change was found, the samples become
+     * the reference if the frame is encoded */
+    if (!is_static)
+      continue;
+
+    if (y % STATIC_BLOCK_SAMPLES == 0)
+      memset (self->static_block_sad, 0, nblocks * sizeof (guint32));
+
+    {
+      const guint8 *prev = self->static_prev + y * sw;
+      guint32 *sad = self->static_block_sad;
+
+      for (x = 0; x < sw; x++)
+        sad[x / STATIC_BLOCK_SAMPLES] += ABS ((gint) cur[x] - (gint) prev[x]);
+    }
+
+    if (y % STATIC_BLOCK_SAMPLES == STATIC_BLOCK_SAMPLES - 1 || y == sh - 1) {
+      for (bx = 0; bx < nblocks; bx++) {
+        if (self->static_block_sad[bx] > limit) {
+          is_static = FALSE;
+          break;
+        }
+      }
+    }
+  }
+
+  gst_video_frame_unmap (&vframe);
+
+  return is_static;
+}
+
+/* Returns the OMX buffer that upstream filled if @buffer comes from
+ * our input port pool and can be passed to the component as is */
+static GstOMXBuffer *
+gst_omx_video_enc_get_in_port_buffer (GstOMXVideoEnc * self,
+    GstBuffer * buffer)
+{
+  GstOMXBuffer *omx_buf;
+  GstMemory *mem;
+
+  if (!self->in_port_pool || buffer->pool != self->in_port_pool)
+    return NULL;
+
+  /* We take over the buffer until EmptyBufferDone, so nobody
+   * else may hold a reference */
+  if (gst_buffer_n_memory (buffer) != 1 || !gst_buffer_is_writable (buffer))
+    return NULL;
+
+  mem = gst_buffer_peek_memory (buffer, 0);
+  if (g_strcmp0 (mem->allocator->mem_type, GST_OMX_MEMORY_TYPE) != 0
+      || mem->offset != 0)
+    return NULL;
+
+  omx_buf = gst_mini_object_get_qdata (GST_MINI_OBJECT_CAST (buffer),
+      gst_omx_buffer_data_quark);
+  if (!omx_buf || omx_buf->port != self->enc_in_port || omx_buf->used)
+    return NULL;
+
+  return omx_buf;
+}
+
 static GstFlowReturn
 gst_omx_video_enc_handle_frame (GstVideoEncoder * encoder,
     GstVideoCodecFrame * frame)
@@ -1713,8 +3154,10 @@ gst_omx_video_enc_handle_frame (GstVideoEncoder * encoder,
   GstOMXAcquireBufferReturn acq_ret = GST_OMX_ACQUIRE_BUFFER_ERROR;
   GstOMXVideoEnc *self;
   GstOMXPort *port;
-  GstOMXBuffer *buf;
+  GstOMXBuffer *buf, *in_buf;
   OMX_ERRORTYPE err;
+  gboolean skip_frame = FALSE;
+  gboolean zero_copy = FALSE;
 
   self = GST_OMX_VIDEO_ENC (encoder);
 
@@ -1731,7 +3174,32 @@ gst_omx_video_enc_handle_frame (GstVideoEncoder * encoder,
     return self->downstream_flow_ret;
   }
 
+  if (self->static_threshold > 0 && !self->hw_path) {
+    if (gst_omx_video_enc_is_static_frame (self, frame->input_buffer)
+        && !GST_VIDEO_CODEC_FRAME_IS_FORCE_KEYFRAME (frame)
+        && self->static_skipped < self->max_skip_frames) {
+      skip_frame = TRUE;
+      self->static_skipped++;
+    } else {
+      guint8 *tmp = self->static_prev;
+
+      self->static_prev = self->static_cur;
+      self->static_cur = tmp ? tmp : g_malloc (self->static_width *
+          self->static_height);
+      self->static_skipped = 0;
+    }
+  }
+
+  gst_omx_video_enc_apply_pending_config (self);
+
+  if (skip_frame && !self->skip_frame_supported) {
+    GST_LOG_OBJECT (self, "Dropping static frame %u",
+        frame->system_frame_number);
+    return gst_video_encoder_finish_frame (encoder, frame);
+  }
+
   port = self->enc_in_port;
+  in_buf = gst_omx_video_enc_get_in_port_buffer (self, frame->input_buffer);
 
   while (acq_ret != GST_OMX_ACQUIRE_BUFFER_OK) {
     BufferIdentification *id;
@@ -1741,7 +3209,16 @@ gst_omx_video_enc_handle_frame (GstVideoEncoder * encoder,
      * _loop() can't call _finish_frame() and we might block forever
      * because no input buffers are released */
     GST_VIDEO_ENCODER_STREAM_UNLOCK (self);
-    acq_ret = gst_omx_port_acquire_buffer (port, &buf);
+    if (in_buf) {
+      /* Upstream already wrote the frame into this one */
+      buf = in_buf;
+      in_buf = NULL;
+      buf->omx_buf->nOffset = 0;
+      zero_copy = TRUE;
+      acq_ret = GST_OMX_ACQUIRE_BUFFER_OK;
+    } else {
+      acq_ret = gst_omx_port_acquire_buffer (port, &buf);
+    }
 
     if (acq_ret == GST_OMX_ACQUIRE_BUFFER_ERROR) {
       GST_VIDEO_ENCODER_STREAM_LOCK (self);
@@ -1751,6 +3228,7 @@ gst_omx_video_enc_handle_frame (GstVideoEncoder * encoder,
       goto flushing;
     } else if (acq_ret == GST_OMX_ACQUIRE_BUFFER_RECONFIGURE) {
       /* Reallocate all buffers */
+      gst_omx_video_enc_drop_in_port_pool (self);
       err = gst_omx_port_set_enabled (port, FALSE);
       if (err != OMX_ErrorNone) {
         GST_VIDEO_ENCODER_STREAM_LOCK (self);
@@ -1799,6 +3277,8 @@ gst_omx_video_enc_handle_frame (GstVideoEncoder * encoder,
         goto reconfigure_error;
       }
 
+      gst_omx_video_enc_offer_in_port_pool (self);
+
       /* Now get a new buffer and fill it */
       GST_VIDEO_ENCODER_STREAM_LOCK (self);
       continue;
@@ -1812,8 +3292,11 @@ gst_omx_video_enc_handle_frame (GstVideoEncoder * encoder,
       goto full_buffer;
     }
 
+    /* Buffers of the input port pool go back to the port when
+     * the frame releases them */
     if (self->downstream_flow_ret != GST_FLOW_OK) {
-      gst_omx_port_release_buffer (port, buf);
+      if (!zero_copy)
+        gst_omx_port_release_buffer (port, buf);
       goto flow_error;
     }
 
@@ -1838,12 +3321,19 @@ gst_omx_video_enc_handle_frame (GstVideoEncoder * encoder,
 
     /* Copy the buffer content in chunks of size as requested
      * by the port */
-    if (!gst_omx_video_enc_fill_buffer (self, frame->input_buffer, buf)) {
+    if (zero_copy) {
+      buf->omx_buf->nFilledLen = gst_buffer_get_size (frame->input_buffer);
+    } else if (!gst_omx_video_enc_fill_buffer (self, frame->input_buffer,
+            buf)) {
       gst_omx_port_release_buffer (port, buf);
       goto buffer_fill_error;
     }
 
+    /* Reordered output is matched to its frame by timestamp, so frames
+     * without one get the expected timestamp to stay distinguishable */
     timestamp = frame->pts;
+    if (timestamp == GST_CLOCK_TIME_NONE && self->reorder_frames > 0)
+      timestamp = self->last_upstream_ts;
     if (timestamp != GST_CLOCK_TIME_NONE) {
       buf->omx_buf->nTimeStamp =
           gst_util_uint64_scale (timestamp, OMX_TICKS_PER_SECOND, GST_SECOND);
@@ -1862,8 +3352,28 @@ gst_omx_video_enc_handle_frame (GstVideoEncoder * encoder,
       buf->omx_buf->nFlags |= OMX_BUFFERFLAG_RETAIN_OMX_TS;
 #endif
 
+    /* The component encodes a P frame with all macroblocks skipped */
+    if (skip_frame) {
+      GST_LOG_OBJECT (self, "Skipping static frame %u",
+          frame->system_frame_number);
+      buf->omx_buf->nFlags |= OMX_BUFFERFLAG_SKIP_FRAME;
+    }
+
+    /* Keep the buffer upstream wrote into referenced by the OMX buffer
+     * until EmptyBufferDone and only keep the metadata in the frame */
+    if (zero_copy) {
+      GstBuffer *meta_buf = gst_buffer_new ();
+
+      gst_buffer_copy_into (meta_buf, frame->input_buffer,
+          GST_BUFFER_COPY_METADATA, 0, -1);
+      buf->gst_buf = frame->input_buffer;
+      frame->input_buffer = meta_buf;
+    }
+
     id = g_slice_new0 (BufferIdentification);
     id->timestamp = buf->omx_buf->nTimeStamp;
+    id->submit_time = g_get_monotonic_time ();
+    id->dts = frame->pts;
     gst_video_codec_frame_set_user_data (frame, id,
         (GDestroyNotify) buffer_identification_free);
 
@@ -2021,8 +3531,52 @@ static gboolean
 gst_omx_video_enc_propose_allocation (GstVideoEncoder * encoder,
     GstQuery * query)
 {
+  GstOMXVideoEnc *self = GST_OMX_VIDEO_ENC (encoder);
+  GstOMXPort *port = self->enc_in_port;
+  GstVideoInfo info;
+  GstCaps *caps;
+
   gst_query_add_allocation_meta (query, GST_VIDEO_META_API_TYPE, NULL);
 
+  gst_query_parse_allocation (query, &caps, NULL);
+
+  /* Let upstream write the frames directly into the buffers of the
+   * input port, once set_format() allocated them. Hardware buffers and
+   * frames that are scaled or converted while copying can't use them.
+   * One buffer stays with us for frames that are copied. */
+  if (caps && gst_video_info_from_caps (&info, caps) && !self->hw_path
+      && !GST_VIDEO_INFO_IS_RGB (&info)
+      && port && port->buffers && port->buffers->len > 1
+      && GST_VIDEO_INFO_WIDTH (&info) == port->port_def.format.video.nFrameWidth
+      && GST_VIDEO_INFO_HEIGHT (&info) ==
+      port->port_def.format.video.nFrameHeight) {
+    guint size = port->port_def.nBufferSize;
+    guint n = port->buffers->len - 1;
+
+    if (!self->in_port_pool) {
+      GstStructure *config;
+
+      self->in_port_pool =
+          gst_omx_buffer_pool_new (GST_ELEMENT_CAST (self), self->enc, port);
+      /* The video meta carries the component's stride and slice height */
+      config = gst_buffer_pool_get_config (self->in_port_pool);
+      gst_buffer_pool_config_set_params (config, caps, size, n, n);
+      gst_buffer_pool_config_add_option (config,
+          GST_BUFFER_POOL_OPTION_VIDEO_META);
+      if (!gst_buffer_pool_set_config (self->in_port_pool, config)) {
+        GST_INFO_OBJECT (self, "Failed to set config on input port pool");
+        gst_object_unref (self->in_port_pool);
+        self->in_port_pool = NULL;
+      }
+    }
+
+    if (self->in_port_pool) {
+      GST_DEBUG_OBJECT (self, "Proposing input port pool with %u buffers "
+          "of %u bytes", n, size);
+      gst_query_add_allocation_pool (query, self->in_port_pool, size, n, n);
+    }
+  }
+
   return
       GST_VIDEO_ENCODER_CLASS
       (gst_omx_video_enc_parent_class)->propose_allocation (encoder, query);
@@ -2032,10 +3586,12 @@ GstCaps *
 gst_omx_video_enc_negotiate_caps (GstVideoEncoder * encoder, GstCaps * caps,
     GstCaps * filter)
 {
+  GstOMXVideoEnc *self = GST_OMX_VIDEO_ENC (encoder);
   GstCaps *templ_caps;
   GstCaps *allowed;
   GstCaps *fcaps, *filter_caps;
   GstCapsFeatures *feature;
+  gboolean scaling = self->output_width || self->output_height;
   gint i, j;
 
   /* Allow downstream to specify width/height/framerate/PAR constraints
@@ -2069,13 +3625,15 @@ gst_omx_video_enc_negotiate_caps (GstVideoEncoder * encoder, GstCaps * caps,
 
       s = gst_structure_new_id_empty (q_name);
       feature = gst_caps_features_new (f_name, NULL);
-      if ((val = gst_structure_get_value (allowed_s, "width")))
+      /* The downstream size doesn't apply to the input when scaling */
+      if (!scaling && (val = gst_structure_get_value (allowed_s, "width")))
         gst_structure_set_value (s, "width", val);
-      if ((val = gst_structure_get_value (allowed_s, "height")))
+      if (!scaling && (val = gst_structure_get_value (allowed_s, "height")))
         gst_structure_set_value (s, "height", val);
       if ((val = gst_structure_get_value (allowed_s, "framerate")))
         gst_structure_set_value (s, "framerate", val);
-      if ((val = gst_structure_get_value (allowed_s, "pixel-aspect-ratio")))
+      if (!scaling
+          && (val = gst_structure_get_value (allowed_s, "pixel-aspect-ratio")))
         gst_structure_set_value (s, "pixel-aspect-ratio", val);
 
       filter_caps = gst_caps_merge_structure_full (filter_caps, s, feature);
@@ -2111,7 +3669,12 @@ gst_omx_video_enc_getcaps (GstVideoEncoder * encoder, GstCaps * filter)
   GstStructure *str;
   gint n;
   GValue list = G_VALUE_INIT;
+  GValue rgb_list = G_VALUE_INIT;
   GValue val = G_VALUE_INIT;
+  static const GstVideoFormat rgb_formats[] = {
+    GST_VIDEO_FORMAT_RGBA, GST_VIDEO_FORMAT_BGRA, GST_VIDEO_FORMAT_RGBx,
+    GST_VIDEO_FORMAT_BGRx, GST_VIDEO_FORMAT_RGB16
+  };
 
   if (!self->enc)
     return gst_omx_video_enc_negotiate_caps (encoder, NULL, filter);
@@ -2130,10 +3693,27 @@ gst_omx_video_enc_getcaps (GstVideoEncoder * encoder, GstCaps * filter)
     gst_value_list_append_value (&list, &val);
   }
 
+  /* RGB in system memory is converted to any YUV format of the component */
+  g_value_init (&rgb_list, GST_TYPE_LIST);
+  g_value_copy (&list, &rgb_list);
+  if (negotiation_map) {
+    for (n = 0; n < G_N_ELEMENTS (rgb_formats); n++) {
+      g_value_set_static_string (&val,
+          gst_video_format_to_string (rgb_formats[n]));
+      gst_value_list_append_value (&rgb_list, &val);
+    }
+  }
+
   if (!gst_caps_is_empty (comp_supported_caps)) {
     for (n = 0; n < gst_caps_get_size (comp_supported_caps); n++) {
+      GstCapsFeatures *features;
+
       str = gst_caps_get_structure (comp_supported_caps, n);
-      gst_structure_set_value (str, "format", &list);
+      features = gst_caps_get_features (comp_supported_caps, n);
+      if (features && gst_caps_features_contains (features, "memory:NVMM"))
+        gst_structure_set_value (str, "format", &list);
+      else
+        gst_structure_set_value (str, "format", &rgb_list);
     }
     ret =
         gst_omx_video_enc_negotiate_caps (encoder, comp_supported_caps, filter);
@@ -2144,6 +3724,7 @@ gst_omx_video_enc_getcaps (GstVideoEncoder * encoder, GstCaps * filter)
   }
 
   g_value_unset (&val);
+  g_value_unset (&rgb_list);
   g_value_unset (&list);
   return ret;
 }
@@ -43,6 +43,70 @@ G_BEGIN_DECLS
   (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_OMX_VIDEO_ENC))
 typedef struct _GstOMXVideoEnc GstOMXVideoEnc;
 typedef struct _GstOMXVideoEncClass GstOMXVideoEncClass;
+typedef struct _GstOMXVideoEncStats GstOMXVideoEncStats;
+typedef struct _GstOMXVideoEncStatsMeta GstOMXVideoEncStatsMeta;
+
+/* Settings changed while playing, applied before the next frame */
+typedef enum
+{
+  GST_OMX_VIDEO_ENC_CONFIG_BITRATE = (1 << 1),
+  GST_OMX_VIDEO_ENC_CONFIG_QUANT = (1 << 2),
+  GST_OMX_VIDEO_ENC_CONFIG_QP_RANGE = (1 << 3),
+  GST_OMX_VIDEO_ENC_CONFIG_INTRA_PERIOD = (1 << 4),
+  GST_OMX_VIDEO_ENC_CONFIG_FRAMERATE = (1 << 5)
+} GstOMXVideoEncConfig;
+
+/* Color matrix for converting RGB input */
+typedef enum
+{
+  GST_OMX_VIDEO_ENC_RGB_MATRIX_AUTO,
+  GST_OMX_VIDEO_ENC_RGB_MATRIX_BT601,
+  GST_OMX_VIDEO_ENC_RGB_MATRIX_BT709
+} GstOMXVideoEncRGBMatrix;
+
+#define GST_OMX_VIDEO_ENC_STATS_META_API_TYPE \
+  (gst_omx_video_enc_stats_meta_api_get_type())
+#define GST_OMX_VIDEO_ENC_STATS_META_INFO \
+  (gst_omx_video_enc_stats_meta_get_info())
+#define gst_buffer_get_omx_video_enc_stats_meta(b) \
+  ((GstOMXVideoEncStatsMeta*)gst_buffer_get_meta((b),GST_OMX_VIDEO_ENC_STATS_META_API_TYPE))
+
+/* What the encoder did for one frame, attached to the buffer
+ * that finishes the frame */
+struct _GstOMXVideoEncStatsMeta
+{
+  GstMeta meta;
+
+  /* Quantization parameter of the frame, G_MAXUINT if unknown */
+  guint qp;
+  /* Encoded size of the complete frame in bytes */
+  gsize size;
+  OMX_VIDEO_PICTURETYPE picture_type;
+  /* Time between submitting the frame and getting it back */
+  GstClockTime encode_time;
+};
+
+/* Running totals behind the stats property */
+struct _GstOMXVideoEncStats
+{
+  guint64 frames;
+  guint64 bytes;
+
+  /* Current averaging window */
+  gint64 window_start;
+  guint window_frames;
+  guint64 window_bytes;
+  GstClockTime window_duration;
+  guint64 window_qp;
+  guint window_qp_frames;
+  GstClockTime window_encode_time;
+
+  /* Averages over the last complete window */
+  guint64 bitrate;
+  gdouble framerate;
+  gdouble average_qp;
+  GstClockTime average_encode_time;
+};
 
 struct _GstOMXVideoEnc
 {
@@ -54,7 +118,14 @@ struct _GstOMXVideoEnc
   GstOMXComponent *enc;
   GstOMXPort *enc_in_port, *enc_out_port;
 
+  /* Buffers of the input port that upstream writes frames into */
+  GstBufferPool *in_port_pool;
+
   /* < private > */
+  /* TRUE if upstream lost the input port pool and gets
+   * a new one once the port's buffers are reallocated */
+  gboolean in_port_pool_dropped;
+
   GstVideoCodecState *input_state;
   /* TRUE if the component is configured and saw
    * the first buffer */
@@ -79,6 +150,54 @@ struct _GstOMXVideoEnc
   guint32 quant_p_frames;
   guint32 quant_b_frames;
   guint32 iframeinterval;
+  /* min/max QP for I, P and B frames, 0xffffffff=component default */
+  guint32 qp_range[6];
+  /* Quantization in effect on the component, what the properties go
+   * back to if it refuses a change while playing. Object lock */
+  guint32 applied_quant[3];
+  guint32 applied_qp_range[6];
+  gboolean slice_level_encode;
+  /* Encoded size if it differs from the input, 0=input size */
+  guint output_width;
+  guint output_height;
+  GstOMXVideoEncRGBMatrix rgb_matrix;
+  gboolean rgb_full_range;
+
+  /* Fixed point Y, U and V rows of the RGB conversion matrix,
+   * coefficients for R, G and B followed by the offset */
+  gint rgb_coef[3][4];
+
+  /* GstOMXVideoEncConfig flags, protected by the object lock */
+  guint pending_config;
+
+  /* Number of frames the component holds back to reorder them,
+   * set by subclasses that enable B frames */
+  guint reorder_frames;
+  /* Highest PTS output since the last (re)start */
+  GstClockTime max_out_pts;
+
+  /* Frame that was finished with its first slice while its
+   * other slices are still being encoded */
+  GstVideoCodecFrame *slice_frame;
+  /* Size of the slices of the current frame pushed so far */
+  gsize slice_bytes;
+
+  /* Static scene detection */
+  guint static_threshold;
+  guint max_skip_frames;
+  /* Subsampled luma of the last encoded and of the current frame */
+  guint8 *static_prev, *static_cur;
+  guint32 *static_block_sad;
+  guint static_width, static_height;
+  /* Number of static frames skipped in a row */
+  guint static_skipped;
+  /* TRUE if the component encodes skip frames for flagged buffers */
+  gboolean skip_frame_supported;
+
+  /* Extension index to query the last frame QP, 0 if unsupported */
+  OMX_INDEXTYPE last_qp_index;
+  /* protected by the object lock */
+  GstOMXVideoEncStats stats;
 
   GstFlowReturn downstream_flow_ret;
 };
@@ -95,9 +214,16 @@ struct _GstOMXVideoEncClass
       GstVideoCodecState * state);
     GstFlowReturn (*handle_output_frame) (GstOMXVideoEnc * self,
       GstOMXPort * port, GstOMXBuffer * buffer, GstVideoCodecFrame * frame);
+    OMX_ERRORTYPE (*set_intra_period) (GstOMXVideoEnc * self);
 };
 
 GType gst_omx_video_enc_get_type (void);
 
+void gst_omx_video_enc_scale_frame (GstVideoFrame * src,
+    GstVideoFrame * dest);
+
+GType gst_omx_video_enc_stats_meta_api_get_type (void);
+const GstMetaInfo *gst_omx_video_enc_stats_meta_get_info (void);
+
 G_END_DECLS
 #endif /* __GST_OMX_VIDEO_ENC_H__ */
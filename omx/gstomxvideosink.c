@@ -105,6 +105,9 @@ G_DEFINE_TYPE (GstOmxSinkMemoryAllocator, gst_omx_sink_memory_allocator,
 #define DEFAULT_OVERLAY_W      0
 #define DEFAULT_OVERLAY_H      0
 
+/* Length of the window the stats property averages over */
+#define STATS_WINDOW           GST_SECOND
+
 enum
 {
   PROP_0,
@@ -113,7 +116,8 @@ enum
   PROP_OVERLAY_X,
   PROP_OVERLAY_Y,
   PROP_OVERLAY_W,
-  PROP_OVERLAY_H
+  PROP_OVERLAY_H,
+  PROP_STATS
 };
 
 static void
@@ -405,9 +409,8 @@ gst_omx_sink_buffer_pool_alloc_buffer (GstBufferPool * bpool,
         stride[0] = pool->port->port_def.format.video.nStride;
         offset[1] = stride[0] * pool->port->port_def.format.video.nSliceHeight;
         stride[1] = pool->port->port_def.format.video.nStride / 2;
-        offset[2] =
-            offset[1] +
-            stride[1] * (pool->port->port_def.format.video.nSliceHeight / 2);
+        offset[2] = offset[1] + stride[1] *
+            ((pool->port->port_def.format.video.nSliceHeight + 1) / 2);
         stride[2] = pool->port->port_def.format.video.nStride / 2;
         break;
       case GST_VIDEO_FORMAT_NV12:
@@ -498,6 +501,7 @@ gst_omx_video_sink_show_frame (GstVideoSink * video_sink, GstBuffer * buf);
 
 static void
 gst_omx_video_sink_check_nvfeatures (GstOmxVideoSink * self, GstCaps * caps);
+static guint32 gst_omx_video_sink_get_rendered_frames (GstOmxVideoSink * self);
 
 gboolean gst_omx_video_sink_start (GstBaseSink * sink);
 gboolean gst_omx_video_sink_stop (GstBaseSink * videosink);
@@ -734,6 +738,44 @@ gst_omx_video_sink_class_init (GstOmxVideoSinkClass * klass)
       g_param_spec_uint ("overlay-h", "overlay-h",
           "Overlay Height", 0, G_MAXUINT,
           DEFAULT_OVERLAY_H, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_STATS,
+      g_param_spec_boxed ("stats", "Statistics",
+          "Render statistics: frames submitted, presented and dropped by "
+          "the renderer, and presented framerate and jitter over the last "
+          "second", GST_TYPE_STRUCTURE,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+}
+
+static void
+gst_omx_video_sink_reset_stats (GstOmxVideoSink * self, guint32 counter)
+{
+  GstOmxVideoSinkStats *stats = &self->stats;
+
+  GST_OBJECT_LOCK (self);
+  memset (stats, 0, sizeof (*stats));
+  stats->counter = counter;
+  stats->frame_interval = GST_CLOCK_TIME_NONE;
+  stats->window_start = GST_CLOCK_TIME_NONE;
+  GST_OBJECT_UNLOCK (self);
+}
+
+static GstStructure *
+gst_omx_video_sink_create_stats (GstOmxVideoSink * self)
+{
+  GstOmxVideoSinkStats *stats = &self->stats;
+  GstStructure *s;
+
+  GST_OBJECT_LOCK (self);
+  s = gst_structure_new ("application/x-omx-video-sink-stats",
+      "submitted", G_TYPE_UINT64, stats->submitted,
+      "rendered", G_TYPE_UINT64, stats->rendered,
+      "dropped", G_TYPE_UINT64, stats->dropped,
+      "framerate", G_TYPE_DOUBLE, stats->framerate,
+      "jitter", G_TYPE_UINT64, stats->jitter, NULL);
+  GST_OBJECT_UNLOCK (self);
+
+  return s;
 }
 
 static void
@@ -753,6 +795,9 @@ gst_omx_video_sink_init (GstOmxVideoSink * omxvideosink)
 
   omxvideosink->update_pos = FALSE;
   omxvideosink->update_size = FALSE;
+
+  omxvideosink->has_rendered_frames = FALSE;
+  gst_omx_video_sink_reset_stats (omxvideosink, 0);
 }
 
 static void
@@ -831,6 +876,9 @@ gst_omx_video_sink_get_property (GObject * object, guint prop_id,
     case PROP_OVERLAY_H:
       g_value_set_uint (value, self->overlay_h);
       break;
+    case PROP_STATS:
+      g_value_take_boxed (value, gst_omx_video_sink_create_stats (self));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -1067,6 +1115,7 @@ gst_omx_video_sink_setcaps (GstBaseSink * sink, GstCaps * caps)
       return FALSE;
   }
 
+  self->info = info;
   GST_VIDEO_SINK_WIDTH (self) = info.width;
   GST_VIDEO_SINK_HEIGHT (self) = info.height;
   self->fps_n = info.fps_n;
@@ -1154,7 +1203,16 @@ gst_omx_video_sink_setcaps (GstBaseSink * sink, GstCaps * caps)
 #ifdef USE_OMX_TARGET_TEGRA
   gstomx_use_allow_secondary_window_extension (self);
   gstomx_use_overlay_index_extension (self);
+
+  self->has_rendered_frames =
+      gst_omx_component_get_index (self->sink,
+      (gpointer) NVX_INDEX_CONFIG_NUMRENDEREDFRAMES,
+      &self->rendered_frames_index) == OMX_ErrorNone;
+  if (!self->has_rendered_frames)
+    GST_INFO_OBJECT (self, "Renderer doesn't count rendered frames");
 #endif
+  gst_omx_video_sink_reset_stats (self,
+      gst_omx_video_sink_get_rendered_frames (self));
 
   if (OMX_ErrorNone != Update_Overlay_PlaneBlend (self))
     GST_ERROR_OBJECT (self, "Failed to set Overlay depth");
@@ -1200,6 +1258,238 @@ gst_omx_video_sink_getcaps (GstBaseSink * sink, GstCaps * filter)
   return caps;
 }
 
+/* Number of frames the renderer presented so far, 0 if unknown */
+static guint32
+gst_omx_video_sink_get_rendered_frames (GstOmxVideoSink * self)
+{
+  NVX_CONFIG_NUMRENDEREDFRAMES param;
+
+  if (!self->has_rendered_frames)
+    return 0;
+
+  GST_OMX_INIT_STRUCT (&param);
+  param.nPortIndex = self->sink_in_port->index;
+  if (gst_omx_component_get_config (self->sink, self->rendered_frames_index,
+          &param) != OMX_ErrorNone)
+    return 0;
+
+  return param.nFrames;
+}
+
+/* Called once a flush returned all buffers of the renderer port. The
+ * frames it gave back were neither presented nor dropped, and the
+ * renderer's count is taken as the new base for the next window. */
+static void
+gst_omx_video_sink_rebase_stats (GstOmxVideoSink * self)
+{
+  GstOmxVideoSinkStats *stats = &self->stats;
+  guint32 counter;
+
+  if (!self->has_rendered_frames)
+    return;
+
+  counter = gst_omx_video_sink_get_rendered_frames (self);
+
+  GST_OBJECT_LOCK (self);
+  /* Presented before the flush but not polled yet */
+  if (counter > stats->counter)
+    stats->rendered += counter - stats->counter;
+  stats->counter = counter;
+  if (stats->submitted > stats->rendered + stats->dropped)
+    stats->flushed = stats->submitted - stats->rendered - stats->dropped;
+
+  stats->frame_interval = GST_CLOCK_TIME_NONE;
+  stats->window_start = GST_CLOCK_TIME_NONE;
+  stats->window_submitted = 0;
+  GST_OBJECT_UNLOCK (self);
+}
+
+/* Accounts @buf, just submitted to the renderer, in the stats and tells
+ * upstream about frames the renderer dropped. Reading the renderer's
+ * count is a round trip to the component, so it is only polled once
+ * per window and the jitter is that of the mean frame interval. */
+static void
+gst_omx_video_sink_update_stats (GstOmxVideoSink * self, GstBuffer * buf)
+{
+  GstOmxVideoSinkStats *stats = &self->stats;
+  GstOMXPort *port = self->sink_in_port;
+  GstClockTime now, elapsed, expected = GST_CLOCK_TIME_NONE, running_time;
+  gdouble proportion = 1.0;
+  guint64 dropped = 0;
+  guint32 counter;
+  guint in_flight = 0, frames, drops = 0;
+
+  if (!self->has_rendered_frames)
+    return;
+
+  now = gst_util_get_timestamp ();
+
+  GST_OBJECT_LOCK (self);
+  stats->submitted++;
+  stats->window_submitted++;
+  if (!GST_CLOCK_TIME_IS_VALID (stats->window_start))
+    stats->window_start = now;
+  elapsed = now - stats->window_start;
+  GST_OBJECT_UNLOCK (self);
+
+  if (elapsed < STATS_WINDOW)
+    return;
+
+  counter = gst_omx_video_sink_get_rendered_frames (self);
+  if (self->fps_n > 0)
+    expected =
+        gst_util_uint64_scale_int (GST_SECOND, self->fps_d, self->fps_n);
+  else if (GST_BUFFER_DURATION_IS_VALID (buf))
+    expected = GST_BUFFER_DURATION (buf);
+
+  /* Everything the renderer didn't give back yet */
+  g_mutex_lock (&self->sink->lock);
+  if (port->buffers)
+    in_flight =
+        port->buffers->len - g_queue_get_length (&port->pending_buffers);
+  g_mutex_unlock (&self->sink->lock);
+
+  GST_OBJECT_LOCK (self);
+  /* The renderer restarts counting after reconfiguration */
+  if (counter < stats->counter)
+    stats->counter = 0;
+  frames = counter - stats->counter;
+  stats->counter = counter;
+  stats->rendered += frames;
+
+  stats->framerate = (gdouble) frames * GST_SECOND / elapsed;
+  if (frames > 0) {
+    stats->frame_interval = elapsed / frames;
+    if (GST_CLOCK_TIME_IS_VALID (expected))
+      stats->jitter = stats->frame_interval > expected ?
+          stats->frame_interval - expected :
+          expected - stats->frame_interval;
+    proportion = MAX (1.0, (gdouble) stats->window_submitted / frames);
+  }
+
+  /* Neither presented nor queued in the renderer anymore */
+  if (stats->submitted > stats->flushed + stats->rendered + in_flight)
+    dropped = stats->submitted - stats->flushed - stats->rendered - in_flight;
+  if (dropped > stats->dropped) {
+    drops = dropped - stats->dropped;
+    stats->dropped = dropped;
+  }
+
+  stats->window_start = now;
+  stats->window_submitted = 0;
+  GST_OBJECT_UNLOCK (self);
+
+  if (drops == 0 || !gst_base_sink_is_qos_enabled (GST_BASE_SINK (self)))
+    return;
+
+  running_time =
+      gst_segment_to_running_time (&GST_BASE_SINK (self)->segment,
+      GST_FORMAT_TIME, GST_BUFFER_PTS (buf));
+  if (!GST_CLOCK_TIME_IS_VALID (running_time))
+    return;
+
+  /* The renderer can't keep up, the frame just submitted is presented
+   * after everything queued before it */
+  GST_DEBUG_OBJECT (self, "Renderer dropped %u frames, %u queued", drops,
+      in_flight);
+  gst_pad_push_event (GST_BASE_SINK_PAD (self),
+      gst_event_new_qos (GST_QOS_TYPE_OVERFLOW, proportion,
+          GST_CLOCK_TIME_IS_VALID (expected) ? in_flight * expected : 0,
+          running_time));
+}
+
+/* Copies a frame that is not from our pool into @omxbuf, plane by
+ * plane into the layout of the renderer port. Upstream strides and
+ * memories rarely match it for software decoders and cameras. */
+static gboolean
+gst_omx_video_sink_fill_buffer (GstOmxVideoSink * self, GstBuffer * inbuf,
+    GstOMXBuffer * omxbuf)
+{
+  OMX_PARAM_PORTDEFINITIONTYPE *port_def = &self->sink_in_port->port_def;
+  GstVideoInfo *info = &self->info;
+  guint8 *base = omxbuf->omx_buf->pBuffer + omxbuf->omx_buf->nOffset;
+  gsize max_size = omxbuf->omx_buf->nAllocLen - omxbuf->omx_buf->nOffset;
+  gsize offset[GST_VIDEO_MAX_PLANES] = { 0, };
+  gint dest_stride[GST_VIDEO_MAX_PLANES] = { 0, };
+  gint stride, slice_height;
+  GstVideoFrame frame;
+  guint i;
+
+  /*
+   * The hardware path passes structures, not pixels. Other formats
+   * have no known port layout, they are copied as they are.
+   */
+  if (self->hw_path || (GST_VIDEO_INFO_FORMAT (info) != GST_VIDEO_FORMAT_I420
+          && GST_VIDEO_INFO_FORMAT (info) != GST_VIDEO_FORMAT_NV12)) {
+    gsize size = gst_buffer_get_size (inbuf);
+
+    if (size > max_size) {
+      GST_ERROR_OBJECT (self, "Frame of %" G_GSIZE_FORMAT " bytes does not "
+          "fit into %" G_GSIZE_FORMAT " bytes", size, max_size);
+      return FALSE;
+    }
+    omxbuf->omx_buf->nFilledLen = gst_buffer_extract (inbuf, 0, base, size);
+    return TRUE;
+  }
+
+  stride = port_def->format.video.nStride;
+  slice_height = port_def->format.video.nSliceHeight;
+  if (stride <= 0)
+    stride = GST_VIDEO_INFO_PLANE_STRIDE (info, 0);
+  if (slice_height <= 0)
+    slice_height = GST_VIDEO_INFO_HEIGHT (info);
+
+  /* Same layout as the buffers of our pool */
+  dest_stride[0] = stride;
+  offset[1] = stride * slice_height;
+  if (GST_VIDEO_INFO_FORMAT (info) == GST_VIDEO_FORMAT_I420) {
+    dest_stride[1] = dest_stride[2] = stride / 2;
+    offset[2] = offset[1] + (stride / 2) * ((slice_height + 1) / 2);
+  } else {
+    dest_stride[1] = stride;
+  }
+
+  /* Takes the strides and offsets of the video meta into account and
+   * maps every memory of the frame */
+  if (!gst_video_frame_map (&frame, info, inbuf, GST_MAP_READ)) {
+    GST_ERROR_OBJECT (self, "Invalid input buffer size");
+    return FALSE;
+  }
+
+  omxbuf->omx_buf->nFilledLen = 0;
+  for (i = 0; i < GST_VIDEO_FRAME_N_PLANES (&frame); i++) {
+    guint8 *src = GST_VIDEO_FRAME_PLANE_DATA (&frame, i);
+    guint8 *dest = base + offset[i];
+    gint src_stride = GST_VIDEO_FRAME_PLANE_STRIDE (&frame, i);
+    gint height = GST_VIDEO_FRAME_COMP_HEIGHT (&frame, i);
+    gint width = GST_VIDEO_FRAME_COMP_WIDTH (&frame, i) *
+        GST_VIDEO_FRAME_COMP_PSTRIDE (&frame, i);
+    gint j;
+
+    if (offset[i] + dest_stride[i] * height > max_size) {
+      gst_video_frame_unmap (&frame);
+      GST_ERROR_OBJECT (self, "Invalid output buffer size");
+      return FALSE;
+    }
+
+    /* One copy for the whole plane if the strides match, libc's
+     * memcpy does the vectorizing */
+    if (src_stride == dest_stride[i]) {
+      memcpy (dest, src, dest_stride[i] * (height - 1) + width);
+    } else {
+      for (j = 0; j < height; j++) {
+        memcpy (dest, src, width);
+        src += src_stride;
+        dest += dest_stride[i];
+      }
+    }
+    omxbuf->omx_buf->nFilledLen = offset[i] + dest_stride[i] * height;
+  }
+  gst_video_frame_unmap (&frame);
+
+  return TRUE;
+}
+
 static GstFlowReturn
 gst_omx_video_sink_show_frame (GstVideoSink * video_sink, GstBuffer * buf)
 {
@@ -1213,6 +1503,12 @@ gst_omx_video_sink_show_frame (GstVideoSink * video_sink, GstBuffer * buf)
 
   GST_DEBUG_OBJECT (self, "Received the frame");
 
+  /* The window was moved or resized while playing */
+  if (self->update_pos && Update_Overlay_Position (self) != OMX_ErrorNone)
+    GST_ERROR_OBJECT (self, "Failed to set Overlay Position");
+  if (self->update_size && Update_Overlay_Size (self) != OMX_ErrorNone)
+    GST_ERROR_OBJECT (self, "Failed to set Overlay Width");
+
   /*
      if (buf && self->cur_buf != buf) {
      if (self->cur_buf) {
@@ -1233,30 +1529,32 @@ gst_omx_video_sink_show_frame (GstVideoSink * video_sink, GstBuffer * buf)
     omxbuf = gst_mini_object_get_qdata (GST_MINI_OBJECT_CAST (buf),
         gst_omx_sink_data_quark);
 
-    gst_omx_handle_messages (self->sink);
-
-    /*
-     * The number of buffers in the decoder output pool is maintained
-     * using the length of the pending_buffers queue
-     */
-    g_queue_pop_head (&self->sink_in_port->pending_buffers);
+    /* Still owned by the renderer, e.g. the preroll frame */
+    if (omxbuf->used) {
+      GST_DEBUG_OBJECT (self, "Frame %p is being rendered already", buf);
+      goto done;
+    }
 
     /*
-     * To prevent deadlock when no buffers are available in the
-     * decoder output buffer pool, we make sure there is at least
-     * one buffer in the pool
+     * Upstream gets the buffers of the port from our pool, always leave
+     * one of them to it so that it can't deadlock waiting for a buffer
+     * while the renderer holds all of them
      */
-    while (g_queue_get_length (&self->sink_in_port->pending_buffers) == 0) {
-      g_mutex_lock (&self->sink->messages_lock);
-      g_cond_wait (&self->sink->messages_cond, &self->sink->messages_lock);
-      g_mutex_unlock (&self->sink->messages_lock);
-      gst_omx_handle_messages (self->sink);
+    switch (gst_omx_port_claim_buffer (self->sink_in_port, omxbuf,
+            MAX (self->sink_in_port->buffers->len, 2) - 1)) {
+      case GST_OMX_ACQUIRE_BUFFER_OK:
+        break;
+      case GST_OMX_ACQUIRE_BUFFER_FLUSHING:
+        res = GST_FLOW_FLUSHING;
+        goto done;
+      default:
+        res = GST_FLOW_ERROR;
+        goto done;
     }
-    res = GST_FLOW_OK;
+    omxbuf->omx_buf->nFilledLen = mem->size;
   } else {
 /* Buffer is not from our pool, copy data */
 
-    GstMapInfo map = GST_MAP_INFO_INIT;
     GstOMXPort *port = self->sink_in_port;
 
     if (!gst_omx_port_is_enabled (port)) {
@@ -1281,17 +1579,23 @@ gst_omx_video_sink_show_frame (GstVideoSink * video_sink, GstBuffer * buf)
       }
     }
 
-    if (gst_omx_port_acquire_buffer (self->sink_in_port,
-            &omxbuf) != GST_OMX_ACQUIRE_BUFFER_OK) {
+    switch (gst_omx_port_acquire_buffer (self->sink_in_port, &omxbuf)) {
+      case GST_OMX_ACQUIRE_BUFFER_OK:
+        break;
+      case GST_OMX_ACQUIRE_BUFFER_FLUSHING:
+        res = GST_FLOW_FLUSHING;
+        goto done;
+      default:
+        res = GST_FLOW_ERROR;
+        goto done;
+    }
+    if (!gst_omx_video_sink_fill_buffer (self, buf, omxbuf)) {
+      GST_ELEMENT_ERROR (self, STREAM, FORMAT, (NULL),
+          ("Failed to copy the frame into the renderer buffer"));
       res = GST_FLOW_ERROR;
       goto done;
     }
-    gst_buffer_map (buf, &map, GST_MAP_READ);
-    memcpy (omxbuf->omx_buf->pBuffer + omxbuf->omx_buf->nOffset,
-        map.data, map.size);
-    gst_buffer_unmap (buf, &map);
   }
-  omxbuf->omx_buf->nFilledLen = mem->size;
   omxbuf->gst_buf = gst_buffer_ref (buf);
 
   if (self->hw_path)
@@ -1305,6 +1609,8 @@ gst_omx_video_sink_show_frame (GstVideoSink * video_sink, GstBuffer * buf)
 
   gst_omx_port_release_buffer (self->sink_in_port, omxbuf);
 
+  gst_omx_video_sink_update_stats (self, buf);
+
 done:
 
   return res;
@@ -1413,6 +1719,12 @@ gst_omx_video_sink_get_times (GstBaseSink * sink, GstBuffer * buffer,
       if (self->fps_n > 0) {
         *end = *start +
             gst_util_uint64_scale_int (GST_SECOND, self->fps_d, self->fps_n);
+      } else {
+        /* Variable framerate, the renderer's pace is the best guess */
+        GST_OBJECT_LOCK (self);
+        if (GST_CLOCK_TIME_IS_VALID (self->stats.frame_interval))
+          *end = *start + self->stats.frame_interval;
+        GST_OBJECT_UNLOCK (self);
       }
     }
   }
@@ -1425,6 +1737,20 @@ gst_omx_video_sink_event (GstBaseSink * sink, GstEvent * event)
   GstOmxVideoSink *omxsink = GST_OMX_VIDEO_SINK (sink);
 
   switch (GST_EVENT_TYPE (event)) {
+    case GST_EVENT_FLUSH_START:
+      /* Gets the renderer's frames back and wakes up show_frame */
+      if (omxsink->sink_in_port
+          && gst_omx_port_is_enabled (omxsink->sink_in_port))
+        gst_omx_port_set_flushing (omxsink->sink_in_port, 5 * GST_SECOND,
+            TRUE);
+      break;
+    case GST_EVENT_FLUSH_STOP:
+      if (omxsink->sink_in_port) {
+        gst_omx_port_set_flushing (omxsink->sink_in_port, 5 * GST_SECOND,
+            FALSE);
+        gst_omx_video_sink_rebase_stats (omxsink);
+      }
+      break;
     case GST_EVENT_CUSTOM_DOWNSTREAM: {
       if (gst_event_has_name (event, "ReleaseLastBuffer")) {
         GstOMXBuffer *omxbuf;
@@ -35,6 +35,30 @@ G_BEGIN_DECLS
 #define GST_IS_OMX_VIDEO_SINK_CLASS(obj)   (G_TYPE_CHECK_CLASS_TYPE((klass),GST_TYPE_OMX_VIDEO_SINK))
 typedef struct _GstOmxVideoSink GstOmxVideoSink;
 typedef struct _GstOmxVideoSinkClass GstOmxVideoSinkClass;
+typedef struct _GstOmxVideoSinkStats GstOmxVideoSinkStats;
+
+/* Running totals behind the stats property */
+struct _GstOmxVideoSinkStats
+{
+  guint64 submitted;
+  guint64 rendered;
+  guint64 dropped;
+  /* Submitted frames a flush gave back unpresented */
+  guint64 flushed;
+
+  /* Frame count read from the renderer at the last poll */
+  guint32 counter;
+  /* Mean time between presented frames over the last window */
+  GstClockTime frame_interval;
+
+  /* Current averaging window */
+  GstClockTime window_start;
+  guint window_submitted;
+
+  /* Averages over the last complete window */
+  gdouble framerate;
+  GstClockTime jitter;
+};
 
 struct _GstOmxVideoSink
 {
@@ -43,6 +67,9 @@ struct _GstOmxVideoSink
   GstOMXComponent *sink;
   GstOMXPort *sink_in_port;
 
+  /* Negotiated input format */
+  GstVideoInfo info;
+
   /* Framerate numerator and denominator */
   gint fps_n;
   gint fps_d;
@@ -62,6 +89,11 @@ struct _GstOmxVideoSink
   gboolean update_size;
 
   GMutex flow_lock;
+
+  /* Renderer frame counter, polled once per stats window */
+  gboolean has_rendered_frames;
+  OMX_INDEXTYPE rendered_frames_index;
+  GstOmxVideoSinkStats stats;           /* OBJECT_LOCK */
 };
 
 struct _GstOmxVideoSinkClass